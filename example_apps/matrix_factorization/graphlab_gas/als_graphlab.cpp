@@ -32,9 +32,9 @@
 #include <string>
 #include <algorithm>
 
+#include "graphchi_basic_includes.hpp"
 #include "../matrixmarket/mmio.h"
 #include "../matrixmarket/mmio.c"
-#include "graphchi_basic_includes.hpp"
 #include "api/graphlab2_1_GAS_api/graphlab.hpp"
 
 #include "als_vertex_program.hpp"
@@ -96,7 +96,8 @@ int convert_matrixmarket_for_ALS_graphlab(std::string base_filename) {
     int ret_code;
     MM_typecode matcode;
     FILE *f;
-    int M, N, nz;   
+    uint M, N;
+    size_t nz;   
     
     /**
      * Create sharder object
@@ -154,7 +155,7 @@ int convert_matrixmarket_for_ALS_graphlab(std::string base_filename) {
     
     
     if (!sharderobj.preprocessed_file_exists()) {
-        for (int i=0; i<nz; i++)
+        for (size_t i=0; i<nz; i++)
         {
             int I, J;
             double val;
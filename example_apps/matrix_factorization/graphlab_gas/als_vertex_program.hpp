@@ -218,6 +218,16 @@ public:
     Xy = X * y;
   } // end of constructor for gather type
 
+  /**
+   * \brief Computes the change of the gather of a neighbor when its
+   * factor changes from X_old to X, for the gather caching
+   */
+  gather_type(const vec_type& X, const vec_type& X_old, const double y) :
+    XtX(X.size(), X.size()), Xy(X.size()) {
+    XtX.triangularView<Eigen::Upper>() = X * X.transpose() - X_old * X_old.transpose();
+    Xy = (X - X_old) * y;
+  } // end of constructor for delta gather type
+
   /** \brief Save the values to a binary archive */
 //  void save(graphlab::oarchive& arc) const { arc << XtX << Xy; }
 
@@ -262,6 +272,9 @@ public:
   static double LAMBDA;
   static size_t MAX_UPDATES;
 
+  /** The factor before apply, for posting the deltas in scatter */
+  vec_type old_factor;
+
   /** The set of edges to gather along */
   edge_dir_type gather_edges(icontext_type& context, 
                              const vertex_type& vertex) const { 
@@ -290,22 +303,28 @@ public:
     // Add regularization
     for(int i = 0; i < XtX.rows(); ++i) XtX(i,i) += LAMBDA; // /nneighbors;
     // Solve the least squares problem using eigen ----------------------------
-    const vec_type old_factor = vdata.factor;
+    old_factor = vdata.factor;
     vdata.factor = XtX.selfadjointView<Eigen::Upper>().ldlt().solve(Xy);
     // Compute the residual change in the factor factor -----------------------
     vdata.residual = (vdata.factor - old_factor).cwiseAbs().sum() / XtX.rows();
     ++vdata.nupdates;
   } // end of apply
   
-  /** The edges to scatter along */
+  /** The edges to scatter along: only needed to update the gather caches */
   edge_dir_type scatter_edges(icontext_type& context,
                               const vertex_type& vertex) const { 
-    return graphlab::ALL_EDGES; 
+    if (context.gather_caching() && old_factor.size() > 0 &&
+        vertex.data().residual > 0) return graphlab::ALL_EDGES;
+    return graphlab::NO_EDGES;
   }; // end of scatter edges
 
-  /** Scatter reschedules neighbors */  
+  /** Scatter posts the change of the factor to the neighbors' caches */  
   void scatter(icontext_type& context, const vertex_type& vertex, 
                edge_type& edge) const {
+    if(edge.data().role == edge_data::TRAIN) {
+      const vertex_type other_vertex = get_other_vertex(edge, vertex);
+      context.post_delta(other_vertex, gather_type(vertex.data().factor, old_factor, edge.data().obs));
+    }
   /*  edge_data& edata = edge.data();
     if(edata.role == edge_data::TRAIN) {
       const vertex_type other_vertex = get_other_vertex(edge, vertex);
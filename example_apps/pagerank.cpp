@@ -35,6 +35,7 @@
 
 
 #include "graphchi_basic_includes.hpp"
+#include "engine/inmemory/graphchi_inmemory_engine.hpp"
 #include "util/toplist.hpp"
 
 using namespace graphchi;
@@ -48,6 +49,10 @@ typedef float EdgeDataType;
 
 struct PagerankProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
     
+    bool scheduling;
+    
+    PagerankProgram(bool scheduling) : scheduling(scheduling) {}
+    
     /**
       * Called before an iteration starts. Not implemented.
       */
@@ -77,11 +82,16 @@ struct PagerankProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
                The initialization is important,
                because on every run, GraphChi will modify the data in the edges on disk. 
              */
+            /* With selective scheduling the out-edges must match the vertex value,
+               because a neighbor is not run again if the value does not change. */
+            float initval = (scheduling ? RANDOMRESETPROB : 1.0);
             for(int i=0; i < v.num_outedges(); i++) {
                 graphchi_edge<float> * edge = v.outedge(i);
-                edge->set_data(1.0 / v.num_outedges());
+                edge->set_data(initval / v.num_outedges());
             }
             v.set_data(RANDOMRESETPROB); 
+            
+            if (scheduling) ginfo.scheduler->add_task(v.id());
         } else {
             /* Compute the sum of neighbors' weighted pageranks by
                reading from the in-edges. */
@@ -105,7 +115,17 @@ struct PagerankProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
                 
             /* Keep track of the progression of the computation.
                GraphChi engine writes a file filename.deltalog. */
-            ginfo.log_change(std::abs(pagerank - v.get_data()));
+            float delta = std::abs(pagerank - v.get_data());
+            ginfo.log_change(delta);
+            
+            /* With selective scheduling, the change of my pagerank is the
+               residual of my out-neighbors. */
+            if (scheduling && delta > 0 && v.num_outedges() > 0) {
+                float residual = (1 - RANDOMRESETPROB) * delta / v.num_outedges();
+                for(int i=0; i < v.num_outedges(); i++) {
+                    ginfo.scheduler->add_priority(v.outedge(i)->vertex_id(), residual);
+                }
+            }
             
             /* Set my new pagerank as the vertex value */
             v.set_data(pagerank); 
@@ -121,17 +141,24 @@ int main(int argc, const char ** argv) {
     /* Parameters */
     std::string filename    = get_option_string("file"); // Base filename
     int niters              = get_option_int("niters", 4);
-    bool scheduler          = false;                    // Non-dynamic version of pagerank.
+    bool scheduler          = get_option_int("scheduler", 0); // Use with --scheduler.type=priority
     int ntop                = get_option_int("top", 20);
     
     /* Process input file - if not already preprocessed */
     int nshards             = convert_if_notexists<EdgeDataType>(filename, get_option_string("nshards", "auto"));
 
     /* Run */
-    graphchi_engine<float, float> engine(filename, nshards, scheduler, m); 
-    engine.set_modifies_inedges(false); // Improves I/O performance.
-    PagerankProgram program;
-    engine.run(program, niters);
+    PagerankProgram program(scheduler);
+    if (get_option_int("inmemory", 0)) {
+        /* Graph is read from the shards to memory once */
+        graphchi_inmemory_engine<float, float> engine(filename, nshards, scheduler, m);
+        engine.set_modifies_inedges(false);
+        engine.run(program, niters);
+    } else {
+        graphchi_engine<float, float> engine(filename, nshards, scheduler, m); 
+        engine.set_modifies_inedges(false); // Improves I/O performance.
+        engine.run(program, niters);
+    }
         
     /* Output top ranked vertices */
     std::vector< vertex_value<float> > top = get_top_vertices<float>(filename, ntop);
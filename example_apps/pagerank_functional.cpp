@@ -47,6 +47,8 @@ using namespace graphchi;
 
 struct pagerank_kernel : public functional_kernel<float, float> {
     
+    static const bool gather_needs_nbids = false;
+    
     /* Initial value - on first iteration */
     float initial_value(graphchi_context &info, vertex_info& myvertex) {
         return 1.0;
@@ -68,6 +70,12 @@ struct pagerank_kernel : public functional_kernel<float, float> {
         return curval + toadd;
     }
     
+    // "Gather" and "Sum" over the in-edges
+    float gather_span(graphchi_context &info, vertex_info& myvertex, float cumval,
+                      const vid_t * nbids, const float * nbvals, int n) {
+        return cumval + sum_span(nbvals, n);
+    }
+    
     // "Apply"
     float compute_vertexvalue(graphchi_context &ginfo, vertex_info& myvertex, float nbvalsum) {
         assert(ginfo.nvertices > 0);
@@ -25,118 +25,35 @@
  * @section DESCRIPTION
  *
  * Random walk simulation. From a set of source vertices, a set of 
- * random walks is started. Random walks walk via edges, and we use the
- * dynamic chivectors to support multiple walks in one edge. Each
+ * random walks is started. The walks are run by the random walk engine,
+ * which keeps them in buckets by the interval of their vertex and advances
+ * them window by window, so the edges do not need to store the walks. Each
  * vertex keeps track of the walks that pass by it, thus in the end
  * we have estimate of the "pagerank" of each vertex.
  *
- * Note, this version does not support 'resets' of random walks.
- * TODO: from each vertex, start new random walks with some probability,
- * and also terminate a walk with some probablity.
- *
+ * With walks.reset_prob > 0, a walk jumps back to its source with that
+ * probability on each hop. With walks.ppr=1, the most visited vertices of
+ * each source (personalized PageRank) are written to a file.
  */
 
-#define DYNAMICEDATA 1
-
 #include <string>
 
 #include "graphchi_basic_includes.hpp"
-#include "api/dynamicdata/chivector.hpp"
+#include "engine/randomwalks/graphchi_walk_engine.hpp"
 #include "util/toplist.hpp"
 
 using namespace graphchi;
 
 /**
  * Type definitions. Remember to create suitable graph shards using the
- * Sharder-program.
+ * Sharder-program. Edge values are not read.
  */
 typedef unsigned int VertexDataType;
-typedef chivector<vid_t>  EdgeDataType;
+typedef vid_t EdgeDataType;
 
- 
-struct RandomWalkProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
-    
-    int walks_per_source() {
-        return 100;
-    }
-    
-    bool is_source(vid_t v) {
-        return (v % 50 == 0);
-    }
-    
-    /**
-     *  Vertex update function.
-     */
-    void update(graphchi_vertex<VertexDataType, EdgeDataType > &vertex, graphchi_context &gcontext) {
-        if (gcontext.iteration == 0) {
-            
-            if (is_source(vertex.id())) {
-                for(int i=0; i < walks_per_source(); i++) {
-                    /* Get random out edge's vector */
-                    graphchi_edge<EdgeDataType> * outedge = vertex.random_outedge();
-                    if (outedge != NULL) {
-                        chivector<vid_t> * evector = outedge->get_vector();
-                        /* Add a random walk particle, represented by the vertex-id of the source (this vertex) */
-                        evector->add(vertex.id());
-                        gcontext.scheduler->add_task(outedge->vertex_id()); // Schedule destination
-                    }
-                }
-            }
-            vertex.set_data(0);
-        } else {
-            /* Check inbound edges for walks and advance them. */
-            int num_walks = 0;
-            for(int i=0; i < vertex.num_inedges(); i++) {
-                graphchi_edge<EdgeDataType> * edge = vertex.inedge(i);
-                chivector<vid_t> * invector = edge->get_vector();
-                for(int j=0; j < invector->size(); j++) {
-                    /* Get one walk */
-                    vid_t walk = invector->get(j);
-                    /* Move to a random out-edge */
-                    graphchi_edge<EdgeDataType> * outedge = vertex.random_outedge();
-                    if (outedge != NULL) {
-                        chivector<vid_t> * outvector = outedge->get_vector();
-                        /* Add a random walk particle, represented by the vertex-id of the source (this vertex) */
-                        outvector->add(walk);
-                        gcontext.scheduler->add_task(outedge->vertex_id()); // Schedule destination
-                    }
-                    num_walks ++;
-                }
-                /* Remove all walks from the inbound vector */
-                invector->clear();
-            }
-            /* Keep track of the walks passed by via this vertex */
-            vertex.set_data(vertex.get_data() + num_walks);
-        }
-    }
-    
-    /**
-     * Called before an iteration starts.
-     */
-    void before_iteration(int iteration, graphchi_context &gcontext) {
-    }
-    
-    /**
-     * Called after an iteration has finished.
-     */
-    void after_iteration(int iteration, graphchi_context &gcontext) {
-    }
-    
-    /**
-     * Called before an execution interval is started.
-     */
-    void before_exec_interval(vid_t window_st, vid_t window_en, graphchi_context &gcontext) {
-    }
-    
-    /**
-     * Called after an execution interval has finished.
-     */
-    void after_exec_interval(vid_t window_st, vid_t window_en, graphchi_context &gcontext) {
-    }
-    
-};
-
- 
+bool is_source(vid_t v) {
+    return (v % 50 == 0);
+}
 
 int main(int argc, const char ** argv) {
     /* GraphChi initialization will read the command line
@@ -149,20 +66,25 @@ int main(int argc, const char ** argv) {
     
     /* Basic arguments for application */
     std::string filename = get_option_string("file");  // Base filename
-    int niters           = get_option_int("niters", 4); // Number of iterations
-    bool scheduler       = true;                       // Whether to use selective scheduling
+    int niters           = get_option_int("niters", 1000); // Maximum number of iterations
+    bool ppr             = get_option_int("walks.ppr", 0) != 0;
     
     /* Detect the number of shards or preprocess an input to create them */
-    bool preexisting_shards;
-    int nshards          = convert_if_notexists<vid_t>(filename, get_option_string("nshards", "auto"), preexisting_shards);
+    int nshards          = convert_if_notexists<EdgeDataType>(filename, get_option_string("nshards", "auto"));
     
     /* Run */
-    RandomWalkProgram program;
-    graphchi_engine<VertexDataType, EdgeDataType> engine(filename, nshards, scheduler, m);
-    if (preexisting_shards) {
-        engine.reinitialize_edge_data(0);
+    graphchi_walk_engine<EdgeDataType> engine(filename, nshards, m);
+    for(vid_t v=0; v < (vid_t) engine.num_vertices(); v++) {
+        if (is_source(v)) engine.add_source(v);
+    }
+    engine.set_count_by_source(ppr);
+    engine.run(niters);
+    
+    if (ppr) {
+        std::string pprfile = filename + ".ppr.txt";
+        engine.write_top_visits(pprfile, get_option_int("top", 20));
+        std::cout << "Wrote most visited vertices of each source to " << pprfile << std::endl;
     }
-    engine.run(program, niters);
     
     /* List top 20 */
     int ntop = 20;
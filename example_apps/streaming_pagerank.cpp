@@ -257,6 +257,7 @@ void * dynamic_graph_reader(void * info) {
     vid_t from;
     vid_t to;
     char s[1024];
+    dynamicgraph_ingestor<float, float> ingestor(*dyngraph_engine);
     
     while(fgets(s, 1024, f) != NULL) {
         FIXLINE(s);
@@ -273,14 +274,12 @@ void * dynamic_graph_reader(void * info) {
             continue;
         }
         
-        bool success=false;
-        while (!success) {
-            success = dyngraph_engine->add_edge(from, to, 0.0f);
-        }
-        dyngraph_engine->add_task(from);
+        ingestor.add_edge(from, to, 0.0f);
+        ingestor.add_task(from);
         ingested++;
         
         if (++c % edges_per_sec == 0) {
+            ingestor.flush();
             std::cout << "Stream speed check...." << std::endl;
             double sincelast;
             double speed;
@@ -303,6 +302,7 @@ void * dynamic_graph_reader(void * info) {
         
     } 
     fclose(f);
+    ingestor.flush();
     dyngraph_engine->finish_after_iters(10);
     return NULL;
 }
@@ -37,16 +37,24 @@
  * where a > b > c. 
  *
  * The application involves a special preprocessing step which orders the vertices in ascending
- * order of their degree. This turns out to be a very important optimization on big graphs. 
+ * order of their degree, and orients each edge from the lower to the higher id. Then the relevant
+ * adjacency list of a vertex is its list of out-edges, which is short even for the vertices of
+ * highest degree. This turns out to be a very important optimization on big graphs. 
+ * The pivot interval is chosen so that the adjacency lists of the pivots fit in
+ * triangles.pivot_membudget_mb, using the out-degrees computed by the sharder.
  *
  * This algorithm also utilizes the dynamic graph engine, and deletes edges after they have been
  * accounted for. 
+ *
+ * With clustering=1, the local clustering coefficient of each vertex is written
+ * to [file].clustering, using the original vertex ids.
  */
 
 
 
 #include <string>
 #include <vector>
+#include <algorithm>
 
 /**
   * Need to define prior to including GraphChi
@@ -58,6 +66,7 @@
 
 #include "graphchi_basic_includes.hpp"
 #include "engine/dynamic_graphs/graphchi_dynamicgraph_engine.hpp"
+#include "util/intersect.hpp"
 
 using namespace graphchi;
 
@@ -82,44 +91,112 @@ class OutputVertexCallback : public VCallback<VertexDataType> {
     }
 };
 
+/**
+ * Class for writing the local clustering coefficients. Degrees are
+ * the numbers of distinct neighbors, recorded when the vertices were pivots.
+ */
+class ClusteringCallback : public VCallback<VertexDataType> {
+    FILE * f;
+    std::vector<uint32_t> &degrees;
+    std::vector<vid_t> &origids;
+  public:
+    double sum;
+    ClusteringCallback(FILE * f, std::vector<uint32_t> &degrees, std::vector<vid_t> &origids) :
+        f(f), degrees(degrees), origids(origids), sum(0) {}
+    
+    virtual void callback(vid_t vertex_id, VertexDataType &value) {
+        double d = degrees[vertex_id];
+        double cc = (d > 1 ? 2.0 * value / (d * (d - 1)) : 0.0);
+        sum += cc;
+        vid_t orig = (vertex_id < origids.size() ? origids[vertex_id] : vertex_id);
+        fprintf(f, "%u %u %lf\n", orig, value, cc);
+    }
+};
+
 /**
   * Code for intersection size computation and 
   * pivot management.
   */
 int grabbed_edges = 0;
 
+bool compute_clustering = false;
+std::vector<uint32_t> distinct_degrees;
 
-// Linear search
-inline bool findadj_linear(vid_t * datachunk, size_t n, vid_t target) {
-    for(int i=0; i<(int)n; i++) {
-        if (datachunk[i] == target) return true;
-        else if (datachunk[i] > target) return false;
-    }
-    return false;
-}
 
-// Binary search
-inline bool findadj(vid_t * datachunk, size_t n, vid_t target) {
-    if (n<32) return findadj_linear(datachunk, n, target);
-    register size_t lo = 0;
-    register size_t hi = n;
-    register size_t m = lo + (hi-lo)/2;
-    while(hi>lo) {
-        vid_t eto = datachunk[m];
-        if (target == eto) {
-            return true;
+/**
+  * Out-neighbors of a vertex sorted by id without duplicates, and the
+  * indices of the corresponding out-edges. Each thread has its own
+  * instance, so that the arrays are not reallocated for every vertex.
+  * Duplicate edges can be removed only on odd iterations, when the
+  * in-edges are not read by other vertices.
+  */
+struct sorted_outedges {
+    std::vector<vid_t> ids;
+    std::vector<int> idx;
+    std::vector< std::pair<vid_t, int> > tmp;
+    
+    void build(graphchi_vertex<VertexDataType, EdgeDataType> &v, bool remove_duplicates) {
+        int n = v.num_outedges();
+        ids.clear();
+        idx.clear();
+        
+        /* The out-edges are usually already sorted */
+        bool sorted = true;
+        for(int i=1; i < n && sorted; i++) {
+            sorted = v.outedge(i - 1)->vertex_id() <= v.outedge(i)->vertex_id();
         }
-        if (target > eto) {
-            lo = m+1;
-        } else {
-            hi = m;
+        if (!sorted) {
+            tmp.clear();
+            for(int i=0; i < n; i++) tmp.push_back(std::pair<vid_t, int>(v.outedge(i)->vertex_id(), i));
+            std::sort(tmp.begin(), tmp.end());
+        }
+        for(int k=0; k < n; k++) {
+            int i = (sorted ? k : tmp[k].second);
+            graphchi_edge<EdgeDataType> * e = v.outedge(i);
+            if (is_deleted_edge_value(e->get_data())) continue;
+            if (!ids.empty() && ids.back() == e->vertex_id()) {
+                /* Duplicate edges are never matched, so they can be removed unless they hold a count */
+                if (remove_duplicates && e->get_data() == 0) v.remove_outedge(i);
+                continue;
+            }
+            ids.push_back(e->vertex_id());
+            idx.push_back(i);
         }
-        m = lo + (hi-lo)/2;
     }
-    return false;
+    
+    size_t size() {
+        return ids.size();
+    }
+    
+    size_t lower_bound(vid_t x) {
+        return std::lower_bound(ids.begin(), ids.end(), x) - ids.begin();
+    }
+};
+
+std::vector<sorted_outedges> adjscratch;
+
+sorted_outedges &thread_scratch() {
+    int t = omp_get_thread_num();
+    assert(t < (int) adjscratch.size());
+    return adjscratch[t];
 }
 
 
+/**
+  * Adds one to the edges from a vertex to the common neighbors of
+  * the vertex and a pivot.
+  */
+struct increment_match {
+    graphchi_vertex<VertexDataType, EdgeDataType> &v;
+    const int * idx;
+    increment_match(graphchi_vertex<VertexDataType, EdgeDataType> &v, const int * idx) : v(v), idx(idx) {}
+    
+    inline void operator()(size_t j) {
+        graphchi_edge<EdgeDataType> * e = v.outedge(idx[j]);
+        e->set_data(e->get_data() + 1);
+    }
+};
+
 
 struct dense_adj {
     int count;
@@ -164,39 +241,66 @@ public:
         adjs.resize(pivot_en - pivot_st);
     }
     
+    /**
+      * Chooses the next interval of pivots, so that their adjacency lists
+      * take at most membudget bytes. The out-degrees of the vertices
+      * are read from the degree file of the graph. At least one vertex
+      * is chosen.
+      */
+    void next_pivotrange(std::string degreefile, vid_t nvertices, size_t membudget) {
+        int f = open(degreefile.c_str(), O_RDONLY);
+        if (f < 0) {
+            logstream(LOG_FATAL) << "Could not open degree file " << degreefile << ": " << strerror(errno) << std::endl;
+        }
+        assert(f >= 0);
+        const vid_t chunk = 1024 * 1024;
+        std::vector<degree> degs(chunk);
+        size_t mem = 0;
+        vid_t en = pivot_st;
+        while (en < nvertices) {
+            vid_t n = std::min(chunk, nvertices - en);
+            preada(f, &degs[0], n * sizeof(degree), en * sizeof(degree));
+            vid_t i = 0;
+            for(; i < n; i++) {
+                size_t adjmem = degs[i].outdegree * sizeof(vid_t) + sizeof(dense_adj);
+                if (mem + adjmem > membudget && en + i > pivot_st) break;
+                mem += adjmem;
+            }
+            en += i;
+            if (i < n) break;
+        }
+        close(f);
+        logstream(LOG_DEBUG) << "Pivot adjacency lists: " << mem / 1024 / 1024 << " MB" << std::endl;
+        extend_pivotrange(en);
+    }
+    
     /**
       * Grab pivot's adjacency list into memory.
       */
-    int grab_adj(graphchi_vertex<uint32_t, uint32_t> &v) {
+    int grab_adj(graphchi_vertex<VertexDataType, EdgeDataType> &v) {
         if(is_pivot(v.id())) {            
-            int ncount = v.num_edges();
-            // Count how many neighbors have larger id than v
-            v.sort_edges_indirect();
-     
-            
-            int actcount = 0;
-            vid_t lastvid = 0;
-            for(int i=0; i<ncount; i++) {
-                if (v.edge(i)->vertexid > v.id() && v.edge(i)->vertexid != lastvid)  
-                    actcount++;  // Need to store only ids larger than me
-                lastvid = v.edge(i)->vertex_id();
-            }
+            sorted_outedges &outs = thread_scratch();
+            outs.build(v, false);
             
             // Allocate the in-memory adjacency list, using the
             // knowledge of the number of edges.
-            dense_adj dadj = dense_adj(actcount, (vid_t*) calloc(sizeof(vid_t), actcount));
-            actcount = 0;
-            lastvid = 0;
-            for(int i=0; i<ncount; i++) {
-                if (v.edge(i)->vertexid > v.id() && v.edge(i)->vertexid != lastvid) {  // Need to store only ids larger than me
-                    dadj.adjlist[actcount++] = v.edge(i)->vertex_id();
-                }
-                lastvid = v.edge(i)->vertex_id();
-            }
-            assert(dadj.count == actcount);
-            adjs[v.id() - pivot_st] = dadj;
+            int actcount = (int) outs.size();
+            dense_adj dadj = dense_adj(actcount, (vid_t*) calloc(sizeof(vid_t), std::max(actcount, 1)));
+            std::copy(outs.ids.begin(), outs.ids.end(), dadj.adjlist);
             assert(v.id() - pivot_st < adjs.size());
+            adjs[v.id() - pivot_st] = dadj;
             __sync_add_and_fetch(&grabbed_edges, actcount);
+            
+            if (compute_clustering) {
+                /* None of the in-edges have been deleted before the vertex is a pivot */
+                std::vector<vid_t> &ins = outs.ids;
+                ins.clear();
+                for(int i=0; i < v.num_inedges(); i++) {
+                    if (!is_deleted_edge_value(v.inedge(i)->get_data())) ins.push_back(v.inedge(i)->vertex_id());
+                }
+                std::sort(ins.begin(), ins.end());
+                distinct_degrees[v.id()] = (uint32_t) (actcount + (std::unique(ins.begin(), ins.end()) - ins.begin()));
+            }
             return actcount;
         }
         return 0;
@@ -208,60 +312,16 @@ public:
     
     
     /** 
-      * Compute size of the relevant intersection of v and a pivot
+      * Compute size of the relevant intersection of v and a pivot: the
+      * pivot's adjacency list is intersected with the out-neighbors of v
+      * that come after the pivot, outs[k+1..].
       */
-    int intersection_size(graphchi_vertex<uint32_t, uint32_t> &v, vid_t pivot, int start_i) {
+    int intersection_size(graphchi_vertex<VertexDataType, EdgeDataType> &v, sorted_outedges &outs, size_t k) {
+        vid_t pivot = outs.ids[k];
         assert(is_pivot(pivot));
-        int count = 0;
-        if (pivot > v.id()) {
-            dense_adj &dadj = adjs[pivot - pivot_st];
-            int vc = v.num_edges();
-             
-            /**
-              * If the adjacency list sizes are not too different, use
-              * 'merge'-type of operation to compute size intersection.
-              */
-            if (dadj.count < 32 * (vc - start_i)) { // TODO: do real profiling to find best cutoff value
-                // Do merge-style of check
-                assert(v.edge(start_i)->vertex_id() == pivot);
-                int i1 = 0;
-                int i2 = start_i+1;
-                int nedges = v.num_edges(); 
-                
-                while (i1 < dadj.count && i2 < nedges) {
-                    vid_t dst = v.edge(i2)->vertexid;
-                    vid_t a = dadj.adjlist[i1];
-                    if (a == dst) {
-                        /* Add one to edge between v and the match */
-                        v.edge(i2)->set_data(v.edge(i2)->get_data() + 1);
-                        count++;
-                        i1++; i2++;
-                        
-                    } else {
-                        i1 += a < dst;
-                        i2 += a > dst;
-                    }  
-                }
-            } else {
-                /**
-                  * Otherwise, use linear/binary search.
-                  */
-                vid_t lastvid = 0;
-                for(int i=start_i+1; i < vc; i++) {
-                    vid_t nb = v.edge(i)->vertexid;
-                    if (nb > pivot && nb != lastvid) {
-                        int match = findadj(dadj.adjlist, dadj.count, nb);
-                        count += match;
-                        if (match > 0) {
-                            /* Add one to edge between v and the match */
-                            v.edge(i)->set_data(v.edge(i)->get_data() + 1);
-                        }
-                    }
-                    lastvid = nb;
-                }
-            }
-        }        
-        return count;
+        dense_adj &dadj = adjs[pivot - pivot_st];
+        increment_match onmatch(v, &outs.idx[k + 1]);
+        return (int) intersect_sorted(dadj.adjlist, dadj.count, &outs.ids[k + 1], outs.size() - k - 1, onmatch);
     }
     
     inline bool is_pivot(vid_t vid) {
@@ -279,6 +339,11 @@ adjlist_container * adjcontainer;
   */
 struct TriangleCountingProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
     
+    std::string degreefile;
+    size_t pivot_membudget;
+    
+    TriangleCountingProgram(std::string degreefile, size_t pivot_membudget) :
+        degreefile(degreefile), pivot_membudget(pivot_membudget) {}
      
     /**
      *  Vertex update function.
@@ -291,39 +356,29 @@ struct TriangleCountingProgram : public GraphChiProgram<VertexDataType, EdgeData
             uint32_t oldcount = v.get_data();
             uint32_t newcounts = 0;
 
-            v.sort_edges_indirect();
-            
-            vid_t lastvid = 0;
+            sorted_outedges &outs = thread_scratch();
+            outs.build(v, true);
             
             /**
-              * Iterate through the edges, and if an edge is from a 
-              * pivot vertex, compute intersection of the relevant
-              * adjacency lists.
+              * Iterate through the edges to pivot vertices, and
+              * compute intersection of the relevant adjacency lists.
+              * The edges are oriented, so all neighbors have larger id.
               */
-            for(int i=0; i<v.num_edges(); i++) {
-                graphchi_edge<uint32_t> * e = v.edge(i);
-                if (e->vertexid > v.id() && e->vertexid >= adjcontainer->pivot_st) {
-                    assert(!is_deleted_edge_value(e->get_data()));
-                    if (e->vertexid != lastvid) {  // Handles reciprocal edges (a->b, b<-a)
-                        if (adjcontainer->is_pivot(e->vertexid)) {
-                            uint32_t pivot_triangle_count = adjcontainer->intersection_size(v, e->vertexid, i);
-                            newcounts += pivot_triangle_count;
-                            
-                            /* Write the number of triangles into edge between this vertex and pivot */
-                            if (pivot_triangle_count == 0 && e->get_data() == 0) {
-                                /* ... or remove the edge, if the count is zero. */
-                                v.remove_edge(i); 
-                            } else {
-                                
-                                e->set_data(e->get_data() + pivot_triangle_count);
-                            }
-                        } else {
-                            break;
-                        }
-                    }
-                    lastvid = e->vertexid;
-                }  
-                assert(newcounts >= 0);
+            size_t first = outs.lower_bound(adjcontainer->pivot_st);
+            size_t last = outs.lower_bound(adjcontainer->pivot_en);
+            for(size_t k=first; k < last; k++) {
+                graphchi_edge<EdgeDataType> * e = v.outedge(outs.idx[k]);
+                assert(!is_deleted_edge_value(e->get_data()));
+                uint32_t pivot_triangle_count = adjcontainer->intersection_size(v, outs, k);
+                newcounts += pivot_triangle_count;
+                
+                /* Write the number of triangles into edge between this vertex and pivot */
+                if (pivot_triangle_count == 0 && e->get_data() == 0) {
+                    /* ... or remove the edge, if the count is zero. */
+                    v.remove_outedge(outs.idx[k]); 
+                } else {
+                    e->set_data(e->get_data() + pivot_triangle_count);
+                }
             }
             
             if (newcounts > 0) {
@@ -337,16 +392,15 @@ struct TriangleCountingProgram : public GraphChiProgram<VertexDataType, EdgeData
         if (gcontext.iteration % 2 == 0) {
             int newcounts = 0;
           
-            for(int i=0; i < v.num_edges(); i++) {
-                graphchi_edge<uint32_t> * e = v.edge(i);
-                if (e->vertexid < v.id()) {
-                    newcounts += e->get_data();
-                    e->set_data(0);
-                    
-                    // This edge can be now deleted. Is there some other situations we can delete?
-                    if (v.id() < adjcontainer->pivot_st && e->vertexid < adjcontainer->pivot_st) {
-                        v.remove_edge(i);
-                    }
+            for(int i=0; i < v.num_inedges(); i++) {
+                graphchi_edge<EdgeDataType> * e = v.inedge(i);
+                if (is_deleted_edge_value(e->get_data())) continue;
+                newcounts += e->get_data();
+                e->set_data(0);
+                
+                // This edge can be now deleted. Is there some other situations we can delete?
+                if (v.id() < adjcontainer->pivot_st && e->vertexid < adjcontainer->pivot_st) {
+                    v.remove_inedge(i);
                 }
             }
             v.set_data(v.get_data() + newcounts);
@@ -367,13 +421,24 @@ struct TriangleCountingProgram : public GraphChiProgram<VertexDataType, EdgeData
             }
             grabbed_edges = 0;
             adjcontainer->clear();
+            
+            // Take as many new pivots as their adjacency lists fit in memory.
+            if (adjcontainer->pivot_st < gcontext.nvertices) {
+                adjcontainer->next_pivotrange(degreefile, gcontext.nvertices, pivot_membudget);
+                for(vid_t i=adjcontainer->pivot_st; i < adjcontainer->pivot_en; i++) {
+                    gcontext.scheduler->add_task(i);
+                }
+                if (adjcontainer->pivot_en == gcontext.nvertices) {
+                    // Last iteration needed for collecting last triangle counts
+                    gcontext.set_last_iteration(gcontext.iteration + 2);
+                }
+            }
         } else {
             // Schedule everything that has id < pivot
-            logstream(LOG_INFO) << "Now pivots: " << adjcontainer->pivot_st << " " << adjcontainer->pivot_en << std::endl;
-            for(vid_t i=0; i < gcontext.nvertices; i++) {
-                if (i < adjcontainer->pivot_en) { 
-                    gcontext.scheduler->add_task(i); 
-                }
+            logstream(LOG_INFO) << "Now pivots: " << adjcontainer->pivot_st << " " << adjcontainer->pivot_en
+                << ", grabbed " << grabbed_edges << " edges" << std::endl;
+            for(vid_t i=0; i < adjcontainer->pivot_en; i++) {
+                gcontext.scheduler->add_task(i); 
             }
         }
         
@@ -387,31 +452,8 @@ struct TriangleCountingProgram : public GraphChiProgram<VertexDataType, EdgeData
     
     /**
      * Called before an execution interval is started.
-     *
-     * On every even iteration, we store pivot's adjacency lists to memory. 
-     * Here we manage the memory to ensure that we do not load too much
-     * edges into memory.
      */
     void before_exec_interval(vid_t window_st, vid_t window_en, graphchi_context &gcontext) {        
-        if (gcontext.iteration % 2 == 0) {
-            if (adjcontainer->pivot_st <= window_en) {
-                size_t max_grab_edges = get_option_long("membudget_mb", 1024) * 1024 * 1024 / 8;
-                if (grabbed_edges < max_grab_edges * 0.8) {
-                    logstream(LOG_DEBUG) << "Window init, grabbed: " << grabbed_edges << " edges" << std::endl;
-                    for(vid_t vid=window_st; vid <= window_en; vid++) {
-                        gcontext.scheduler->add_task(vid);
-                    }
-                    adjcontainer->extend_pivotrange(window_en + 1);
-                    if (window_en == gcontext.nvertices) {
-                        // Last iteration needed for collecting last triangle counts
-                        gcontext.set_last_iteration(gcontext.iteration + 3);                    
-                    }
-                } else {
-                    std::cout << "Too many edges, already grabbed: " << grabbed_edges << std::endl;
-                }
-            }
-        }
-        
     }
     
     /**
@@ -437,24 +479,27 @@ int main(int argc, const char ** argv) {
     std::string filename = get_option_string("file");  // Base filename
     int niters           = 100000; // Automatically determined during running
     bool scheduler       = true;
+    compute_clustering   = get_option_int("clustering", 0) != 0;
     
-    /* Preprocess the file, and order the vertices in the order of their degree.
+    /* Preprocess the file, order the vertices in the order of their degree
+       and orient the edges from lower to higher id.
        Mapping from original ids to new ids is saved separately. */
-    OrderByDegree<EdgeDataType> * orderByDegreePreprocessor = new OrderByDegree<EdgeDataType> ();
+    OrderByDegree<EdgeDataType> * orderByDegreePreprocessor = new OrderByDegree<EdgeDataType> (true);
     int nshards          = convert_if_notexists<EdgeDataType>(filename, 
                                                                 get_option_string("nshards", "auto"),
                                                                     orderByDegreePreprocessor);
+    std::string graphfile = filename + orderByDegreePreprocessor->getSuffix();
     
     /* Initialize adjacency container */
     adjcontainer = new adjlist_container();
-    
-    // TODO: ordering by degree.
+    adjscratch.resize(std::max(get_option_int("execthreads", omp_get_max_threads()), omp_get_max_threads()));
     
     /* Run */
-    TriangleCountingProgram program;
-    graphchi_dynamicgraph_engine<VertexDataType, EdgeDataType> engine(filename + orderByDegreePreprocessor->getSuffix(),
-                                                                      nshards, scheduler, m); 
+    size_t pivot_membudget = (size_t) (get_option_float("triangles.pivot_membudget_mb", get_option_int("membudget_mb", 1024) / 2.0) * 1024 * 1024);
+    TriangleCountingProgram program(filename_degree_data(graphfile), pivot_membudget);
+    graphchi_dynamicgraph_engine<VertexDataType, EdgeDataType> engine(graphfile, nshards, scheduler, m); 
     engine.set_enable_deterministic_parallelism(false);
+    if (compute_clustering) distinct_degrees.resize(engine.num_vertices(), 0);
     
     // Low memory budget is required to prevent swapping as triangle counting
     // uses more memory than standard GraphChi apps.
@@ -465,7 +510,7 @@ int main(int argc, const char ** argv) {
     metrics_report(m);
     
     /* Count triangles */
-    size_t ntriangles = sum_vertices<vid_t, size_t>(filename + "_degord", 0, (vid_t)engine.num_vertices());
+    size_t ntriangles = sum_vertices<vid_t, size_t>(graphfile, 0, (vid_t)engine.num_vertices());
     std::cout << "Number of triangles: " << ntriangles / 3 << "(" << ntriangles << ")" << std::endl;
 
     
@@ -476,9 +521,34 @@ int main(int argc, const char ** argv) {
         assert(expected == ntriangles / 3);
     }
     
+    /* Write the clustering coefficients, with the original vertex ids */
+    if (compute_clustering) {
+        std::vector<vid_t> origids;
+        std::string vertexmapfile = filename + ".vertexmap";
+        int mf = open(vertexmapfile.c_str(), O_RDONLY);
+        if (mf >= 0) {
+            size_t n = get_filesize(vertexmapfile) / sizeof(vid_t);
+            std::vector<vid_t> translate(n);
+            if (n > 0) preada(mf, &translate[0], n * sizeof(vid_t), 0);
+            close(mf);
+            origids.resize(n);
+            for(vid_t orig=0; orig < n; orig++) origids[translate[orig]] = orig;
+        } else {
+            logstream(LOG_WARNING) << "Could not read " << vertexmapfile << ", writing the degree-ordered ids." << std::endl;
+        }
+        std::string outfile = filename + ".clustering";
+        FILE * f = fopen(outfile.c_str(), "w");
+        assert(f != NULL);
+        ClusteringCallback callback(f, distinct_degrees, origids);
+        foreach_vertices<VertexDataType>(graphfile, 0, (vid_t)engine.num_vertices(), callback);
+        fclose(f);
+        std::cout << "Average clustering coefficient: " << callback.sum / engine.num_vertices() << std::endl;
+        std::cout << "Clustering coefficients written to " << outfile << std::endl;
+    }
+    
     /* write the output */
   //  OutputVertexCallback callback;
-  //  foreach_vertices<VertexDataType>(filename + "_degord", 0, engine.num_vertices(), callback);
+  //  foreach_vertices<VertexDataType>(graphfile, 0, engine.num_vertices(), callback);
 
     return 0;
 }
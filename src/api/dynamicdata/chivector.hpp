@@ -30,21 +30,67 @@
 #ifndef DEF_GRAPHCHI_CHIVECTOR
 #define DEF_GRAPHCHI_CHIVECTOR
 
-#include <vector>
+#include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "util/pthread_tools.hpp"
 
 namespace graphchi {
 
     
 #define MINCAPACITY 2
     
+/* Size of the chunks of the extension pools */
+#define EXTENSION_POOL_CHUNK (1024 * 1024)
+    
 
 /**
-  * Pool the extension parts of chi-vectors
+  * Pool the extension parts of chi-vectors. The pool belongs to a
+  * block of vectors: memory is allocated from large chunks and released
+  * all at once when the block is written and deleted.
   */
 template <typename T>
 class extension_pool {
-        
+    
+    std::vector<T *> chunks;
+    size_t chunkpos;
+    size_t chunklen;
+    spinlock lock;
+    
+    extension_pool(const extension_pool &);
+    extension_pool &operator=(const extension_pool &);
+    
+public:
+    
+    extension_pool() : chunkpos(0), chunklen(0) {}
+    
+    ~extension_pool() {
+        for(int i=0; i < (int)chunks.size(); i++) free(chunks[i]);
+        chunks.clear();
+    }
+    
+    /**
+     * Allocates space for n elements. Thread-safe.
+     */
+    T * allocate(size_t n) {
+        lock.lock();
+        if (chunkpos + n > chunklen) {
+            size_t len = EXTENSION_POOL_CHUNK / sizeof(T);
+            if (len < n) len = n;
+            chunks.push_back((T *) malloc(len * sizeof(T)));
+            assert(chunks.back() != NULL);
+            chunkpos = 0;
+            chunklen = len;
+        }
+        T * p = chunks.back() + chunkpos;
+        chunkpos += n;
+        lock.unlock();
+        return p;
+    }
+    
 };
     
     
@@ -54,34 +100,34 @@ class chivector {
     uint16_t nsize;
     uint16_t ncapacity;
     T * data;
-    std::vector<T> * extensions;  // TODO: use a more memory efficient system?
+    /* When the vector grows past its capacity, its elements are moved here */
+    extension_pool<T> * pool;
+    
+    void grow() {
+        assert(pool != NULL);
+        assert(ncapacity < 0xffff);
+        int newcap = (ncapacity < MINCAPACITY ? 2 * MINCAPACITY : 2 * (int)ncapacity);
+        if (newcap > 0xffff) newcap = 0xffff;
+        T * newdata = pool->allocate(newcap);
+        if (nsize > 0) memcpy(newdata, data, nsize * sizeof(T));
+        data = newdata;
+        ncapacity = (uint16_t) newcap;
+    }
     
 public:
     typedef T element_type_t;
     typedef uint32_t sizeword_t;
-    chivector() {
-        extensions = NULL;
+    chivector() : nsize(0), ncapacity(0), data(NULL), pool(NULL) {
     }
     
-    chivector(uint16_t sz, uint16_t cap, T * dataptr) : data(dataptr) {
+    chivector(uint16_t sz, uint16_t cap, T * dataptr, extension_pool<T> * pool = NULL) : data(dataptr), pool(pool) {
         nsize = sz;
         ncapacity = cap;
         assert(cap >= nsize);
-        extensions = NULL;
-    }
-    
-    ~chivector() {
-        if (extensions != NULL) {
-            delete extensions;
-            extensions = NULL;
-        }
     }
     
     void write(T * dest) {
-        int sz = (int) this->size();
-        for(int i=0; i < sz; i++) {
-            dest[i] = get(i);  // TODO: use memcpy
-        }
+        if (nsize > 0) memcpy(dest, data, nsize * sizeof(T));
     }
     
     uint16_t size() {
@@ -93,31 +139,18 @@ public:
     }
     
     void add(T val) {
-        nsize ++;
-        if (nsize > ncapacity) {
-            if (extensions == NULL) extensions = new std::vector<T>();
-            extensions->push_back(val);
-        } else {
-            data[nsize - 1] = val;
-        }
+        if (nsize == ncapacity) grow();
+        data[nsize++] = val;
     }
     //idx should already exist in the array
     void set(int idx, T val){
-	if (idx >= ncapacity) {
-            (*extensions)[idx - (int)ncapacity] = val;
-        } else {
-            data[idx] = val;
-        }
+        data[idx] = val;
     }
   
     // TODO: addmany()
     
     T get(int idx) {
-        if (idx >= ncapacity) {
-            return (* extensions)[idx - (int)ncapacity];
-        } else {
-            return data[idx];
-        }
+        return data[idx];
     }
     
     void remove(int idx) {
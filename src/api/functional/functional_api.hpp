@@ -27,6 +27,10 @@
  * layer on top of the standard API, but uses a specialized engine "functional_engine",
  * which processes the graph data in different order. Namely, it first loads in-edges,
  * then executes updates, and finally writes new values (broadcasts) to out-edges.
+ *
+ * The in-edge values of a window are copied to spans, contiguous by vertex,
+ * when the memory shard is loaded. The gather over a span is run in parallel
+ * by the updates, with gather_span() of the kernel.
  */
 
 
@@ -57,6 +61,10 @@ namespace graphchi {
         typedef FVertexDataType VertexDataType;
         typedef FEdgeDataType EdgeDataType;
         
+        /* Kernels whose gather_span() does not use the neighbor ids can set
+           this to false, and the ids of the in-edges are not loaded */
+        static const bool gather_needs_nbids = true;
+        
         functional_kernel() {}
          
         /* Initial value - on first iteration */
@@ -72,6 +80,19 @@ namespace graphchi {
         virtual VertexDataType compute_vertexvalue(graphchi_context &ginfo, vertex_info& myvertex, EdgeDataType nbvalsum) = 0;        
         // "Scatter
         virtual EdgeDataType value_to_neighbor(graphchi_context &info, vertex_info& myvertex, vid_t nbid, VertexDataType myval) = 0;        
+        
+        /**
+         * "Gather" and "Sum" over the in-edge values of a vertex. Kernels
+         * can hide this with a loop that the compiler can vectorize; it is
+         * resolved at compile time, as the vertices know the kernel type.
+         */
+        VertexDataType gather_span(graphchi_context &info, vertex_info& myvertex, VertexDataType cumval,
+                                   const vid_t * nbids, const EdgeDataType * nbvals, int n) {
+            for(int i=0; i < n; i++) {
+                cumval = plus(cumval, op_neighborval(info, myvertex, nbids[i], nbvals[i]));
+            }
+            return cumval;
+        }
     }; 
 
     
@@ -53,18 +53,24 @@ namespace graphchi {
         
         typedef typename KERNEL::VertexDataType VT;
         typedef PairContainer<typename KERNEL::EdgeDataType> ET;
+        typedef typename KERNEL::EdgeDataType span_value_t;
        
         KERNEL kernel;
 
         VT cumval;
         
+        /* Old values of the in-edges, in the span buffers of the engine */
+        vid_t * span_nbids;
+        span_value_t * span_vals;
+        int nspan;
+        
         vertex_info vinfo;
         graphchi_context * gcontext;
         
         functional_vertex_unweighted_bulksync() : graphchi_vertex<VT, ET> () {}
         
         functional_vertex_unweighted_bulksync(graphchi_context &ginfo, vid_t _id, int indeg, int outdeg) : 
-        graphchi_vertex<VT, ET> (_id, NULL, NULL, indeg, outdeg) { 
+        graphchi_vertex<VT, ET> (_id, NULL, NULL, indeg, outdeg), span_nbids(NULL), span_vals(NULL), nspan(0) { 
             vinfo.indegree = indeg;
             vinfo.outdegree = outdeg;
             vinfo.vertexid = _id;
@@ -85,18 +91,27 @@ namespace graphchi {
             gcontext = &ginfo;
         }
         
-        // Optimization: as only memshard (not streaming shard) creates inedgers,
-        // we do not need atomic instructions here!
+        void set_inedge_span(vid_t * nbids, span_value_t * vals, int n) {
+            span_nbids = nbids;
+            span_vals = vals;
+            nspan = n;
+        }
+        
+        static bool gather_needs_nbids() {
+            return KERNEL::gather_needs_nbids;
+        }
+        
+        static span_value_t span_value(ET e, int iteration) {
+            return e.oldval(iteration);
+        }
+        
+        /* The engine loads the old values of the in-edges to the spans */
         inline void add_inedge(vid_t src, ET * ptr, bool special_edge) {
-            if (gcontext->iteration > 0) {
-                cumval = kernel.plus(cumval, kernel.op_neighborval(*gcontext, 
-                                                               vinfo, 
-                                                               src, 
-                                                               ptr->oldval(gcontext->iteration)));
-            }
+            assert(false);
         }
         
         void ready(graphchi_context &ginfo) {
+            cumval = kernel.gather_span(*gcontext, vinfo, cumval, span_nbids, span_vals, nspan);
             this->set_data(kernel.compute_vertexvalue(*gcontext, vinfo, cumval));
         }
         
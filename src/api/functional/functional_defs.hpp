@@ -36,6 +36,21 @@ namespace graphchi {
         int indegree;
         int outdegree;
     };
+    
+    /**
+     * Sum of a span of values, with eight partial sums so that
+     * the compiler can vectorize the loop.
+     */
+    template <typename T>
+    inline T sum_span(const T * vals, int n) {
+        T s[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        int i = 0;
+        for(; i + 8 <= n; i += 8) {
+            for(int j=0; j < 8; j++) s[j] += vals[i + j];
+        }
+        for(; i < n; i++) s[0] += vals[i];
+        return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+    }
 
 };
 
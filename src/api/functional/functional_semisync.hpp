@@ -48,8 +48,15 @@ public:
     typedef typename KERNEL::VertexDataType VT;
     typedef typename KERNEL::EdgeDataType ET;
     
+    typedef ET span_value_t;
+    
     VT cumval;
     
+    /* In-edges of the vertex, in the span buffers of the engine */
+    vid_t * span_nbids;
+    ET * span_vals;
+    int nspan;
+    
     KERNEL kernel;
     vertex_info vinfo;
     graphchi_context * gcontext;
@@ -57,7 +64,7 @@ public:
     functional_vertex_unweighted_semisync() : graphchi_vertex<VT, ET> () {}
     
     functional_vertex_unweighted_semisync(graphchi_context &ginfo, vid_t _id, int indeg, int outdeg) : 
-    graphchi_vertex<VT, ET> (_id, NULL, NULL, indeg, outdeg) { 
+    graphchi_vertex<VT, ET> (_id, NULL, NULL, indeg, outdeg), span_nbids(NULL), span_vals(NULL), nspan(0) { 
         vinfo.indegree = indeg;
         vinfo.outdegree = outdeg;
         vinfo.vertexid = _id;
@@ -77,15 +84,27 @@ public:
         this->set_data(kernel.initial_value(gcontext_, vinfo));
     }
     
-    // Optimization: as only memshard (not streaming shard) creates inedgers,
-    // we do not need atomic instructions here!
+    void set_inedge_span(vid_t * nbids, span_value_t * vals, int n) {
+        span_nbids = nbids;
+        span_vals = vals;
+        nspan = n;
+    }
+    
+    static bool gather_needs_nbids() {
+        return KERNEL::gather_needs_nbids;
+    }
+    
+    static span_value_t span_value(ET e, int iteration) {
+        return e;
+    }
+    
+    /* The engine loads the in-edges to the spans */
     inline void add_inedge(vid_t src, ET * ptr, bool special_edge) {
-        if (gcontext->iteration > 0) {
-            cumval = kernel.plus(cumval, kernel.op_neighborval(*gcontext, vinfo, src, *ptr));
-        } 
+        assert(false);
     }
     
     void ready(graphchi_context &gcontext_) {
+        cumval = kernel.gather_span(gcontext_, vinfo, cumval, span_nbids, span_vals, nspan);
         this->set_data(kernel.compute_vertexvalue(gcontext_, vinfo, cumval));
     }
     
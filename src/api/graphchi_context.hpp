@@ -39,6 +39,7 @@
 
 #include "graphchi_types.hpp"
 #include "api/ischeduler.hpp"
+#include "api/thread_aggregator.hpp"
 
 namespace graphchi {
     
@@ -52,12 +53,13 @@ namespace graphchi {
         int num_iterations;
         int last_iteration;
         int execthreads;
-        std::vector<double> deltas;
+        sum_aggregator<double> deltas;
+        std::vector<ithread_aggregator *> aggregators;
         timeval start;
         std::string filename;
         double last_deltasum;
         
-        graphchi_context() : scheduler(NULL), iteration(0), last_iteration(-1) {
+        graphchi_context() : scheduler(NULL), iteration(0), last_iteration(-1), execthreads(omp_get_max_threads()) {
             gettimeofday(&start, NULL);
             last_deltasum = 0.0;
         }
@@ -76,16 +78,43 @@ namespace graphchi {
         }
         
         void reset_deltas(int nthreads) {
-            deltas = std::vector<double>(nthreads, 0.0);
+            deltas.set_nthreads(nthreads);
+            deltas.reset();
+            for(size_t i=0; i < aggregators.size(); i++) {
+                aggregators[i]->set_nthreads(nthreads);
+            }
         }
         
+        /**
+         * Sum of the deltas logged in this iteration, up to the
+         * previous execution interval.
+         */
         double get_delta() {
-            double d = 0.0;
-            for(int i=0; i < (int)deltas.size(); i++) {
-                d += deltas[i];
+            last_deltasum = deltas.get();
+            return last_deltasum;
+        }
+        
+        /**
+         * Registers a per-thread aggregator (see thread_aggregator.hpp), which
+         * the engine merges after each execution interval. Registering the same
+         * aggregator again has no effect. The context does not take ownership.
+         */
+        void register_aggregator(ithread_aggregator * aggregator) {
+            for(size_t i=0; i < aggregators.size(); i++) {
+                if (aggregators[i] == aggregator) return;
+            }
+            aggregator->set_nthreads(execthreads);
+            aggregators.push_back(aggregator);
+        }
+        
+        /**
+         * Called by the engine after each execution interval.
+         */
+        void merge_aggregators() {
+            deltas.merge();
+            for(size_t i=0; i < aggregators.size(); i++) {
+                aggregators[i]->merge();
             }
-            last_deltasum = d;
-            return d;
         }
         
         inline bool isnan(double x) {
@@ -99,7 +128,7 @@ namespace graphchi {
           * @param delta
           */
         void log_change(double delta) {
-            deltas[omp_get_thread_num()] += delta;  
+            deltas.add(delta);
             assert(delta >= 0);
             assert(!isnan(delta)); /* Sanity check */
         }
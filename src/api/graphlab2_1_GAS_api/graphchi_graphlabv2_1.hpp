@@ -24,12 +24,23 @@
  * @section DESCRIPTION
  *
  * Wrapper classes for GraphLab v2.1 API.
+ *
+ * Gather caching: if enabled (option gather_caching=1), the result of the
+ * gather of each vertex is kept in memory next to the vertex values, and
+ * the gather is skipped while the cached value is valid. The vertex
+ * program must keep the caches of its neighbors up to date by posting
+ * the changes of its gather contributions with icontext::post_delta(),
+ * or invalidate them with icontext::clear_gather_cache().
  */
 
 #ifndef DEF_GRAPHLAB_WRAPPERS
 #define DEF_GRAPHLAB_WRAPPERS
 
+#include <stdint.h>
+#include <vector>
+
 #include "graphchi_basic_includes.hpp"
+#include "util/pthread_tools.hpp"
 
 using namespace graphchi;
  
@@ -68,6 +79,65 @@ namespace graphlab {
     
     typedef vid_t vertex_id_type;
     
+#define GATHER_CACHE_NLOCKS 1024
+    
+    /**
+     * Cached gather results of the vertices. Deltas may be posted
+     * concurrently, so the entries are protected by striped locks.
+     */
+    template <typename GatherType>
+    struct gather_cache {
+        std::vector<GatherType> values;
+        std::vector<uint8_t> valid;
+        spinlock locks[GATHER_CACHE_NLOCKS];
+        
+        void resize(size_t n) {
+            values.resize(n);
+            valid.resize(n, 0);
+        }
+        
+        /**
+         * Copies the cached value to out, if it is valid.
+         */
+        bool get(vid_t v, GatherType &out) {
+            spinlock &l = locks[v % GATHER_CACHE_NLOCKS];
+            l.lock();
+            bool hit = valid[v] != 0;
+            if (hit) out = values[v];
+            l.unlock();
+            return hit;
+        }
+        
+        void set(vid_t v, const GatherType &x) {
+            spinlock &l = locks[v % GATHER_CACHE_NLOCKS];
+            l.lock();
+            values[v] = x;
+            valid[v] = 1;
+            l.unlock();
+        }
+        
+        /**
+         * Adds the delta to the cached value. Deltas to invalid
+         * entries are dropped: the next gather recomputes them.
+         */
+        void post_delta(vid_t v, const GatherType &delta) {
+            spinlock &l = locks[v % GATHER_CACHE_NLOCKS];
+            l.lock();
+            if (valid[v]) values[v] += delta;
+            l.unlock();
+        }
+        
+        void invalidate(vid_t v) {
+            spinlock &l = locks[v % GATHER_CACHE_NLOCKS];
+            l.lock();
+            if (valid[v]) {
+                values[v] = GatherType();
+                valid[v] = 0;
+            }
+            l.unlock();
+        }
+    };
+    
     template<typename GraphType,
     typename GatherType, 
     typename MessageType>
@@ -107,11 +177,13 @@ namespace graphlab {
         /* GraphChi */
         graphchi_context * gcontext;
         
-        
+        /* NULL if gather caching is disabled */
+        gather_cache<gather_type> * cache;
         
     public:        
         
-        icontext(graphchi_context * gcontext) : gcontext(gcontext) {}
+        icontext(graphchi_context * gcontext, gather_cache<gather_type> * cache = NULL) :
+            gcontext(gcontext), cache(cache) {}
         
         /** \brief icontext destructor */
         virtual ~icontext() { }
@@ -283,7 +355,7 @@ namespace graphlab {
          */
         virtual void post_delta(const vertex_type& vertex, 
                                 const gather_type& delta) { 
-            assert(false); // Not implemented
+            if (cache != NULL) cache->post_delta(vertex.id(), delta);
         } 
         
         /**
@@ -295,9 +367,15 @@ namespace graphlab {
          * \param vertex [in] the vertex whose cache to clear.
          */
         virtual void clear_gather_cache(const vertex_type& vertex) {
-            assert(false); // Not implemented
+            if (cache != NULL) cache->invalidate(vertex.id());
         } 
         
+        /**
+         * \brief Returns true if the engine caches the gathers. (GraphChi
+         * extension: programs can skip computing deltas otherwise.)
+         */
+        bool gather_caching() const { return cache != NULL; }
+        
     }; // end of icontext
     
 
@@ -533,10 +611,24 @@ namespace graphlab {
         typedef typename GraphLabVertexProgram::graph_type graph_type;
         typedef typename GraphLabVertexProgram::message_type message_type;
         
+        typedef GraphLabEdgeWrapper<GLVertexDataType, EdgeDataType> edge_wrapper_type;
+        
         std::vector<GLVertexDataType> * vertexInmemoryArray;
+        gather_cache<gather_type> * gatherCache;
+        
+        metrics &m;
+        metric_handle mh_cache_hits;
+        metric_handle mh_gathered_edges;
      
-        GraphLabWrapper() {
+        GraphLabWrapper(metrics &_m, bool gather_caching=false) : m(_m) {
             vertexInmemoryArray = new std::vector<GLVertexDataType>();
+            gatherCache = (gather_caching ? new gather_cache<gather_type>() : NULL);
+            mh_cache_hits = m.register_metric("gathercache.hits", INTEGER);
+            mh_gathered_edges = m.register_metric("gathered-edges", INTEGER);
+        }
+        
+        ~GraphLabWrapper() {
+            if (gatherCache != NULL) delete gatherCache;
         }
         
         /**
@@ -546,6 +638,7 @@ namespace graphlab {
             if (gcontext.iteration == 0) {
                 logstream(LOG_INFO) << "Initialize vertices in memory." << std::endl;
                 vertexInmemoryArray->resize(gcontext.nvertices);
+                if (gatherCache != NULL) gatherCache->resize(gcontext.nvertices);
             }
         }
         
@@ -568,29 +661,19 @@ namespace graphlab {
         }
         
         /**
-         * Update function.
+         * Gathers over the edges of a vertex.
          */
-        void update(graphchi_vertex<bool, EdgeDataType> &vertex, graphchi_context &gcontext) {
-            graphlab::icontext<graph_type, gather_type, message_type> glcontext(&gcontext);
-            
-            /* Create the vertex program */
-            GraphLabVertexWrapper<GLVertexDataType, EdgeDataType> wrapperVertex(vertex.id(), &vertex, vertexInmemoryArray);
-            GraphLabVertexProgram glVertexProgram;
-            
-            /* Init */
-            glVertexProgram.init(glcontext, wrapperVertex, typename GraphLabVertexProgram::message_type());
-            const GraphLabVertexProgram& const_vprog = glVertexProgram;
-            
-            /* Gather */
-            edge_dir_type gather_direction = const_vprog.gather_edges(glcontext, wrapperVertex);
-            gather_type sum;
-            
+        void gather(GraphLabVertexProgram &vprog, graphlab::icontext<graph_type, gather_type, message_type> &glcontext,
+                    GraphLabVertexWrapper<GLVertexDataType, EdgeDataType> &wrapperVertex,
+                    graphchi_vertex<bool, EdgeDataType> &vertex, edge_dir_type gather_direction, gather_type &sum) {
+            const GraphLabVertexProgram& const_vprog = vprog;
+            edge_wrapper_type edgeWrapper(NULL, &vertex, vertexInmemoryArray, true);
             int gathered = 0;
             switch (gather_direction) {
                 case ALL_EDGES:
                 case IN_EDGES:
                     for(int i=0; i < vertex.num_inedges(); i++) {
-                        GraphLabEdgeWrapper<GLVertexDataType, EdgeDataType> edgeWrapper(vertex.inedge(i), &vertex, vertexInmemoryArray, true);
+                        edgeWrapper.edge = vertex.inedge(i);
                         if (gathered > 0) sum += const_vprog.gather(glcontext, wrapperVertex, edgeWrapper);
                         else sum = const_vprog.gather(glcontext, wrapperVertex, edgeWrapper);
                         gathered++;
@@ -598,8 +681,9 @@ namespace graphlab {
                     if (gather_direction != ALL_EDGES)
                         break;
                 case OUT_EDGES:
+                    edgeWrapper.is_inedge = false;
                     for(int i=0; i < vertex.num_outedges(); i++) {
-                        GraphLabEdgeWrapper<GLVertexDataType, EdgeDataType> edgeWrapper(vertex.outedge(i), &vertex, vertexInmemoryArray, false);
+                        edgeWrapper.edge = vertex.outedge(i);
                         if (gathered > 0) sum += const_vprog.gather(glcontext, wrapperVertex, edgeWrapper);
                         else sum = const_vprog.gather(glcontext, wrapperVertex, edgeWrapper);
                         gathered++;
@@ -610,26 +694,56 @@ namespace graphlab {
                 default:
                     assert(false); // Huh?
             }
+            m.add(mh_gathered_edges, gathered);
+        }
+        
+        /**
+         * Update function.
+         */
+        void update(graphchi_vertex<bool, EdgeDataType> &vertex, graphchi_context &gcontext) {
+            graphlab::icontext<graph_type, gather_type, message_type> glcontext(&gcontext, gatherCache);
+            
+            /* Create the vertex program */
+            GraphLabVertexWrapper<GLVertexDataType, EdgeDataType> wrapperVertex(vertex.id(), &vertex, vertexInmemoryArray);
+            GraphLabVertexProgram glVertexProgram;
             
+            /* Init */
+            glVertexProgram.init(glcontext, wrapperVertex, typename GraphLabVertexProgram::message_type());
+            const GraphLabVertexProgram& const_vprog = glVertexProgram;
+            
+            /* Gather, unless the cached value is valid */
+            edge_dir_type gather_direction = const_vprog.gather_edges(glcontext, wrapperVertex);
+            gather_type sum;
+            
+            if (gatherCache == NULL || gather_direction == NO_EDGES) {
+                gather(glVertexProgram, glcontext, wrapperVertex, vertex, gather_direction, sum);
+            } else if (gatherCache->get(vertex.id(), sum)) {
+                m.add(mh_cache_hits, 1);
+            } else {
+                gather(glVertexProgram, glcontext, wrapperVertex, vertex, gather_direction, sum);
+                gatherCache->set(vertex.id(), sum);
+            }
             
             /* Apply */
             glVertexProgram.apply(glcontext, wrapperVertex, sum);
             
             /* Scatter */
             edge_dir_type scatter_direction = const_vprog.scatter_edges(glcontext, wrapperVertex);
+            edge_wrapper_type edgeWrapper(NULL, &vertex, vertexInmemoryArray, true);
             
             switch(scatter_direction) {
                 case ALL_EDGES:
                 case IN_EDGES:
                     for(int i=0; i < vertex.num_inedges(); i++) {
-                        GraphLabEdgeWrapper<GLVertexDataType, EdgeDataType> edgeWrapper(vertex.inedge(i), &vertex, vertexInmemoryArray, true);
+                        edgeWrapper.edge = vertex.inedge(i);
                         const_vprog.scatter(glcontext, wrapperVertex, edgeWrapper);
                     }    
                     if (scatter_direction != ALL_EDGES)
                         break;
                 case OUT_EDGES:
+                    edgeWrapper.is_inedge = false;
                     for(int i=0; i < vertex.num_outedges(); i++) {
-                        GraphLabEdgeWrapper<GLVertexDataType, EdgeDataType> edgeWrapper(vertex.outedge(i), &vertex, vertexInmemoryArray, false);
+                        edgeWrapper.edge = vertex.outedge(i);
                         const_vprog.scatter(glcontext, wrapperVertex, edgeWrapper);
                     }    
                     break;
@@ -767,7 +881,7 @@ template <typename GraphLabVertexProgram>
             run_graphlab_vertexprogram(std::string base_filename, int nshards, int niters, bool scheduler, metrics & _m,
                                     bool modifies_inedges=true, bool modifies_outedges=true) {
     typedef graphlab::GraphLabWrapper<GraphLabVertexProgram> GLWrapper;
-    GLWrapper wrapperProgram;
+    GLWrapper wrapperProgram(_m, get_option_int("gather_caching", 0) != 0);
     graphchi_engine<bool, typename GLWrapper::EdgeDataType> engine(base_filename, nshards, scheduler, _m); 
     engine.set_modifies_inedges(modifies_inedges);
     engine.set_modifies_outedges(modifies_outedges);
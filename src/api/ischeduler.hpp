@@ -42,6 +42,15 @@ namespace graphchi {
             virtual void remove_tasks(vid_t fromvertex, vid_t tovertex) = 0;
             virtual void add_task_to_all()  = 0;
             virtual bool is_scheduled(vid_t vertex) = 0;
+        
+            /**
+             * Adds delta to the pending priority (for example the accumulated
+             * residual) of a vertex. Schedulers without priorities just
+             * schedule the vertex.
+             */
+            virtual void add_priority(vid_t vid, float delta) {
+                add_task(vid);
+            }
     };
     
     
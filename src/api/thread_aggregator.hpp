@@ -0,0 +1,178 @@
+
+
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ *
+ * @section DESCRIPTION
+ *
+ * Per-thread reductions for update functions. Each thread accumulates to
+ * its own slot, padded to a cache line so that the threads do not
+ * false-share, and the slots are merged to a single value after each
+ * execution interval. Aggregators are registered to the graphchi_context:
+ *
+ *    sum_aggregator<double> error;
+ *    ...
+ *    void before_iteration(int iteration, graphchi_context &gcontext) {
+ *        error.reset();
+ *        gcontext.register_aggregator(&error);
+ *    }
+ *    void update(...) { error.add(err); }
+ *    void after_iteration(int iteration, graphchi_context &gcontext) {
+ *        std::cout << error.get() << std::endl;
+ *    }
+ */
+
+#ifndef DEF_GRAPHCHI_THREAD_AGGREGATOR
+#define DEF_GRAPHCHI_THREAD_AGGREGATOR
+
+#include <vector>
+#include <limits>
+#include <assert.h>
+#include <omp.h>
+
+#define GRAPHCHI_CACHE_LINE 64
+
+namespace graphchi {
+    
+    /**
+     * Value padded to a multiple of the cache line size.
+     */
+    template <typename T>
+    struct padded_value {
+        T val;
+        char pad[GRAPHCHI_CACHE_LINE - sizeof(T) % GRAPHCHI_CACHE_LINE];
+        padded_value() {}
+        padded_value(const T &v) : val(v) {}
+    };
+    
+    /* Reduction operators. The identity is the initial value of a slot. */
+    
+    template <typename T>
+    struct reduce_sum {
+        static T identity() { return T(0); }
+        inline void operator()(T &a, const T &b) const { a += b; }
+    };
+    
+    template <typename T>
+    struct reduce_min {
+        static T identity() { return std::numeric_limits<T>::max(); }
+        inline void operator()(T &a, const T &b) const { if (b < a) a = b; }
+    };
+    
+    template <typename T>
+    struct reduce_max {
+        static T identity() {
+            return std::numeric_limits<T>::is_integer ? std::numeric_limits<T>::min() : -std::numeric_limits<T>::max();
+        }
+        inline void operator()(T &a, const T &b) const { if (b > a) a = b; }
+    };
+    
+    /**
+     * Interface used by graphchi_context to size and merge the aggregators.
+     */
+    class ithread_aggregator {
+    public:
+        virtual ~ithread_aggregator() {}
+        virtual void set_nthreads(int nthreads) = 0;
+        virtual void merge() = 0;
+    };
+    
+    template <typename T, typename ReduceOp>
+    class thread_aggregator : public ithread_aggregator {
+        std::vector<padded_value<T> > local;
+        T value;
+        ReduceOp op;
+        
+    public:
+        thread_aggregator() : value(ReduceOp::identity()) {
+            set_nthreads(omp_get_max_threads());
+        }
+        
+        virtual ~thread_aggregator() {}
+        
+        /**
+         * Resizes the per-thread slots. Values not yet merged are merged first.
+         */
+        void set_nthreads(int nthreads) {
+            merge();
+            local.resize(nthreads, padded_value<T>(ReduceOp::identity()));
+        }
+        
+        /**
+         * Called from the update functions.
+         */
+        inline void add(const T &x) {
+            int t = omp_get_thread_num();
+            assert(t < (int) local.size());
+            op(local[t].val, x);
+        }
+        
+        /**
+         * Merges the per-thread values to the aggregate value. Not thread-safe
+         * with add(), so called by the engine between execution intervals.
+         */
+        void merge() {
+            for(size_t i=0; i < local.size(); i++) {
+                op(value, local[i].val);
+                local[i].val = ReduceOp::identity();
+            }
+        }
+        
+        /**
+         * Value merged so far (after the previous interval).
+         */
+        T get() const {
+            return value;
+        }
+        
+        /**
+         * Clears the aggregate and the per-thread values.
+         */
+        void reset() {
+            value = ReduceOp::identity();
+            for(size_t i=0; i < local.size(); i++) {
+                local[i].val = ReduceOp::identity();
+            }
+        }
+    };
+    
+    template <typename T>
+    class sum_aggregator : public thread_aggregator<T, reduce_sum<T> > { };
+    
+    template <typename T>
+    class min_aggregator : public thread_aggregator<T, reduce_min<T> > { };
+    
+    template <typename T>
+    class max_aggregator : public thread_aggregator<T, reduce_max<T> > { };
+    
+    /**
+     * Counts events, for example the number of vertices with a property.
+     */
+    class count_aggregator : public thread_aggregator<size_t, reduce_sum<size_t> > {
+    public:
+        inline void inc() {
+            add(1);
+        }
+    };
+    
+}
+
+#endif
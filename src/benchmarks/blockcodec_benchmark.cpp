@@ -0,0 +1,124 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Compares the edge data block codecs: compression ratio and encode/decode
+ * throughput (GB/s of uncompressed data) on synthetic edge values.
+ * Usage: blockcodec_benchmark [--blocksize=4194304] [--nblocks=8] [--reps=5]
+ */
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "graphchi_basic_includes.hpp"
+#include "util/block_codec.hpp"
+
+using namespace graphchi;
+
+static double now() {
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1.0e-6;
+}
+
+/**
+ * Fills a block with edge values of the given kind:
+ * ids - neighboring vertex ids (sorted with gaps),
+ * labels - small integers (component labels, counters),
+ * floats - random floating point values.
+ */
+static void fill_block(std::string kind, uint8_t * buf, size_t n, unsigned int seed) {
+    size_t nwords = n / 4;
+    uint32_t * w = (uint32_t *) buf;
+    srand(seed);
+    if (kind == "ids") {
+        uint32_t cur = (uint32_t) (rand() % 1000000);
+        for(size_t i=0; i < nwords; i++) {
+            cur += rand() % 64;
+            w[i] = cur;
+        }
+    } else if (kind == "labels") {
+        for(size_t i=0; i < nwords; i++) w[i] = rand() % 1000;
+    } else {
+        float * f = (float *) buf;
+        for(size_t i=0; i < nwords; i++) f[i] = rand() / (float) RAND_MAX;
+    }
+}
+
+int main(int argc, const char ** argv) {
+    graphchi_init(argc, argv);
+
+    size_t blocksize = get_option_long("blocksize", 4096 * 1024);
+    int nblocks = get_option_int("nblocks", 8);
+    int reps = get_option_int("reps", 5);
+
+    const char * kinds[] = {"ids", "labels", "floats"};
+    std::vector<uint8_t *> blocks(nblocks);
+    std::vector<uint8_t *> encoded(nblocks);
+    std::vector<size_t> encsizes(nblocks);
+    uint8_t * out = (uint8_t *) malloc(blocksize);
+
+    printf("%-8s %-12s %8s %12s %12s\n", "data", "codec", "ratio", "enc GB/s", "dec GB/s");
+    for(int k=0; k < 3; k++) {
+        for(int i=0; i < nblocks; i++) {
+            blocks[i] = (uint8_t *) malloc(blocksize);
+            fill_block(kinds[k], blocks[i], blocksize, 1 + i);
+        }
+        for(int c=0; c < BLOCK_CODEC_COUNT; c++) {
+            block_codec * codec = get_block_codec(c);
+            if (codec == NULL) continue;
+
+            double t = now();
+            size_t totenc = 0;
+            for(int i=0; i < nblocks; i++) {
+                encsizes[i] = encode_block(c, blocks[i], blocksize, &encoded[i]);
+                totenc += encsizes[i];
+            }
+            double enctime = now() - t;
+
+            t = now();
+            for(int r=0; r < reps; r++) {
+                for(int i=0; i < nblocks; i++) {
+                    decode_block(encoded[i], encsizes[i], out, blocksize);
+                }
+            }
+            double dectime = now() - t;
+
+            /* Check the last block round-trips */
+            if (memcmp(out, blocks[nblocks - 1], blocksize) != 0) {
+                logstream(LOG_FATAL) << "Codec " << codec->name() << " did not decode correctly!" << std::endl;
+                return 1;
+            }
+
+            double gb = (double) blocksize * nblocks / (1024.0 * 1024.0 * 1024.0);
+            printf("%-8s %-12s %8.3f %12.3f %12.3f\n", kinds[k], codec->name().c_str(),
+                   (double) totenc / (blocksize * nblocks), gb / enctime, gb * reps / dectime);
+            for(int i=0; i < nblocks; i++) free(encoded[i]);
+        }
+        for(int i=0; i < nblocks; i++) free(blocks[i]);
+    }
+    free(out);
+    return 0;
+}
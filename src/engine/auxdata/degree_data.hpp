@@ -141,6 +141,82 @@ namespace graphchi {
             iomgr->truncate(filedesc, (1 + maxid) * sizeof(degree));
         }
         
+        /**
+         * Hint that the degrees of vertices st..en are needed next.
+         */
+        virtual void prefetch(vid_t st, vid_t en) {
+            // Loaded on demand
+        }
+        
+    };
+    
+    /**
+     * Degree data for graphs that do not change during the run. The chunk
+     * in memory is reused if it covers the requested range, and the range
+     * given to prefetch() is read asynchronously to a second buffer.
+     */
+    class prefetching_degree_data : public degree_data {
+        
+        vid_t chunk_st, chunk_en;
+        vid_t prefetch_st, prefetch_en;
+        degree * prefetched_chunk;
+        
+        void release_prefetch() {
+            if (prefetched_chunk != NULL) {
+                iomgr->wait_for_reads();
+                iomgr->managed_release(filedesc, &prefetched_chunk);
+            }
+        }
+        
+    public:
+        
+        prefetching_degree_data(std::string base_filename, stripedio * iomgr) : degree_data(base_filename, iomgr), prefetched_chunk(NULL) {
+            chunk_st = chunk_en = 0;
+            prefetch_st = prefetch_en = 0;
+        }
+        
+        virtual ~prefetching_degree_data() {
+            release_prefetch();
+        }
+        
+        virtual void load(vid_t _vertex_st, vid_t _vertex_en) {
+            assert(_vertex_en >= _vertex_st);
+            if (loaded_chunk == NULL || _vertex_st < chunk_st || _vertex_en > chunk_en) {
+                if (prefetched_chunk != NULL && _vertex_st >= prefetch_st && _vertex_en <= prefetch_en) {
+                    iomgr->wait_for_reads();
+                    if (loaded_chunk != NULL) {
+                        iomgr->managed_release(filedesc, &loaded_chunk);
+                    }
+                    loaded_chunk = prefetched_chunk;
+                    prefetched_chunk = NULL;
+                    chunk_st = prefetch_st;
+                    chunk_en = prefetch_en;
+                } else {
+                    release_prefetch();
+                    degree_data::load(_vertex_st, _vertex_en);
+                    chunk_st = _vertex_st;
+                    chunk_en = _vertex_en;
+                }
+            }
+            /* get_degree() indexes the chunk from vertex_st */
+            vertex_st = chunk_st;
+            vertex_en = chunk_en;
+        }
+        
+        virtual void prefetch(vid_t st, vid_t en) {
+            assert(en >= st);
+            if (loaded_chunk != NULL && st >= chunk_st && en <= chunk_en) return;
+            if (prefetched_chunk != NULL && st >= prefetch_st && en <= prefetch_en) return;
+            release_prefetch();
+            prefetch_st = st;
+            prefetch_en = en;
+            size_t datasize = (en - st + 1) * sizeof(degree);
+            size_t datastart = st * sizeof(degree);
+            iomgr->managed_malloc(filedesc, &prefetched_chunk, datasize, datastart);
+            iomgr->managed_preada_async(filedesc, &prefetched_chunk, datasize, datastart);
+            iomgr->submit_reads();
+        }
+        
     };
     
 }
@@ -209,6 +209,10 @@ namespace graphchi {
             }
         }
         
+        virtual void flush() {
+            // Blocks are written by save()
+        }
+        
         
         /**
          * Returns id of the first vertex currently in memory. Fails if nothing loaded yet.
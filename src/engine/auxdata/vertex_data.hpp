@@ -39,6 +39,7 @@
 
 #include <stdlib.h>
 #include <string>
+#include <vector>
 #include <assert.h>
 
 #include "graphchi_types.hpp"
@@ -63,16 +64,56 @@ namespace graphchi {
         int filedesc;
         
         VertexDataType * loaded_chunk;
+        
+        /* Chunk read ahead for the next window (pipelined engine) */
+        vid_t prefetch_st;
+        vid_t prefetch_en;
+        VertexDataType * prefetched_chunk;
+        
+        /* Ranges of vertices written asynchronously, perhaps not yet on disk */
+        std::vector<std::pair<vid_t, vid_t> > pending_writes;
 
 
         virtual void open_file(std::string base_filename) {
             filedesc = iomgr->open_session(filename.c_str(), false);
         }
         
+        /**
+         * Writes vertices st..en from buf asynchronously. The buffer is
+         * released by the I/O threads.
+         */
+        void write_async(VertexDataType ** buf, vid_t st, vid_t en) {
+            size_t datasize = (en - st + 1) * sizeof(VertexDataType);
+            size_t datastart = st * sizeof(VertexDataType);
+            iomgr->managed_pwritea_async(filedesc, buf, datasize, datastart, true);
+            pending_writes.push_back(std::make_pair(st, en));
+            *buf = NULL;
+        }
+        
+        /**
+         * Before vertices st..en are read or rewritten, waits for the
+         * asynchronous writes if any of them may still be writing the range.
+         */
+        void wait_for_pending(vid_t st, vid_t en) {
+            if (pending_writes.empty()) return;
+            if (!iomgr->writes_pending()) {
+                pending_writes.clear();
+                return;
+            }
+            for(size_t i=0; i < pending_writes.size(); i++) {
+                if (pending_writes[i].first <= en && pending_writes[i].second >= st) {
+                    iomgr->wait_for_writes();
+                    pending_writes.clear();
+                    return;
+                }
+            }
+        }
+        
     public:
         
-        vertex_data_store(std::string base_filename, size_t nvertices, stripedio * iomgr) : iomgr(iomgr), loaded_chunk(NULL){
+        vertex_data_store(std::string base_filename, size_t nvertices, stripedio * iomgr) : iomgr(iomgr), loaded_chunk(NULL), prefetched_chunk(NULL) {
             vertex_st = vertex_en = 0;
+            prefetch_st = prefetch_en = 0;
             filename = filename_vertex_data<VertexDataType>(base_filename);
             check_size(nvertices);
             iomgr->allow_preloading(filename);
@@ -85,13 +126,18 @@ namespace graphchi {
             if (loaded_chunk != NULL) {
                 iomgr->managed_release(filedesc, &loaded_chunk);
             }    
+            if (prefetched_chunk != NULL) {
+                iomgr->managed_release(filedesc, &prefetched_chunk);
+            }
         }
         
-        void check_size(size_t nvertices) {
+        virtual void check_size(size_t nvertices) {
             checkarray_filesize<VertexDataType>(filename, nvertices);
         }
         
-        void clear(size_t nvertices) {
+        virtual void clear(size_t nvertices) {
+            iomgr->wait_for_writes();
+            pending_writes.clear();
             check_size(0);
             check_size(nvertices);
         }
@@ -113,24 +159,72 @@ namespace graphchi {
                 iomgr->managed_release(filedesc, &loaded_chunk);
             }
             
+            wait_for_pending(vertex_st, vertex_en);
             iomgr->managed_malloc(filedesc, &loaded_chunk, datasize, datastart);
             iomgr->managed_preada_now(filedesc, &loaded_chunk, datasize, datastart);
         }
         
         /**
-          * Saves the current chunk of vertex values
+         * Reads a chunk of vertex values into a secondary buffer, leaving
+         * the current chunk untouched. Used by the pipelined engine
+         * to load the next window while the current one is being updated.
+         * @param vertex_st first vertex id
+         * @param vertex_en last vertex id, inclusive
+         */
+        virtual void prefetch(vid_t _vertex_st, vid_t _vertex_en) {
+            assert(_vertex_en >= _vertex_st);
+            assert(prefetched_chunk == NULL);
+            prefetch_st = _vertex_st;
+            prefetch_en = _vertex_en;
+            
+            size_t datasize = (prefetch_en - prefetch_st + 1)* sizeof(VertexDataType);
+            size_t datastart = prefetch_st * sizeof(VertexDataType);
+            
+            wait_for_pending(prefetch_st, prefetch_en);
+            iomgr->managed_malloc(filedesc, &prefetched_chunk, datasize, datastart);
+            iomgr->managed_preada_now(filedesc, &prefetched_chunk, datasize, datastart);
+        }
+        
+        /**
+         * Releases the current chunk and makes the prefetched chunk current.
+         * The current chunk must have been saved before, if needed.
+         */
+        virtual void swap_prefetched() {
+            assert(prefetched_chunk != NULL);
+            if (loaded_chunk != NULL) {
+                iomgr->managed_release(filedesc, &loaded_chunk);
+            }
+            loaded_chunk = prefetched_chunk;
+            vertex_st = prefetch_st;
+            vertex_en = prefetch_en;
+            prefetched_chunk = NULL;
+        }
+        
+        /**
+          * Saves the current chunk of vertex values. An asynchronous save hands
+          * the chunk over to the I/O threads, so the chunk is not accessible
+          * after it, and the next load reads to a new buffer.
           */
         virtual void save(bool async=false) {
             assert(loaded_chunk != NULL); 
             size_t datasize = (vertex_en - vertex_st + 1) * sizeof(VertexDataType);
             size_t datastart = vertex_st * sizeof(VertexDataType);
+            wait_for_pending(vertex_st, vertex_en);
             if (async) {
-                iomgr->managed_pwritea_async(filedesc, &loaded_chunk, datasize, datastart, false);
+                write_async(&loaded_chunk, vertex_st, vertex_en);
             } else {
                 iomgr->managed_pwritea_now(filedesc, &loaded_chunk, datasize, datastart);
             }
         }
         
+        /**
+         * Starts writing back values held in memory beyond the current
+         * chunk. The chunk itself is written by save().
+         */
+        virtual void flush() {
+            // Nothing cached
+        }
+        
         
         /**
          * Returns id of the first vertex currently in memory. Fails if nothing loaded yet.
@@ -141,7 +235,7 @@ namespace graphchi {
         }  
         
         
-        VertexDataType * vertex_data_ptr(vid_t vertexid) {
+        virtual VertexDataType * vertex_data_ptr(vid_t vertexid) {
             assert(vertexid >= vertex_st && vertexid <= vertex_en);
             return &loaded_chunk[vertexid - vertex_st];
         }   
@@ -0,0 +1,410 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Vertex data store that keeps pages of vertex values in memory across
+ * windows and iterations. If the whole vertex data file fits in the cache
+ * budget, it is read once and pinned, and windows do no vertex I/O at all.
+ * Otherwise pages are admitted by access frequency: a page replaces the
+ * least recently used resident page only if it has been accessed more
+ * often. Under the sequential sweeps of the engine this keeps a stable set
+ * of pages resident instead of thrashing, and pages of frequently scheduled
+ * vertices win the space over time. Vertices of non-resident pages are
+ * read and written per window as by vertex_data_store.
+ *
+ * Modified pages are written back asynchronously when evicted or flushed.
+ * Reads and rewrites of a page whose write may still be in flight wait
+ * for the writes first. The vertex data file must not be modified by
+ * others while the store is alive.
+ */
+
+#ifndef DYNAMICVERTEXDATA
+
+#ifndef DEF_GRAPHCHI_VERTEXDATA_CACHE
+#define DEF_GRAPHCHI_VERTEXDATA_CACHE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <set>
+#include <vector>
+
+#include "engine/auxdata/vertex_data.hpp"
+#include "logger/logger.hpp"
+#include "metrics/metrics.hpp"
+
+/* Vertex data read and written in pages of about 64 kilobytes */
+#define VERTEXCACHE_PAGE_BYTES 65536
+
+namespace graphchi {
+
+    template <typename VertexDataType>
+    class cached_vertex_data_store : public vertex_data_store<VertexDataType> {
+
+        typedef vertex_data_store<VertexDataType> base_t;
+
+        struct cache_page {
+            VertexDataType * data;  // NULL if not resident
+            uint32_t accesses;
+            uint64_t lastuse;
+            bool dirty;
+            cache_page() : data(NULL), accesses(0), lastuse(0), dirty(false) {}
+        };
+
+        /* Eviction order: fewest accesses, then least recently used */
+        typedef std::pair<std::pair<uint32_t, uint64_t>, size_t> victim_key;
+
+        metrics &m;
+        size_t nvertices;
+        int pagebits;
+        size_t maxpages;
+        size_t nresident;
+        uint64_t clock;
+        std::vector<cache_page> pages;
+        std::set<victim_key> victims;
+
+        /* Pinned mode: the whole vertex array in one allocation */
+        bool pinned;
+        VertexDataType * pinned_data;
+
+        bool has_prefetch;
+        size_t hits, misses, evictions;
+
+        size_t page_of(vid_t v) { return (size_t)v >> pagebits; }
+        vid_t page_first(size_t p) { return (vid_t) (p << pagebits); }
+        size_t page_len(size_t p) {
+            return std::min((size_t)1 << pagebits, nvertices - ((size_t)p << pagebits));
+        }
+        vid_t page_last(size_t p) { return (vid_t) (page_first(p) + page_len(p) - 1); }
+        size_t npages() { return (nvertices + ((size_t)1 << pagebits) - 1) >> pagebits; }
+
+        victim_key key_of(size_t p) {
+            return victim_key(std::make_pair(pages[p].accesses, pages[p].lastuse), p);
+        }
+
+        void touch(size_t p) {
+            cache_page &pg = pages[p];
+            if (pg.data != NULL && !pinned) victims.erase(key_of(p));
+            if (pg.accesses < 0xffffffffu) pg.accesses++;
+            pg.lastuse = ++clock;
+            if (pg.data != NULL && !pinned) victims.insert(key_of(p));
+        }
+
+        /**
+         * Writes back the dirty resident pages. Consecutive pages are written
+         * with one request, from a copy so that the pages can be modified
+         * while the write is in flight.
+         */
+        void writeback(bool async) {
+            size_t n = npages();
+            size_t p = 0;
+            while (p < n) {
+                if (pages[p].data == NULL || !pages[p].dirty) { p++; continue; }
+                size_t q = p;
+                while (q + 1 < n && pages[q + 1].data != NULL && pages[q + 1].dirty) q++;
+                this->wait_for_pending(page_first(p), page_last(q));
+
+                size_t len = 0;
+                for(size_t r=p; r <= q; r++) len += page_len(r);
+                VertexDataType * buf = (VertexDataType *) malloc(len * sizeof(VertexDataType));
+                assert(buf != NULL);
+                size_t off = 0;
+                for(size_t r=p; r <= q; r++) {
+                    memcpy((void *) (buf + off), (void *) pages[r].data, page_len(r) * sizeof(VertexDataType));
+                    off += page_len(r);
+                    pages[r].dirty = false;
+                }
+                if (async) {
+                    this->write_async(&buf, page_first(p), page_last(q));
+                } else {
+                    this->iomgr->pwritea_now(this->filedesc, buf, len * sizeof(VertexDataType),
+                                             (size_t)page_first(p) * sizeof(VertexDataType));
+                    free(buf);
+                }
+                p = q + 1;
+            }
+        }
+
+        void drop_all() {
+            this->iomgr->wait_for_writes();
+            this->pending_writes.clear();
+            if (pinned) {
+                free(pinned_data);
+            } else {
+                for(size_t p=0; p < pages.size(); p++) {
+                    if (pages[p].data != NULL) free(pages[p].data);
+                }
+            }
+            pinned_data = NULL;
+            pages.clear();
+            victims.clear();
+            nresident = 0;
+        }
+
+        void setup(size_t _nvertices) {
+            nvertices = _nvertices;
+            pages.resize(npages());
+            pinned = (npages() <= maxpages);
+        }
+
+        void read_pinned() {
+            size_t datasize = nvertices * sizeof(VertexDataType);
+            pinned_data = (VertexDataType *) malloc(std::max(datasize, sizeof(VertexDataType)));
+            assert(pinned_data != NULL);
+            if (datasize > 0) this->iomgr->preada_now(this->filedesc, pinned_data, datasize, 0);
+            for(size_t p=0; p < pages.size(); p++) {
+                pages[p].data = pinned_data + ((size_t)p << pagebits);
+            }
+            nresident = pages.size();
+            m.add("vertexcache_bytes_read", (double) datasize);
+            logstream(LOG_INFO) << "Vertex data pinned in memory: " << datasize / 1024 << " KB" << std::endl;
+        }
+
+        /**
+         * Returns a resident page that may be evicted to make room for page p,
+         * or -1. Pages of the windows in memory are never evicted.
+         */
+        long find_victim(size_t p, size_t pst, size_t pen) {
+            for(typename std::set<victim_key>::iterator it=victims.begin(); it != victims.end(); ++it) {
+                size_t q = it->second;
+                if (pages[q].accesses >= pages[p].accesses) return -1;
+                if (q >= pst && q <= pen) continue;
+                if (q >= page_of(this->vertex_st) && q <= page_of(this->vertex_en)) continue;
+                if (has_prefetch && q >= page_of(this->prefetch_st) && q <= page_of(this->prefetch_en)) continue;
+                return (long) q;
+            }
+            return -1;
+        }
+
+        void evict(size_t q) {
+            cache_page &pg = pages[q];
+            victims.erase(key_of(q));
+            if (pg.dirty) {
+                /* The page buffer is released by the I/O threads */
+                this->wait_for_pending(page_first(q), page_last(q));
+                this->write_async(&pg.data, page_first(q), page_last(q));
+            } else {
+                free(pg.data);
+            }
+            pg.data = NULL;
+            pg.dirty = false;
+            nresident--;
+            evictions++;
+        }
+
+        /**
+         * Makes page p resident, if the cache has room or p is accessed more
+         * often than the eviction candidate.
+         */
+        void admit(size_t p, size_t pst, size_t pen) {
+            if (nresident >= maxpages) {
+                long q = find_victim(p, pst, pen);
+                if (q < 0) return;
+                evict((size_t) q);
+            }
+            cache_page &pg = pages[p];
+            size_t len = page_len(p);
+            this->wait_for_pending(page_first(p), page_last(p));
+            pg.data = (VertexDataType *) malloc(len * sizeof(VertexDataType));
+            assert(pg.data != NULL);
+            this->iomgr->preada_now(this->filedesc, pg.data, len * sizeof(VertexDataType),
+                                    (size_t)page_first(p) * sizeof(VertexDataType));
+            m.add("vertexcache_bytes_read", (double) (len * sizeof(VertexDataType)));
+            victims.insert(key_of(p));
+            nresident++;
+        }
+
+        /**
+         * Touches the pages of the window and reads the vertices of the
+         * non-resident pages to a chunk covering the window.
+         */
+        void load_range(vid_t st, vid_t en, VertexDataType ** chunk, bool mayadmit) {
+            if (pinned) {
+                if (pinned_data == NULL) read_pinned();
+                hits++;
+                return;
+            }
+            size_t pst = page_of(st), pen = page_of(en);
+            for(size_t p=pst; p <= pen; p++) {
+                touch(p);
+                if (pages[p].data == NULL && mayadmit) admit(p, pst, pen);
+                if (pages[p].data != NULL) hits++; else misses++;
+            }
+
+            *chunk = NULL;
+            size_t p = pst;
+            while (p <= pen) {
+                if (pages[p].data != NULL) { p++; continue; }
+                size_t q = p;
+                while (q + 1 <= pen && pages[q + 1].data == NULL) q++;
+                if (*chunk == NULL) {
+                    *chunk = (VertexDataType *) malloc((en - st + 1) * sizeof(VertexDataType));
+                    assert(*chunk != NULL);
+                }
+                vid_t rst = std::max(st, page_first(p));
+                vid_t ren = std::min(en, page_last(q));
+                this->wait_for_pending(rst, ren);
+                size_t len = (size_t) (ren - rst + 1) * sizeof(VertexDataType);
+                this->iomgr->preada_now(this->filedesc, *chunk + (rst - st), len, (size_t)rst * sizeof(VertexDataType));
+                m.add("vertexcache_bytes_read", (double) len);
+                p = q + 1;
+            }
+        }
+
+        void release_chunk(VertexDataType ** chunk) {
+            if (*chunk != NULL) free(*chunk);
+            *chunk = NULL;
+        }
+
+    public:
+
+        /**
+         * @param cache_bytes memory for the resident pages
+         */
+        cached_vertex_data_store(std::string base_filename, size_t nvertices, stripedio * iomgr, size_t cache_bytes, metrics &m) :
+                base_t(base_filename, nvertices, iomgr), m(m), nresident(0), clock(0), pinned_data(NULL),
+                has_prefetch(false), hits(0), misses(0), evictions(0) {
+            assert(!iomgr->pinned_session(this->filedesc));
+            pagebits = 0;
+            while (((size_t)2 << pagebits) * sizeof(VertexDataType) <= VERTEXCACHE_PAGE_BYTES) pagebits++;
+            maxpages = cache_bytes / (((size_t)1 << pagebits) * sizeof(VertexDataType));
+            setup(nvertices);
+            logstream(LOG_INFO) << "Vertex data cache: " << maxpages << " pages of " << (1 << pagebits) << " vertices"
+                << (pinned ? ", whole vertex data fits" : "") << std::endl;
+        }
+
+        virtual ~cached_vertex_data_store() {
+            writeback(false);
+            drop_all();
+            release_chunk(&this->loaded_chunk);
+            release_chunk(&this->prefetched_chunk);
+        }
+
+        virtual void check_size(size_t _nvertices) {
+            if (_nvertices != nvertices) {
+                writeback(false);
+                drop_all();
+                base_t::check_size(_nvertices);
+                setup(_nvertices);
+            }
+        }
+
+        virtual void clear(size_t _nvertices) {
+            drop_all();
+            base_t::clear(_nvertices);
+            setup(_nvertices);
+        }
+
+        virtual void load(vid_t _vertex_st, vid_t _vertex_en) {
+            assert(_vertex_en >= _vertex_st);
+            release_chunk(&this->loaded_chunk);
+            this->vertex_st = _vertex_st;
+            this->vertex_en = _vertex_en;
+            load_range(_vertex_st, _vertex_en, &this->loaded_chunk, true);
+        }
+
+        /**
+         * Pages are not admitted during prefetch, as the page of the
+         * window boundary may have unsaved values in the current window.
+         */
+        virtual void prefetch(vid_t _vertex_st, vid_t _vertex_en) {
+            assert(_vertex_en >= _vertex_st);
+            assert(!has_prefetch);
+            this->prefetch_st = _vertex_st;
+            this->prefetch_en = _vertex_en;
+            load_range(_vertex_st, _vertex_en, &this->prefetched_chunk, false);
+            has_prefetch = true;
+        }
+
+        virtual void swap_prefetched() {
+            assert(has_prefetch);
+            release_chunk(&this->loaded_chunk);
+            this->loaded_chunk = this->prefetched_chunk;
+            this->prefetched_chunk = NULL;
+            this->vertex_st = this->prefetch_st;
+            this->vertex_en = this->prefetch_en;
+            has_prefetch = false;
+        }
+
+        /**
+         * Marks the resident pages of the window modified, and writes
+         * the other vertices of the window. An asynchronous save hands
+         * the chunk over to the I/O threads, if it is written as a whole.
+         */
+        virtual void save(bool async=false) {
+            vid_t st = this->vertex_st, en = this->vertex_en;
+            size_t pst = page_of(st), pen = page_of(en);
+            size_t p = pst;
+            while (p <= pen) {
+                if (pages[p].data != NULL) {
+                    pages[p].dirty = true;
+                    p++;
+                    continue;
+                }
+                size_t q = p;
+                while (q + 1 <= pen && pages[q + 1].data == NULL) q++;
+                vid_t rst = std::max(st, page_first(p));
+                vid_t ren = std::min(en, page_last(q));
+                size_t len = (size_t) (ren - rst + 1);
+                this->wait_for_pending(rst, ren);
+                if (!async) {
+                    this->iomgr->pwritea_now(this->filedesc, this->loaded_chunk + (rst - st),
+                                             len * sizeof(VertexDataType), (size_t)rst * sizeof(VertexDataType));
+                } else if (rst == st && ren == en) {
+                    this->write_async(&this->loaded_chunk, rst, ren);
+                } else {
+                    VertexDataType * buf = (VertexDataType *) malloc(len * sizeof(VertexDataType));
+                    assert(buf != NULL);
+                    memcpy((void *) buf, (void *) (this->loaded_chunk + (rst - st)), len * sizeof(VertexDataType));
+                    this->write_async(&buf, rst, ren);
+                }
+                p = q + 1;
+            }
+        }
+
+        /**
+         * Starts writing back the modified resident pages.
+         */
+        virtual void flush() {
+            writeback(true);
+            m.set("vertexcache_hits", hits);
+            m.set("vertexcache_misses", misses);
+            m.set("vertexcache_evictions", evictions);
+            m.set("vertexcache_resident_pages", nresident);
+        }
+
+        virtual VertexDataType * vertex_data_ptr(vid_t vertexid) {
+            assert(vertexid >= this->vertex_st && vertexid <= this->vertex_en);
+            if (pinned) return &pinned_data[vertexid];
+            VertexDataType * pg = pages[page_of(vertexid)].data;
+            if (pg != NULL) return &pg[vertexid & (((vid_t)1 << pagebits) - 1)];
+            return &this->loaded_chunk[vertexid - this->vertex_st];
+        }
+
+    };
+}
+
+#endif
+#endif
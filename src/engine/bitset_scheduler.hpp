@@ -23,36 +23,65 @@
  *
  * @section DESCRIPTION
  *
- * Bitset scheduler.
+ * Bitset scheduler. The number of scheduled vertices is also kept for
+ * each block of 4096 vertices, so that empty blocks are skipped without
+ * reading their bits: a sparse frontier is enumerated in time
+ * proportional to the number of blocks plus the scheduled vertices.
  */
 
 #ifndef DEF_GRAPHCHI_BITSETSCHEDULER
 #define DEF_GRAPHCHI_BITSETSCHEDULER
 
+#include <vector>
+#include <algorithm>
+
 #include "graphchi_types.hpp"
 #include "api/ischeduler.hpp"
 #include "util/dense_bitset.hpp"
 
+#define SCHEDULER_BLOCK_BITS 12
+
 namespace graphchi {
     
     class bitset_scheduler : public ischeduler {
-    private:
+    protected:
         dense_bitset bitset;
+        std::vector<uint32_t> blockcounts;
+        
+        static inline size_t block_of(vid_t v) {
+            return v >> SCHEDULER_BLOCK_BITS;
+        }
+        
+        static inline vid_t block_last(size_t b) {
+            return (vid_t) (((b + 1) << SCHEDULER_BLOCK_BITS) - 1);
+        }
+        
+        /**
+         * Sets the bit of a vertex. Returns true if it was not set before.
+         */
+        inline bool set_scheduled(vid_t vertex) {
+            if (bitset.set_bit(vertex)) return false;
+            __sync_add_and_fetch(&blockcounts[block_of(vertex)], 1);
+            return true;
+        }
+        
     public:
         bool has_new_tasks;
         
-        bitset_scheduler(int nvertices) : bitset(nvertices) {
+        bitset_scheduler(int nvertices) : bitset(nvertices), has_new_tasks(false) {
+            blockcounts.resize(block_of(nvertices) + 1, 0);
         }
         
         virtual ~bitset_scheduler() {}
         
         inline void add_task(vid_t vertex) {
-            bitset.set_bit(vertex);
+            set_scheduled(vertex);
             has_new_tasks = true;
         }
         
-        void resize(vid_t maxsize) {
+        virtual void resize(vid_t maxsize) {
             bitset.resize(maxsize);
+            blockcounts.resize(block_of(maxsize) + 1, 0);
         }
         
         inline bool is_scheduled(vid_t vertex) {
@@ -60,16 +89,83 @@ namespace graphchi {
         }
         
         inline void remove_task(vid_t vertex) {
-            bitset.clear_bit(vertex);
+            if (bitset.clear_bit(vertex)) {
+                __sync_sub_and_fetch(&blockcounts[block_of(vertex)], 1);
+            }
         }
         
+        /**
+         * Not thread-safe with add_task() for the same vertices.
+         */
         void remove_tasks(vid_t fromvertex, vid_t tovertex) {
+            for(size_t b=block_of(fromvertex); b <= block_of(tovertex); b++) {
+                if (blockcounts[b] == 0) continue;
+                vid_t st = std::max(fromvertex, (vid_t) (b << SCHEDULER_BLOCK_BITS));
+                vid_t en = std::min(tovertex, block_last(b));
+                blockcounts[b] -= (uint32_t) bitset.count_set(st, en);
+            }
             bitset.clear_bits(fromvertex, tovertex);
         }
         
         void add_task_to_all() {
             has_new_tasks = true;
             bitset.setall();
+            size_t n = bitset.size();
+            for(size_t b=0; b < blockcounts.size(); b++) {
+                size_t st = b << SCHEDULER_BLOCK_BITS;
+                blockcounts[b] = (uint32_t) (st < n ? std::min(n - st, (size_t)1 << SCHEDULER_BLOCK_BITS) : 0);
+            }
+        }
+        
+        /**
+         * Returns the first scheduled vertex in the interval (inclusive),
+         * or tovertex + 1 if none is scheduled.
+         */
+        vid_t next_scheduled(vid_t fromvertex, vid_t tovertex) {
+            vid_t v = fromvertex;
+            while (v <= tovertex) {
+                size_t b = block_of(v);
+                vid_t en = std::min(tovertex, block_last(b));
+                if (blockcounts[b] > 0) {
+                    vid_t x = bitset.next_set(v, en);
+                    if (x <= en) return x;
+                }
+                if (en == tovertex) break;
+                v = en + 1;
+            }
+            return tovertex + 1;
+        }
+        
+        /**
+         * Number of scheduled vertices in the interval (inclusive).
+         */
+        size_t num_scheduled(vid_t fromvertex, vid_t tovertex) {
+            size_t n = 0;
+            for(size_t b=block_of(fromvertex); b <= block_of(tovertex); b++) {
+                vid_t st = (vid_t) (b << SCHEDULER_BLOCK_BITS);
+                if (blockcounts[b] == 0) continue;
+                if (st >= fromvertex && block_last(b) <= tovertex) {
+                    n += blockcounts[b];
+                } else {
+                    n += bitset.count_set(std::max(fromvertex, st), std::min(tovertex, block_last(b)));
+                }
+            }
+            return n;
+        }
+        
+        /**
+         * Returns true if the interval (inclusive) needs to be executed.
+         */
+        virtual bool is_any_scheduled(vid_t fromvertex, vid_t tovertex) {
+            return next_scheduled(fromvertex, tovertex) <= tovertex;
+        }
+        
+        /**
+         * Pending work of an interval, used to order the intervals.
+         * Here the number of scheduled vertices.
+         */
+        virtual double pending_priority(vid_t fromvertex, vid_t tovertex) {
+            return (double) num_scheduled(fromvertex, tovertex);
         }
     };
     
@@ -77,4 +173,3 @@ namespace graphchi {
 
 
 #endif
-
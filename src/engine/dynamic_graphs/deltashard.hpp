@@ -0,0 +1,185 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Delta shards of the dynamic graph engine. A delta shard is a sorted
+ * run of edges that were added to the graph after its shard was last
+ * written. The edges of a delta shard have their destination in the
+ * vertex interval of the shard and are sorted by source, so the out-edges
+ * of a window are a contiguous range. Delta shards are memory-mapped,
+ * and the engine points the edges of the vertices directly to the mapping,
+ * so updates to edge values are written to the file.
+ */
+
+#ifndef DEF_GRAPHCHI_DELTASHARD
+#define DEF_GRAPHCHI_DELTASHARD
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "engine/dynamic_graphs/edgebuffers.hpp"
+#include "logger/logger.hpp"
+#include "util/ioutil.hpp"
+
+namespace graphchi {
+
+    template <typename ET>
+    class delta_shard {
+
+        std::string filename;
+        created_edge<ET> * edges;
+        size_t nedges;
+
+        static bool edge_less(const created_edge<ET> &a, const created_edge<ET> &b) {
+            return a.src < b.src || (a.src == b.src && a.dst < b.dst);
+        }
+
+        static void write_file(std::string filename, const created_edge<ET> * edges, size_t n) {
+            int f = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+            if (f < 0) {
+                logstream(LOG_ERROR) << "Could not create delta shard " << filename << ": " << strerror(errno) << std::endl;
+            }
+            assert(f >= 0);
+            writea(f, edges, n * sizeof(created_edge<ET>));
+            close(f);
+        }
+
+    public:
+
+        /**
+         * Maps an existing delta shard file.
+         */
+        delta_shard(std::string filename) : filename(filename), edges(NULL), nedges(0) {
+            int f = open(filename.c_str(), O_RDWR);
+            if (f < 0) {
+                logstream(LOG_ERROR) << "Could not open delta shard " << filename << ": " << strerror(errno) << std::endl;
+            }
+            assert(f >= 0);
+            struct stat st;
+            fstat(f, &st);
+            nedges = st.st_size / sizeof(created_edge<ET>);
+            assert(nedges > 0);
+            void * addr = mmap(NULL, nedges * sizeof(created_edge<ET>), PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+            if (addr == MAP_FAILED) {
+                logstream(LOG_ERROR) << "Could not mmap delta shard " << filename << ": " << strerror(errno) << std::endl;
+            }
+            assert(addr != MAP_FAILED);
+            close(f);
+            edges = (created_edge<ET> *) addr;
+        }
+
+        ~delta_shard() {
+            munmap(edges, nedges * sizeof(created_edge<ET>));
+        }
+
+        /**
+         * Sorts the edges and writes them to a new delta shard.
+         */
+        static delta_shard * create(std::string filename, std::vector< created_edge<ET> > &newedges) {
+            assert(!newedges.empty());
+            std::sort(newedges.begin(), newedges.end(), edge_less);
+            write_file(filename, &newedges[0], newedges.size());
+            return new delta_shard(filename);
+        }
+
+        /**
+         * Merges delta shards into a new delta shard. The runs
+         * are not removed.
+         */
+        static delta_shard * merge(std::string filename, std::vector<delta_shard *> &runs) {
+            size_t total = 0;
+            for(size_t i=0; i < runs.size(); i++) total += runs[i]->size();
+            std::vector< created_edge<ET> > merged;
+            merged.reserve(total);
+            for(size_t i=0; i < runs.size(); i++) {
+                size_t mid = merged.size();
+                merged.insert(merged.end(), runs[i]->edges, runs[i]->edges + runs[i]->size());
+                std::inplace_merge(merged.begin(), merged.begin() + mid, merged.end(), edge_less);
+            }
+            write_file(filename, &merged[0], merged.size());
+            return new delta_shard(filename);
+        }
+
+        size_t size() {
+            return nedges;
+        }
+
+        created_edge<ET> * operator[](size_t i) {
+            return &edges[i];
+        }
+
+        /**
+         * Index of the first edge with source at least src.
+         */
+        size_t lower_bound(vid_t src) {
+            size_t lo = 0, hi = nedges;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (edges[mid].src < src) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+
+        /**
+         * Removes the file. The object must be deleted after.
+         */
+        void remove_file() {
+            remove(filename.c_str());
+        }
+
+    };
+
+    /**
+     * Size-tiered compaction policy: delta shards belong to tier k if they
+     * have between min_edges * factor^k and min_edges * factor^(k+1) edges.
+     * Returns the indices of the runs of the lowest tier that has at least
+     * factor runs, or an empty vector if no merge is due.
+     */
+    template <typename ET>
+    std::vector<int> select_delta_merge(std::vector<delta_shard<ET> *> &runs, size_t min_edges, int factor) {
+        std::vector< std::vector<int> > tiers;
+        for(int i=0; i < (int) runs.size(); i++) {
+            int tier = 0;
+            for(size_t lim = min_edges * factor; runs[i]->size() >= lim; lim *= factor) tier++;
+            if (tier >= (int) tiers.size()) tiers.resize(tier + 1);
+            tiers[tier].push_back(i);
+        }
+        for(int t=0; t < (int) tiers.size(); t++) {
+            if ((int) tiers[t].size() >= factor) return tiers[t];
+        }
+        return std::vector<int>();
+    }
+
+};
+
+#endif
@@ -23,13 +23,16 @@
  *
  * @section DESCRIPTION
  *
- * Edge buffers used by the dynamic graph engine. 
+ * Edge buffers used by the dynamic graph engine. Ingesting threads publish
+ * edges in chunks to a lock-free list of the buffer, and the engine moves
+ * them to the buffer proper at points where it does not read the buffer.
  */
 
 #ifndef DEF_GRAPHCHI_EDGEBUFFERS
 #define DEF_GRAPHCHI_EDGEBUFFERS
 
 #include <stdlib.h>
+#include <assert.h>
 #include <vector> 
 
 
@@ -52,6 +55,28 @@ namespace graphchi {
     
 #define EDGE_BUFFER_CHUNKSIZE 65536
     
+    /**
+     * Chunk of edges published to an edge buffer. The edges
+     * follow the header in the same allocation.
+     */
+    template <typename ET>
+    struct published_edge_chunk {
+        published_edge_chunk * next;
+        size_t count;
+        
+        created_edge<ET> * edges() {
+            return (created_edge<ET> *) (this + 1);
+        }
+        
+        static published_edge_chunk * create(size_t count) {
+            published_edge_chunk * chunk = (published_edge_chunk *) malloc(sizeof(published_edge_chunk) + count * sizeof(created_edge<ET>));
+            assert(chunk != NULL);
+            chunk->next = NULL;
+            chunk->count = count;
+            return chunk;
+        }
+    };
+    
     /**
      * Efficient chunked edge-buffer with very low memory-overhead (compared
      * to just using a std-vector.
@@ -62,9 +87,21 @@ namespace graphchi {
         unsigned int count;
         std::vector<created_edge<ET> *> bufs;
         
+        /* Published chunks not yet collected, newest first */
+        published_edge_chunk<ET> * volatile incoming;
+        volatile size_t npending;
+        
+        published_edge_chunk<ET> * take_incoming() {
+            published_edge_chunk<ET> * head;
+            do {
+                head = incoming;
+            } while (!__sync_bool_compare_and_swap(&incoming, head, (published_edge_chunk<ET> *) NULL));
+            return head;
+        }
+        
     public:    
         
-        edge_buffer_flat() : count(0) {
+        edge_buffer_flat() : count(0), incoming(NULL), npending(0) {
         }
         
         ~edge_buffer_flat() {
@@ -77,12 +114,70 @@ namespace graphchi {
             }   
             bufs.clear();       
             count = 0;
+            published_edge_chunk<ET> * chunk = take_incoming();
+            while (chunk != NULL) {
+                published_edge_chunk<ET> * next = chunk->next;
+                __sync_sub_and_fetch(&npending, chunk->count);
+                free(chunk);
+                chunk = next;
+            }
         }
         
+        /**
+         * Number of edges in the buffer, not counting the
+         * published edges that have not been collected.
+         */
         unsigned int size() {
             return count;
         }
         
+        size_t num_pending() {
+            return npending;
+        }
+        
+        /**
+         * Adds a chunk of edges. Can be called by many threads
+         * concurrently, also while the buffer is being read.
+         * The buffer takes the ownership of the chunk.
+         */
+        void publish(published_edge_chunk<ET> * chunk) {
+            __sync_add_and_fetch(&npending, chunk->count);
+            published_edge_chunk<ET> * head;
+            do {
+                head = incoming;
+                chunk->next = head;
+            } while (!__sync_bool_compare_and_swap(&incoming, head, chunk));
+        }
+        
+        /**
+         * Moves the published edges to the buffer, in the order they were
+         * published. Must not be called concurrently with readers of the buffer.
+         * Returns the number of edges moved.
+         */
+        size_t collect() {
+            published_edge_chunk<ET> * chunk = take_incoming();
+            published_edge_chunk<ET> * ordered = NULL;
+            while (chunk != NULL) {
+                published_edge_chunk<ET> * next = chunk->next;
+                chunk->next = ordered;
+                ordered = chunk;
+                chunk = next;
+            }
+            size_t n = 0;
+            while (ordered != NULL) {
+                published_edge_chunk<ET> * next = ordered->next;
+                created_edge<ET> * edges = ordered->edges();
+                for(size_t i=0; i < ordered->count; i++) {
+                    add(edges[i]);
+                }
+                n += ordered->count;
+                __sync_sub_and_fetch(&npending, ordered->count);
+                free(ordered);
+                ordered = next;
+            }
+            return n;
+        }
+        
         created_edge<ET> * operator[](unsigned int i) {
             return &bufs[i / EDGE_BUFFER_CHUNKSIZE][i % EDGE_BUFFER_CHUNKSIZE];
         }
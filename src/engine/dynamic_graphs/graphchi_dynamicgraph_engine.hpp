@@ -36,6 +36,7 @@
 
 #include "engine/graphchi_engine.hpp"
 #include "engine/dynamic_graphs/edgebuffers.hpp"
+#include "engine/dynamic_graphs/deltashard.hpp"
 #include "logger/logger.hpp"
 
 
@@ -50,12 +51,23 @@ namespace graphchi {
     public:
         typedef graphchi_engine<VertexDataType, EdgeDataType>  base_engine;
         typedef edge_buffer_flat<EdgeDataType> edge_buffer; 
+        typedef delta_shard<EdgeDataType> delta_t;
         
         graphchi_dynamicgraph_engine(std::string base_filename, int nshards, bool selective_scheduling, metrics &_m) :
         graphchi_engine<VertexDataType, EdgeDataType, svertex_t>(base_filename, nshards, selective_scheduling, _m){
             _m.set("engine", "dynamicgraphs");
             added_edges = 0;
             maxshardsize = 200 * 1024 * 1024;
+            delta_seq = 0;
+            stopped = false;
+        }
+        
+        virtual ~graphchi_dynamicgraph_engine() {
+            /* The delta shards only live for the run: each run starts from
+               a copy of the original shards (prepare_clean_slate()). */
+            for(int p=0; p < (int) deltas.size(); p++) {
+                remove_deltas(p);
+            }
         }
         
     protected:
@@ -67,20 +79,38 @@ namespace graphchi {
         std::vector<int> deletecounts;
         std::vector<std::string> shard_suffices;
         
+        /**
+         * Delta shards of each shard, oldest first. Buffered edges are
+         * flushed to a new delta shard on commit, and the delta shards are
+         * merged into the shard only when they have grown large relative to it.
+         */
+        std::vector< std::vector< delta_t * > > deltas;
+        int delta_seq;
+        size_t delta_flush_edges;
+        size_t delta_min_edges;
+        int delta_merge_factor;
+        double delta_rewrite_ratio;
+        double rewrite_deleted_ratio;
+        
         vid_t max_vertex_id;
         size_t max_edge_buffer;
         size_t last_commit;
         size_t added_edges;
         std::string state;
+        volatile bool stopped; // set after the last iteration; edges are no longer committed
         size_t maxshardsize;
         size_t edges_in_shards;
         size_t orig_edges;
         
         /**
-         * Concurrency control
+         * Concurrency control. Ingesting threads hold ingestlock for reading
+         * while they publish edges; commits hold it for writing, as they
+         * replace the edge buffers. The modification lock must not be
+         * acquired while ingestlock is held.
          */
         mutex schedulerlock;
         mutex shardlock;
+        rwlock ingestlock;
         
         /** 
          * Preloading will interfere with the operation.
@@ -89,6 +119,14 @@ namespace graphchi {
             return true;
         }
         
+        /**
+         * Edges may be added while a window is executing, so
+         * the next window cannot be loaded ahead.
+         */
+        virtual bool use_pipelining() {
+            return false;
+        }
+        
         /** 
           * Create a dynamic version of the degree file.
           */
@@ -106,7 +144,8 @@ namespace graphchi {
             for(int i=0; i < this->nshards; i++) {
                 ne += this->sliding_shards[i]->num_edges();
                 for(int j=0; j < (int) new_edge_buffers[i].size(); j++)
-                    ne += new_edge_buffers[i][j]->size();
+                    ne += new_edge_buffers[i][j]->size() + new_edge_buffers[i][j]->num_pending();
+                ne += num_delta_edges(i);
             }
             shardlock.unlock();
             return ne;
@@ -123,6 +162,12 @@ namespace graphchi {
         }
         
     protected:
+        size_t num_delta_edges(int shard) {
+            size_t ne = 0;
+            for(int j=0; j < (int) deltas[shard].size(); j++) ne += deltas[shard][j]->size();
+            return ne;
+        }
+        
         void init_buffers() {
             max_edge_buffer = get_option_long("max_edgebuffer_mb", 1000) * 1024 * 1024 / sizeof(created_edge<EdgeDataType>);
             
@@ -143,6 +188,7 @@ namespace graphchi {
                 oldit != new_edge_buffers.end(); ++oldit) {
                 for(typename std::vector< edge_buffer *>::iterator bufit = oldit->begin(); bufit != oldit->end(); ++bufit) {
                     edge_buffer &buffer_for_window = **bufit;
+                    buffer_for_window.collect();
                     for(unsigned int ebi = 0; ebi < buffer_for_window.size(); ebi++ ) {
                         created_edge<EdgeDataType> * edge = buffer_for_window[ebi];
                         int shard = get_shard_for(edge->dst);
@@ -162,27 +208,35 @@ namespace graphchi {
         
         /**
          * In the beginning of run, we copy the shards into dynamic versions.
+         * The file is copied in chunks; a zeroed copy is only truncated to the size.
          */
-        // Should be changed to read the file in smaller chunks
         size_t cp(std::string origfile, std::string dstfile, bool zeroout=false) {
-            char * buf;
-            int f = open(origfile.c_str(), O_RDONLY);    
-            size_t len = readfull(f, &buf);
+            size_t len = get_filesize(origfile);
             std::cout << "Length: " << len << std::endl;
             std::cout << origfile << " ----> " << dstfile << std::endl;
             
-            close(f);
             remove(dstfile.c_str());
             int of = open(dstfile.c_str(), O_WRONLY | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
             assert(of >= 0);
             if (zeroout) {
-                memset(buf, 0, len);
+                int err = ftruncate(of, len);
+                assert(err == 0);
+            } else {
+                int f = open(origfile.c_str(), O_RDONLY);
+                assert(f >= 0);
+                size_t chunksize = 16 * 1024 * 1024;
+                char * buf = (char *) malloc(std::min(len, chunksize) + 1);
+                for(size_t off=0; off < len; off += chunksize) {
+                    size_t n = std::min(chunksize, len - off);
+                    preada(f, buf, n, off);
+                    writea(of, buf, n);
+                }
+                free(buf);
+                close(f);
             }
-            writea(of, buf, len);
             
             assert(get_filesize(origfile) == get_filesize(dstfile));
             close(of);
-            free(buf);
             return len;
         }
         
@@ -268,9 +322,12 @@ namespace graphchi {
                 std::string dest_adj = filename_shard_adj(this->base_filename, 0, 0) + ".dyngraph" + shard_suffices[shard];          
                 std::string dest_edata = filename_shard_edata<EdgeDataType>(this->base_filename, 0, 0) + ".dyngraph" + shard_suffices[shard];
                 
+                /* Shards are rewritten in the raw adjacency format */
+                require_raw_adjacency(adj_filename, "The dynamic graph engine");
                 cpedata(edata_filename, dest_edata, true);
                 cp(adj_filename, dest_adj);
             }
+            deltas.assign(this->nshards, std::vector<delta_t *>());
         }
         
         int get_shard_for(vid_t dst) {
@@ -282,12 +339,62 @@ namespace graphchi {
             return this->nshards - 1; // Last shard
         }
         
+        /**
+         * Extends the degree file and the scheduler to contain vertex maxid.
+         */
+        void grow_vertex_range(vid_t maxid) {
+            this->modification_lock.lock();
+            if (maxid > max_vertex_id) {
+                max_vertex_id = maxid;
+                this->degree_handler->ensure_size(this->max_vertex_id); // Expand the file
+                
+                // Expand scheduler
+                if (this->scheduler != NULL) {
+                    schedulerlock.lock();
+                    this->scheduler->resize(1 + max_vertex_id);
+                    schedulerlock.unlock();
+                }
+            }
+            this->modification_lock.unlock();
+        }
+        
+        /**
+         * Moves the edges published by the ingesting threads to the edge buffers.
+         * Called with the modification lock held.
+         */
+        void collect_published_edges() {
+            for(int shard=0; shard < (int) new_edge_buffers.size(); shard++) {
+                for(int w=0; w < (int) new_edge_buffers[shard].size(); w++) {
+                    new_edge_buffers[shard][w]->collect();
+                }
+            }
+        }
+        
     public:       
+        /**
+         * True after the last iteration has finished. Edges added after
+         * that are not committed to the graph.
+         */
+        bool has_stopped() {
+            return stopped;
+        }
+        
         bool add_edge(vid_t src, vid_t dst, EdgeDataType edata) {
-            if (src == dst) {
-                logstream(LOG_WARNING) << "WARNING : tried to add self-edge!" << std::endl;
-                return true;
-            }
+            created_edge<EdgeDataType> edge(src, dst, edata);
+            return add_edges(&edge, 1);
+        }
+        
+        /**
+         * Adds a batch of edges. The edges are grouped by their buffer and
+         * published as one chunk per buffer, so ingesting threads do not
+         * contend with each other or with the computation. The edges become
+         * visible to the engine when the next window is loaded.
+         * Self-edges are skipped.
+         * @return false if the edges were not added and the call should be
+         * retried (before the first iteration has finished, or when the
+         * buffers are full).
+         */
+        bool add_edges(const created_edge<EdgeDataType> * edges, size_t n) {
             if (this->iter < 1) {
                 logstream(LOG_WARNING) << "Tried to add edge before first iteration has passed" << std::endl;
                 usleep(1000000);
@@ -298,37 +405,66 @@ namespace graphchi {
                 usleep(1000000); // Sleep 1 sec
                 return false;
             }
-            this->modification_lock.lock();
-            added_edges++;
-            int shard = get_shard_for(dst);
-            int srcshard = get_shard_for(src);
-            /* Maintain max vertex id */
-            vid_t prev_max_id = max_vertex_id;
-            max_vertex_id = std::max(max_vertex_id, dst);
-            max_vertex_id = std::max(max_vertex_id, src);
-            
-            // Extend degree and vertex data files
-            if (max_vertex_id>prev_max_id) {
-                this->degree_handler->ensure_size(this->max_vertex_id); // Expand the file
-                
-                // Expand scheduler
-                if (this->scheduler != NULL) {
-                    schedulerlock.lock();
-                    this->scheduler->resize(1 + max_vertex_id);
-                    schedulerlock.unlock();
+            
+            /* Maintain max vertex id. Done before taking ingestlock, as it needs the modification lock. */
+            vid_t maxid = 0;
+            for(size_t i=0; i < n; i++) {
+                maxid = std::max(maxid, std::max(edges[i].src, edges[i].dst));
+            }
+            if (maxid > max_vertex_id) {
+                grow_vertex_range(maxid);
+            }
+            
+            ingestlock.readlock();
+            int nbufs = this->nshards * this->nshards;
+            std::vector<int> bufferof(n);
+            std::vector<size_t> counts(nbufs, 0);
+            size_t nselfedges = 0;
+            for(size_t i=0; i < n; i++) {
+                if (edges[i].src == edges[i].dst) {
+                    bufferof[i] = -1;
+                    nselfedges++;
+                    continue;
+                }
+                bufferof[i] = get_shard_for(edges[i].dst) * this->nshards + get_shard_for(edges[i].src);
+                counts[bufferof[i]]++;
+            }
+            std::vector<published_edge_chunk<EdgeDataType> *> chunks(nbufs, (published_edge_chunk<EdgeDataType> *) NULL);
+            for(int b=0; b < nbufs; b++) {
+                if (counts[b] > 0) {
+                    chunks[b] = published_edge_chunk<EdgeDataType>::create(counts[b]);
+                    counts[b] = 0;
+                }
+            }
+            for(size_t i=0; i < n; i++) {
+                if (bufferof[i] < 0) continue;
+                int b = bufferof[i];
+                chunks[b]->edges()[counts[b]++] = created_edge<EdgeDataType>(edges[i].src, edges[i].dst, edges[i].data);
+            }
+            for(int b=0; b < nbufs; b++) {
+                if (chunks[b] != NULL) {
+                    new_edge_buffers[b / this->nshards][b % this->nshards]->publish(chunks[b]);
                 }
             }
+            __sync_add_and_fetch(&added_edges, n - nselfedges);
+            ingestlock.unlock();
             
-            // Add edge to buffers
-            new_edge_buffers[shard][srcshard]->add(src, dst, edata);            
-            this->modification_lock.unlock();
+            if (nselfedges > 0) {
+                logstream(LOG_WARNING) << "WARNING : tried to add " << nselfedges << " self-edges!" << std::endl;
+            }
             return true;
         }
         
         void add_task(vid_t vid) {
+            add_tasks(&vid, 1);
+        }
+        
+        void add_tasks(const vid_t * vids, size_t n) {
             if (this->scheduler != NULL) {
                 this->modification_lock.lock();
-                this->scheduler->add_task(vid);                
+                for(size_t i=0; i < n; i++) {
+                    this->scheduler->add_task(vids[i]);
+                }
                 this->modification_lock.unlock();
             }
         }
@@ -350,6 +486,17 @@ namespace graphchi {
                         }
                     }
                 }
+                // Delta shards are sorted by source
+                for(int j=0; j < (int) deltas[shard].size(); j++) {
+                    delta_t &delta = *deltas[shard][j];
+                    for(size_t ei=delta.lower_bound(window_st); ei < delta.size() && delta[ei]->src <= window_en; ei++) {
+                        created_edge<EdgeDataType> * edge = delta[ei];
+                        if (vertices[edge->src-window_st].scheduled) {
+                            vertices[edge->src-window_st].add_outedge(edge->dst, &edge->data, false);
+                            ncreated++;
+                        }
+                    }
+                }
             }
             
             // Then inedges
@@ -367,6 +514,16 @@ namespace graphchi {
                     }
                 }
             }
+            for(int j=0; j < (int) deltas[window].size(); j++) {
+                delta_t &delta = *deltas[window][j];
+                for(size_t ei=0; ei < delta.size(); ei++) {
+                    created_edge<EdgeDataType> * edge = delta[ei];
+                    if (edge->dst >= window_st && edge->dst <= window_en && vertices[edge->dst - window_st].scheduled) {
+                        vertices[edge->dst - window_st].add_inedge(edge->src, &edge->data, false);
+                        ncreated++;
+                    }
+                }
+            }
             logstream(LOG_INFO) << "::: Used " << ncreated << " buffered edges." << std::endl;
         }
         
@@ -433,6 +590,10 @@ namespace graphchi {
         }
         
         virtual vid_t determine_next_window(vid_t iinterval, vid_t fromvid, vid_t maxvid, size_t membudget) {
+            /* New edges are taken in here, so that the degrees and the edges
+               of the window are computed from the same edges */
+            collect_published_edges();
+            
             /* Load degrees */
             this->degree_handler->load(fromvid, maxvid);
             if (incorporate_new_edge_degrees(iinterval, fromvid, maxvid)) {
@@ -490,7 +651,9 @@ namespace graphchi {
         }
         
         virtual void iteration_finished() {
-            if (this->iter < this->niters - 1) {
+            if (this->iter >= this->niters - 1) {
+                stopped = true;
+            } else {
                 // Flush and restart stream shards before commiting edges
                 for(int p=0; p < this->nshards; p++) {
                     this->sliding_shards[p]->flush();
@@ -506,6 +669,12 @@ namespace graphchi {
         virtual void initialize_before_run() {
             prepare_clean_slate();
             init_buffers();
+            
+            delta_flush_edges = get_option_long("dyngraph.delta_flush_edges", 1000000);
+            delta_min_edges = std::max((uint64_t) 1, get_option_long("dyngraph.delta_min_edges", 1000000));
+            delta_merge_factor = std::max(2, get_option_int("dyngraph.delta_merge_factor", 4));
+            delta_rewrite_ratio = get_option_float("dyngraph.delta_rewrite_ratio", 0.5);
+            rewrite_deleted_ratio = get_option_float("dyngraph.rewrite_deleted_ratio", 0.2);
 
             max_vertex_id = (vid_t) (this->num_vertices() - 1);
             
@@ -530,8 +699,81 @@ namespace graphchi {
         
 #define BBUF 32000000
         
+        std::string delta_filename(int shard) {
+            char seqstr[128];
+            sprintf(seqstr, ".delta%d", delta_seq++);
+            return filename_shard_adj(this->base_filename, 0, 0) + ".dyngraph" + shard_suffices[shard] + std::string(seqstr);
+        }
+        
+        void remove_deltas(int shard) {
+            for(int j=0; j < (int) deltas[shard].size(); j++) {
+                deltas[shard][j]->remove_file();
+                delete deltas[shard][j];
+            }
+            deltas[shard].clear();
+        }
+        
         /**
-         * Code for committing changes to disk.
+         * Moves the buffered edges to a new delta shard of each shard. Edges
+         * whose degrees have not been accounted for yet stay in the buffers.
+         */
+        void flush_buffers_to_deltas() {
+            std::vector< created_edge<EdgeDataType> > flushed;
+            std::vector< created_edge<EdgeDataType> > kept;
+            for(int shard=0; shard < this->nshards; shard++) {
+                flushed.clear();
+                for(int w=0; w < this->nshards; w++) {
+                    edge_buffer &buffer_for_window = *new_edge_buffers[shard][w];
+                    kept.clear();
+                    for(unsigned int ebi=0; ebi < buffer_for_window.size(); ebi++) {
+                        created_edge<EdgeDataType> * edge = buffer_for_window[ebi];
+                        if (edge->accounted_for_inc && edge->accounted_for_outc) {
+                            flushed.push_back(*edge);
+                        } else {
+                            kept.push_back(*edge);
+                        }
+                    }
+                    buffer_for_window.clear();
+                    for(size_t i=0; i < kept.size(); i++) buffer_for_window.add(kept[i]);
+                }
+                if (!flushed.empty()) {
+                    deltas[shard].push_back(delta_t::create(delta_filename(shard), flushed));
+                    logstream(LOG_DEBUG) << shard << ": flushed " << flushed.size() << " edges to a delta shard" << std::endl;
+                }
+            }
+        }
+        
+        /**
+         * Merges the delta shards of a shard by the size-tiered policy.
+         */
+        void compact_deltas(int shard) {
+            std::vector<int> tomerge;
+            while (!(tomerge = select_delta_merge(deltas[shard], delta_min_edges, delta_merge_factor)).empty()) {
+                std::vector<delta_t *> runs;
+                for(int i=0; i < (int) tomerge.size(); i++) runs.push_back(deltas[shard][tomerge[i]]);
+                delta_t * merged = delta_t::merge(delta_filename(shard), runs);
+                logstream(LOG_DEBUG) << shard << ": merged " << runs.size() << " delta shards, " << merged->size() << " edges" << std::endl;
+                
+                std::vector<delta_t *> remaining;
+                for(int j=0; j < (int) deltas[shard].size(); j++) {
+                    if (std::find(runs.begin(), runs.end(), deltas[shard][j]) == runs.end()) {
+                        remaining.push_back(deltas[shard][j]);
+                    }
+                }
+                for(int i=0; i < (int) runs.size(); i++) {
+                    runs[i]->remove_file();
+                    delete runs[i];
+                }
+                remaining.push_back(merged);
+                deltas[shard] = remaining;
+            }
+        }
+        
+        /**
+         * Code for committing changes to disk. Buffered edges are flushed to
+         * delta shards, and a shard is rewritten only when its delta shards
+         * have grown to dyngraph.delta_rewrite_ratio of its edges, or enough
+         * of its edges have been deleted.
          */
         void commit_graph_changes() {            
             // Count deleted
@@ -540,13 +782,11 @@ namespace graphchi {
                 ndeleted += deletecounts[i];
             }
             
-            // TODO: remove ad hoc limits, move to configuration.
-            // Perhaps do some cost estimation?
             logstream(LOG_DEBUG) << "Total deleted: " << ndeleted << " total edges: " << this->num_edges() << std::endl;
 
-            if (added_edges - last_commit < max_edge_buffer * 0.8 && ndeleted < this->num_edges() * 0.1) {
+            if (added_edges - last_commit < delta_flush_edges && ndeleted < this->num_edges() * 0.1) {
                 std::cout << "==============================" << std::endl;
-                std::cout << "No time to commit yet.... Only " << (added_edges - last_commit) << " / " << max_edge_buffer
+                std::cout << "No time to commit yet.... Only " << (added_edges - last_commit) << " / " << delta_flush_edges
                 << " in buffers" << std::endl;
                 return;
             }
@@ -554,9 +794,11 @@ namespace graphchi {
             
             bool rangeschanged = false;
             state = "commit-ingests";
-            vid_t maxwindow = 4000000; // FIXME: HARDCODE
             size_t mem_budget = this->membudget_mb * 1024 * 1024;
             this->modification_lock.lock();
+            ingestlock.writelock();
+            collect_published_edges();
+            flush_buffers_to_deltas();
             
             // Clean up sliding shards
             // NOTE: there is a problem since this will waste
@@ -568,32 +810,24 @@ namespace graphchi {
             
             std::vector<std::pair<vid_t, vid_t> > newranges;
             std::vector<std::string> newsuffices;
+            std::vector< std::vector<delta_t *> > newdeltas;
             
             char iterstr[128];
             sprintf(iterstr, "%d", this->iter);
             
-            size_t min_buffer_in_shard_to_commit = max_edge_buffer / this->nshards / 2;
-            
-            std::vector<bool> was_commited(this->nshards, true);
-            
             for(int shard=0; shard < this->nshards; shard++) {
-                std::vector<edge_buffer*> &shard_buffer = new_edge_buffers[shard];
-                
-                // Check there are any new edges
-                size_t bufedges = 0;
-                for(int w=0; w < this->nshards; w++) {
-                    bufedges += shard_buffer[w]->size();
-                    
-                }
+                compact_deltas(shard);
+                size_t deltaedges = num_delta_edges(shard);
+                size_t shardedges = std::max(1, edgespershard[shard]);
                 
-                if (bufedges < min_buffer_in_shard_to_commit && deletecounts[shard] * 1.0 / edgespershard[shard] < 0.2) {
-                    logstream(LOG_DEBUG) << shard << ": not enough edges for shard: " << bufedges << " deleted:" << deletecounts[shard] << "/" << edgespershard[shard] << std::endl;
+                if (deltaedges < delta_rewrite_ratio * shardedges && deletecounts[shard] * 1.0 / shardedges < rewrite_deleted_ratio) {
+                    logstream(LOG_DEBUG) << shard << ": not enough edges for shard: " << deltaedges << " deleted:" << deletecounts[shard] << "/" << edgespershard[shard] << std::endl;
                     newranges.push_back(this->intervals[shard]);
                     newsuffices.push_back(shard_suffices[shard]);
-                    was_commited[shard] = false;
+                    newdeltas.push_back(deltas[shard]);
                     continue;
                 } else {
-                    logstream(LOG_DEBUG) << shard << ": going to rewrite, deleted:" << deletecounts[shard] << "/" << edgespershard[shard] << " bufedges: " << bufedges << std::endl;
+                    logstream(LOG_DEBUG) << shard << ": going to rewrite, deleted:" << deletecounts[shard] << "/" << edgespershard[shard] << " deltaedges: " << deltaedges << std::endl;
                     shardlock.lock();
                     delete this->sliding_shards[shard];
                     this->sliding_shards[shard] = NULL;
@@ -614,16 +848,14 @@ namespace graphchi {
                     // Compute number edges (not including ingested ones!)
                     size_t halfedges = (sz / sizeof(EdgeDataType)) / 2;
                     // Correct to include estimate of ingested ones
-                    for(int w=0; w < this->nshards; w++) {
-                        halfedges += new_edge_buffers[shard][w]->size() / 2;
-                    }
+                    halfedges += num_delta_edges(shard) / 2;
                     size_t nedges = 0;
                     
                     vid_t st = this->intervals[shard].first;
                     splitpos = st + (this->intervals[shard].second - st) / 2;
                     bool found = false;
                     while(st < this->intervals[shard].second) {
-                        vid_t en = std::min(st + maxwindow, this->intervals[shard].second);
+                        vid_t en = std::min(st + (vid_t) this->maxwindow, this->intervals[shard].second);
                         this->degree_handler->load(st, en);
                         int nv = en - st + 1;
                         
@@ -658,6 +890,7 @@ namespace graphchi {
                     }
                     suffix = suffix + ".i" + std::string(iterstr);
                     newsuffices.push_back(suffix);
+                    newdeltas.push_back(std::vector<delta_t *>());
                     std::string outfile_edata = filename_shard_edata<EdgeDataType>(this->base_filename, 0, 0) + ".dyngraph" + suffix;
                     std::string outfile_edata_dirname = dirname_shard_edata_block(outfile_edata, base_engine::blocksize);
                     mkdir(outfile_edata_dirname.c_str(), 0777);
@@ -699,12 +932,11 @@ namespace graphchi {
                         vid_t range_st = this->intervals[window].first;
                         vid_t range_en = this->intervals[window].second;
                         if (window == this->nshards - 1) range_en = max_vertex_id;
-                        edge_buffer &buffer_for_window = *new_edge_buffers[shard][window];
                         
                         for(vid_t window_st=range_st; window_st<range_en; ) {
                             // Check how much we can read
                             vid_t window_en = determine_next_window(window, window_st, 
-                                                                    std::min(range_en, window_st + (vid_t)maxwindow), mem_budget);
+                                                                    std::min(range_en, window_st + (vid_t) this->maxwindow), mem_budget);
                             // Create vertices
                             int nvertices = window_en-window_st+1;
                             std::vector< svertex_t > vertices(nvertices, svertex_t());
@@ -730,12 +962,13 @@ namespace graphchi {
                             // Read vertices in
                             curshard->read_next_vertices(nvertices, window_st, vertices, false, true);
                             
-                            // Incorporate buffered edges
-                            for(unsigned int ebi=0; ebi<buffer_for_window.size(); ebi++) {
-                                created_edge<EdgeDataType> * edge = buffer_for_window[ebi];
-                                if (edge->src >= window_st && edge->src <= window_en) {
+                            // Incorporate the edges of the delta shards. Edges still in the
+                            // buffers are not accounted for, and stay there.
+                            for(int j=0; j < (int) deltas[shard].size(); j++) {
+                                delta_t &delta = *deltas[shard][j];
+                                for(size_t ei=delta.lower_bound(window_st); ei < delta.size() && delta[ei]->src <= window_en; ei++) {
+                                    created_edge<EdgeDataType> * edge = delta[ei];
                                     vertices[edge->src-window_st].add_outedge(edge->dst, &edge->data, false);
-                                    
                                 }
                             }
                             this->iomgr->wait_for_reads();
@@ -855,34 +1088,18 @@ namespace graphchi {
                 
                 std::string old_sizefilename = old_file_edata + ".size";
                 remove(old_sizefilename.c_str());
+                remove_deltas(shard);
             }
             
-            // Clear buffers
+            // Update number of shards. Edges left in the buffers count as uncommitted.
+            size_t nkept = 0;
             for(int shard=0; shard < this->nshards; shard++) {
-                if (was_commited[shard]) {
-                    for (int win=0; win < this->nshards; win++) {
-                        edge_buffer &buffer_for_window = *new_edge_buffers[shard][win];
-                        for(unsigned int ebi=0; ebi<buffer_for_window.size(); ebi++) {
-                            created_edge<EdgeDataType> * edge = buffer_for_window[ebi];                            
-                            if (!edge->accounted_for_outc) {
-                                std::cout << "Edge not accounted (out)! " << edge->src << " -- " << edge->dst << std::endl;
-                            }
-                            if (!edge->accounted_for_inc) {
-                                std::cout << "Edge not accounted (in)! " << edge->src << " -- " << edge->dst << std::endl;
-                            }
-                            
-                            assert(edge->accounted_for_inc);
-                            assert(edge->accounted_for_outc);
-                        }
-                        buffer_for_window.clear();
-                    }
-                }
+                for(int w=0; w < this->nshards; w++) nkept += new_edge_buffers[shard][w]->size();
             }
-            
-            // Update number of shards:
-            last_commit = added_edges;
+            last_commit = added_edges - nkept;
             this->intervals = newranges;
             shard_suffices = newsuffices;
+            deltas = newdeltas;
             this->nshards = (int) this->intervals.size();
             
             /* If the vertex intervals change, need to recreate the shard objects. */
@@ -901,6 +1118,7 @@ namespace graphchi {
             fclose(f);
             
             init_buffers();
+            ingestlock.unlock();
             this->modification_lock.unlock();
         }
         
@@ -1010,6 +1228,64 @@ namespace graphchi {
         
     }; // End class
     
+    /**
+     * Buffers the edges of one ingesting thread and adds them to the
+     * engine in batches. Each thread should have its own ingestor.
+     */
+    template <typename VertexDataType, typename EdgeDataType>
+    class dynamicgraph_ingestor {
+        
+        graphchi_dynamicgraph_engine<VertexDataType, EdgeDataType> &engine;
+        std::vector<created_edge<EdgeDataType> > edges;
+        std::vector<vid_t> tasks;
+        size_t batchsize;
+        
+    public:
+        
+        dynamicgraph_ingestor(graphchi_dynamicgraph_engine<VertexDataType, EdgeDataType> &engine, size_t batchsize = 4096) :
+                engine(engine), batchsize(batchsize) {
+            edges.reserve(batchsize);
+        }
+        
+        ~dynamicgraph_ingestor() {
+            flush();
+        }
+        
+        void add_edge(vid_t src, vid_t dst, EdgeDataType edata) {
+            edges.push_back(created_edge<EdgeDataType>(src, dst, edata));
+            if (edges.size() >= batchsize) flush();
+        }
+        
+        /**
+         * Schedules a vertex after the buffered edges have been added.
+         */
+        void add_task(vid_t vid) {
+            tasks.push_back(vid);
+        }
+        
+        /**
+         * Adds the buffered edges to the engine, waiting while the
+         * engine does not accept them. If the engine has stopped, the
+         * edges are dropped with a warning.
+         */
+        void flush() {
+            if (!edges.empty()) {
+                while (!engine.add_edges(&edges[0], edges.size())) {
+                    if (engine.has_stopped()) {
+                        logstream(LOG_WARNING) << "Engine has stopped, dropping " << edges.size() << " buffered edges" << std::endl;
+                        break;
+                    }
+                }
+                edges.clear();
+            }
+            if (!tasks.empty()) {
+                engine.add_tasks(&tasks[0], tasks.size());
+                tasks.clear();
+            }
+        }
+        
+    };
+    
 }; // End namespace
 
 
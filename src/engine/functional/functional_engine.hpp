@@ -25,7 +25,9 @@
  *
  * Engine for the alternative "functional" API for GraphChi.
  * The functional engine first processes in-edges, then executes "updates",
- * and then loads and updates out-edges.
+ * and then loads and updates out-edges. The in-edge values are copied
+ * to spans of the engine, contiguous by vertex, so that the gathers can be
+ * run in parallel by the updates.
  */
 
 
@@ -39,6 +41,21 @@ namespace graphchi {
     
     template <typename VertexDataType, typename EdgeDataType, typename fvertex_t>
     class functional_engine : public graphchi_engine<VertexDataType, EdgeDataType,  fvertex_t> {
+        typedef typename fvertex_t::span_value_t span_value_t;
+        
+        /* In-edges of the window, grouped by the destination vertex */
+        std::vector<vid_t> span_nbids;
+        std::vector<span_value_t> span_vals;
+        std::vector<size_t> span_cursors;
+        
+        struct span_value_of {
+            int iteration;
+            span_value_of(int iteration) : iteration(iteration) {}
+            inline span_value_t operator()(const EdgeDataType &e) {
+                return fvertex_t::span_value(e, iteration);
+            }
+        };
+        
     public:
         functional_engine(std::string base_filename, int nshards, bool selective_scheduling, metrics &_m) :
         graphchi_engine<VertexDataType, EdgeDataType, fvertex_t>(base_filename, nshards, selective_scheduling, _m){
@@ -46,6 +63,16 @@ namespace graphchi {
         }
         
     protected:
+        /* Override - out-edges are loaded after the updates, so windows cannot be pipelined */
+        virtual bool use_pipelining() {
+            return false;
+        }
+        
+        /* The in-edges are loaded again on every iteration */
+        virtual bool is_inmemory_mode() {
+            return false;
+        }
+        
         /* Override - load only memory shard (i.e inedges) */
         virtual void load_before_updates(std::vector<fvertex_t> &vertices) {
             logstream(LOG_DEBUG) << "Processing in-edges." << std::endl;
@@ -54,8 +81,13 @@ namespace graphchi {
                 this->memoryshard->load();
             }
             
-            /* Load vertex edges from memory shard */
-            this->memoryshard->load_vertices(this->sub_interval_st, this->sub_interval_en, vertices, true, false);
+            /* Copy the in-edge values from the memory shard to the spans */
+            if (this->chicontext.iteration > 0 && !span_vals.empty()) {
+                span_value_of value_of(this->chicontext.iteration);
+                this->memoryshard->load_inedge_spans(this->sub_interval_st, this->sub_interval_en, span_cursors,
+                                                     (fvertex_t::gather_needs_nbids() ? &span_nbids[0] : NULL),
+                                                     &span_vals[0], value_of);
+            }
             
             /* Load vertices */ 
             this->vertex_data_handler->load(this->sub_interval_st, this->sub_interval_en);
@@ -74,6 +106,7 @@ namespace graphchi {
             
              /* Assign vertex edge array pointers */
             size_t ecounter = 0;
+            size_t nspan = 0;
             for(int i=0; i < (int)nvertices; i++) {
                 degree d = this->degree_handler->get_degree(this->sub_interval_st + i);
                 int inc = d.indegree;
@@ -92,8 +125,29 @@ namespace graphchi {
                     vertices[i].scheduled =  true;
                     ecounter += inc + outc;
                 }
+                if (vertices[i].scheduled) nspan += inc;
             }
             this->work += num_edges;
+            
+            /* In-edges are not gathered on the first iteration */
+            span_vals.clear();
+            if (this->chicontext.iteration > 0 && nspan > 0) {
+                bool with_nbids = fvertex_t::gather_needs_nbids();
+                if (with_nbids) span_nbids.resize(nspan);
+                span_vals.resize(nspan);
+                span_cursors.resize(nvertices);
+                size_t off = 0;
+                for(int i=0; i < (int)nvertices; i++) {
+                    if (!vertices[i].scheduled) {
+                        span_cursors[i] = (size_t)-1;
+                        continue;
+                    }
+                    int inc = this->degree_handler->get_degree(this->sub_interval_st + i).indegree;
+                    vertices[i].set_inedge_span((with_nbids ? &span_nbids[off] : NULL), &span_vals[off], inc);
+                    span_cursors[i] = off;
+                    off += inc;
+                }
+            }
         }        
 
         
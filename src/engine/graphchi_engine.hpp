@@ -47,12 +47,16 @@
 #include "api/graphchi_program.hpp"
 #include "engine/auxdata/degree_data.hpp"
 #include "engine/auxdata/vertex_data.hpp"
+#include "engine/auxdata/vertex_data_cache.hpp"
 #include "engine/bitset_scheduler.hpp"
+#include "engine/priority_scheduler.hpp"
+#include "engine/worksteal_scheduler.hpp"
 #include "io/stripedio.hpp"
 #include "logger/logger.hpp"
 #include "metrics/metrics.hpp"
 #include "shards/memoryshard.hpp"
 #include "shards/slidingshard.hpp"
+#include "util/buffer_arena.hpp"
 #include "util/pthread_tools.hpp"
 
 
@@ -88,6 +92,23 @@ namespace graphchi {
         /* Scheduler */
         bitset_scheduler * scheduler;
         
+        /* Distributes the updates of a window to the threads */
+        worksteal_scheduler update_chunks;
+        
+        /**
+         * Vertex objects and edge buffer of a sub-interval. These are
+         * reused from window to window and from iteration to iteration.
+         * The pipelined mode alternates between two of them.
+         */
+        struct window_buffers {
+            vid_t st;
+            vid_t en;
+            std::vector<svertex_t> vertices;
+            buffer_arena<graphchi_edge<EdgeDataType> > edgebuffer;
+            window_buffers() : st(0), en(0) {}
+        };
+        window_buffers windowbufs[2];
+        
         /* Configuration */
         bool modifies_outedges;
         bool modifies_inedges;
@@ -97,9 +118,13 @@ namespace graphchi {
         bool store_inedges;
         bool disable_vertexdata_storage;
         bool preload_commit; //alow storing of modified edge data on preloaded data into memory
+        bool pipelined;
+        bool order_intervals;
 
         size_t blocksize;
         int membudget_mb;
+        int vertexcache_mb;
+        size_t vertexcache_bytes;
         int load_threads;
         int exec_threads;
         
@@ -121,6 +146,9 @@ namespace graphchi {
         /* Metrics */
         metrics &m;
         
+        /* Phases of the windows, timed by interval */
+        metric_handle phase_load, phase_update, phase_save, phase_commit;
+        
         void print_config() {
             logstream(LOG_INFO) << "Engine configuration: " << std::endl;
             logstream(LOG_INFO) << " exec_threads = " << exec_threads << std::endl;
@@ -128,6 +156,10 @@ namespace graphchi {
             logstream(LOG_INFO) << " membudget_mb = " << membudget_mb << std::endl;
             logstream(LOG_INFO) << " blocksize = " << blocksize << std::endl;
             logstream(LOG_INFO) << " scheduler = " << use_selective_scheduling << std::endl;
+            if (use_selective_scheduling) {
+                logstream(LOG_INFO) << " scheduler.type = " << get_option_string("scheduler.type", "bitset") << std::endl;
+            }
+            logstream(LOG_INFO) << " pipelined = " << use_pipelining() << std::endl;
         }
         
     public:
@@ -178,6 +210,8 @@ namespace graphchi {
             disable_vertexdata_storage = false;
 
             membudget_mb = get_option_int("membudget_mb", 1024);
+            vertexcache_mb = get_option_int("vertexcache.membudget_mb", 0);
+            vertexcache_bytes = 0;
             nupdates = 0;
             iter = 0;
             work = 0;
@@ -190,6 +224,8 @@ namespace graphchi {
             load_threads = get_option_int("loadthreads", 2);
             exec_threads = get_option_int("execthreads", omp_get_max_threads());
             maxwindow = 40000000;
+            pipelined = get_option_int("pipelined", 0) != 0;
+            order_intervals = get_option_int("scheduler.order_intervals", 0) != 0;
 
             /* Load graph shard interval information */
             _load_vertex_intervals();
@@ -197,6 +233,11 @@ namespace graphchi {
             _m.set("file", _base_filename);
             _m.set("engine", "default");
             _m.set("nshards", (size_t)nshards);
+            
+            phase_load = _m.register_phase("window-load", "by-interval");
+            phase_update = _m.register_phase("window-update", "by-interval");
+            phase_save = _m.register_phase("window-save", "by-interval");
+            phase_commit = _m.register_phase("interval-commit", "by-interval");
         }
         
         virtual ~graphchi_engine() {
@@ -221,7 +262,7 @@ namespace graphchi {
     protected:
         
         virtual degree_data * create_degree_handler() {
-            return new degree_data(base_filename, iomgr);
+            return new prefetching_degree_data(base_filename, iomgr);
         }
         
         virtual bool disable_preloading() {
@@ -281,10 +322,25 @@ namespace graphchi {
             
         }
         
+        /**
+         * Creates the scheduler given by option scheduler.type: "bitset", or
+         * "priority" for the priority scheduler (options scheduler.threshold
+         * and scheduler.window_threshold).
+         */
         virtual void initialize_scheduler() {
             if (use_selective_scheduling) {
                 if (scheduler != NULL) delete scheduler;
-                scheduler = new bitset_scheduler((int) num_vertices());
+                std::string type = get_option_string("scheduler.type", "bitset");
+                if (type == "priority") {
+                    scheduler = new priority_scheduler((int) num_vertices(),
+                                                       get_option_float("scheduler.threshold", 0.0),
+                                                       get_option_float("scheduler.window_threshold", 0.0));
+                } else {
+                    if (type != "bitset") {
+                        logstream(LOG_ERROR) << "Unknown scheduler.type: " << type << ", using bitset." << std::endl;
+                    }
+                    scheduler = new bitset_scheduler((int) num_vertices());
+                }
                 scheduler->add_task_to_all();
             } else {
                 scheduler = NULL;
@@ -295,10 +351,24 @@ namespace graphchi {
          * If the data is only in one shard, we can just
          * keep running from memory.
          */
-        bool is_inmemory_mode() {
+        virtual bool is_inmemory_mode() {
             return nshards == 1;
         }
         
+        /**
+         * In the pipelined mode, the next sub-interval is loaded while
+         * the updates of the current one are executed. Not supported with
+         * selective scheduling, because the next window is initialized before the
+         * current window's updates have added their tasks.
+         */
+        virtual bool use_pipelining() {
+#if defined(DYNAMICEDATA) || defined(DYNAMICVERTEXDATA)
+            return false;
+#else
+            return pipelined && scheduler == NULL && !is_inmemory_mode();
+#endif
+        }
+        
         
         /**
          * Extends the window to fill the memory budget, but not over maxvid
@@ -312,9 +382,24 @@ namespace graphchi {
                 return maxvid;
             } else {
                 size_t memreq = 0;
-                int max_interval = maxvid - fromvid;
-                for(int i=0; i < max_interval; i++) {
-                    degree deg = degree_handler->get_degree(fromvid + i);
+                vid_t v = fromvid;
+                while (v < maxvid) {
+                    /* With selective scheduling, only the edges of the scheduled
+                       vertices are loaded. The others cost just the vertex object. */
+                    if (scheduler != NULL) {
+                        vid_t next = std::min(scheduler->next_scheduled(v, maxvid - 1), maxvid);
+                        if (next > v) {
+                            size_t nfit = (memreq < membudget ? (membudget - memreq) / sizeof(svertex_t) : 0);
+                            if (nfit < (size_t) (next - v)) {
+                                logstream(LOG_DEBUG) << "Memory budget exceeded with unscheduled vertices." << std::endl;
+                                return v + (vid_t) nfit - 1;
+                            }
+                            memreq += (next - v) * sizeof(svertex_t);
+                            v = next;
+                            continue;
+                        }
+                    }
+                    degree deg = degree_handler->get_degree(v);
                     int inc = deg.indegree;
                     int outc = deg.outdegree;
                     
@@ -322,8 +407,9 @@ namespace graphchi {
                     memreq += sizeof(svertex_t) + (sizeof(EdgeDataType) + sizeof(vid_t) + sizeof(graphchi_edge<EdgeDataType>))*(outc + inc);
                     if (memreq > membudget) {
                         logstream(LOG_DEBUG) << "Memory budget exceeded with " << memreq << " bytes." << std::endl;
-                        return fromvid + i - 1;  // Previous was enough
+                        return v - 1;  // Previous was enough
                     }
+                    v++;
                 }
                 return maxvid;
             }
@@ -337,12 +423,10 @@ namespace graphchi {
             size_t num_edges = 0;
             int nvertices = en - st + 1;
             if (scheduler != NULL) {
-                for(int i=0; i < nvertices; i++) {
-                    bool is_sched = scheduler->is_scheduled(st + i);
-                    if (is_sched) {
-                        degree d = degree_handler->get_degree(st + i);
-                        num_edges += d.indegree * store_inedges + d.outdegree;
-                    }
+                for(vid_t v=scheduler->next_scheduled(st, en); v <= en; v=scheduler->next_scheduled(v + 1, en)) {
+                    degree d = degree_handler->get_degree(v);
+                    num_edges += d.indegree * store_inedges + d.outdegree;
+                    if (v == en) break;
                 }
             } else {
                 for(int i=0; i < nvertices; i++) {
@@ -354,6 +438,15 @@ namespace graphchi {
         }
         
         virtual void load_before_updates(std::vector<svertex_t> &vertices) {
+            load_window(sub_interval_st, sub_interval_en, vertices, false);
+        }
+        
+        /**
+         * Loads the edges and vertex values of a window.
+         * @param prefetch if true, vertex values are read to the prefetch buffer of
+         *        the vertex data store, leaving the current chunk intact.
+         */
+        void load_window(vid_t window_st, vid_t window_en, std::vector<svertex_t> &vertices, bool prefetch) {
             omp_set_num_threads(load_threads);
 #pragma omp parallel for schedule(dynamic, 1)
             for(int p=-1; p < nshards; p++)  {
@@ -364,19 +457,22 @@ namespace graphchi {
                     }
                     
                     /* Load vertex edges from memory shard */
-                    memoryshard->load_vertices(sub_interval_st, sub_interval_en, vertices);
+                    memoryshard->load_vertices(window_st, window_en, vertices);
                     
-                    /* Load vertices */ 
-                    vertex_data_handler->load(sub_interval_st, sub_interval_en);
-
                     /* Load vertices */
                     if (!disable_vertexdata_storage) {
-                        vertex_data_handler->load(sub_interval_st, sub_interval_en);
+                        if (!prefetch) {
+                            vertex_data_handler->load(window_st, window_en);
+                        } else {
+#ifndef DYNAMICVERTEXDATA
+                            vertex_data_handler->prefetch(window_st, window_en);
+#endif
+                        }
                     }
                 } else {
                     /* Load edges from a sliding shard */
                     if (p != exec_interval) {
-                        sliding_shards[p]->read_next_vertices((int) vertices.size(), sub_interval_st, vertices,
+                        sliding_shards[p]->read_next_vertices((int) vertices.size(), window_st, vertices,
                                                               scheduler != NULL && chicontext.iteration == 0);
                         
                     }
@@ -387,49 +483,67 @@ namespace graphchi {
             iomgr->wait_for_reads();
         }
         
-        void exec_updates(GraphChiProgram<VertexDataType, EdgeDataType, svertex_t> &userprogram,
-                          std::vector<svertex_t> &vertices) {
+        virtual void exec_updates(GraphChiProgram<VertexDataType, EdgeDataType, svertex_t> &userprogram,
+                                  std::vector<svertex_t> &vertices) {
             metrics_entry me = m.start_time();
             size_t nvertices = vertices.size();
             if (!enable_deterministic_parallelism) {
                 for(int i=0; i < (int)nvertices; i++) vertices[i].parallel_safe = true;
             }
             
-            omp_set_num_threads(exec_threads);
+            /* With deterministic parallelism, the vertices that are not parallel-safe are
+               executed sequentially by the first thread (the serial lane), which
+               then continues by stealing chunks of the parallel-safe vertices. */
+            bool serial_lane = exec_threads > 1 && enable_deterministic_parallelism;
+            update_chunks.build(vertices, exec_threads, serial_lane ? 1 : 0, serial_lane);
+            
+            std::vector<double> busytime(exec_threads, 0.0);
+            std::vector<double> totaltime(exec_threads, 0.0);
+            int nonsafe_count = 0;
             
-#pragma omp parallel sections 
+#pragma omp parallel num_threads(exec_threads)
             {
-#pragma omp section
-                {
-#pragma omp parallel for schedule(dynamic)
-                    for(int vid=sub_interval_st; vid <= (int)sub_interval_en; vid++) {
-                        svertex_t & v = vertices[vid - sub_interval_st];
-                        
-                        if (exec_threads == 1 || v.parallel_safe) {
+                int thread = omp_get_thread_num();
+                double thread_st = worksteal_clock();
+                
+                if (serial_lane && thread == 0) {
+                    for(int i=0; i < (int)nvertices; i++) {
+                        svertex_t & v = vertices[i];
+                        if (!v.parallel_safe && v.scheduled) {
                             if (!disable_vertexdata_storage)
-                                v.dataptr = vertex_data_handler->vertex_data_ptr(vid);
-                            if (v.scheduled) 
-                                userprogram.update(v, chicontext);
+                                v.dataptr = vertex_data_handler->vertex_data_ptr(sub_interval_st + i);
+                            userprogram.update(v, chicontext);
+                            nonsafe_count++;
                         }
                     }
+                    busytime[thread] += worksteal_clock() - thread_st;
                 }
-#pragma omp section
-                {
-                    if (exec_threads > 1 && enable_deterministic_parallelism) {
-                        int nonsafe_count = 0;
-                        for(int vid=sub_interval_st; vid <= (int)sub_interval_en; vid++) {
-                            svertex_t & v = vertices[vid - sub_interval_st];
-                            if (!v.parallel_safe && v.scheduled) {
-                                if (!disable_vertexdata_storage)
-                                    v.dataptr = vertex_data_handler->vertex_data_ptr(vid);
+                
+                update_chunk chunk;
+                while (update_chunks.next(thread, chunk)) {
+                    double chunk_st = worksteal_clock();
+                    for(int i=chunk.first; i < chunk.last; i++) {
+                        svertex_t & v = vertices[i];
+                        
+                        if (exec_threads == 1 || v.parallel_safe) {
+                            if (!disable_vertexdata_storage)
+                                v.dataptr = vertex_data_handler->vertex_data_ptr(sub_interval_st + i);
+                            if (v.scheduled) 
                                 userprogram.update(v, chicontext);
-                                nonsafe_count++;
-                            }
                         }
-                        
-                        m.add("serialized-updates", nonsafe_count);
                     }
+                    busytime[thread] += worksteal_clock() - chunk_st;
                 }
+                totaltime[thread] = worksteal_clock() - thread_st;
+            }
+            
+            if (serial_lane) {
+                m.add("serialized-updates", nonsafe_count);
+            }
+            m.add("update-chunks", update_chunks.num_chunks());
+            for(int t=0; t < exec_threads; t++) {
+                m.add_vector_entry("exec-thread-busy", t, busytime[t]);
+                m.add_vector_entry("exec-thread-idle", t, totaltime[t] - busytime[t]);
             }
             m.stop_time(me, "execute-updates");
         }
@@ -439,9 +553,8 @@ namespace graphchi {
          Special method for running all iterations with the same vertex-vector.
          This is a hacky solution.
 
-         FIXME:  this does not work well with deterministic parallelism. Needs a
-         a separate analysis phase to check which vertices can be run in parallel, and
-         then run it in chunks. Not difficult.
+         FIXME:  this does not work well with deterministic parallelism. For graphs
+         that fit in memory, use graphchi_inmemory_engine, which colors the vertices.
          **/
         void exec_updates_inmemory_mode(GraphChiProgram<VertexDataType, EdgeDataType, svertex_t> &userprogram,
                                         std::vector<svertex_t> &vertices) {
@@ -477,6 +590,7 @@ namespace graphchi {
                 exec_updates(userprogram, vertices);
                 load_after_updates(vertices);
                 
+                chicontext.merge_aggregators();
                 userprogram.after_exec_interval(0, (int)num_vertices(), chicontext);
                 userprogram.after_iteration(iter, chicontext);
                 if (chicontext.last_iteration > 0 && chicontext.last_iteration <= iter){
@@ -489,24 +603,35 @@ namespace graphchi {
         
 
         virtual void init_vertices(std::vector<svertex_t> &vertices, graphchi_edge<EdgeDataType> * &edata) {
+            init_window_vertices(sub_interval_st, sub_interval_en, vertices, edata, windowbufs[0].edgebuffer);
+        }
+        
+        /**
+         * Takes the edge buffer of a window from the arena and assigns the
+         * edge array pointers of its vertices.
+         */
+        void init_window_vertices(vid_t window_st, vid_t window_en, std::vector<svertex_t> &vertices, graphchi_edge<EdgeDataType> * &edata,
+                                  buffer_arena<graphchi_edge<EdgeDataType> > &edgebuffer) {
             size_t nvertices = vertices.size();
             
             /* Compute number of edges */
-            size_t num_edges = num_edges_subinterval(sub_interval_st, sub_interval_en);
+            size_t num_edges = num_edges_subinterval(window_st, window_en);
             
-            /* Allocate edge buffer */
-            edata = (graphchi_edge<EdgeDataType>*) malloc(num_edges * sizeof(graphchi_edge<EdgeDataType>));
+            /* Get edge buffer (allocated only if it needs to grow) */
+            metrics_entry me = m.start_time();
+            edata = edgebuffer.allocate(num_edges);
+            m.stop_time(me, "edgebuffer_alloc", false);
             
             /* Assign vertex edge array pointers */
             size_t ecounter = 0;
             for(int i=0; i < (int)nvertices; i++) {
-                degree d = degree_handler->get_degree(sub_interval_st + i);
+                degree d = degree_handler->get_degree(window_st + i);
                 int inc = d.indegree;
                 int outc = d.outdegree;
-                vertices[i] = svertex_t(sub_interval_st + i, &edata[ecounter], 
+                vertices[i] = svertex_t(window_st + i, &edata[ecounter], 
                                         &edata[ecounter + inc * store_inedges], inc, outc);
                 if (scheduler != NULL) {
-                    bool is_sched = ( scheduler->is_scheduled(sub_interval_st + i));
+                    bool is_sched = ( scheduler->is_scheduled(window_st + i));
                     if (is_sched) {
                         vertices[i].scheduled =  true;
                         nupdates++;
@@ -534,7 +659,8 @@ namespace graphchi {
                 }
             }
             if (modified_any_vertex) {
-                vertex_data_handler->save();
+                /* The chunk is written in the background while the next window is loaded */
+                vertex_data_handler->save(true);
             }
         }
         
@@ -542,6 +668,98 @@ namespace graphchi {
             // Do nothing.
         }   
         
+        /**
+         * Resets the vertex objects of a window. The vector keeps its
+         * capacity, so it is reallocated only when the window grows.
+         */
+        void reset_window_vertices(std::vector<svertex_t> &vertices, int nvertices) {
+            metrics_entry me = m.start_time();
+            vertices.assign(nvertices, svertex_t());
+            m.stop_time(me, "vertexbuffer_init", false);
+        }
+        
+        /**
+         * Determines the window starting from fromvid and loads it.
+         */
+        void load_pipelined_window(window_buffers &w, vid_t fromvid, vid_t interval_en, size_t membudget, bool prefetch) {
+            w.st = fromvid;
+            w.en = determine_next_window(exec_interval, fromvid,
+                                         std::min(interval_en, fromvid + maxwindow), membudget);
+            assert(w.en >= w.st);
+            logstream(LOG_INFO) << "Iteration " << iter << "/" << (niters - 1) << ", subinterval: " << w.st << " - " << w.en
+                << (prefetch ? " (prefetch)" : "") << std::endl;
+            
+            graphchi_edge<EdgeDataType> * edata = NULL;
+            reset_window_vertices(w.vertices, w.en - w.st + 1);
+            init_window_vertices(w.st, w.en, w.vertices, edata, w.edgebuffer);
+            load_window(w.st, w.en, w.vertices, prefetch);
+        }
+        
+        /**
+         * Executes the sub-intervals of the current execution interval so that
+         * the next sub-interval is loaded while the updates of the previous one
+         * are running. The memory budget is split between the two windows.
+         * Loading does not continue over the interval boundary, as the memory shard changes.
+         */
+        void exec_interval_pipelined(GraphChiProgram<VertexDataType, EdgeDataType, svertex_t> &userprogram,
+                                     vid_t interval_st, vid_t interval_en) {
+#if !defined(DYNAMICEDATA) && !defined(DYNAMICVERTEXDATA)
+            size_t window_membudget = window_membudget_bytes() / 2;
+            
+            window_buffers * curwindow = &windowbufs[0];
+            phase_timer lpt = m.start_phase(phase_load);
+            load_pipelined_window(*curwindow, interval_st, interval_en, window_membudget, false);
+            m.stop_phase(lpt, exec_interval);
+            
+            while (curwindow != NULL) {
+                window_buffers * nextwindow = NULL;
+                sub_interval_st = curwindow->st;
+                sub_interval_en = curwindow->en;
+                
+                logstream(LOG_INFO) << "Start updates" << std::endl;
+                metrics_entry me = m.start_time();
+#pragma omp parallel sections num_threads(2)
+                {
+#pragma omp section
+                    {
+                        /* Overlaps with the load below: no hardware counters */
+                        phase_timer pt = m.start_phase(phase_update, false);
+                        exec_updates(userprogram, curwindow->vertices);
+                        load_after_updates(curwindow->vertices);
+                        m.stop_phase(pt, exec_interval);
+                    }
+#pragma omp section
+                    {
+                        if (curwindow->en < interval_en) {
+                            metrics_entry lm = m.start_time();
+                            phase_timer pt = m.start_phase(phase_load, false);
+                            nextwindow = (curwindow == &windowbufs[0] ? &windowbufs[1] : &windowbufs[0]);
+                            load_pipelined_window(*nextwindow, curwindow->en + 1, interval_en, window_membudget, true);
+                            m.stop_phase(pt, exec_interval);
+                            m.stop_time(lm, "pipelined-load");
+                        }
+                    }
+                }
+                m.stop_time(me, "pipelined-window");
+                logstream(LOG_INFO) << "Finished updates" << std::endl;
+                
+                /* Save vertices and make the prefetched chunk current */
+                if (!disable_vertexdata_storage) {
+                    phase_timer pt = m.start_phase(phase_save);
+                    save_vertices(curwindow->vertices);
+                    m.stop_phase(pt, exec_interval);
+                    if (nextwindow != NULL) {
+                        vertex_data_handler->swap_prefetched();
+                    }
+                }
+                curwindow = nextwindow;
+            }
+            sub_interval_st = interval_en + 1;
+#else
+            assert(false);
+#endif
+        }
+        
         virtual void write_delta_log() {
             // Write delta log
             std::string deltafname = iomgr->multiplexprefix(0) + base_filename + ".deltalog";
@@ -617,21 +835,91 @@ namespace graphchi {
          * Checks whether any vertex is scheduled in the given interval.
          * If no scheduler is configured, returns always true.
          */
-        // TODO: support for a minimum fraction of scheduled vertices
         bool is_any_vertex_scheduled(vid_t st, vid_t en) {
             if (scheduler == NULL) return true;
-            for(vid_t v=st; v<=en; v++) {
-                if (scheduler->is_scheduled(v)) {
-                    return true;
-                }
+            return scheduler->is_any_scheduled(st, en);
+        }
+        
+        /**
+         * Order in which the intervals are executed. With option
+         * scheduler.order_intervals, the intervals with most pending
+         * priority are run first (after the first iteration, which
+         * builds the sliding shard indices).
+         */
+        void compute_interval_order(std::vector<int> &order) {
+            order.clear();
+            for(int p=0; p < nshards; p++) order.push_back(p);
+            if (!order_intervals || scheduler == NULL || iter == 0 || is_inmemory_mode()) return;
+            
+            std::vector<std::pair<double, int> > pending;
+            for(int p=0; p < nshards; p++) {
+                vid_t st = get_interval_start(p);
+                vid_t en = get_interval_end(p);
+                pending.push_back(std::pair<double, int>(st <= en ? -scheduler->pending_priority(st, en) : 0.0, p));
             }
-            return false;
+            std::stable_sort(pending.begin(), pending.end());
+            for(int p=0; p < nshards; p++) order[p] = pending[p].second;
+        }
+        
+        /**
+         * Flushes the sliding shards and moves them to the beginning.
+         */
+        void rewind_sliding_shards() {
+            for(int p=0; p<nshards; p++) {
+                sliding_shards[p]->flush();
+                sliding_shards[p]->set_offset(0, 0, 0);
+            }
+            iomgr->wait_for_writes();
         }
         
         virtual void initialize_iter() {
             // Do nothing
         }
         
+        /**
+         * Creates the vertex data store. If vertexcache.membudget_mb is set, vertex
+         * values are cached in memory over windows and iterations, in at most half
+         * of the memory budget.
+         */
+        virtual vertex_data_store<VertexDataType> * create_vertex_data_handler() {
+#ifndef DYNAMICVERTEXDATA
+            size_t membudget = size_t(membudget_mb) * 1024 * 1024;
+            size_t databytes = num_vertices() * sizeof(VertexDataType);
+            vertexcache_bytes = (vertexcache_mb > 0 ? size_t(vertexcache_mb) * 1024 * 1024 : 0);
+            vertexcache_bytes = std::min(vertexcache_bytes, membudget / 2);
+            if (vertexcache_bytes > 0) {
+                m.set("vertexcache_budget", vertexcache_bytes);
+                vertexcache_bytes = std::min(vertexcache_bytes, databytes + VERTEXCACHE_PAGE_BYTES);
+                return new cached_vertex_data_store<VertexDataType>(base_filename, num_vertices(), iomgr,
+                                                                    vertexcache_bytes, m);
+            }
+            vertexcache_bytes = 0;
+#endif
+            return new vertex_data_store<VertexDataType>(base_filename, num_vertices(), iomgr);
+        }
+        
+        /**
+         * Starts reading the degrees of the vertices after the current
+         * sub-interval, or of the next interval to be executed.
+         */
+        void prefetch_next_degrees(std::vector<int> &interval_order, int k) {
+            vid_t interval_en = get_interval_end(exec_interval);
+            if (sub_interval_en < interval_en) {
+                degree_handler->prefetch(sub_interval_en + 1, std::min(interval_en, sub_interval_en + 1 + maxwindow));
+            } else if (k + 1 < (int) interval_order.size()) {
+                vid_t st = get_interval_start(interval_order[k + 1]);
+                vid_t en = get_interval_end(interval_order[k + 1]);
+                if (st <= en) degree_handler->prefetch(st, std::min(en, st + maxwindow));
+            }
+        }
+        
+        /**
+         * Memory budget of a window: the memory budget less the vertex data cache.
+         */
+        size_t window_membudget_bytes() {
+            return size_t(membudget_mb) * 1024 * 1024 - vertexcache_bytes;
+        }
+        
         virtual void initialize_before_run() {
             if (reset_vertexdata) {
                 vertex_data_handler->clear(num_vertices());
@@ -675,7 +963,7 @@ namespace graphchi {
             logstream(LOG_INFO) << "Copyright Aapo Kyrola et al., Carnegie Mellon University (2012)" << std::endl;
             
             if (vertex_data_handler == NULL)
-                vertex_data_handler = new vertex_data_store<VertexDataType>(base_filename, num_vertices(), iomgr);
+                vertex_data_handler = create_vertex_data_handler();
         
             initialize_before_run();
             
@@ -689,6 +977,11 @@ namespace graphchi {
                 
             initialize_scheduler();
             omp_set_nested(1);
+#ifndef DYNAMICEDATA
+            for(int p=0; p < nshards; p++) {
+                sliding_shards[p]->set_pipelined(use_pipelining());
+            }
+#endif
             
             /* Install a 'mock'-scheduler to chicontext if scheduler
              is not used. */
@@ -737,7 +1030,12 @@ namespace graphchi {
                 }
                 
                 /* Interval loop */
-                for(exec_interval=0; exec_interval < nshards; ++exec_interval) {
+                std::vector<int> interval_order;
+                compute_interval_order(interval_order);
+                int prev_interval = -1;
+                for(int k=0; k < nshards; k++) {
+                    exec_interval = interval_order[k];
+                    
                     /* Determine interval limits */
                     vid_t interval_st = get_interval_start(exec_interval);
                     vid_t interval_en = get_interval_end(exec_interval);
@@ -746,6 +1044,23 @@ namespace graphchi {
 
                     if (!is_inmemory_mode())
                         userprogram.before_exec_interval(interval_st, interval_en, chicontext);
+                    
+                    /* Skip the whole interval (without flushing or loading any shards) if
+                       nothing is scheduled in it */
+                    if (!is_inmemory_mode() && !is_any_vertex_scheduled(interval_st, interval_en)) {
+                        logstream(LOG_INFO) << "No vertices scheduled in interval " << exec_interval << ", skip." << std::endl;
+                        m.add("intervals_skipped", 1.0);
+                        chicontext.merge_aggregators();
+                        userprogram.after_exec_interval(interval_st, interval_en, chicontext);
+                        continue;
+                    }
+                    
+                    /* Sliding shards only move forward, so rewind them if the intervals
+                       are executed out of order */
+                    if (exec_interval < prev_interval) {
+                        rewind_sliding_shards();
+                    }
+                    prev_interval = exec_interval;
 
                     /* Flush stream shard for the exec interval */
                     sliding_shards[exec_interval]->flush();
@@ -760,73 +1075,82 @@ namespace graphchi {
                     logstream(LOG_INFO) << chicontext.runtime() << "s: Starting: " 
                     << sub_interval_st << " -- " << interval_en << std::endl;
                     
-                    while (sub_interval_st <= interval_en) {
+                    if (use_pipelining()) {
+                        exec_interval_pipelined(userprogram, interval_st, interval_en);
+                    } else {
+                        while (sub_interval_st <= interval_en) {
                         
-                        modification_lock.lock();
-                        /* Determine the sub interval */
-                        sub_interval_en = determine_next_window(exec_interval,
-                                                                sub_interval_st, 
-                                                                std::min(interval_en, sub_interval_st + maxwindow), 
-                                                                size_t(membudget_mb) * 1024 * 1024);
-                        assert(sub_interval_en >= sub_interval_st);
+                            modification_lock.lock();
+                            /* Determine the sub interval */
+                            sub_interval_en = determine_next_window(exec_interval,
+                                                                    sub_interval_st, 
+                                                                    std::min(interval_en, sub_interval_st + maxwindow), 
+                                                                    window_membudget_bytes());
+                            assert(sub_interval_en >= sub_interval_st);
                         
-                        logstream(LOG_INFO) << "Iteration " << iter << "/" << (niters - 1) << ", subinterval: " << sub_interval_st << " - " << sub_interval_en << std::endl;
+                            logstream(LOG_INFO) << "Iteration " << iter << "/" << (niters - 1) << ", subinterval: " << sub_interval_st << " - " << sub_interval_en << std::endl;
                         
-                        bool any_vertex_scheduled = is_any_vertex_scheduled(sub_interval_st, sub_interval_en);
-                        if (!any_vertex_scheduled) {
-                            logstream(LOG_INFO) << "No vertices scheduled, skip." << std::endl;
-                            sub_interval_st = sub_interval_en + 1;
-                            modification_lock.unlock();
-                            continue;
-                        }
+                            bool any_vertex_scheduled = is_any_vertex_scheduled(sub_interval_st, sub_interval_en);
+                            if (!any_vertex_scheduled) {
+                                logstream(LOG_INFO) << "No vertices scheduled, skip." << std::endl;
+                                sub_interval_st = sub_interval_en + 1;
+                                modification_lock.unlock();
+                                continue;
+                            }
                         
-                        /* Initialize vertices */
-                        int nvertices = sub_interval_en - sub_interval_st + 1;
-                        graphchi_edge<EdgeDataType> * edata = NULL;
+                            /* Initialize vertices */
+                            int nvertices = sub_interval_en - sub_interval_st + 1;
+                            graphchi_edge<EdgeDataType> * edata = NULL;
+                            
+                            phase_timer pt = m.start_phase(phase_load);
+                            std::vector<svertex_t> &vertices = windowbufs[0].vertices;
+                            reset_window_vertices(vertices, nvertices);
+                            init_vertices(vertices, edata);
                         
-                        std::vector<svertex_t> vertices(nvertices, svertex_t());
-                        init_vertices(vertices, edata);
+                            /* Now clear scheduler bits for the interval */
+                            if (scheduler != NULL)
+                                scheduler->remove_tasks(sub_interval_st, sub_interval_en);
                         
-                        /* Now clear scheduler bits for the interval */
-                        if (scheduler != NULL)
-                            scheduler->remove_tasks(sub_interval_st, sub_interval_en);
+                            /* Load data */
+                            load_before_updates(vertices);                        
+                            m.stop_phase(pt, exec_interval);
                         
-                        /* Load data */
-                        load_before_updates(vertices);                        
+                            modification_lock.unlock();
                         
-                        modification_lock.unlock();
+                            /* Read the degrees of the next window while the updates run */
+                            prefetch_next_degrees(interval_order, k);
                         
-                        logstream(LOG_INFO) << "Start updates" << std::endl;
-                        /* Execute updates */
-                        if (!is_inmemory_mode()) {
-                            exec_updates(userprogram, vertices);
-                            /* Load phase after updates (used by the functional engine) */
-                            load_after_updates(vertices);
-                        } else {
+                            logstream(LOG_INFO) << "Start updates" << std::endl;
+                            /* Execute updates */
+                            pt = m.start_phase(phase_update);
+                            if (!is_inmemory_mode()) {
+                                exec_updates(userprogram, vertices);
+                                /* Load phase after updates (used by the functional engine) */
+                                load_after_updates(vertices);
+                            } else {
 
-                            exec_updates_inmemory_mode(userprogram, vertices); 
-                        }
-                        logstream(LOG_INFO) << "Finished updates" << std::endl;
+                                exec_updates_inmemory_mode(userprogram, vertices); 
+                            }
+                            m.stop_phase(pt, exec_interval);
+                            logstream(LOG_INFO) << "Finished updates" << std::endl;
                         
                         
-                        /* Save vertices */
-                        if (!disable_vertexdata_storage) {
-                            save_vertices(vertices);
-                        }
-                        sub_interval_st = sub_interval_en + 1;
-                        
-                        /* Delete edge buffer. TODO: reuse. */
-                        if (edata != NULL) {
-                            delete edata;
-                            edata = NULL;
-                        }
-                       
-                    } // while subintervals
+                            /* Save vertices */
+                            if (!disable_vertexdata_storage) {
+                                pt = m.start_phase(phase_save);
+                                save_vertices(vertices);
+                                m.stop_phase(pt, exec_interval);
+                            }
+                            sub_interval_st = sub_interval_en + 1;
+                        } // while subintervals
+                    }
 
                     if (memoryshard->loaded() && !is_inmemory_mode()) {
                         logstream(LOG_INFO) << "Commit memshard" << std::endl;
 
+                        phase_timer pt = m.start_phase(phase_commit);
                         memoryshard->commit(modifies_inedges, modifies_outedges);
+                        m.stop_phase(pt, exec_interval);
 
                         sliding_shards[exec_interval]->set_offset(memoryshard->offset_for_stream_cont(), memoryshard->offset_vid_for_stream_cont(),
                                                                   memoryshard->edata_ptr_for_stream_cont());
@@ -834,21 +1158,22 @@ namespace graphchi {
                         delete memoryshard;
                         memoryshard = NULL;
                     }     
+                    chicontext.merge_aggregators();
                     if (!is_inmemory_mode())
                         userprogram.after_exec_interval(interval_st, interval_en, chicontext);
 
                 } // For exec_interval
                 
+                /* Write back the vertex values cached over the iteration */
+                if (!disable_vertexdata_storage)
+                    vertex_data_handler->flush();
+                
                 if (!is_inmemory_mode())  // Run sepately
                     userprogram.after_iteration(iter, chicontext);
                 
                 /* Move the sliding shard of the current interval to correct position and flush
                  writes of all shards for next iteration. */
-                for(int p=0; p<nshards; p++) {
-                    sliding_shards[p]->flush();
-                    sliding_shards[p]->set_offset(0, 0, 0);
-                }
-                iomgr->wait_for_writes();
+                rewind_sliding_shards();
                 
                 /* Write progress log */
                 write_delta_log();
@@ -865,6 +1190,19 @@ namespace graphchi {
             if (preload_commit)
               iomgr->commit_preloaded();
             
+            /* Vertex data file is up to date when run() returns */
+            vertex_data_handler->flush();
+            iomgr->wait_for_writes();
+            
+            /* Release the window buffers */
+            size_t edgebuffer_bytes = 0;
+            for(int i=0; i < 2; i++) {
+                edgebuffer_bytes += windowbufs[i].edgebuffer.capacity_bytes();
+                windowbufs[i].edgebuffer.release();
+                std::vector<svertex_t>().swap(windowbufs[i].vertices);
+            }
+            m.set("edgebuffer_bytes", edgebuffer_bytes);
+            
             m.stop_time("runtime");
             
             m.set("updates", nupdates);
@@ -922,7 +1260,17 @@ namespace graphchi {
         void set_membudget_mb(int mbs) {
             membudget_mb = mbs;
         }
-        
+
+        /**
+         * Set the amount of memory, taken from the memory budget, for
+         * caching vertex values. Default is 0 (no cache). Must be
+         * called before run().
+         * @param mbs amount of memory to be used.
+         */
+        void set_vertexcache_mb(int mbs) {
+            vertexcache_mb = mbs;
+        }
+
         
         void set_load_threads(int lt) {
             load_threads = lt;
@@ -961,6 +1309,15 @@ namespace graphchi {
             maxwindow = _maxwindow;
         }; 
         
+        /**
+         * Sets whether the loading of the next sub-interval is overlapped with
+         * the updates of the current one. Default false (command-line
+         * argument 'pipelined').
+         */
+        void set_pipelined(bool b) {
+            pipelined = b;
+        }
+        
     protected:
               
         virtual void _load_vertex_intervals() {
@@ -0,0 +1,517 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Engine for graphs that fit in memory. The shards are read once to
+ * an in-memory graph: the edge values of all shards in one array, the
+ * out-edges of the vertices in CSR order and the in-edges in CSC order.
+ * All iterations then run on the same vertex objects without any I/O.
+ * Vertex and edge data are written back to the files when the run finishes.
+ *
+ * For deterministic parallelism, the vertices are colored greedily so that
+ * no two adjacent vertices have the same color. The colors are executed
+ * one after another, and the vertices of a color in parallel.
+ */
+
+#ifndef DEF_GRAPHCHI_INMEMORY_ENGINE
+#define DEF_GRAPHCHI_INMEMORY_ENGINE
+
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <omp.h>
+
+#include "engine/graphchi_engine.hpp"
+#include "logger/logger.hpp"
+#include "shards/adjacency_codec.hpp"
+#include "util/ioutil.hpp"
+
+#ifdef DYNAMICEDATA
+#error "graphchi_inmemory_engine does not support dynamic edge data"
+#endif
+
+namespace graphchi {
+
+    template <typename VertexDataType, typename EdgeDataType,
+    typename svertex_t = graphchi_vertex<VertexDataType, EdgeDataType> >
+    class graphchi_inmemory_engine : public graphchi_engine<VertexDataType, EdgeDataType, svertex_t> {
+    public:
+        typedef graphchi_engine<VertexDataType, EdgeDataType, svertex_t> base_engine;
+
+        graphchi_inmemory_engine(std::string base_filename, int nshards, bool selective_scheduling, metrics &_m) :
+        graphchi_engine<VertexDataType, EdgeDataType, svertex_t>(base_filename, nshards, selective_scheduling, _m) {
+            _m.set("engine", "inmemory");
+            edgevalues = NULL;
+            inedges = NULL;
+            outedges = NULL;
+            built = false;
+            nedges_total = 0;
+            min_parallel_color = 256;
+        }
+
+        virtual ~graphchi_inmemory_engine() {
+            if (edgevalues != NULL) free(edgevalues);
+            if (inedges != NULL) free(inedges);
+            if (outedges != NULL) free(outedges);
+        }
+
+    protected:
+
+        /* Edge values of all shards, shard after shard */
+        EdgeDataType * edgevalues;
+        std::vector<size_t> shard_edge_start;
+        std::vector<std::vector<int> > block_codecs;
+
+        /* In-edges (CSC) and out-edges (CSR) of the vertices */
+        graphchi_edge<EdgeDataType> * inedges;
+        graphchi_edge<EdgeDataType> * outedges;
+
+        /* Vertices ordered by color. Color c is [color_start[c], color_start[c + 1]). */
+        std::vector<svertex_t> vertices;
+        std::vector<int> color_start;
+
+        bool built;
+        size_t nedges_total;
+
+        /* Colors smaller than this are run by one thread */
+        int min_parallel_color;
+
+        std::string edata_filename(int p) {
+            return filename_shard_edata<EdgeDataType>(this->base_filename, p, this->nshards);
+        }
+
+        size_t shard_edata_bytes(int p) {
+            return (shard_edge_start[p + 1] - shard_edge_start[p]) * sizeof(EdgeDataType);
+        }
+
+        char * block_ptr(int p, int b) {
+            return (char *) (edgevalues + shard_edge_start[p]) + (size_t)b * this->blocksize;
+        }
+
+        size_t block_len(int p, int b) {
+            return std::min(this->blocksize, shard_edata_bytes(p) - (size_t)b * this->blocksize);
+        }
+
+        /**
+         * Reads the edge data blocks of all shards to the edge value array.
+         */
+        void load_edge_values() {
+            int nshards = this->nshards;
+            shard_edge_start.assign(nshards + 1, 0);
+            for(int p=0; p < nshards; p++) {
+                shard_edge_start[p + 1] = shard_edge_start[p] +
+                    get_shard_edata_filesize<EdgeDataType>(edata_filename(p)) / sizeof(EdgeDataType);
+            }
+            edgevalues = (EdgeDataType *) malloc(std::max(shard_edge_start[nshards], (size_t)1) * sizeof(EdgeDataType));
+            assert(edgevalues != NULL);
+
+            std::vector<std::pair<int, int> > blocks;
+            block_codecs.resize(nshards);
+            for(int p=0; p < nshards; p++) {
+                size_t bytes = shard_edata_bytes(p);
+                int nblocks = (int) (bytes / this->blocksize + (bytes % this->blocksize != 0));
+                block_codecs[p].assign(nblocks, -1);
+                for(int b=0; b < nblocks; b++) blocks.push_back(std::pair<int, int>(p, b));
+            }
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(this->load_threads)
+            for(int i=0; i < (int)blocks.size(); i++) {
+                int p = blocks[i].first;
+                int b = blocks[i].second;
+                std::string block_filename = filename_shard_edata_block(edata_filename(p), b, this->blocksize);
+                int f = open(block_filename.c_str(), O_RDONLY);
+                if (f < 0) {
+                    logstream(LOG_ERROR) << "Could not open edge data block: " << block_filename << std::endl;
+                    assert(f >= 0);
+                }
+                block_codecs[p][b] = read_compressed(f, block_ptr(p, b), block_len(p, b));
+                close(f);
+            }
+        }
+
+        /**
+         * Writes the edge values back to the shard blocks, each block
+         * with the codec it was read with.
+         */
+        void commit_edge_values() {
+            std::vector<std::pair<int, int> > blocks;
+            for(int p=0; p < this->nshards; p++) {
+                for(int b=0; b < (int)block_codecs[p].size(); b++) blocks.push_back(std::pair<int, int>(p, b));
+            }
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(this->load_threads)
+            for(int i=0; i < (int)blocks.size(); i++) {
+                int p = blocks[i].first;
+                int b = blocks[i].second;
+                std::string block_filename = filename_shard_edata_block(edata_filename(p), b, this->blocksize);
+                int f = open(block_filename.c_str(), O_WRONLY);
+                assert(f >= 0);
+                write_compressed(f, block_ptr(p, b), block_len(p, b), block_codecs[p][b]);
+                close(f);
+            }
+        }
+
+        /**
+         * Adds the edges of a shard to the vertices. Shards are read in order, so the
+         * out-edges of a vertex are sorted by the destination and the in-edges by the source,
+         * as in the disk-based engine.
+         */
+        void load_shard_adjacency(int p, std::vector<svertex_t> &byid, std::vector<vid_t> &nbrbuf) {
+            std::string adj_filename = filename_shard_adj(this->base_filename, p, this->nshards);
+            int f = open(adj_filename.c_str(), O_RDONLY);
+            if (f < 0) {
+                logstream(LOG_ERROR) << "Could not open shard adjacency: " << adj_filename << std::endl;
+                assert(f >= 0);
+            }
+            char * adjdata = NULL;
+            size_t adjsize = readfull(f, &adjdata);
+            close(f);
+
+            uint8_t * ptr = (uint8_t *) adjdata;
+            uint8_t * end = ptr + adjsize;
+            bool svb = is_svb_adjacency_header(ptr, adjsize);
+            if (svb) ptr += SVB_ADJ_HEADER_SIZE;
+
+            EdgeDataType * evals = (this->only_adjacency ? NULL : edgevalues + shard_edge_start[p]);
+            size_t edgeidx = 0;
+            vid_t vid = 0;
+            size_t nvertices = byid.size();
+            while (ptr < end) {
+                uint8_t ns = *ptr;
+                ptr += sizeof(uint8_t);
+                if (ns == 0x00) {
+                    uint8_t nz = *ptr;
+                    ptr += sizeof(uint8_t);
+                    vid += 1 + nz;
+                    continue;
+                }
+                int n;
+                if (ns == 0xff) {
+                    n = *((uint32_t *) ptr);
+                    ptr += sizeof(uint32_t);
+                } else {
+                    n = ns;
+                }
+                vid_t * nbrs;
+                if (svb) {
+                    if (nbrbuf.size() < (size_t) n) nbrbuf.resize(n);
+                    nbrs = &nbrbuf[0];
+                    ptr += svb_decode_neighbors(ptr, n, end, nbrs);
+                } else {
+                    nbrs = (vid_t *) ptr;
+                    ptr += n * sizeof(vid_t);
+                }
+                assert(vid < nvertices);
+                svertex_t &src = byid[vid];
+                for(int i=0; i < n; i++) {
+                    vid_t dst = nbrs[i];
+                    assert(dst < nvertices);
+                    EdgeDataType * eptr = (evals == NULL ? NULL : &evals[edgeidx]);
+                    src.add_outedge(dst, eptr, false);
+                    byid[dst].add_inedge(vid, eptr, false);
+                    edgeidx++;
+                }
+                vid++;
+            }
+            free(adjdata);
+            assert(this->only_adjacency || edgeidx == shard_edge_start[p + 1] - shard_edge_start[p]);
+        }
+
+        /**
+         * Greedy coloring in vertex id order: each vertex gets the smallest color
+         * that none of its lower-id neighbors has. Returns the number of colors.
+         */
+        int color_vertices(std::vector<svertex_t> &byid, std::vector<int> &color) {
+            size_t nvertices = byid.size();
+            std::vector<size_t> mark; // mark[c] == v if a neighbor of v has color c
+            int ncolors = 1;
+            for(size_t v=0; v < nvertices; v++) {
+                svertex_t &vertex = byid[v];
+                for(int i=0; i < vertex.num_edges(); i++) {
+                    vid_t nbr = vertex.edge(i)->vertex_id();
+                    if (nbr >= v) continue;
+                    int c = color[nbr];
+                    if (c >= (int)mark.size()) mark.resize(c + 1, (size_t)(-1));
+                    mark[c] = v;
+                }
+                int c = 0;
+                while (c < (int)mark.size() && mark[c] == v) c++;
+                color[v] = c;
+                if (c + 1 > ncolors) ncolors = c + 1;
+            }
+            return ncolors;
+        }
+
+        /**
+         * Builds the in-memory graph from the shards.
+         */
+        void build_graph() {
+            metrics_entry me = this->m.start_time();
+            size_t nvertices = this->num_vertices();
+            logstream(LOG_INFO) << "Building in-memory graph of " << nvertices << " vertices." << std::endl;
+
+            /* Edge array offsets from the vertex degrees */
+            this->degree_handler->load(0, (vid_t) (nvertices - 1));
+            std::vector<size_t> inoff(nvertices + 1, 0);
+            std::vector<size_t> outoff(nvertices + 1, 0);
+            for(size_t v=0; v < nvertices; v++) {
+                degree d = this->degree_handler->get_degree((vid_t) v);
+                inoff[v + 1] = inoff[v] + d.indegree;
+                outoff[v + 1] = outoff[v] + d.outdegree;
+            }
+            nedges_total = outoff[nvertices];
+            assert(inoff[nvertices] == nedges_total);
+            inedges = (graphchi_edge<EdgeDataType> *) malloc(std::max(nedges_total, (size_t)1) * sizeof(graphchi_edge<EdgeDataType>));
+            outedges = (graphchi_edge<EdgeDataType> *) malloc(std::max(nedges_total, (size_t)1) * sizeof(graphchi_edge<EdgeDataType>));
+            assert(inedges != NULL && outedges != NULL);
+
+            if (!this->only_adjacency) {
+                metrics_entry lm = this->m.start_time();
+                load_edge_values();
+                this->m.stop_time(lm, "inmemory_load_edata");
+                if (shard_edge_start[this->nshards] != nedges_total) {
+                    logstream(LOG_ERROR) << "Shards have " << shard_edge_start[this->nshards] << " edges, but degree file has "
+                        << nedges_total << ". Perhaps a preprocessing step had failed?" << std::endl;
+                    assert(false);
+                }
+            }
+
+            std::vector<svertex_t> byid(nvertices);
+            for(size_t v=0; v < nvertices; v++) {
+                byid[v] = svertex_t((vid_t) v, &inedges[inoff[v]], &outedges[outoff[v]],
+                                    (int) (inoff[v + 1] - inoff[v]), (int) (outoff[v + 1] - outoff[v]));
+                byid[v].scheduled = true;
+            }
+            std::vector<vid_t> nbrbuf;
+            for(int p=0; p < this->nshards; p++) {
+                load_shard_adjacency(p, byid, nbrbuf);
+            }
+
+            /* Vertices ordered by color. Coloring is needed only if several
+               threads run the updates deterministically. */
+            std::vector<int> color(nvertices, 0);
+            int ncolors = 1;
+            if (this->exec_threads > 1 && this->enable_deterministic_parallelism) {
+                ncolors = color_vertices(byid, color);
+            }
+            color_start.assign(ncolors + 1, 0);
+            for(size_t v=0; v < nvertices; v++) color_start[color[v] + 1]++;
+            for(int c=0; c < ncolors; c++) color_start[c + 1] += color_start[c];
+            std::vector<int> pos(color_start.begin(), color_start.end() - 1);
+            vertices.resize(nvertices);
+            for(size_t v=0; v < nvertices; v++) {
+                vertices[pos[color[v]]++] = byid[v];
+            }
+
+            built = true;
+            this->m.set("inmemory.colors", (size_t) ncolors);
+            this->m.set("inmemory.bytes", nedges_total * (2 * sizeof(graphchi_edge<EdgeDataType>) + sizeof(EdgeDataType)) +
+                        nvertices * (sizeof(svertex_t) + sizeof(VertexDataType)));
+            this->m.stop_time(me, "inmemory_build");
+            logstream(LOG_INFO) << "In-memory graph: " << nedges_total << " edges, " << ncolors << " colors." << std::endl;
+        }
+
+        /**
+         * Sets the scheduled flags from the scheduler and clears the tasks.
+         */
+        void schedule_vertices() {
+            size_t nupd = 0;
+            size_t wrk = 0;
+            int nvertices = (int) vertices.size();
+            bitset_scheduler * scheduler = this->scheduler;
+#pragma omp parallel for reduction(+:nupd,wrk) num_threads(this->exec_threads)
+            for(int i=0; i < nvertices; i++) {
+                svertex_t &v = vertices[i];
+                v.scheduled = (scheduler == NULL || scheduler->is_scheduled(v.id()));
+                if (v.scheduled) {
+                    nupd++;
+                    wrk += v.num_edges();
+                }
+            }
+            if (scheduler != NULL) {
+                scheduler->remove_tasks(0, (int) this->num_vertices() - 1);
+            }
+            this->nupdates += nupd;
+            this->work += wrk;
+        }
+
+        void exec_updates_colored(GraphChiProgram<VertexDataType, EdgeDataType, svertex_t> &userprogram) {
+            metrics_entry me = this->m.start_time();
+            int exec_threads = this->exec_threads;
+            graphchi_context &chicontext = this->chicontext;
+            int ncolors = (int) color_start.size() - 1;
+            for(int c=0; c < ncolors; c++) {
+                int first = color_start[c];
+                int last = color_start[c + 1];
+                if (exec_threads == 1 || last - first < min_parallel_color) {
+                    for(int i=first; i < last; i++) {
+                        if (vertices[i].scheduled) userprogram.update(vertices[i], chicontext);
+                    }
+                    continue;
+                }
+                this->update_chunks.build(vertices, first, last, exec_threads, 0, false);
+#pragma omp parallel num_threads(exec_threads)
+                {
+                    int thread = omp_get_thread_num();
+                    update_chunk chunk;
+                    while (this->update_chunks.next(thread, chunk)) {
+                        for(int i=chunk.first; i < chunk.last; i++) {
+                            if (vertices[i].scheduled) userprogram.update(vertices[i], chicontext);
+                        }
+                    }
+                }
+            }
+            this->m.stop_time(me, "execute-updates");
+        }
+
+    public:
+
+        virtual size_t num_edges() {
+            if (!built) {
+                logstream(LOG_ERROR) << "engine.num_edges() can be called only after engine has been started." << std::endl;
+                assert(false);
+            }
+            return nedges_total;
+        }
+
+        /**
+         * Run GraphChi program, specified as a template
+         * parameter.
+         * @param niters number of iterations
+         */
+        void run(GraphChiProgram<VertexDataType, EdgeDataType, svertex_t> &userprogram, int _niters) {
+            metrics &m = this->m;
+            graphchi_context &chicontext = this->chicontext;
+            m.start_time("runtime");
+            if (this->degree_handler == NULL)
+                this->degree_handler = this->create_degree_handler();
+
+            this->niters = _niters;
+            logstream(LOG_INFO) << "GraphChi starting (in-memory engine)" << std::endl;
+            logstream(LOG_INFO) << "Licensed under the Apache License 2.0" << std::endl;
+            logstream(LOG_INFO) << "Copyright Aapo Kyrola et al., Carnegie Mellon University (2012)" << std::endl;
+
+            if (this->vertex_data_handler == NULL)
+                this->vertex_data_handler = new vertex_data_store<VertexDataType>(this->base_filename, this->num_vertices(), this->iomgr);
+
+            this->initialize_before_run();
+
+            if (!built) {
+                build_graph();
+            } else {
+                logstream(LOG_DEBUG) << "Engine being restarted, do not rebuild." << std::endl;
+            }
+
+            /* All vertex data stays in memory during the run */
+            if (!this->disable_vertexdata_storage) {
+                this->vertex_data_handler->check_size(this->num_vertices());
+                this->vertex_data_handler->load(0, (vid_t) (this->num_vertices() - 1));
+                for(int i=0; i < (int)vertices.size(); i++) {
+                    vertices[i].dataptr = this->vertex_data_handler->vertex_data_ptr(vertices[i].id());
+                }
+            }
+
+            this->initialize_scheduler();
+            chicontext.scheduler = this->scheduler;
+            if (this->scheduler == NULL) {
+                chicontext.scheduler = new non_scheduler();
+            }
+
+            this->print_config();
+
+            /* Main loop */
+            for(this->iter=0; this->iter < this->niters; this->iter++) {
+                int iter = this->iter;
+                logstream(LOG_INFO) << "Start iteration: " << iter << std::endl;
+
+                this->initialize_iter();
+
+                chicontext.filename = this->base_filename;
+                chicontext.iteration = iter;
+                chicontext.num_iterations = this->niters;
+                chicontext.nvertices = this->num_vertices();
+                if (!this->only_adjacency) chicontext.nedges = num_edges();
+                chicontext.execthreads = this->exec_threads;
+                chicontext.reset_deltas(this->exec_threads);
+
+                userprogram.before_iteration(iter, chicontext);
+
+                if (this->use_selective_scheduling && this->scheduler != NULL) {
+                    if (!this->scheduler->has_new_tasks) {
+                        logstream(LOG_INFO) << "No new tasks to run!" << std::endl;
+                        break;
+                    }
+                    this->scheduler->has_new_tasks = false;
+                }
+
+                schedule_vertices();
+
+                userprogram.before_exec_interval(0, (vid_t) (this->num_vertices() - 1), chicontext);
+                exec_updates_colored(userprogram);
+                chicontext.merge_aggregators();
+                userprogram.after_exec_interval(0, (vid_t) (this->num_vertices() - 1), chicontext);
+
+                userprogram.after_iteration(iter, chicontext);
+
+                this->write_delta_log();
+
+                /* Check if user has defined a last iteration */
+                if (chicontext.last_iteration >= 0) {
+                    this->niters = chicontext.last_iteration + 1;
+                    logstream(LOG_DEBUG) << "Last iteration is now: " << (this->niters - 1) << std::endl;
+                }
+                this->iteration_finished();
+            }
+
+            /* Write the results back */
+            metrics_entry cm = m.start_time();
+            if (!this->disable_vertexdata_storage) {
+                this->vertex_data_handler->save();
+            }
+            if (!this->only_adjacency && (this->modifies_inedges || this->modifies_outedges)) {
+                commit_edge_values();
+            }
+            m.stop_time(cm, "inmemory_commit");
+
+            m.stop_time("runtime");
+
+            m.set("updates", this->nupdates);
+            m.set("work", this->work);
+            m.set("nvertices", this->num_vertices());
+            m.set("execthreads", (size_t)this->exec_threads);
+            m.set("loadthreads", (size_t)this->load_threads);
+#ifndef GRAPHCHI_DISABLE_COMPRESSION
+            m.set("compression", 1);
+#endif
+            m.set("scheduler", (size_t)this->use_selective_scheduling);
+            m.set("niters", this->niters);
+        }
+
+    };
+
+}
+
+#endif
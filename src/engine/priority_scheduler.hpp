@@ -0,0 +1,165 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ 
+ *
+ * @section DESCRIPTION
+ *
+ * Priority scheduler. Each vertex has a pending priority, typically the
+ * (non-negative) residual accumulated from its neighbors, as in
+ * delta-PageRank. A vertex is scheduled when its priority reaches the
+ * threshold, and running the vertex consumes the priority. The priority mass is also summed per block
+ * of vertices (the blocks of the bitset scheduler), so that the engine can skip windows and intervals whose
+ * pending mass is too small, and run the intervals with most mass first.
+ */
+
+#ifndef DEF_GRAPHCHI_PRIORITYSCHEDULER
+#define DEF_GRAPHCHI_PRIORITYSCHEDULER
+
+#include <vector>
+#include <algorithm>
+
+#include "graphchi_types.hpp"
+#include "engine/bitset_scheduler.hpp"
+#include "util/atomic.hpp"
+
+namespace graphchi {
+    
+    /* Atomically adds delta to a, returns the old value */
+    template <typename T>
+    inline T atomic_add_fp(T &a, T delta) {
+        T oldval, newval;
+        do {
+            oldval = a;
+            newval = oldval + delta;
+        } while (!atomic_compare_and_swap(a, oldval, newval));
+        return oldval;
+    }
+    
+    class priority_scheduler : public bitset_scheduler {
+    private:
+        std::vector<float> priority;
+        std::vector<double> blockmass;
+        float threshold;
+        double window_threshold;
+        
+        void recompute_blockmass() {
+            std::fill(blockmass.begin(), blockmass.end(), 0.0);
+            for(size_t v=0; v < priority.size(); v++) {
+                blockmass[block_of((vid_t) v)] += priority[v];
+            }
+        }
+        
+    public:
+        /**
+         * @param threshold minimum priority of a scheduled vertex
+         * @param window_threshold minimum pending priority mass of an interval
+         *        to be executed. Vertices of skipped intervals keep their priority.
+         */
+        priority_scheduler(int nvertices, float threshold, double window_threshold) :
+            bitset_scheduler(nvertices), threshold(threshold), window_threshold(window_threshold) {
+            priority.resize(nvertices, 0.0f);
+            blockmass.resize(block_of(nvertices) + 1, 0.0);
+        }
+        
+        virtual ~priority_scheduler() {}
+        
+        /**
+         * Explicitly added tasks have priority 1.
+         */
+        void add_task(vid_t vertex) {
+            add_priority(vertex, 1.0f);
+        }
+        
+        void add_priority(vid_t vertex, float delta) {
+            float oldp = atomic_add_fp(priority[vertex], delta);
+            atomic_add_fp(blockmass[block_of(vertex)], (double) delta);
+            float newp = oldp + delta;
+            if (newp >= threshold && newp > 0) {
+                if (set_scheduled(vertex)) has_new_tasks = true;
+            }
+        }
+        
+        float get_priority(vid_t vertex) {
+            return priority[vertex];
+        }
+        
+        void resize(vid_t maxsize) {
+            bitset_scheduler::resize(maxsize);
+            priority.resize(maxsize, 0.0f);
+            blockmass.resize(block_of(maxsize) + 1, 0.0);
+        }
+        
+        /**
+         * Consumes the priority of the scheduled vertices. Not thread-safe
+         * with add_priority() for the same vertices.
+         */
+        void remove_tasks(vid_t fromvertex, vid_t tovertex) {
+            for(vid_t v=next_scheduled(fromvertex, tovertex); v <= tovertex; v=next_scheduled(v + 1, tovertex)) {
+                blockmass[block_of(v)] -= priority[v];
+                priority[v] = 0.0f;
+                if (v == tovertex) break;
+            }
+            bitset_scheduler::remove_tasks(fromvertex, tovertex);
+        }
+        
+        void add_task_to_all() {
+            for(size_t v=0; v < priority.size(); v++) {
+                priority[v] = std::max(priority[v], 1.0f);
+            }
+            recompute_blockmass();
+            bitset_scheduler::add_task_to_all();
+        }
+        
+        bool is_any_scheduled(vid_t fromvertex, vid_t tovertex) {
+            if (window_threshold > 0 && pending_priority(fromvertex, tovertex) < window_threshold) {
+                return false;
+            }
+            return bitset_scheduler::is_any_scheduled(fromvertex, tovertex);
+        }
+        
+        /**
+         * Sum of the pending priorities of an interval. Whole blocks are
+         * summed from the block masses.
+         */
+        double pending_priority(vid_t fromvertex, vid_t tovertex) {
+            double mass = 0.0;
+            vid_t v = fromvertex;
+            while (v <= tovertex) {
+                size_t b = block_of(v);
+                vid_t blockend = block_last(b);
+                if ((v & ((1 << SCHEDULER_BLOCK_BITS) - 1)) == 0 && blockend <= tovertex) {
+                    mass += blockmass[b];
+                } else {
+                    vid_t en = std::min(blockend, tovertex);
+                    for(vid_t u=v; u <= en; u++) mass += priority[u];
+                }
+                if (blockend >= tovertex) break;
+                v = blockend + 1;
+            }
+            return mass;
+        }
+    };
+    
+}
+
+
+#endif
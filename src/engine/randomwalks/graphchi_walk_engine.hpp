@@ -0,0 +1,334 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Engine for simulating random walks on a sharded graph (DrunkardMob).
+ * Walks are not stored on the edges: the walk manager keeps them in
+ * buckets by interval, and when a window is loaded, the walks at its vertices
+ * are advanced over the out-edges of the window. A walk continues in the
+ * window as long as it stays on vertices of the window, and is otherwise
+ * moved to the bucket of the interval of its next vertex. Only the
+ * adjacency of the shards is read, and nothing is written to them.
+ *
+ * The number of visits to each vertex is stored as its vertex value.
+ * Optionally, the visits are also counted by the source of the walk, for
+ * personalized PageRank.
+ */
+
+#ifndef DEF_GRAPHCHI_WALK_ENGINE
+#define DEF_GRAPHCHI_WALK_ENGINE
+
+#include <stdio.h>
+#include <omp.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "api/thread_aggregator.hpp"
+#include "engine/graphchi_engine.hpp"
+#include "engine/randomwalks/walk_manager.hpp"
+#include "logger/logger.hpp"
+
+namespace graphchi {
+
+    template <typename EdgeDataType>
+    class graphchi_walk_engine : public graphchi_engine<unsigned int, EdgeDataType> {
+    public:
+        typedef graphchi_engine<unsigned int, EdgeDataType> base_engine;
+        typedef graphchi_vertex<unsigned int, EdgeDataType> svertex_t;
+        typedef std::pair<vid_t, uint32_t> visit_count;
+
+    protected:
+
+        /**
+         * Calls back the engine when an interval starts and ends.
+         * Vertices are not updated.
+         */
+        struct interval_hooks : public GraphChiProgram<unsigned int, EdgeDataType> {
+            graphchi_walk_engine * engine;
+            interval_hooks(graphchi_walk_engine * engine) : engine(engine) {}
+
+            void before_exec_interval(vid_t window_st, vid_t window_en, graphchi_context &gcontext) {
+                engine->begin_interval();
+            }
+            void after_exec_interval(vid_t window_st, vid_t window_en, graphchi_context &gcontext) {
+                engine->end_interval();
+            }
+            void update(svertex_t &v, graphchi_context &gcontext) {}
+        };
+
+        walk_manager walks;
+        std::vector< padded_value<walk_rng> > rngs;
+
+        std::vector<vid_t> sources;
+        int walks_per_source;
+        uint32_t walk_length;
+        double reset_prob;
+
+        /* Personalized PageRank: visits by source, sorted by vertex */
+        bool count_by_source;
+        std::vector< std::vector<uint64_t> > source_visits;
+        std::vector< std::vector<visit_count> > ppr;
+
+    public:
+
+        graphchi_walk_engine(std::string base_filename, int nshards, metrics &_m) :
+                base_engine(base_filename, nshards, true, _m) {
+            _m.set("engine", "randomwalks");
+            walks_per_source = get_option_int("walks.per_source", 100);
+            walk_length = (uint32_t) get_option_int("walks.length", 10);
+            reset_prob = get_option_float("walks.reset_prob", 0.0);
+            count_by_source = false;
+            assert(walk_length <= WALK_MAX_HOPS);
+            this->set_only_adjacency(true);
+            this->set_modifies_inedges(false);
+            this->set_modifies_outedges(false);
+            this->set_reset_vertexdata(true);
+        }
+
+        void add_source(vid_t v) {
+            assert(sources.size() < WALK_MAX_SOURCES);
+            sources.push_back(v);
+        }
+
+        void set_walks_per_source(int n) {
+            walks_per_source = n;
+        }
+
+        void set_walk_length(int len) {
+            assert(len <= WALK_MAX_HOPS);
+            walk_length = (uint32_t) len;
+        }
+
+        /**
+         * Probability that a walk jumps back to its source on a hop.
+         * Walks at vertices without out-edges always jump back.
+         */
+        void set_reset_prob(double p) {
+            reset_prob = p;
+        }
+
+        /**
+         * Count the visits of each source's walks separately.
+         */
+        void set_count_by_source(bool b) {
+            count_by_source = b;
+        }
+
+        /**
+         * Runs the walks until they have all finished, or for niters iterations.
+         */
+        void run(int niters) {
+            walks.init(this->exec_threads, this->intervals);
+            rngs.resize(this->exec_threads);
+            for(int t=0; t < this->exec_threads; t++) {
+                rngs[t].val = walk_rng(get_option_int("walks.seed", 1) * 1000003ULL + t);
+            }
+            source_visits.assign(this->exec_threads, std::vector<uint64_t>());
+            ppr.assign(count_by_source ? sources.size() : 0, std::vector<visit_count>());
+
+            for(uint32_t s=0; s < (uint32_t) sources.size(); s++) {
+                for(int j=0; j < walks_per_source; j++) {
+                    walks.add_walk(0, make_walk(sources[s], s, 0));
+                }
+            }
+            logstream(LOG_INFO) << "Starting " << sources.size() * walks_per_source << " walks of length "
+                << walk_length << ", reset probability " << reset_prob << std::endl;
+
+            interval_hooks hooks(this);
+            base_engine::run(hooks, niters);
+
+            if (walks.num_walks() > 0) {
+                logstream(LOG_WARNING) << walks.num_walks() << " walks did not finish in " << niters << " iterations" << std::endl;
+            }
+        }
+
+        /**
+         * Visits of the walks started from the source with given index,
+         * sorted by vertex. Requires set_count_by_source(true).
+         */
+        const std::vector<visit_count> &visits_by_source(int sourceidx) {
+            return ppr[sourceidx];
+        }
+
+        /**
+         * Writes the ntop most visited vertices of each source to a text
+         * file with lines "source vertex visits".
+         */
+        void write_top_visits(std::string filename, int ntop) {
+            FILE * f = fopen(filename.c_str(), "w");
+            assert(f != NULL);
+            std::vector<visit_count> top;
+            for(int s=0; s < (int) ppr.size(); s++) {
+                top = ppr[s];
+                int n = std::min(ntop, (int) top.size());
+                std::partial_sort(top.begin(), top.begin() + n, top.end(), more_visits);
+                for(int i=0; i < n; i++) {
+                    fprintf(f, "%u %u %u\n", sources[s], top[i].first, top[i].second);
+                }
+            }
+            fclose(f);
+        }
+
+    protected:
+
+        static bool more_visits(const visit_count &a, const visit_count &b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        }
+
+        /* Walks must run also if there is only one shard */
+        virtual bool is_inmemory_mode() {
+            return false;
+        }
+
+        /* Nothing is scheduled before the walks are */
+        virtual void initialize_scheduler() {
+            base_engine::initialize_scheduler();
+            this->scheduler->remove_tasks(0, (vid_t) this->num_vertices() - 1);
+            this->scheduler->has_new_tasks = true;
+        }
+
+        /**
+         * Collects the walks of the interval and schedules their vertices.
+         */
+        void begin_interval() {
+            size_t n = walks.gather(this->exec_interval);
+            std::vector<walk_t> &cur = walks.current_walks();
+            vid_t prev = (vid_t) -1;
+            for(size_t i=0; i < n; i++) {
+                vid_t v = walk_vertex(cur[i]);
+                if (v != prev) this->scheduler->add_task(v);
+                prev = v;
+            }
+            this->m.add("walks-gathered", (double) n);
+        }
+
+        void end_interval() {
+            walks.current_walks().clear();
+            if (count_by_source) merge_source_visits();
+        }
+
+        /**
+         * Advances the walks of the window, instead of executing updates.
+         */
+        virtual void exec_updates(GraphChiProgram<unsigned int, EdgeDataType> &userprogram,
+                                  std::vector<svertex_t> &vertices) {
+            metrics_entry me = this->m.start_time();
+            vid_t st = this->sub_interval_st;
+            vid_t en = this->sub_interval_en;
+            std::pair<size_t, size_t> range = walks.current_range(st, en);
+            std::vector<walk_t> &cur = walks.current_walks();
+            long first = (long) range.first, last = (long) range.second;
+            size_t nsteps = 0;
+
+#pragma omp parallel num_threads(this->exec_threads) reduction(+:nsteps)
+            {
+                int thread = omp_get_thread_num();
+                walk_rng rng = rngs[thread].val;
+#pragma omp for schedule(dynamic, 4096)
+                for(long i=first; i < last; i++) {
+                    nsteps += advance(thread, rng, cur[i], st, en, vertices);
+                }
+                rngs[thread].val = rng;
+            }
+            this->nupdates += last - first;
+            this->m.add("walk-steps", (double) nsteps);
+            this->m.stop_time(me, "execute-walks");
+        }
+
+        /**
+         * Moves a walk until it leaves the window or finishes.
+         * @return the number of hops taken
+         */
+        inline size_t advance(int thread, walk_rng &rng, walk_t w, vid_t st, vid_t en, std::vector<svertex_t> &vertices) {
+            size_t nhops = 0;
+            while (true) {
+                vid_t v = walk_vertex(w);
+                uint32_t src = walk_source(w);
+                uint32_t hops = walk_hops(w);
+                svertex_t &vertex = vertices[v - st];
+                if (hops > 0) {
+                    __sync_fetch_and_add(this->vertex_data_handler->vertex_data_ptr(v), 1);
+                    vertex.modified = true;
+                    if (count_by_source) source_visits[thread].push_back(((uint64_t) src << 32) | v);
+                }
+                if (hops >= walk_length) return nhops;
+
+                int outc = vertex.num_outedges();
+                vid_t next;
+                if (outc == 0 || (reset_prob > 0 && rng.next_double() < reset_prob)) {
+                    next = sources[src];
+                } else {
+                    next = vertex.outedge(rng.next_index(outc))->vertex_id();
+                }
+                w = make_walk(next, src, hops + 1);
+                nhops++;
+                if (next < st || next > en || !vertices[next - st].scheduled) {
+                    walks.add_walk(thread, w);
+                    return nhops;
+                }
+            }
+        }
+
+        struct visit_key {
+            uint64_t operator()(uint64_t x) const { return x; }
+        };
+
+        /**
+         * Adds the visits recorded by the threads to the counts by source.
+         */
+        void merge_source_visits() {
+            std::vector<uint64_t> all;
+            for(int t=0; t < (int) source_visits.size(); t++) {
+                all.insert(all.end(), source_visits[t].begin(), source_visits[t].end());
+                source_visits[t].clear();
+            }
+            if (all.empty()) return;
+            radixSort(&all[0], all.size(), 32 + WALK_SOURCE_BITS, visit_key(), this->exec_threads);
+
+            std::vector<visit_count> merged;
+            size_t i = 0;
+            while (i < all.size()) {
+                uint32_t src = (uint32_t) (all[i] >> 32);
+                std::vector<visit_count> &counts = ppr[src];
+                merged.clear();
+                size_t j = 0;
+                while (i < all.size() && (uint32_t) (all[i] >> 32) == src) {
+                    vid_t v = (vid_t) all[i];
+                    uint32_t c = 0;
+                    while (i < all.size() && all[i] == all[i - c]) { c++; i++; }
+                    while (j < counts.size() && counts[j].first < v) merged.push_back(counts[j++]);
+                    if (j < counts.size() && counts[j].first == v) c += counts[j++].second;
+                    merged.push_back(visit_count(v, c));
+                }
+                while (j < counts.size()) merged.push_back(counts[j++]);
+                counts.swap(merged);
+            }
+        }
+
+    };
+
+};
+
+#endif
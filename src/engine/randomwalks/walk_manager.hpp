@@ -0,0 +1,198 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Storage of random walks for the walk engine, in the manner of DrunkardMob.
+ * A walk is a 64-bit word holding its current vertex, the index of its source
+ * and the number of hops it has taken. Walks are kept in buckets by the
+ * interval of their current vertex; each thread has its own buckets, so
+ * moving a walk does not need synchronization. Before an interval is executed,
+ * the buckets of the threads are gathered and sorted by the vertex, so that
+ * the walks of a window are a contiguous range.
+ */
+
+#ifndef DEF_GRAPHCHI_WALK_MANAGER
+#define DEF_GRAPHCHI_WALK_MANAGER
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "graphchi_types.hpp"
+#include "util/radixsort.hpp"
+
+namespace graphchi {
+
+    typedef uint64_t walk_t;
+
+#define WALK_SOURCE_BITS 24
+#define WALK_HOP_BITS 8
+#define WALK_MAX_SOURCES (1 << WALK_SOURCE_BITS)
+#define WALK_MAX_HOPS ((1 << WALK_HOP_BITS) - 1)
+
+    inline walk_t make_walk(vid_t vertex, uint32_t source, uint32_t hops) {
+        return ((walk_t) vertex << 32) | ((walk_t) source << WALK_HOP_BITS) | (walk_t) hops;
+    }
+
+    inline vid_t walk_vertex(walk_t w) {
+        return (vid_t) (w >> 32);
+    }
+
+    inline uint32_t walk_source(walk_t w) {
+        return (uint32_t) (w >> WALK_HOP_BITS) & (WALK_MAX_SOURCES - 1);
+    }
+
+    inline uint32_t walk_hops(walk_t w) {
+        return (uint32_t) w & WALK_MAX_HOPS;
+    }
+
+    /**
+     * Xorshift128+ generator. Each thread has its own.
+     */
+    struct walk_rng {
+        uint64_t s[2];
+
+        walk_rng(uint64_t seed=1) {
+            /* Splitmix64 to spread the seed */
+            for(int i=0; i < 2; i++) {
+                uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                s[i] = z ^ (z >> 31);
+            }
+        }
+
+        inline uint64_t next() {
+            uint64_t x = s[0];
+            uint64_t const y = s[1];
+            s[0] = y;
+            x ^= x << 23;
+            s[1] = x ^ y ^ (x >> 17) ^ (y >> 26);
+            return s[1] + y;
+        }
+
+        /** Uniform integer in [0, n) */
+        inline uint32_t next_index(uint32_t n) {
+            return (uint32_t) (((next() >> 32) * (uint64_t) n) >> 32);
+        }
+
+        /** Uniform in [0, 1) */
+        inline double next_double() {
+            return (next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+    };
+
+    struct walk_vertex_key {
+        uint64_t operator()(walk_t w) const {
+            return w >> 32;
+        }
+    };
+
+    class walk_manager {
+
+        int nthreads;
+        int nintervals;
+        std::vector<vid_t> interval_ends;
+
+        /* buckets[thread][interval] */
+        std::vector< std::vector< std::vector<walk_t> > > buckets;
+
+        /* Walks of the interval being executed, sorted by vertex */
+        std::vector<walk_t> current;
+
+    public:
+
+        walk_manager() : nthreads(0), nintervals(0) {}
+
+        void init(int _nthreads, const std::vector< std::pair<vid_t, vid_t> > &intervals) {
+            nthreads = _nthreads;
+            nintervals = (int) intervals.size();
+            interval_ends.clear();
+            for(int i=0; i < nintervals; i++) interval_ends.push_back(intervals[i].second);
+            buckets.assign(nthreads, std::vector< std::vector<walk_t> >(nintervals));
+        }
+
+        int interval_of(vid_t v) {
+            int i = (int) (std::lower_bound(interval_ends.begin(), interval_ends.end(), v) - interval_ends.begin());
+            return std::min(i, nintervals - 1);
+        }
+
+        /**
+         * Adds a walk to the bucket of a thread. Each thread must
+         * use its own index.
+         */
+        inline void add_walk(int thread, walk_t w) {
+            buckets[thread][interval_of(walk_vertex(w))].push_back(w);
+        }
+
+        /**
+         * Moves the walks of an interval from the thread buckets
+         * to the current walks, sorted by the vertex.
+         * @return number of walks
+         */
+        size_t gather(int interval) {
+            size_t n = 0;
+            for(int t=0; t < nthreads; t++) n += buckets[t][interval].size();
+            current.clear();
+            current.reserve(n);
+            for(int t=0; t < nthreads; t++) {
+                std::vector<walk_t> &b = buckets[t][interval];
+                current.insert(current.end(), b.begin(), b.end());
+                /* Keep the capacity: walks keep flowing to the same buckets */
+                b.clear();
+            }
+            if (n > 0) {
+                radixSort(&current[0], n, 32, walk_vertex_key(), nthreads);
+            }
+            return n;
+        }
+
+        std::vector<walk_t> &current_walks() {
+            return current;
+        }
+
+        /**
+         * Range [first, last) of the current walks at vertices st..en.
+         */
+        std::pair<size_t, size_t> current_range(vid_t st, vid_t en) {
+            std::vector<walk_t>::iterator lo = std::lower_bound(current.begin(), current.end(), make_walk(st, 0, 0));
+            std::vector<walk_t>::iterator hi = (en == (vid_t) -1 ? current.end() :
+                                                std::lower_bound(lo, current.end(), make_walk(en + 1, 0, 0)));
+            return std::pair<size_t, size_t>(lo - current.begin(), hi - current.begin());
+        }
+
+        size_t num_walks() {
+            size_t n = current.size();
+            for(int t=0; t < nthreads; t++) {
+                for(int i=0; i < nintervals; i++) n += buckets[t][i].size();
+            }
+            return n;
+        }
+
+    };
+
+};
+
+#endif
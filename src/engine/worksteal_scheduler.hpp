@@ -0,0 +1,193 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Work-stealing scheduler for executing the updates of a sub-interval.
+ * The vertices are divided into chunks of roughly equal number of edges,
+ * so that a high-degree vertex gets a chunk of its own while low-degree
+ * vertices are batched together. The chunks are distributed to per-thread
+ * lanes; a thread that runs out of work steals chunks from the end of the
+ * other lanes.
+ */
+
+#ifndef DEF_GRAPHCHI_WORKSTEAL_SCHEDULER
+#define DEF_GRAPHCHI_WORKSTEAL_SCHEDULER
+
+#include <vector>
+#include <assert.h>
+#include <sys/time.h>
+
+namespace graphchi {
+
+    /**
+     * Range [first, last) of vertex indices in the window.
+     */
+    struct update_chunk {
+        int first;
+        int last;
+        update_chunk() : first(0), last(0) {}
+        update_chunk(int first, int last) : first(first), last(last) {}
+    };
+
+    /**
+     * Chunk queue of a thread. Padded to a cache line, as
+     * the lanes are accessed by different threads.
+     */
+    struct worksteal_lane {
+        volatile int lock;
+        int head;
+        int tail;
+        char padding[64 - 3 * sizeof(int)];
+        worksteal_lane() : lock(0), head(0), tail(0) {}
+    };
+
+    class worksteal_scheduler {
+
+        std::vector<update_chunk> chunks;
+        std::vector<worksteal_lane> lanes;
+        int chunks_per_thread;
+        size_t min_chunk_edges;
+
+        inline void lock_lane(worksteal_lane &l) {
+            while (__sync_lock_test_and_set(&l.lock, 1)) {
+                while (l.lock) {}
+            }
+        }
+
+        inline void unlock_lane(worksteal_lane &l) {
+            __sync_lock_release(&l.lock);
+        }
+
+        bool pop_front(worksteal_lane &l, update_chunk &c) {
+            bool found = false;
+            lock_lane(l);
+            if (l.head < l.tail) {
+                c = chunks[l.head++];
+                found = true;
+            }
+            unlock_lane(l);
+            return found;
+        }
+
+        bool pop_back(worksteal_lane &l, update_chunk &c) {
+            bool found = false;
+            lock_lane(l);
+            if (l.head < l.tail) {
+                c = chunks[--l.tail];
+                found = true;
+            }
+            unlock_lane(l);
+            return found;
+        }
+
+    public:
+
+        worksteal_scheduler(int chunks_per_thread = 8, size_t min_chunk_edges = 1024) :
+            chunks_per_thread(chunks_per_thread), min_chunk_edges(min_chunk_edges) {}
+
+        /**
+         * Divides the window to chunks, balanced by the number of edges
+         * of the vertices, and assigns the chunks to lanes first_lane..nlanes-1.
+         * Lanes below first_lane start empty (they are used by threads that
+         * have other work first, and then steal).
+         * @param only_parallel_safe if true, only parallel-safe vertices are counted
+         *        into the cost (the others are executed in a separate lane).
+         */
+        template <typename svertex_t>
+        void build(std::vector<svertex_t> &vertices, int nlanes, int first_lane, bool only_parallel_safe) {
+            build(vertices, 0, (int) vertices.size(), nlanes, first_lane, only_parallel_safe);
+        }
+
+        /**
+         * Builds the chunks of the vertex range [first, last) only.
+         */
+        template <typename svertex_t>
+        void build(std::vector<svertex_t> &vertices, int first, int last, int nlanes, int first_lane, bool only_parallel_safe) {
+            assert(nlanes > 0 && first_lane >= 0);
+            assert(first >= 0 && last <= (int) vertices.size());
+            if (first_lane >= nlanes) first_lane = nlanes - 1;
+
+            size_t total = 0;
+            for(int i=first; i < last; i++) {
+                svertex_t &v = vertices[i];
+                if (v.scheduled && (!only_parallel_safe || v.parallel_safe))
+                    total += 1 + v.num_edges();
+            }
+            size_t target = total / ((size_t)(nlanes - first_lane) * chunks_per_thread) + 1;
+            if (target < min_chunk_edges) target = min_chunk_edges;
+
+            chunks.clear();
+            int chunkst = first;
+            size_t acc = 0;
+            for(int i=first; i < last; i++) {
+                svertex_t &v = vertices[i];
+                if (v.scheduled && (!only_parallel_safe || v.parallel_safe))
+                    acc += 1 + v.num_edges();
+                if (acc >= target) {
+                    chunks.push_back(update_chunk(chunkst, i + 1));
+                    chunkst = i + 1;
+                    acc = 0;
+                }
+            }
+            if (chunkst < last) chunks.push_back(update_chunk(chunkst, last));
+
+            /* Contiguous ranges of chunks to the lanes */
+            lanes.assign(nlanes, worksteal_lane());
+            int nchunks = (int) chunks.size();
+            int nworklanes = nlanes - first_lane;
+            for(int j=0; j < nworklanes; j++) {
+                worksteal_lane &l = lanes[first_lane + j];
+                l.head = (int) ((size_t)nchunks * j / nworklanes);
+                l.tail = (int) ((size_t)nchunks * (j + 1) / nworklanes);
+            }
+        }
+
+        /**
+         * Returns next chunk for the thread of the lane: from the front
+         * of its own lane, or stolen from the back of another lane.
+         * Returns false when no work is left.
+         */
+        bool next(int lane, update_chunk &c) {
+            int nlanes = (int) lanes.size();
+            if (lane < nlanes && pop_front(lanes[lane], c)) return true;
+            for(int i=1; i <= nlanes; i++) {
+                int victim = (lane + i) % nlanes;
+                if (victim != lane && pop_back(lanes[victim], c)) return true;
+            }
+            return false;
+        }
+
+        int num_chunks() {
+            return (int) chunks.size();
+        }
+    };
+
+    static inline double worksteal_clock() {
+        timeval t;
+        gettimeofday(&t, NULL);
+        return t.tv_sec + t.tv_usec * 1.0e-6;
+    }
+
+}
+
+#endif
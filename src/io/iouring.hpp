@@ -0,0 +1,387 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Linux io_uring read backend for the I/O manager (stripedio). Reads
+ * are queued to the submission ring and submitted in batches, and
+ * completed by a small pool of completion threads. Uses the raw system
+ * calls, so liburing is not required.
+ */
+
+#ifndef DEF_GRAPHCHI_IOURING_HPP
+#define DEF_GRAPHCHI_IOURING_HPP
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define GRAPHCHI_HAVE_IOURING
+#endif
+#endif
+#endif
+
+#ifdef GRAPHCHI_HAVE_IOURING
+
+#include <vector>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/io_uring.h>
+
+#include "logger/logger.hpp"
+#include "util/ioutil.hpp"
+#include "util/pthread_tools.hpp"
+
+namespace graphchi {
+
+    static inline int sys_io_uring_setup(unsigned entries, struct io_uring_params * p) {
+        return (int) syscall(__NR_io_uring_setup, entries, p);
+    }
+
+    static inline int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    }
+
+    /**
+     * A read in flight. For compressed block files the whole file is
+     * first read to a temporary buffer, and inflated on completion.
+     */
+    struct uring_read {
+        int fd;
+        char * buf;              // destination
+        size_t len;
+        size_t off;
+        char * compressed_buf;   // non-null for compressed reads
+        size_t compressed_len;
+        volatile int * refcount; // stripe reference count of the destination buffer
+        void * refobj;           // freed when refcount drops to zero
+        volatile int * doneptr;
+        volatile int * codecptr; // set to the codec of a compressed block
+    };
+
+    // Forward declaration
+    static void * uring_completion_loop(void * _info);
+
+    class uring_reader {
+
+        int ringfd;
+        struct io_uring_params params;
+
+        /* Submission ring */
+        void * sq_ptr;
+        size_t sq_ringsize;
+        unsigned * sq_head;
+        unsigned * sq_tail;
+        unsigned * sq_mask;
+        unsigned * sq_array;
+        struct io_uring_sqe * sqes;
+
+        /* Completion ring */
+        void * cq_ptr;
+        size_t cq_ringsize;
+        unsigned * cq_head;
+        unsigned * cq_tail;
+        unsigned * cq_mask;
+        struct io_uring_cqe * cqes;
+
+        mutex sqlock;
+        mutex cqlock;
+        unsigned unsubmitted;
+        std::vector<pthread_t> threads;
+
+        volatile int pending;
+        volatile size_t nsubmits;
+        volatile size_t nreads;
+
+        bool initialized;
+
+        /* Caller holds sqlock */
+        struct io_uring_sqe * next_sqe() {
+            while (true) {
+                unsigned tail = *sq_tail;
+                unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+                if (tail - head < params.sq_entries) {
+                    unsigned idx = tail & *sq_mask;
+                    struct io_uring_sqe * sqe = &sqes[idx];
+                    memset(sqe, 0, sizeof(*sqe));
+                    sq_array[idx] = idx;
+                    return sqe;
+                }
+                /* Ring is full */
+                submit_locked();
+            }
+        }
+
+        /* Caller holds sqlock */
+        void push_sqe() {
+            __atomic_store_n(sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+            unsubmitted++;
+        }
+
+        /* Caller holds sqlock */
+        void submit_locked() {
+            while (unsubmitted > 0) {
+                int ret = sys_io_uring_enter(ringfd, unsubmitted, 0, 0);
+                if (ret < 0) {
+                    if (errno == EAGAIN || errno == EBUSY || errno == EINTR) {
+                        usleep(100);
+                        continue;
+                    }
+                    logstream(LOG_FATAL) << "io_uring_enter failed: " << strerror(errno) << std::endl;
+                    assert(false);
+                }
+                unsubmitted -= ret;
+                __sync_add_and_fetch(&nsubmits, 1);
+            }
+        }
+
+        void queue_nop() {
+            sqlock.lock();
+            struct io_uring_sqe * sqe = next_sqe();
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = 0;
+            push_sqe();
+            submit_locked();
+            sqlock.unlock();
+        }
+
+    public:
+
+        /**
+         * @param depth number of submission queue entries
+         * @param nthreads number of completion threads
+         */
+        uring_reader(int depth, int nthreads) : ringfd(-1), sq_ptr(NULL), sqes(NULL), cq_ptr(NULL),
+                unsubmitted(0), pending(0), nsubmits(0), nreads(0), initialized(false) {
+            memset(&params, 0, sizeof(params));
+            ringfd = sys_io_uring_setup(depth, &params);
+            if (ringfd < 0) {
+                logstream(LOG_WARNING) << "Could not set up io_uring: " << strerror(errno) << std::endl;
+                return;
+            }
+
+            sq_ringsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ringsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single_mmap) {
+                if (cq_ringsize > sq_ringsize) sq_ringsize = cq_ringsize;
+                cq_ringsize = sq_ringsize;
+            }
+            sq_ptr = mmap(NULL, sq_ringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+            assert(sq_ptr != MAP_FAILED);
+            if (single_mmap) {
+                cq_ptr = sq_ptr;
+            } else {
+                cq_ptr = mmap(NULL, cq_ringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_CQ_RING);
+                assert(cq_ptr != MAP_FAILED);
+            }
+            sqes = (struct io_uring_sqe *) mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                                                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+            assert(sqes != MAP_FAILED);
+
+            char * sq = (char *) sq_ptr;
+            sq_head = (unsigned *) (sq + params.sq_off.head);
+            sq_tail = (unsigned *) (sq + params.sq_off.tail);
+            sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+            sq_array = (unsigned *) (sq + params.sq_off.array);
+
+            char * cq = (char *) cq_ptr;
+            cq_head = (unsigned *) (cq + params.cq_off.head);
+            cq_tail = (unsigned *) (cq + params.cq_off.tail);
+            cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+            cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+            initialized = true;
+            for(int i=0; i < nthreads; i++) {
+                pthread_t t;
+                int ret = pthread_create(&t, NULL, uring_completion_loop, this);
+                assert(ret >= 0);
+                threads.push_back(t);
+            }
+            logstream(LOG_INFO) << "Started io_uring reader with " << params.sq_entries << " entries, "
+                << nthreads << " completion threads." << std::endl;
+        }
+
+        ~uring_reader() {
+            if (!initialized) {
+                if (ringfd >= 0) close(ringfd);
+                return;
+            }
+            /* Each completion thread quits when it reaps a nop */
+            for(int i=0; i < (int)threads.size(); i++) {
+                queue_nop();
+            }
+            for(int i=0; i < (int)threads.size(); i++) {
+                pthread_join(threads[i], NULL);
+            }
+            munmap(sqes, params.sq_entries * sizeof(struct io_uring_sqe));
+            if (cq_ptr != sq_ptr) munmap(cq_ptr, cq_ringsize);
+            munmap(sq_ptr, sq_ringsize);
+            close(ringfd);
+        }
+
+        bool ok() {
+            return initialized;
+        }
+
+        /**
+         * Queues a read. The read is not started before submit() is called,
+         * or the submission ring fills up.
+         */
+        void queue_read(int fd, char * buf, size_t len, size_t off, bool compressed,
+                        volatile int * refcount, void * refobj, volatile int * doneptr,
+                        volatile int * codecptr = NULL) {
+            uring_read * r = new uring_read();
+            r->fd = fd;
+            r->buf = buf;
+            r->len = len;
+            r->off = off;
+            r->compressed_buf = NULL;
+            r->compressed_len = 0;
+            r->refcount = refcount;
+            r->refobj = refobj;
+            r->doneptr = doneptr;
+            r->codecptr = codecptr;
+
+            char * dst = buf;
+            size_t dstlen = len;
+#ifndef GRAPHCHI_DISABLE_COMPRESSION
+            if (compressed) {
+                assert(off == 0);
+                struct stat st;
+                int err = fstat(fd, &st);
+                assert(err == 0);
+                r->compressed_len = st.st_size;
+                r->compressed_buf = (char *) malloc(r->compressed_len);
+                dst = r->compressed_buf;
+                dstlen = r->compressed_len;
+            }
+#endif
+            __sync_add_and_fetch(&pending, 1);
+            sqlock.lock();
+            struct io_uring_sqe * sqe = next_sqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = (unsigned long) dst;
+            sqe->len = (unsigned) dstlen;
+            sqe->off = (r->compressed_buf != NULL ? 0 : off);
+            sqe->user_data = (unsigned long) r;
+            push_sqe();
+            sqlock.unlock();
+        }
+
+        /**
+         * Submits all queued reads with one system call (unless the
+         * kernel consumes them partially).
+         */
+        void submit() {
+            sqlock.lock();
+            submit_locked();
+            sqlock.unlock();
+        }
+
+        int num_pending() {
+            return pending;
+        }
+
+        size_t num_submits() {
+            return nsubmits;
+        }
+
+        size_t num_reads() {
+            return nreads;
+        }
+
+        /**
+         * Reaps one completion, waiting if needed. Returns false
+         * if the thread should quit.
+         */
+        bool complete_next() {
+            while (true) {
+                cqlock.lock();
+                unsigned head = *cq_head;
+                unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+                if (head != tail) {
+                    struct io_uring_cqe * cqe = &cqes[head & *cq_mask];
+                    unsigned long user_data = (unsigned long) cqe->user_data;
+                    int res = cqe->res;
+                    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                    cqlock.unlock();
+                    if (user_data == 0) return false;
+                    finish((uring_read *) user_data, res);
+                    return true;
+                }
+                cqlock.unlock();
+                int ret = sys_io_uring_enter(ringfd, 0, 1, IORING_ENTER_GETEVENTS);
+                if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+                    logstream(LOG_FATAL) << "io_uring_enter (wait) failed: " << strerror(errno) << std::endl;
+                    assert(false);
+                }
+            }
+        }
+
+    private:
+
+        void finish(uring_read * r, int res) {
+            if (res < 0) {
+                logstream(LOG_ERROR) << "io_uring read failed: " << strerror(-res) << "; file-desc: " << r->fd << std::endl;
+                assert(res >= 0);
+            }
+            if (r->compressed_buf != NULL) {
+                if ((size_t) res < r->compressed_len) {
+                    preada(r->fd, r->compressed_buf + res, r->compressed_len - res, res);
+                }
+                int codec = uncompress_buffer((unsigned char *) r->compressed_buf, r->compressed_len, r->buf, r->len);
+                if (r->codecptr != NULL) *r->codecptr = codec;
+                free(r->compressed_buf);
+            } else if ((size_t) res < r->len) {
+                /* Short read - read the rest synchronously */
+                preada(r->fd, r->buf + res, r->len - res, r->off + res);
+            }
+
+            __sync_add_and_fetch(&nreads, 1);
+            if (__sync_sub_and_fetch(r->refcount, 1) == 0) {
+                free(r->refobj);
+            }
+            if (r->doneptr != NULL) {
+                __sync_sub_and_fetch(r->doneptr, 1);
+            }
+            __sync_sub_and_fetch(&pending, 1);
+            delete r;
+        }
+    };
+
+    static void * uring_completion_loop(void * _info) {
+        uring_reader * reader = (uring_reader *) _info;
+        while (reader->complete_next()) {}
+        return NULL;
+    }
+
+}
+
+#endif
+#endif
@@ -39,6 +39,8 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 //#include <omp.h>
 
 #include <vector>
@@ -48,6 +50,7 @@
 #include "util/synchronized_queue.hpp"
 #include "util/ioutil.hpp"
 #include "util/cmdopts.hpp"
+#include "io/iouring.hpp"
 
 
 
@@ -64,6 +67,10 @@ namespace graphchi {
         std::vector<int> readdescs;
         std::vector<int> writedescs;
         pinned_file * pinned_to_memory;
+        uint8_t * mapped;        // Mapping of an open memory-mapped session
+        size_t mappedlen;
+        bool memory_mapped;      // Stays set after close, for managed_release()
+        volatile int codec;      // Codec of the compressed block, -1 if not read yet
         int start_mplex;
         bool open;
         bool compressed;
@@ -111,6 +118,7 @@ namespace graphchi {
         
         bool running;
         metrics * m;
+        metric_handle mh_read, mh_write, mh_bytes_read, mh_bytes_written;
         volatile int pending_writes;
         volatile int pending_reads;
         int mplex;
@@ -147,6 +155,20 @@ namespace graphchi {
     // Forward declaration
     static void * stream_read_loop(void * _info);    
     
+    /**
+     * Sets the codec for new compressed block files from
+     * option "io.codec" (zlib, lz4, zstd, deltavarint or none).
+     */
+    static void configure_block_codec() {
+        std::string codecname = get_option_string("io.codec", "zlib");
+        int codec = block_codec_for_name(codecname);
+        if (codec < 0) {
+            logstream(LOG_FATAL) << "Unknown block codec, or not compiled in: " << codecname << std::endl;
+            assert(false);
+        }
+        default_block_codec() = codec;
+    }
+    
     
     class stripedio {
         
@@ -163,6 +185,7 @@ namespace graphchi {
         std::vector< pthread_t > threads;
         std::vector< thrinfo * > thread_infos;
         metrics &m;
+        metric_handle mh_preada_now, mh_pwritea_now;
         
         /* Memory-pinned files */
         std::vector<pinned_file *> preloaded_files;
@@ -172,6 +195,11 @@ namespace graphchi {
         
         
         int niothreads; // threads per mplex
+        bool mmap_enabled;
+        
+#ifdef GRAPHCHI_HAVE_IOURING
+        uring_reader * uring; // Non-null if reads go through io_uring
+#endif
         
     public:
         stripedio( metrics &_m) : m(_m) {
@@ -194,10 +222,19 @@ namespace graphchi {
             }
             m.set("stripesize", (size_t)stripesize);
             
+            mmap_enabled = get_option_int("io.mmap", 0) != 0 && multiplex == 1;
+            m.set("io.mmap", (size_t)mmap_enabled);
+            
+            configure_block_codec();
+            m.set("io.codec", get_block_codec(default_block_codec())->name());
+            
             // Start threads (niothreads is now threads per multiplex)
             niothreads = get_option_int("niothreads", 1);
             m.set("niothreads", (size_t)niothreads);
             
+            mh_preada_now = m.register_timer("preada_now");
+            mh_pwritea_now = m.register_timer("pwritea_now");
+            
             logstream(LOG_DEBUG) << "Start io-manager with " << niothreads << " threads." << std::endl;
             
             // Each multiplex partition has its own queues
@@ -219,6 +256,10 @@ namespace graphchi {
                     cthreadinfo->pending_reads = 0;
                     cthreadinfo->mplex = i;
                     cthreadinfo->m = &m;
+                    cthreadinfo->mh_read = m.register_timer("read_thr");
+                    cthreadinfo->mh_write = m.register_timer("commit_thr");
+                    cthreadinfo->mh_bytes_read = m.register_metric("io-bytes-read", INTEGER, true);
+                    cthreadinfo->mh_bytes_written = m.register_metric("io-bytes-written", INTEGER, true);
                     thread_infos.push_back(cthreadinfo);
                     
                     pthread_t iothread;
@@ -228,9 +269,36 @@ namespace graphchi {
                     k++;
                 }
             }
+            
+            /* Read backend: "threads" (default) or "uring" */
+            std::string backend = get_option_string("io.backend", "threads");
+#ifdef GRAPHCHI_HAVE_IOURING
+            uring = NULL;
+            if (backend == "uring") {
+                uring = new uring_reader(get_option_int("io.uring_depth", 256), niothreads);
+                if (!uring->ok()) {
+                    logstream(LOG_WARNING) << "io_uring not available, using I/O threads for reads." << std::endl;
+                    delete uring;
+                    uring = NULL;
+                }
+            }
+            backend = (uring != NULL ? "uring" : "threads");
+#else
+            if (backend == "uring") {
+                logstream(LOG_WARNING) << "Compiled without io_uring support, using I/O threads for reads." << std::endl;
+            }
+            backend = "threads";
+#endif
+            m.set("io.backend", backend);
         }
         
         ~stripedio() {
+#ifdef GRAPHCHI_HAVE_IOURING
+            if (uring != NULL) {
+                delete uring;
+                uring = NULL;
+            }
+#endif
             int mplex = (int) thread_infos.size();
             // Quit all threads
             for(int i=0; i<mplex; i++) {
@@ -302,6 +370,10 @@ namespace graphchi {
             iodesc->open = true;
             iodesc->compressed = compressed;
             iodesc->pinned_to_memory = is_preloaded(filename);
+            iodesc->mapped = NULL;
+            iodesc->mappedlen = 0;
+            iodesc->memory_mapped = false;
+            iodesc->codec = -1;
             iodesc->start_mplex = hash(filename) % multiplex;
             sessions.push_back(iodesc);
             mlock.unlock();
@@ -345,6 +417,40 @@ namespace graphchi {
             return session_id;
         }
         
+        /**
+         * Opens a session that is memory-mapped, if enabled with io.mmap=1.
+         * The managed I/O functions of a mapped session return pointers
+         * into the page cache instead of copying the data. The mapping is
+         * private: changes to the data reach the file only when they are
+         * committed, so shards that disable writes never modify their
+         * files. Compressed files can be mapped only if compression is
+         * disabled. Falls back to a normal session.
+         */
+        int open_mapped_session(std::string filename, bool readonly=false, bool compressed=false) {
+            int session = open_session(filename, readonly, compressed);
+            io_descriptor * iodesc = sessions[session];
+#ifndef GRAPHCHI_DISABLE_COMPRESSION
+            if (compressed) return session;
+#endif
+            if (!mmap_enabled || iodesc->pinned_to_memory != NULL) return session;
+            
+            struct stat st;
+            int fd = iodesc->readdescs[0];
+            if (fstat(fd, &st) != 0 || st.st_size == 0) return session;
+            void * addr = mmap(NULL, st.st_size, (readonly ? PROT_READ : PROT_READ | PROT_WRITE),
+                               MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                logstream(LOG_WARNING) << "Could not mmap " << filename << ": " << strerror(errno) << std::endl;
+                return session;
+            }
+            /* Adjacency files are read sequentially; edge data blocks are read whole */
+            madvise(addr, st.st_size, readonly ? MADV_SEQUENTIAL : MADV_WILLNEED);
+            iodesc->mapped = (uint8_t *) addr;
+            iodesc->mappedlen = st.st_size;
+            iodesc->memory_mapped = true;
+            return session;
+        }
+        
         void close_session(int session) {
             mlock.lock();
             // Note: currently io-descriptors are left into the vertex array
@@ -355,6 +461,10 @@ namespace graphchi {
             wasopen = iodesc->open;
             iodesc->open = false;
             mlock.unlock();
+            if (wasopen && iodesc->mapped != NULL) {
+                munmap(iodesc->mapped, iodesc->mappedlen);
+                iodesc->mapped = NULL;
+            }
             if (wasopen) {
               //  std::cout << "Closing: " << iodesc->filename << " " << iodesc->readdescs[0] << std::endl;
                 for(std::vector<int>::iterator it=iodesc->readdescs.begin(); it!=iodesc->readdescs.end(); ++it) {
@@ -397,6 +507,19 @@ namespace graphchi {
                 assert(off == 0);
             }
             refcountptr * refptr = new refcountptr((char*)tbuf, (int)stripelist.size());
+#ifdef GRAPHCHI_HAVE_IOURING
+            if (uring != NULL) {
+                /* Queued only; submitted by submit_reads() or wait_for_reads() */
+                for(int i=0; i<(int)stripelist.size(); i++) {
+                    stripe_chunk chunk = stripelist[i];
+                    uring->queue_read(sessions[session]->readdescs[chunk.mplex_thread],
+                                      (char*)tbuf + chunk.offset, chunk.len, chunk.offset+off,
+                                      compressed_session(session), &refptr->count, refptr, doneptr,
+                                      &sessions[session]->codec);
+                }
+                return;
+            }
+#endif
             for(int i=0; i<(int)stripelist.size(); i++) {
                 stripe_chunk chunk = stripelist[i];
                 __sync_add_and_fetch(&thread_infos[chunk.mplex_thread]->pending_reads, 1);
@@ -429,6 +552,56 @@ namespace graphchi {
             return sessions[session]->compressed;
         }
         
+        /**
+         * Compressed blocks are written back with the codec
+         * they were read with; -1 for the default codec.
+         */
+        int session_codec(int session) {
+            return sessions[session]->codec;
+        }
+        
+        void set_session_codec(int session, int codec) {
+            sessions[session]->codec = codec;
+        }
+        
+        /**
+         * Memory-mapped sessions, see open_mapped_session().
+         */
+        bool mapped_session(int session) {
+            return sessions[session]->memory_mapped;
+        }
+        
+        /**
+         * Returns pointer to the mapped data, and hints the kernel to
+         * read the range ahead.
+         */
+        template <typename T>
+        T * mapped_range(int session, size_t nbytes, size_t off, bool willneed) {
+            io_descriptor * iodesc = sessions[session];
+            assert(off + nbytes <= iodesc->mappedlen);
+            if (willneed && nbytes > 0) {
+                size_t pagesize = (size_t) sysconf(_SC_PAGESIZE);
+                size_t alignedoff = off / pagesize * pagesize;
+                madvise(iodesc->mapped + alignedoff, nbytes + off - alignedoff, MADV_WILLNEED);
+            }
+            return (T*) (iodesc->mapped + off);
+        }
+        
+        /**
+         * Commits a range of a mapped session: the buffer (usually the
+         * private mapping itself) is written to the file. If the buffer
+         * is not the mapping, it is also copied in, so that later reads
+         * of the session see the data.
+         */
+        template <typename T>
+        void mapped_commit(int session, T * tbuf, size_t nbytes, size_t off) {
+            uint8_t * dst = mapped_range<uint8_t>(session, nbytes, off, false);
+            if ((uint8_t*)tbuf != dst) {
+                memcpy(dst, tbuf, nbytes);
+            }
+            pwritea_now(session, dst, nbytes, off);
+        }
+        
         /**
          * Call to allow files to be preloaded. Note: using this requires
          * that all files are accessed with same path. This is true if
@@ -525,8 +698,8 @@ namespace graphchi {
             if (compressed_session(session)) {
                 // Compressed sessions do not support multiplexing for now
                 assert(off == 0);
-                read_compressed(sessions[session]->readdescs[0], tbuf, nbytes);
-                m.stop_time(me, "preada_now", false);
+                sessions[session]->codec = read_compressed(sessions[session]->readdescs[0], tbuf, nbytes);
+                m.stop_time(me, mh_preada_now);
                 return;
             }
 
@@ -555,7 +728,7 @@ namespace graphchi {
             } else {
                 preada(sessions[session]->readdescs[threads.size()], tbuf, nbytes, off);
             }
-            m.stop_time(me, "preada_now", false);
+            m.stop_time(me, mh_preada_now);
         }
         
         template <typename T>
@@ -565,8 +738,8 @@ namespace graphchi {
             if (compressed_session(session)) {
                 // Compressed sessions do not support multiplexing for now
                 assert(off == 0);
-                write_compressed(sessions[session]->writedescs[0], tbuf, nbytes);
-                m.stop_time(me, "pwritea_now", false);
+                write_compressed(sessions[session]->writedescs[0], tbuf, nbytes, sessions[session]->codec);
+                m.stop_time(me, mh_pwritea_now);
 
                 return;
             }
@@ -579,7 +752,7 @@ namespace graphchi {
                 checklen += chunk.len;
             }
             assert(checklen == nbytes);
-            m.stop_time(me, "pwritea_now", false);
+            m.stop_time(me, mh_pwritea_now);
             
         }
         
@@ -591,7 +764,11 @@ namespace graphchi {
         
         template <typename T>
         void managed_pwritea_async(int session, T ** tbuf, size_t nbytes, size_t off, bool free_after, bool close_fd=false) {
-
+            if (mapped_session(session)) {
+                mapped_commit(session, *tbuf, nbytes, off);
+                if (close_fd) close_session(session);
+                return;
+            }
             if (!pinned_session(session)) {
                 pwritea_async(session, *tbuf, nbytes, off, free_after, close_fd);
             } else {
@@ -602,6 +779,10 @@ namespace graphchi {
         
         template <typename T>
         void managed_preada_now(int session,  T ** tbuf, size_t nbytes, size_t off) {
+            if (mapped_session(session)) {
+                *tbuf = mapped_range<T>(session, nbytes, off, true);
+                return;
+            }
             if (!pinned_session(session)) {
                 preada_now(session, *tbuf, nbytes,  off);
             } else {
@@ -612,6 +793,10 @@ namespace graphchi {
         
         template <typename T>
         void managed_pwritea_now(int session, T ** tbuf, size_t nbytes, size_t off) {
+            if (mapped_session(session)) {
+                mapped_commit(session, *tbuf, nbytes, off);
+                return;
+            }
             if (!pinned_session(session)) {
                 pwritea_now(session, *tbuf, nbytes, off);
             } else {
@@ -622,8 +807,10 @@ namespace graphchi {
         
         template<typename T>
         void managed_malloc(int session, T ** tbuf, size_t nbytes, size_t noff) {
-        
-            
+            if (mapped_session(session)) {
+                *tbuf = mapped_range<T>(session, nbytes, noff, false);
+                return;
+            }
             if (!pinned_session(session)) {
                 *tbuf = (T*) malloc(nbytes);
             } else {
@@ -637,6 +824,13 @@ namespace graphchi {
           */
         template <typename T>
         void managed_preada_async(int session, T ** tbuf, size_t nbytes, size_t off, volatile int * doneptr = NULL) {
+            if (mapped_session(session)) {
+                *tbuf = mapped_range<T>(session, nbytes, off, true);
+                if (doneptr != NULL) {
+                    __sync_sub_and_fetch(doneptr, 1);
+                }
+                return;
+            }
             if (!pinned_session(session)) {
               
                 preada_async(session, *tbuf, nbytes,  off, doneptr);
@@ -651,7 +845,7 @@ namespace graphchi {
         
         template <typename T>
         void managed_release(int session, T ** ptr) {
-            if (!pinned_session(session)) {
+            if (!pinned_session(session) && !mapped_session(session)) {
                 assert(*ptr != NULL);
                 free(*ptr);
             }
@@ -670,9 +864,21 @@ namespace graphchi {
             }
         }
         
+        /**
+         * Starts the reads queued with preada_async(). With the io_uring
+         * backend the reads are submitted in one batch; the I/O threads
+         * start the reads immediately, so this is a no-op for them.
+         */
+        void submit_reads() {
+#ifdef GRAPHCHI_HAVE_IOURING
+            if (uring != NULL) uring->submit();
+#endif
+        }
+        
         void wait_for_reads() {
             metrics_entry me = m.start_time();
             int loops = 0;
+            submit_reads();
             int mplex = (int) thread_infos.size();
             for(int i=0; i<mplex; i++) {
                 while(thread_infos[i]->pending_reads > 0) {
@@ -680,6 +886,16 @@ namespace graphchi {
                     loops++;
                 }
             }
+#ifdef GRAPHCHI_HAVE_IOURING
+            if (uring != NULL) {
+                while(uring->num_pending() > 0) {
+                    usleep(1000);
+                    loops++;
+                }
+                m.set("uring_submits", uring->num_submits());
+                m.set("uring_reads", uring->num_reads());
+            }
+#endif
             m.stop_time(me, "stripedio_wait_for_reads", false);
         }
         
@@ -694,6 +910,16 @@ namespace graphchi {
             m.stop_time(me, "stripedio_wait_for_writes", false);
         }
         
+        /**
+         * Returns true if some writes have not been completed yet.
+         */
+        bool writes_pending() {
+            for(int i=0; i < (int)thread_infos.size(); i++) {
+                if (thread_infos[i]->pending_writes > 0) return true;
+            }
+            return false;
+        }
+        
         
         std::string multiplexprefix(int stripe) {
             if (multiplex > 1) {
@@ -731,7 +957,7 @@ namespace graphchi {
                     
                     if (task.compressed) {
                         assert(task.offset == 0);
-                        write_compressed(task.fd, task.ptr->ptr, task.length);
+                        write_compressed(task.fd, task.ptr->ptr, task.length, task.iomgr->session_codec(task.session));
                     } else {
                         pwritea(task.fd, task.ptr->ptr + task.ptroffset, task.length, task.offset);
                     }
@@ -747,15 +973,19 @@ namespace graphchi {
                     }
                    
                     __sync_sub_and_fetch(&info->pending_writes, 1);
-                    info->m->stop_time(me, "commit_thr");
+                    info->m->stop_time(me, info->mh_write);
+                    info->m->add(info->mh_bytes_written, (double) task.length);
                 } else {
+                    metrics_entry me = info->m->start_time();
                     if (task.compressed) {
                         assert(task.offset == 0);
-                        read_compressed(task.fd, task.ptr->ptr, task.length);
+                        task.iomgr->set_session_codec(task.session, read_compressed(task.fd, task.ptr->ptr, task.length));
 
                     } else {
                         preada(task.fd, task.ptr->ptr+task.ptroffset, task.length, task.offset);
                     }
+                    info->m->stop_time(me, info->mh_read);
+                    info->m->add(info->mh_bytes_read, (double) task.length);
                     __sync_sub_and_fetch(&info->pending_reads, 1);
                     if (__sync_sub_and_fetch(&task.ptr->count, 1) == 0) {
                         free(task.ptr);
@@ -788,7 +1018,7 @@ namespace graphchi {
          * buffer. Otherwise - shuold just return pointer
          * to the in-memory file buffer.
          */
-        if (task->iomgr->pinned_session(task->session)) {
+        if (task->iomgr->pinned_session(task->session) || task->iomgr->mapped_session(task->session)) {
             __sync_add_and_fetch(&task->curpos, task->len);
             return NULL;
         }
@@ -23,7 +23,13 @@
  *
  * @section DESCRIPTION
  *
- * Metrics. 
+ * Metrics. Entries are created and updated by key, under a lock.
+ * Metrics updated on hot paths can be registered instead: updating
+ * a registered metric through its handle only adds to a slot of the
+ * calling thread. Registered timers also keep a histogram of the times,
+ * and phases additionally a time series, times by an index (e.g. the
+ * interval) and the hardware counters of the phase if metrics.perf=1.
+ * Registered metrics are copied to the entries when reported.
  */
 
   
@@ -31,12 +37,16 @@
 #define DEF_METRICS_HPP
 
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <limits>
 #include <assert.h>
+#include <stdint.h>
 #include <sys/time.h>
 
+#include "metrics/perf_counters.hpp"
 #include "util/pthread_tools.hpp"
 #include "util/cmdopts.hpp"
 
@@ -151,6 +161,96 @@ namespace graphchi {
     }
   };
  
+#define METRICS_MAX_THREADS 256
+#define METRICS_MAX_HANDLES 256
+#define METRICS_HIST_BUCKETS 32
+
+  /**
+   * Handle of a registered metric.
+   */
+  struct metric_handle {
+    int idx;
+    metric_handle() : idx(-1) {}
+    explicit metric_handle(int idx) : idx(idx) {}
+    bool valid() const { return idx >= 0; }
+  };
+
+  /**
+   * Value of a registered metric updated by one thread. Slots take
+   * a cache line each, so that threads do not write to the same line.
+   */
+  struct metric_slot {
+    double sum;
+    double minvalue;
+    double maxvalue;
+    size_t count;
+    char padding[64 - 3 * sizeof(double) - sizeof(size_t)];
+
+    metric_slot() : sum(0), minvalue(0), maxvalue(0), count(0) {}
+
+    inline void add(double x) {
+      if (count == 0 || x < minvalue) minvalue = x;
+      if (count == 0 || x > maxvalue) maxvalue = x;
+      sum += x;
+      count++;
+    }
+  };
+
+  /**
+   * Index of the slot of the calling thread. Threads get their
+   * index the first time they update a registered metric.
+   */
+  inline int metrics_thread_slot() {
+    static int nslots = 0;
+    static __thread int slot = -1;
+    if (slot < 0) slot = __sync_fetch_and_add(&nslots, 1);
+    return slot;
+  }
+
+  /**
+   * Histogram bucket of a time: bucket 0 has times under one microsecond,
+   * and bucket i > 0 times from 2^(i-1) to 2^i microseconds.
+   */
+  inline int metrics_hist_bucket(double secs) {
+    double us = secs * 1e6;
+    if (us < 1.0) return 0;
+    int e;
+    frexp(us, &e);
+    return std::min(e, METRICS_HIST_BUCKETS - 1);
+  }
+
+  struct registered_metric {
+    std::string key;
+    metrictype type;
+    bool per_thread;
+    /* One slot per thread, and a shared slot (under the lock) for the rest */
+    std::vector<metric_slot> slots;
+    std::vector<uint64_t> hist;
+
+    /* Phases only, updated under the lock */
+    bool phase;
+    std::string index_name;
+    std::vector<double> series;
+    std::vector<double> by_index;
+    uint64_t perf[PERF_NEVENTS];
+
+    registered_metric(std::string key, metrictype type, bool per_thread, bool histogram) :
+        key(key), type(type), per_thread(per_thread), slots(METRICS_MAX_THREADS + 1), phase(false) {
+      if (histogram) hist.resize((METRICS_MAX_THREADS + 1) * METRICS_HIST_BUCKETS, 0);
+      for(int i=0; i < PERF_NEVENTS; i++) perf[i] = 0;
+    }
+  };
+
+  /**
+   * Start of a phase, see metrics::start_phase().
+   */
+  struct phase_timer {
+    metric_handle h;
+    timeval start;
+    bool count_perf;
+    uint64_t perf[PERF_NEVENTS];
+  };
+
   class imetrics_reporter {
         
     public:
@@ -167,10 +267,22 @@ namespace graphchi {
     std::string name, ident;
     std::map<std::string, metrics_entry> entries;
       mutex mlock;
+      
+      registered_metric * handles[METRICS_MAX_HANDLES];
+      int nhandles;
+      
+      metrics(const metrics &);
+      metrics &operator=(const metrics &);
         
   public: 
-    inline metrics(std::string _name = "", std::string _id = "") : name(_name), ident (_id) {
+    inline metrics(std::string _name = "", std::string _id = "") : name(_name), ident (_id), nhandles(0) {
         this->set("app", _name);
+        /* Open the hardware counters before threads are created, so that they are counted */
+        perf_counters::global();
+    }
+      
+    ~metrics() {
+        for(int i=0; i < nhandles; i++) delete handles[i];
     }
 
     inline void clear() {
@@ -206,10 +318,12 @@ namespace graphchi {
     }
 
     inline void add_vector_entry(std::string key, size_t idx, double value) {
+        mlock.lock();
        if (entries.count(key) == 0) {
          entries[key] = metrics_entry(VECTOR);
        }
        entries[key].add_vector_entry(idx, value);
+        mlock.unlock();
     }
     
     inline void set(std::string key, size_t value) {
@@ -324,16 +438,186 @@ namespace graphchi {
       }
         
     inline metrics_entry get(std::string key) {
+      collect_registered();
       return entries[key];
     }
       
       
     void report(imetrics_reporter & reporter) {
           if (name != "") {
+              collect_registered();
               reporter.do_report(name, ident, entries);
           }
       }
       
+      /**
+       * Registers a metric updated with add(handle, value). If per_thread
+       * is set, the values of each thread are also reported as a vector.
+       * Registering the same key again returns the same handle.
+       * Handles must be registered before they are used.
+       */
+      metric_handle register_metric(std::string key, metrictype type = REAL, bool per_thread = false,
+                                    bool histogram = false) {
+          mlock.lock();
+          for(int i=0; i < nhandles; i++) {
+              if (handles[i]->key == key) {
+                  mlock.unlock();
+                  return metric_handle(i);
+              }
+          }
+          assert(nhandles < METRICS_MAX_HANDLES);
+          handles[nhandles] = new registered_metric(key, type, per_thread, histogram);
+          metric_handle h(nhandles);
+          __sync_synchronize();
+          nhandles++;
+          mlock.unlock();
+          return h;
+      }
+      
+      /**
+       * Registers a timer, updated with stop_time(entry, handle). The
+       * times are also reported as a histogram, key.hist.
+       */
+      metric_handle register_timer(std::string key) {
+          return register_metric(key, TIME, false, true);
+      }
+      
+      /**
+       * Registers a phase: a timer that also keeps the time series of
+       * the phase (key.series), the time by an index (key.[index_name]) and
+       * the hardware counters of the phase (key.cycles etc.).
+       * Phases are timed with start_phase() and stop_phase().
+       */
+      metric_handle register_phase(std::string key, std::string index_name = "") {
+          metric_handle h = register_timer(key);
+          mlock.lock();
+          handles[h.idx]->phase = true;
+          handles[h.idx]->index_name = index_name;
+          mlock.unlock();
+          return h;
+      }
+      
+      /**
+       * Adds to a registered metric. Does not take a lock.
+       */
+      inline void add(metric_handle h, double value) {
+          registered_metric * r = handles[h.idx];
+          int slot = metrics_thread_slot();
+          if (slot < METRICS_MAX_THREADS) {
+              r->slots[slot].add(value);
+              if (!r->hist.empty()) r->hist[slot * METRICS_HIST_BUCKETS + metrics_hist_bucket(value)]++;
+          } else {
+              mlock.lock();
+              r->slots[METRICS_MAX_THREADS].add(value);
+              if (!r->hist.empty()) r->hist[METRICS_MAX_THREADS * METRICS_HIST_BUCKETS + metrics_hist_bucket(value)]++;
+              mlock.unlock();
+          }
+      }
+      
+      inline void stop_time(metrics_entry me, metric_handle h) {
+          me.timer_stop();
+          add(h, me.lasttime);
+      }
+      
+      /**
+       * Starts a phase. The hardware counters are process-wide, so phases
+       * that run at the same time as other phases (the updates and the
+       * loading of the next window in the pipelined execution) must pass
+       * count_perf=false, or the counts would be added to both.
+       */
+      phase_timer start_phase(metric_handle h, bool count_perf = true) {
+          phase_timer t;
+          t.h = h;
+          t.count_perf = count_perf;
+          if (count_perf) perf_counters::global().read_values(t.perf);
+          gettimeofday(&t.start, NULL);
+          return t;
+      }
+      
+      /**
+       * Ends a phase, and records its time under the given index
+       * (if non-negative).
+       * @return duration of the phase in seconds
+       */
+      double stop_phase(phase_timer &t, int index = -1) {
+          timeval end;
+          gettimeofday(&end, NULL);
+          double secs = end.tv_sec - t.start.tv_sec + ((double)(end.tv_usec - t.start.tv_usec)) / 1.0E6;
+          uint64_t perf[PERF_NEVENTS];
+          if (t.count_perf) perf_counters::global().read_values(perf);
+          
+          add(t.h, secs);
+          registered_metric * r = handles[t.h.idx];
+          mlock.lock();
+          r->series.push_back(secs);
+          if (index >= 0) {
+              if ((int) r->by_index.size() <= index) r->by_index.resize(index + 1, 0.0);
+              r->by_index[index] += secs;
+          }
+          if (t.count_perf) {
+              for(int i=0; i < PERF_NEVENTS; i++) r->perf[i] += perf[i] - t.perf[i];
+          }
+          mlock.unlock();
+          return secs;
+      }
+      
+  private:
+      
+      /**
+       * Sums the slots of the registered metrics to the entries.
+       */
+      void collect_registered() {
+          mlock.lock();
+          for(int i=0; i < nhandles; i++) {
+              registered_metric * r = handles[i];
+              metrics_entry total(r->type);
+              metrics_entry bythread(VECTOR);
+              for(int t=0; t <= METRICS_MAX_THREADS; t++) {
+                  metric_slot &sl = r->slots[t];
+                  if (sl.count == 0) continue;
+                  total.minvalue = (total.count == 0 ? sl.minvalue : std::min(total.minvalue, sl.minvalue));
+                  total.maxvalue = (total.count == 0 ? sl.maxvalue : std::max(total.maxvalue, sl.maxvalue));
+                  total.count += sl.count;
+                  total.value += sl.sum;
+                  total.cumvalue += sl.sum;
+                  if (r->per_thread) bythread.add_vector_entry(t, sl.sum);
+              }
+              if (total.count == 0) continue;
+              entries[r->key] = total;
+              if (r->per_thread) entries[r->key + ".by-thread"] = bythread;
+              
+              if (!r->hist.empty()) {
+                  metrics_entry hist(VECTOR);
+                  int nbuckets = 0;
+                  std::vector<double> counts(METRICS_HIST_BUCKETS, 0.0);
+                  for(int t=0; t <= METRICS_MAX_THREADS; t++) {
+                      for(int b=0; b < METRICS_HIST_BUCKETS; b++) {
+                          counts[b] += (double) r->hist[t * METRICS_HIST_BUCKETS + b];
+                          if (counts[b] > 0) nbuckets = std::max(nbuckets, b + 1);
+                      }
+                  }
+                  for(int b=0; b < nbuckets; b++) hist.add_vector_entry(b, counts[b]);
+                  entries[r->key + ".hist"] = hist;
+              }
+              if (r->phase) {
+                  metrics_entry series(VECTOR);
+                  for(size_t j=0; j < r->series.size(); j++) series.add_vector_entry(j, r->series[j]);
+                  entries[r->key + ".series"] = series;
+                  if (r->index_name != "" && !r->by_index.empty()) {
+                      metrics_entry byidx(VECTOR);
+                      for(size_t j=0; j < r->by_index.size(); j++) byidx.add_vector_entry(j, r->by_index[j]);
+                      entries[r->key + "." + r->index_name] = byidx;
+                  }
+                  if (perf_counters::global().is_enabled()) {
+                      for(int e=0; e < PERF_NEVENTS; e++) {
+                          entries[r->key + "." + perf_event_names[e]] = metrics_entry((double) r->perf[e], INTEGER);
+                      }
+                  }
+              }
+          }
+          mlock.unlock();
+      }
+      
   };
 
 
@@ -0,0 +1,121 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Hardware performance counters (Linux perf_event) for the metrics phases.
+ * The counters count the whole process: they are inherited by the threads
+ * created after they are opened, so they are opened when the first metrics
+ * object is created. Enabled with metrics.perf=1; if the kernel does not
+ * allow opening them, phases are only timed.
+ */
+
+#ifndef DEF_GRAPHCHI_PERF_COUNTERS
+#define DEF_GRAPHCHI_PERF_COUNTERS
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "util/cmdopts.hpp"
+
+namespace graphchi {
+
+#define PERF_NEVENTS 3
+
+    static const char * perf_event_names[PERF_NEVENTS] = {"cycles", "instructions", "llc-misses"};
+
+    class perf_counters {
+
+        int fds[PERF_NEVENTS];
+        bool enabled;
+
+        perf_counters() : enabled(false) {
+            for(int i=0; i < PERF_NEVENTS; i++) fds[i] = -1;
+#ifdef __linux__
+            if (get_option_int("metrics.perf", 0) == 0) return;
+            const uint64_t configs[PERF_NEVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                     PERF_COUNT_HW_CACHE_MISSES};
+            enabled = true;
+            for(int i=0; i < PERF_NEVENTS; i++) {
+                struct perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = configs[i];
+                attr.inherit = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fds[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+                if (fds[i] < 0) enabled = false;
+            }
+            if (!enabled) {
+                close_all();
+                std::cout << "WARNING: could not open hardware performance counters (see /proc/sys/kernel/perf_event_paranoid)." << std::endl;
+            }
+#endif
+        }
+
+        void close_all() {
+            for(int i=0; i < PERF_NEVENTS; i++) {
+                if (fds[i] >= 0) close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+
+    public:
+
+        ~perf_counters() {
+            close_all();
+        }
+
+        static perf_counters &global() {
+            static perf_counters counters;
+            return counters;
+        }
+
+        bool is_enabled() {
+            return enabled;
+        }
+
+        /**
+         * Reads the current values of the counters.
+         */
+        void read_values(uint64_t * vals) {
+            for(int i=0; i < PERF_NEVENTS; i++) {
+                vals[i] = 0;
+                if (enabled && read(fds[i], &vals[i], sizeof(uint64_t)) != sizeof(uint64_t)) vals[i] = 0;
+            }
+        }
+
+    };
+
+};
+
+#endif
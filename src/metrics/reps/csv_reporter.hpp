@@ -0,0 +1,92 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ 
+ *
+ * @section DESCRIPTION
+ *
+ * CSV metrics reporter. Writes one row per value: numeric entries have
+ * one row with an empty index, and vectors (such as the time series of
+ * the phases) one row per element. Columns:
+ * metric,index,value,count,min,max.
+ */
+
+
+#ifndef DEF_GRAPHCHI_CSV_REPORTER
+#define DEF_GRAPHCHI_CSV_REPORTER
+
+#include <cstdio>
+#include <string>
+
+#include "metrics/metrics.hpp"
+
+namespace graphchi {
+
+  class csv_reporter : public imetrics_reporter {
+  private:
+    csv_reporter() {}
+        
+    std::string filename;
+    FILE * f;
+  public:
+            
+    csv_reporter(std::string fname) : filename(fname) {
+        f = fopen(fname.c_str(), "w");
+        assert(f != NULL);
+    }
+      
+      virtual ~csv_reporter() {}
+            
+      virtual void do_report(std::string name, std::string ident, std::map<std::string, metrics_entry> & entries) {
+          fprintf(f, "metric,index,value,count,min,max\n");
+          std::map<std::string, metrics_entry>::iterator it;
+          for(it = entries.begin(); it != entries.end(); ++it) {
+              metrics_entry &ent = it->second;
+              const char * key = it->first.c_str();
+              switch(ent.valtype) {
+                  case INTEGER:
+                  case REAL:
+                  case TIME:
+                      if (ent.count > 0) {
+                          fprintf(f, "%s,,%.9g,%lu,%.9g,%.9g\n", key, ent.value, (unsigned long) ent.count, ent.minvalue, ent.maxvalue);
+                      } else {
+                          fprintf(f, "%s,,%.9g,0,,\n", key, ent.value);
+                      }
+                      break;
+                  case STRING:
+                      break;
+                  case VECTOR:
+                      for(size_t j=0; j < ent.v.size(); j++) {
+                          fprintf(f, "%s,%lu,%.9g,,,\n", key, (unsigned long) j, ent.v[j]);
+                      }
+                      break;
+              }
+          }
+          fclose(f);
+      };
+        
+  };
+    
+};
+
+
+
+#endif
@@ -0,0 +1,146 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ 
+ *
+ * @section DESCRIPTION
+ *
+ * JSON metrics reporter. Each entry is written as an object with its
+ * type and values; vectors (such as the time series of the phases)
+ * are written as arrays.
+ */
+
+
+#ifndef DEF_GRAPHCHI_JSON_REPORTER
+#define DEF_GRAPHCHI_JSON_REPORTER
+
+#include <cstdio>
+#include <string>
+
+#include "metrics/metrics.hpp"
+
+namespace graphchi {
+
+  class json_reporter : public imetrics_reporter {
+  private:
+    json_reporter() {}
+        
+    std::string filename;
+    FILE * f;
+      
+    static std::string escape(std::string s) {
+        std::string out;
+        for(size_t i=0; i < s.size(); i++) {
+            char c = s[i];
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if ((unsigned char) c < 0x20) {
+                char hex[8];
+                sprintf(hex, "\\u%04x", (int) c);
+                out += hex;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+      
+    /* NaN and infinity are not JSON numbers; they are written as null */
+    void write_number(double x) {
+        if (x - x != 0) {
+            fprintf(f, "null");
+        } else {
+            fprintf(f, "%.9g", x);
+        }
+    }
+      
+    static const char * type_name(metrictype t) {
+        switch(t) {
+            case REAL: return "real";
+            case INTEGER: return "integer";
+            case TIME: return "time";
+            case STRING: return "string";
+            case VECTOR: return "vector";
+        }
+        return "";
+    }
+      
+  public:
+            
+    json_reporter(std::string fname) : filename(fname) {
+        f = fopen(fname.c_str(), "w");
+        assert(f != NULL);
+    }
+      
+      virtual ~json_reporter() {}
+            
+      virtual void do_report(std::string name, std::string ident, std::map<std::string, metrics_entry> & entries) {
+          fprintf(f, "{\n  \"name\": \"%s\",\n  \"id\": \"%s\",\n  \"metrics\": {", escape(name).c_str(), escape(ident).c_str());
+          std::map<std::string, metrics_entry>::iterator it;
+          bool first = true;
+          for(it = entries.begin(); it != entries.end(); ++it) {
+              metrics_entry &ent = it->second;
+              fprintf(f, "%s\n    \"%s\": {\"type\": \"%s\"", (first ? "" : ","), escape(it->first).c_str(), type_name(ent.valtype));
+              first = false;
+              switch(ent.valtype) {
+                  case INTEGER:
+                  case REAL:
+                  case TIME:
+                      fprintf(f, ", \"value\": ");
+                      write_number(ent.value);
+                      fprintf(f, ", \"count\": %lu", (unsigned long) ent.count);
+                      if (ent.count > 0) {
+                          fprintf(f, ", \"min\": ");
+                          write_number(ent.minvalue);
+                          fprintf(f, ", \"max\": ");
+                          write_number(ent.maxvalue);
+                          fprintf(f, ", \"avg\": ");
+                          write_number(ent.cumvalue / ent.count);
+                      }
+                      break;
+                  case STRING:
+                      fprintf(f, ", \"value\": \"%s\"", escape(ent.stringval).c_str());
+                      break;
+                  case VECTOR:
+                      fprintf(f, ", \"value\": ");
+                      write_number(ent.value);
+                      fprintf(f, ", \"values\": [");
+                      for(size_t j=0; j < ent.v.size(); j++) {
+                          if (j > 0) fprintf(f, ", ");
+                          write_number(ent.v[j]);
+                      }
+                      fprintf(f, "]");
+                      break;
+              }
+              fprintf(f, "}");
+          }
+          fprintf(f, "\n  }\n}\n");
+          fclose(f);
+      };
+        
+  };
+    
+};
+
+
+
+#endif
@@ -33,6 +33,9 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <string.h>
+#include <omp.h>
+#include <algorithm>
 
 #include "graphchi_types.hpp"
 #include "logger/logger.hpp"
@@ -191,13 +194,217 @@ namespace graphchi {
         }
     }
     
+    /**
+     * Edge parsed from a text file.
+     */
+    template <typename EdgeDataType>
+    struct parsed_edge {
+        vid_t from;
+        vid_t to;
+        EdgeDataType value;
+        bool has_value;
+    };
+    
+    static inline bool is_text_delim(char c) {
+        return c == ' ' || c == '\t' || c == ',' || c == '\r';
+    }
+    
+    /**
+     * Parses the next unsigned integer of a line. Returns false
+     * if the line has no more tokens or the token is not a number.
+     */
+    static inline bool parse_vid_token(char * &p, char * eol, vid_t &x) {
+        while (p < eol && is_text_delim(*p)) p++;
+        if (p == eol || *p < '0' || *p > '9') return false;
+        vid_t v = 0;
+        while (p < eol && *p >= '0' && *p <= '9') {
+            v = v * 10 + (vid_t) (*p - '0');
+            p++;
+        }
+        x = v;
+        return true;
+    }
+    
+    static void VARIABLE_IS_NOT_USED text_format_error(const char * expected, char * line, char * eol);
+    static void text_format_error(const char * expected, char * line, char * eol) {
+        logstream(LOG_ERROR) << "Input file is not in right format. "
+        << "Expecting \"" << expected << "\". "
+        << "Current line: \"" << std::string(line, eol - line) << "\"\n";
+        assert(false);
+    }
+    
+    /**
+     * Parses the lines of an edge list: "<from> <to> [value]",
+     * delimited by tabs, spaces or commas.
+     */
+    template <typename EdgeDataType>
+    struct edgelist_range_parser {
+        void operator()(char * st, char * en, std::vector<parsed_edge<EdgeDataType> > &out) {
+            char * p = st;
+            while (p < en) {
+                char * eol = (char *) memchr(p, '\n', en - p);
+                if (eol == NULL) eol = en;
+                char * line = p;
+                p = eol + 1;
+                if (line[0] == '#' || line[0] == '%') continue; // Comment
+                
+                parsed_edge<EdgeDataType> e;
+                char * t = line;
+                if (!parse_vid_token(t, eol, e.from)) {
+                    while (t < eol && is_text_delim(*t)) t++;
+                    if (t == eol) continue; // Empty line
+                    text_format_error("<from>\t<to>", line, eol);
+                }
+                if (!parse_vid_token(t, eol, e.to)) {
+                    text_format_error("<from>\t<to>", line, eol);
+                }
+                
+                /* Check if has value */
+                while (t < eol && is_text_delim(*t)) t++;
+                e.has_value = (t < eol);
+                if (e.has_value) {
+                    char * tend = t;
+                    while (tend < eol && !is_text_delim(*tend)) tend++;
+                    *tend = 0; // The buffer has room for the terminator after the last line
+                    parse(e.value, (const char *) t);
+                }
+                if (e.from != e.to) out.push_back(e);
+            }
+        }
+    };
+    
+    /**
+     * Parses the lines of an adjacency list: "<from> <num> <to-1> ... <to-num>".
+     */
+    template <typename EdgeDataType>
+    struct adjlist_range_parser {
+        void operator()(char * st, char * en, std::vector<parsed_edge<EdgeDataType> > &out) {
+            char * p = st;
+            while (p < en) {
+                char * eol = (char *) memchr(p, '\n', en - p);
+                if (eol == NULL) eol = en;
+                char * line = p;
+                p = eol + 1;
+                if (line[0] == '#' || line[0] == '%') continue; // Comment
+                
+                parsed_edge<EdgeDataType> e;
+                e.value = EdgeDataType();
+                e.has_value = true;
+                char * t = line;
+                vid_t num;
+                if (!parse_vid_token(t, eol, e.from)) continue; // Empty line
+                if (!parse_vid_token(t, eol, num)) continue;
+                vid_t i = 0;
+                while (parse_vid_token(t, eol, e.to)) {
+                    if (e.from != e.to) out.push_back(e);
+                    i++;
+                }
+                if (num != i) {
+                    logstream(LOG_ERROR) << "Mismatch when reading adjacency list: " << num << " != " << i
+                    << " line: " << std::string(line, eol - line) << std::endl;
+                    assert(num == i);
+                }
+            }
+        }
+    };
+    
+    /**
+     * Parses a text file in parallel. The file is read in rounds of
+     * preprocessing.threads * preprocessing.chunksize bytes, cut at the last line
+     * break. The round is split at line breaks to a range per thread, and each thread parses
+     * its range to its own batch of edges. The batches are then added to the sharder
+     * in order, so the edges are in the same order as in the file.
+     */
+    template <typename EdgeDataType, typename RangeParser>
+    void convert_text_parallel(std::string inputfile, sharder<EdgeDataType> &sharderobj, RangeParser rangeparser) {
+        int nthreads = get_option_int("preprocessing.threads", omp_get_max_threads());
+        if (nthreads < 1) nthreads = 1;
+        size_t chunksize = get_option_long("preprocessing.chunksize", 16 * 1024 * 1024);
+        size_t roundsize = nthreads * chunksize;
+        
+        int f = open(inputfile.c_str(), O_RDONLY);
+        if (f < 0) {
+            logstream(LOG_FATAL) << "Could not load :" << inputfile << " error: " << strerror(errno) << std::endl;
+        }
+        assert(f >= 0);
+        size_t filesize = lseek(f, 0, SEEK_END);
+        
+        char * buf = (char *) malloc(roundsize + 1);
+        std::vector<std::vector<parsed_edge<EdgeDataType> > > batches(nthreads);
+        std::vector<size_t> cuts(nthreads + 1);
+        size_t pos = 0;
+        size_t nedges = 0;
+        size_t lastlog = 0;
+        metrics_entry me;
+        me.timer_start();
+        
+        while (pos < filesize) {
+            size_t len = std::min(roundsize, filesize - pos);
+            preada(f, buf, len, pos);
+            size_t uselen = len;
+            if (pos + len < filesize) {
+                char * lastnl = (char *) memrchr(buf, '\n', len);
+                if (lastnl == NULL) {
+                    /* Line longer than the round */
+                    roundsize *= 2;
+                    buf = (char *) realloc(buf, roundsize + 1);
+                    continue;
+                }
+                uselen = lastnl - buf + 1;
+            }
+            
+            cuts[0] = 0;
+            cuts[nthreads] = uselen;
+            for(int t=1; t < nthreads; t++) {
+                size_t c = std::max(uselen * t / nthreads, cuts[t - 1]);
+                char * nl = (c < uselen ? (char *) memchr(buf + c, '\n', uselen - c) : NULL);
+                cuts[t] = (nl == NULL ? uselen : nl - buf + 1);
+            }
+            
+#pragma omp parallel for schedule(static, 1) num_threads(nthreads)
+            for(int t=0; t < nthreads; t++) {
+                batches[t].clear();
+                rangeparser(buf + cuts[t], buf + cuts[t + 1], batches[t]);
+            }
+            
+            for(int t=0; t < nthreads; t++) {
+                std::vector<parsed_edge<EdgeDataType> > &batch = batches[t];
+                for(size_t i=0; i < batch.size(); i++) {
+                    if (batch[i].has_value) {
+                        sharderobj.preprocessing_add_edge(batch[i].from, batch[i].to, batch[i].value);
+                    } else {
+                        sharderobj.preprocessing_add_edge(batch[i].from, batch[i].to);
+                    }
+                }
+                nedges += batch.size();
+            }
+            
+            pos += uselen;
+            if (pos - lastlog >= 500000000) {
+                logstream(LOG_DEBUG) << "Read " << nedges << " edges, " << pos / 1024 / 1024.  << " MB" << std::endl;
+                lastlog = pos;
+            }
+        }
+        free(buf);
+        close(f);
+        
+        me.timer_stop();
+        logstream(LOG_INFO) << "Parsed " << nedges << " edges in " << me.lasttime << " secs ("
+            << (me.lasttime > 0 ? nedges / me.lasttime / 1e6 : 0) << " M edges/sec), " << nthreads << " threads." << std::endl;
+    }
+    
     /**
      * Converts graph from an edge list format. Input may contain
      * value for the edges. Self-edges are ignored.
      */
     template <typename EdgeDataType>
     void convert_edgelist(std::string inputfile, sharder<EdgeDataType> &sharderobj, bool multivalue_edges=false) {
-        
+        if (!multivalue_edges) {
+            logstream(LOG_INFO) << "Reading in edge list format!" << std::endl;
+            convert_text_parallel(inputfile, sharderobj, edgelist_range_parser<EdgeDataType>());
+            return;
+        }
+#ifdef DYNAMICEDATA
         FILE * inf = fopen(inputfile.c_str(), "r");
         size_t bytesread = 0;
         size_t linenum = 0;
@@ -206,7 +413,7 @@ namespace graphchi {
         }
         assert(inf != NULL);
         
-        logstream(LOG_INFO) << "Reading in edge list format!" << std::endl;
+        logstream(LOG_INFO) << "Reading in multivalue edge list format!" << std::endl;
         char s[1024];
         while(fgets(s, 1024, inf) != NULL) {
             linenum++;
@@ -237,42 +444,25 @@ namespace graphchi {
             }
             vid_t to = atoi(t);
             
-            /* Check if has value */
+            /* Values */
             t = strtok(NULL, delims);
+            std::vector<EdgeDataType> vals;
             
-            if (!multivalue_edges) {
-                EdgeDataType val;
-                if (t != NULL) {
-                    parse(val, (const char*) t);
+            parse_multiple(vals, (char*) t);
+            if (from != to) {
+                if (vals.size() == 0) {
+                    // TODO: go around this problem
+                    logstream(LOG_FATAL) << "Each edge needs at least one value." << std::endl;
+                    assert(vals.size() > 0);
                 }
-                if (from != to) {
-                    if (t != NULL) {
-                        sharderobj.preprocessing_add_edge(from, to, val);
-                    } else {
-                        sharderobj.preprocessing_add_edge(from, to);
-                    }
-                }
-            } else {
-#ifdef DYNAMICEDATA
-                std::vector<EdgeDataType> vals;
-                
-                parse_multiple(vals, (char*) t);
-                if (from != to) {
-                    if (vals.size() == 0) {
-                        // TODO: go around this problem
-                        logstream(LOG_FATAL) << "Each edge needs at least one value." << std::endl;
-                        assert(vals.size() > 0);
-                    }
-                    sharderobj.preprocessing_add_edge_multival(from, to, vals);
-                }
-                
-#else
-                logstream(LOG_FATAL) << "To support multivalue-edges, dynamic edge data needs to be used." << std::endl;
-                assert(false);
-#endif
+                sharderobj.preprocessing_add_edge_multival(from, to, vals);
             }
         }
         fclose(inf);
+#else
+        logstream(LOG_FATAL) << "To support multivalue-edges, dynamic edge data needs to be used." << std::endl;
+        assert(false);
+#endif
     }
     
     
@@ -283,55 +473,10 @@ namespace graphchi {
      */
     template <typename EdgeDataType>
     void convert_adjlist(std::string inputfile, sharder<EdgeDataType> &sharderobj) {
-        FILE * inf = fopen(inputfile.c_str(), "r");
-        if (inf == NULL) {
-            logstream(LOG_FATAL) << "Could not load :" << inputfile << " error: " << strerror(errno) << std::endl;
-        }
-        assert(inf != NULL);
         logstream(LOG_INFO) << "Reading in adjacency list format!" << std::endl;
-        
-        int maxlen = 100000000;
-        char * s = (char*) malloc(maxlen);
-        
-        size_t bytesread = 0;
-        
-        char delims[] = " \t";
-        size_t linenum = 0;
-        size_t lastlog = 0;
-        /*** PHASE 1 - count ***/
-        while(fgets(s, maxlen, inf) != NULL) {
-            linenum++;
-            if (bytesread - lastlog >= 500000000) {
-                logstream(LOG_DEBUG) << "Read " << linenum << " lines, " << bytesread / 1024 / 1024.  << " MB" << std::endl;
-                lastlog = bytesread;
-            }
-            FIXLINE(s);
-            bytesread += strlen(s);
-            
-            if (s[0] == '#') continue; // Comment
-            if (s[0] == '%') continue; // Comment
-            char * t = strtok(s, delims);
-            vid_t from = atoi(t);
-            t = strtok(NULL,delims);
-            if (t != NULL) {
-                vid_t num = atoi(t);
-                vid_t i = 0;
-                while((t = strtok(NULL,delims)) != NULL) {
-                    vid_t to = atoi(t);
-                    if (from != to) {
-                        sharderobj.preprocessing_add_edge(from, to, EdgeDataType());
-                    }
-                    i++;
-                }
-                if (num != i)
-                    logstream(LOG_ERROR) << "Mismatch when reading adjacency list: " << num << " != " << i << " s: " << std::string(s)
-                    << " on line: " << linenum << std::endl;
-                assert(num == i);
-            }
-        }
-        free(s);
-        fclose(inf);
+        convert_text_parallel(inputfile, sharderobj, adjlist_range_parser<EdgeDataType>());
     }
+
     
     /**
      * Converts a graph from cassovary's (Twitter) format. Edge values are not supported,
@@ -671,11 +816,15 @@ namespace graphchi {
     
     /**
      * Special preprocessor which relabels vertices in ascending order
-     * of their degree.
+     * of their degree. If orient is set, each edge is also directed
+     * from the endpoint of lower degree to the one of higher degree,
+     * and self-edges are dropped. Then every vertex has at most
+     * O(sqrt(|E|)) out-edges, which bounds the work of triangle counting.
      */
     template <typename EdgeDataType>
     class OrderByDegree : public SharderPreprocessor<EdgeDataType> {
         int phase;
+        bool orient;
         
     public:
         typedef edge_with_value<EdgeDataType> edge_t;
@@ -683,7 +832,7 @@ namespace graphchi {
         vid_t max_vertex_id;
         vertex_degree * degarray;
         binary_adjacency_list_writer<EdgeDataType> * writer;
-        OrderByDegree() {
+        OrderByDegree(bool orient=false) : orient(orient) {
             degarray = NULL;
             writer = NULL;
         }
@@ -696,7 +845,7 @@ namespace graphchi {
         }
         
         std::string getSuffix() {
-            return "_degord";
+            return orient ? "_degord_oriented" : "_degord";
         }
         
         vid_t translate(vid_t vid) {
@@ -714,8 +863,11 @@ namespace graphchi {
             if (phase == 0) {
                 degarray[from].deg++;
                 degarray[to].deg++;
-            } else {
+            } else if (!orient) {
                 writer->add_edge(translate(from), translate(to)); // Value is ignored
+            } else if (from != to) {
+                vid_t tf = translate(from), tt = translate(to);
+                writer->add_edge(std::min(tf, tt), std::max(tf, tt));
             }
         }
         void reprocess(std::string preprocessedFile, std::string baseFilename) {
@@ -741,7 +893,8 @@ namespace graphchi {
             for(vid_t i=0; i<nverts; i++) {
                 translate_table[degarray[i].id] = i;
             }
-            delete degarray;
+            free(degarray);
+            degarray = NULL;
             
             /* Write translate table */
             std::string translate_table_file = baseFilename + ".vertexmap";
@@ -766,7 +919,7 @@ namespace graphchi {
             delete writer;
             writer = NULL;
             
-            delete translate_table;
+            free(translate_table);
         }
         
     };
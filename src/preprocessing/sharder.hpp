@@ -59,8 +59,11 @@
 #include "preprocessing/formats/binary_adjacency_list.hpp"
 #include "shards/memoryshard.hpp"
 #include "shards/slidingshard.hpp"
+#include "shards/adjacency_codec.hpp"
 #include "util/ioutil.hpp"
+#include "util/pthread_tools.hpp"
 #include "util/qsort.hpp"
+#include "util/radixsort.hpp"
 
 namespace graphchi {
     
@@ -129,12 +132,12 @@ namespace graphchi {
         std::string prefix;
         
         int compressed_block_size;
+        int adjformat;
         
         edge_t ** bufs;
         int * bufptrs;
         size_t bufsize;
         size_t edgedatasize;
-        size_t ebuffer_size;
         size_t edges_per_block;
         
         vid_t filter_max_vertex;
@@ -157,7 +160,17 @@ namespace graphchi {
             filter_max_vertex = 0;
             while (compressed_block_size % sizeof(EdgeDataType) != 0) compressed_block_size++;
             edges_per_block = compressed_block_size / sizeof(EdgeDataType);
-
+            configure_block_codec();
+            
+            /* Shard adjacency format: "raw" or "svb" (gap-encoded StreamVByte) */
+            adjformat = ADJ_FORMAT_RAW;
+            if (get_option_string("shard.adjformat", "raw") == "svb") {
+#ifndef DYNAMICEDATA
+                adjformat = ADJ_FORMAT_SVB;
+#else
+                logstream(LOG_WARNING) << "Dynamic edge data shards are written in the raw adjacency format, ignoring shard.adjformat=svb" << std::endl;
+#endif
+            }
         }
         
         
@@ -267,20 +280,45 @@ namespace graphchi {
             bufptr += sizeof(T);
         }
         
-        int blockid;
+        /** Buffered write of an array of bytes */
+        void bwrite_bytes(int f, char * buf, char * &bufptr, const uint8_t * data, size_t len) {
+            if (bufptr + len - buf >= SHARDER_BUFSIZE) {
+                writea(f, buf, bufptr - buf);
+                bufptr = buf;
+                if (len >= SHARDER_BUFSIZE) {
+                    writea(f, (char *) data, len);
+                    return;
+                }
+            }
+            memcpy(bufptr, data, len);
+            bufptr += len;
+        }
         
-        template <typename T>
-        void edata_flush(char * buf, char * bufptr, std::string & shard_filename, size_t totbytes) {
-            int len = (int) (bufptr - buf);
+        /**
+         * Buffered writer of the edge data blocks of one shard. Each shard has its
+         * own writer, so that shards can be written in parallel.
+         */
+        struct edata_writer {
+            std::string filename;
+            char * buf;
+            char * bufptr;
+            size_t bufsize;
+            int blockid;
+            size_t totbytes;
+            size_t edgecounter;
+        };
+        
+        void edata_flush(edata_writer &w) {
+            int len = (int) (w.bufptr - w.buf);
             
-            m.start_time("edata_flush");
+            metrics_entry me = m.start_time();
             
-            std::string block_filename = filename_shard_edata_block(shard_filename, blockid, compressed_block_size);
+            std::string block_filename = filename_shard_edata_block(w.filename, w.blockid, compressed_block_size);
             int f = open(block_filename.c_str(), O_RDWR | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
-            write_compressed(f, buf, len);
+            write_compressed(f, w.buf, len);
             close(f);
             
-            m.stop_time("edata_flush");
+            m.stop_time(me, "edata_flush");
 
             
 #ifdef DYNAMICEDATA
@@ -289,32 +327,31 @@ namespace graphchi {
             
 #endif
             
-            blockid++;
+            w.blockid++;
         }
         
         template <typename T>
-        void bwrite_edata(char * &buf, char * &bufptr, T val, size_t & totbytes, std::string & shard_filename,
-                          size_t & edgecounter) {
+        void bwrite_edata(edata_writer &w, T val) {
             if (no_edgevalues) return;
             
-            if (edgecounter == edges_per_block) {
-                edata_flush<T>(buf, bufptr, shard_filename, totbytes);
-                bufptr = buf;
-                edgecounter = 0;
+            if (w.edgecounter == edges_per_block) {
+                edata_flush(w);
+                w.bufptr = w.buf;
+                w.edgecounter = 0;
             }
             
             // Check if buffer is big enough
-            if (bufptr - buf + sizeof(T) > ebuffer_size) {
-                ebuffer_size *= 2;
-                logstream(LOG_DEBUG) << "Increased buffer size to: " << ebuffer_size << std::endl;
-                size_t ptroff = bufptr - buf; // Remember the offset
-                buf = (char *) realloc(buf, ebuffer_size);
-                bufptr = buf + ptroff;
+            if (w.bufptr - w.buf + sizeof(T) > w.bufsize) {
+                w.bufsize *= 2;
+                logstream(LOG_DEBUG) << "Increased buffer size to: " << w.bufsize << std::endl;
+                size_t ptroff = w.bufptr - w.buf; // Remember the offset
+                w.buf = (char *) realloc(w.buf, w.bufsize);
+                w.bufptr = w.buf + ptroff;
             }
             
-            totbytes += sizeof(T);
-            *((T*)bufptr) = val;
-            bufptr += sizeof(T);
+            w.totbytes += sizeof(T);
+            *((T*)w.bufptr) = val;
+            w.bufptr += sizeof(T);
         }
         
         
@@ -622,7 +659,7 @@ namespace graphchi {
         }
         
         size_t read_shovel(int shard, char ** data) {
-            m.start_time("read_shovel");
+            metrics_entry me = m.start_time();
             size_t sz = shovelsizes[shard];
             *data = (char *) malloc(sz);
             char * ptr = * data;
@@ -636,20 +673,40 @@ namespace graphchi {
                 std::string shovelfblockname = ss.str();
                 int f = open(shovelfblockname.c_str(), O_RDONLY);
                 if (f < 0) break;
-                m.start_time("shovel_read");
+                metrics_entry mr = m.start_time();
                 preada(f, ptr, len, 0);
-                m.stop_time("shovel_read");
+                m.stop_time(mr, "shovel_read");
                 nread += len;
                 ptr += len;
                 close(f);
                 blockidx++;
                 remove(shovelfblockname.c_str());
             }
-            m.stop_time("read_shovel");
+            m.stop_time(me, "read_shovel");
             assert(nread == sz);
             return sz;
         }
         
+        /**
+         * Sorts the shovel by (src, dst). Radix sort on the concatenated
+         * ids, except for dynamic edge data, which also sorts by the value index.
+         */
+        void sort_shovel(edge_t * shovelbuf, size_t numedges, int nthreads) {
+#ifndef DYNAMICEDATA
+            int idbits = radix_key_bits(max_vertex_id);
+            radixSort(shovelbuf, numedges, 2 * idbits, edge_src_dst_key(idbits), nthreads);
+#else
+            quickSort(shovelbuf, (int)numedges, edge_t_src_less<EdgeDataType>);
+#endif
+        }
+        
+        struct edge_src_dst_key {
+            int idbits;
+            edge_src_dst_key(int idbits) : idbits(idbits) {}
+            inline uint64_t operator()(const edge_t &e) const {
+                return ((uint64_t)e.src << idbits) | e.dst;
+            }
+        };
         
         /**
          * Write the shard by sorting the shovel file and compressing the
@@ -678,205 +735,282 @@ namespace graphchi {
                 degrees = (degree *) calloc(1 + max_vertex_id, sizeof(degree));
             }
             
+            /* Shards are written concurrently if the memory budget allows: a shard
+               needs its shovel twice (the sort buffer) and the write buffers. While
+               one shard reads its shovel, the others sort and write. The rest of the
+               threads are used for sorting. */
+            int nthreads = get_option_int("sharder.threads", omp_get_max_threads());
+            if (nthreads < 1) nthreads = 1;
+            size_t maxshovel = 0;
+            for(int shard=0; shard < nshards; shard++) maxshovel = std::max(maxshovel, shovelsizes[shard]);
+            size_t shardmem = 2 * maxshovel + SHARDER_BUFSIZE + 2 * compressed_block_size;
+            int nconcurrent = (int) std::min((size_t)std::min(nthreads, nshards), size_t(membudget_mb) * 1024 * 1024 / shardmem);
+            if (nconcurrent < 1) nconcurrent = 1;
+            int sortthreads = std::max(1, nthreads / nconcurrent);
+            omp_set_nested(1);
+            logstream(LOG_INFO) << "Writing " << nshards << " shards, " << nconcurrent << " at a time, "
+                << sortthreads << " sort threads each." << std::endl;
+            
+            metrics_entry me = m.start_time();
+            size_t totaledges = 0;
+            int shards_done = 0;
+            mutex progresslock;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nconcurrent)
             for(int shard=0; shard < nshards; shard++) {
-                m.start_time("shard_final");
-                blockid = 0;
-                size_t edgecounter = 0;
-                
-                logstream(LOG_INFO) << "Starting final processing for shard: " << shard << std::endl;
-                
-                std::string fname = filename_shard_adj(basefilename, shard, nshards);
-                std::string edfname = filename_shard_edata<EdgeDataType>(basefilename, shard, nshards);
-                std::string edblockdirname = dirname_shard_edata_block(edfname, compressed_block_size);
-                
-                /* Make the block directory */
-                if (!no_edgevalues)
-                    mkdir(edblockdirname.c_str(), 0777);
-                
-                edge_t * shovelbuf;
-                size_t shovelsize = read_shovel(shard, (char**) &shovelbuf);
-                size_t numedges = shovelsize / sizeof(edge_t);
-                
-                logstream(LOG_DEBUG) << "Shovel size:" << shovelsize << " edges: " << numedges << std::endl;
-                
-                quickSort(shovelbuf, (int)numedges, edge_t_src_less<EdgeDataType>);
+                size_t numedges = write_shard(shard, degrees, nconcurrent > 1, sortthreads);
+                progresslock.lock();
+                totaledges += numedges;
+                shards_done++;
+                logstream(LOG_INFO) << "Shard " << shard << " done (" << shards_done << "/" << nshards << "), "
+                    << numedges << " edges." << std::endl;
+                progresslock.unlock();
+            }
+            m.stop_time(me, "write_shards");
+            me.timer_stop();
+            double secs = me.lasttime;
+            if (secs > 0) {
+                m.set("write_shards.edges_per_sec", totaledges / secs);
+            }
+            m.set("write_shards.concurrent", (size_t)nconcurrent);
+            m.set("write_shards.sortthreads", (size_t)sortthreads);
+            
+            if (!count_degrees_inmem) {
+#ifndef DYNAMICEDATA
+                // Use memory-efficient (but slower) method to create degree-data
+                create_degree_file();
+#endif
                 
-                // Create the final file
-                int f = open(fname.c_str(), O_WRONLY | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
-                if (f < 0) {
-                    logstream(LOG_ERROR) << "Could not open " << fname << " error: " << strerror(errno) << std::endl;
+            } else {
+                std::string degreefname = filename_degree_data(basefilename);
+                int degreeOutF = open(degreefname.c_str(), O_RDWR | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+                if (degreeOutF < 0) {
+                    logstream(LOG_ERROR) << "Could not create: " << degreeOutF << std::endl;
+                    assert(degreeOutF >= 0);
                 }
-                assert(f >= 0);
-                int trerr = ftruncate(f, 0);
-                assert(trerr == 0);
-                
-                char * buf = (char*) malloc(SHARDER_BUFSIZE);
-                char * bufptr = buf;
                 
-                char * ebuf = (char*) malloc(compressed_block_size);
-                ebuffer_size = compressed_block_size;
-                char * ebufptr = ebuf;
-                
-                vid_t curvid=0;
+                writea(degreeOutF, degrees, sizeof(degree) * (1 + max_vertex_id));
+                free(degrees);
+                close(degreeOutF);
+            }
+            
+        }
+        
+        /**
+         * Reads, sorts and writes one shard. Can be called for
+         * several shards in parallel.
+         * @param atomic_degrees if true, the out-degrees are incremented atomically, as other
+         *        shards may have edges from the same vertex.
+         * @return number of edges in the shard
+         */
+        size_t write_shard(int shard, degree * degrees, bool atomic_degrees, int sortthreads) {
+            metrics_entry shard_me = m.start_time();
+            
+            logstream(LOG_INFO) << "Starting final processing for shard: " << shard << std::endl;
+            
+            std::string fname = filename_shard_adj(basefilename, shard, nshards);
+            std::string edfname = filename_shard_edata<EdgeDataType>(basefilename, shard, nshards);
+            std::string edblockdirname = dirname_shard_edata_block(edfname, compressed_block_size);
+            
+            /* Make the block directory */
+            if (!no_edgevalues)
+                mkdir(edblockdirname.c_str(), 0777);
+            
+            edge_t * shovelbuf;
+            size_t shovelsize = read_shovel(shard, (char**) &shovelbuf);
+            size_t numedges = shovelsize / sizeof(edge_t);
+            
+            logstream(LOG_DEBUG) << "Shovel size:" << shovelsize << " edges: " << numedges << std::endl;
+            
+            metrics_entry sort_me = m.start_time();
+            sort_shovel(shovelbuf, numedges, sortthreads);
+            m.stop_time(sort_me, "shovel_sort");
+            
+            metrics_entry write_me = m.start_time();
+            
+            // Create the final file
+            int f = open(fname.c_str(), O_WRONLY | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
+            if (f < 0) {
+                logstream(LOG_ERROR) << "Could not open " << fname << " error: " << strerror(errno) << std::endl;
+            }
+            assert(f >= 0);
+            int trerr = ftruncate(f, 0);
+            assert(trerr == 0);
+            
+            char * buf = (char*) malloc(SHARDER_BUFSIZE);
+            char * bufptr = buf;
+            
+            /* Compressed adjacency format: header, and gap-encoded neighbor lists */
+            bool svb_adjacency = (adjformat == ADJ_FORMAT_SVB);
+            std::vector<vid_t> nbrs;
+            std::vector<uint8_t> encbuf;
+            if (svb_adjacency) {
+                bwrite_bytes(f, buf, bufptr, svb_adj_header, SVB_ADJ_HEADER_SIZE);
+            }
+            
+            edata_writer ew;
+            ew.filename = edfname;
+            ew.buf = (char*) malloc(compressed_block_size);
+            ew.bufsize = compressed_block_size;
+            ew.bufptr = ew.buf;
+            ew.blockid = 0;
+            ew.totbytes = 0;
+            ew.edgecounter = 0;
+            
+            vid_t curvid=0;
 #ifdef DYNAMICEDATA
-                vid_t lastdst = 0xffffffff;
-                int jumpover = 0;
-                size_t num_uniq_edges = 0;
-                size_t last_edge_count = 0;
+            vid_t lastdst = 0xffffffff;
+            int jumpover = 0;
+            size_t num_uniq_edges = 0;
+            size_t last_edge_count = 0;
 #endif
-                size_t istart = 0;
-                size_t tot_edatabytes = 0;
-                for(size_t i=0; i <= numedges; i++) {
+            size_t istart = 0;
+            for(size_t i=0; i <= numedges; i++) {
 #ifdef DYNAMICEDATA
-                    i += jumpover;  // With dynamic values, there might be several values for one edge, and thus the edge repeated in the data.
-                    jumpover = 0;
+                i += jumpover;  // With dynamic values, there might be several values for one edge, and thus the edge repeated in the data.
+                jumpover = 0;
 #endif //DYNAMICEDATA
-                    edge_t edge = (i < numedges ? shovelbuf[i] : edge_t(0, 0, EdgeDataType())); // Last "element" is a stopper
-                                        
+                edge_t edge = (i < numedges ? shovelbuf[i] : edge_t(0, 0, EdgeDataType())); // Last "element" is a stopper
+                                    
 #ifdef DYNAMICEDATA
-             
-                    if (lastdst == edge.dst && edge.src == curvid) {
-                        // Currently not supported
-                        logstream(LOG_ERROR) << "Duplicate edge in the stream - aborting" << std::endl;
-                        assert(false);
-                    }
-                    lastdst = edge.dst;
+         
+                if (lastdst == edge.dst && edge.src == curvid) {
+                    // Currently not supported
+                    logstream(LOG_ERROR) << "Duplicate edge in the stream - aborting" << std::endl;
+                    assert(false);
+                }
+                lastdst = edge.dst;
 #endif
-                    
-                    if (!edge.stopper()) {
+                
+                if (!edge.stopper()) {
 #ifndef DYNAMICEDATA
-                        bwrite_edata<EdgeDataType>(ebuf, ebufptr, EdgeDataType(edge.value), tot_edatabytes, edfname, edgecounter);
+                    bwrite_edata<EdgeDataType>(ew, EdgeDataType(edge.value));
 #else
-                        /* If we have dynamic edge data, we need to write the header of chivector - if there are edge values */
-                        if (edge.is_chivec_value) {
-                            // Need to check how many values for this edge
-                            int count = 1;
-                            while(shovelbuf[i + count].valindex == count) { count++; }
-                           
-                            assert(count < 32768);
-                            
-                            typename chivector<EdgeDataType>::sizeword_t szw;
-                            ((uint16_t *) &szw)[0] = (uint16_t)count;  // Sizeword with length and capacity = count
-                            ((uint16_t *) &szw)[1] = (uint16_t)count;
-                            bwrite_edata<typename chivector<EdgeDataType>::sizeword_t>(ebuf, ebufptr, szw, tot_edatabytes, edfname, edgecounter);
-                            for(int j=0; j < count; j++) {
-                                bwrite_edata<EdgeDataType>(ebuf, ebufptr, EdgeDataType(shovelbuf[i + j].value), tot_edatabytes, edfname, edgecounter);
-                            }
-                            jumpover = count - 1; // Jump over
-                        } else {
-                            // Just write size word with zero
-                            bwrite_edata<int>(ebuf, ebufptr, 0, tot_edatabytes, edfname, edgecounter);
+                    /* If we have dynamic edge data, we need to write the header of chivector - if there are edge values */
+                    if (edge.is_chivec_value) {
+                        // Need to check how many values for this edge
+                        int count = 1;
+                        while(shovelbuf[i + count].valindex == count) { count++; }
+                       
+                        assert(count < 32768);
+                        
+                        typename chivector<EdgeDataType>::sizeword_t szw;
+                        ((uint16_t *) &szw)[0] = (uint16_t)count;  // Sizeword with length and capacity = count
+                        ((uint16_t *) &szw)[1] = (uint16_t)count;
+                        bwrite_edata<typename chivector<EdgeDataType>::sizeword_t>(ew, szw);
+                        for(int j=0; j < count; j++) {
+                            bwrite_edata<EdgeDataType>(ew, EdgeDataType(shovelbuf[i + j].value));
                         }
-                        num_uniq_edges++;
+                        jumpover = count - 1; // Jump over
+                    } else {
+                        // Just write size word with zero
+                        bwrite_edata<int>(ew, 0);
+                    }
+                    num_uniq_edges++;
 
 #endif
-                        edgecounter++; // Increment edge counter here --- notice that dynamic edata case makes two or more calls to bwrite_edata before incrementing
-                    }
-                    if (degrees != NULL && edge.src != edge.dst) {
+                    ew.edgecounter++; // Increment edge counter here --- notice that dynamic edata case makes two or more calls to bwrite_edata before incrementing
+                }
+                if (degrees != NULL && edge.src != edge.dst) {
+                    if (atomic_degrees) {
+                        __sync_add_and_fetch(&degrees[edge.src].outdegree, 1);
+                    } else {
                         degrees[edge.src].outdegree++;
-                        degrees[edge.dst].indegree++;
                     }
-                    
-                    if ((edge.src != curvid) || edge.stopper()) {
-                        // New vertex
+                    degrees[edge.dst].indegree++;  // Only this shard has in-edges of dst
+                }
+                
+                if ((edge.src != curvid) || edge.stopper()) {
+                    // New vertex
 #ifndef DYNAMICEDATA
-                        size_t count = i - istart;
+                    size_t count = i - istart;
 #else
-                        size_t count = num_uniq_edges - 1 - last_edge_count;
-                        last_edge_count = num_uniq_edges - 1;
-                        if (edge.stopper()) count++;  
+                    size_t count = num_uniq_edges - 1 - last_edge_count;
+                    last_edge_count = num_uniq_edges - 1;
+                    if (edge.stopper()) count++;  
 #endif
-                        assert(count>0 || curvid==0);
-                        if (count>0) {
-                            if (count < 255) {
-                                uint8_t x = (uint8_t)count;
-                                bwrite<uint8_t>(f, buf, bufptr, x);
-                            } else {
-                                bwrite<uint8_t>(f, buf, bufptr, 0xff);
-                                bwrite<uint32_t>(f, buf, bufptr, (uint32_t)count);
-                            }
+                    assert(count>0 || curvid==0);
+                    if (count>0) {
+                        if (count < 255) {
+                            uint8_t x = (uint8_t)count;
+                            bwrite<uint8_t>(f, buf, bufptr, x);
+                        } else {
+                            bwrite<uint8_t>(f, buf, bufptr, 0xff);
+                            bwrite<uint32_t>(f, buf, bufptr, (uint32_t)count);
                         }
-                        
+                    }
+                    
 #ifndef DYNAMICEDATA
+                    if (svb_adjacency && count > 0) {
+                        /* Shovel is sorted by (src, dst) */
+                        nbrs.resize(count);
+                        for(size_t j=istart; j < i; j++) {
+                            nbrs[j - istart] = shovelbuf[j].dst;
+                        }
+                        encbuf.resize(svb_max_bytes(count));
+                        size_t enclen = svb_encode_neighbors(&nbrs[0], count, &encbuf[0]);
+                        bwrite_bytes(f, buf, bufptr, &encbuf[0], enclen);
+                    } else if (!svb_adjacency) {
                         for(size_t j=istart; j < i; j++) {
                             bwrite(f, buf, bufptr,  shovelbuf[j].dst);
                         }
+                    }
 #else
-                        // Special dealing with dynamic edata because some edges can be present multiple
-                        // times in the shovel.
-                        for(size_t j=istart; j < i; j++) {
-                            if (j == istart || shovelbuf[j - 1].dst != shovelbuf[j].dst) {
-                                bwrite(f, buf, bufptr,  shovelbuf[j].dst);
-                            }
+                    // Special dealing with dynamic edata because some edges can be present multiple
+                    // times in the shovel.
+                    for(size_t j=istart; j < i; j++) {
+                        if (j == istart || shovelbuf[j - 1].dst != shovelbuf[j].dst) {
+                            bwrite(f, buf, bufptr,  shovelbuf[j].dst);
                         }
+                    }
 #endif
-                        istart = i;
+                    istart = i;
 #ifdef DYNAMICEDATA
-                        istart += jumpover;
+                    istart += jumpover;
 #endif
-                        
-                        // Handle zeros
-                        if (!edge.stopper()) {
-                            if (edge.src - curvid > 1 || (i == 0 && edge.src>0)) {
-                                int nz = edge.src - curvid - 1;
-                                if (i == 0 && edge.src > 0) nz = edge.src; // border case with the first one
-                                do {
-                                    bwrite<uint8_t>(f, buf, bufptr, 0);
-                                    nz--;
-                                    int tnz = std::min(254, nz);
-                                    bwrite<uint8_t>(f, buf, bufptr, (uint8_t) tnz);
-                                    nz -= tnz;
-                                } while (nz>0);
-                            }
+                    
+                    // Handle zeros
+                    if (!edge.stopper()) {
+                        if (edge.src - curvid > 1 || (i == 0 && edge.src>0)) {
+                            int nz = edge.src - curvid - 1;
+                            if (i == 0 && edge.src > 0) nz = edge.src; // border case with the first one
+                            do {
+                                bwrite<uint8_t>(f, buf, bufptr, 0);
+                                nz--;
+                                int tnz = std::min(254, nz);
+                                bwrite<uint8_t>(f, buf, bufptr, (uint8_t) tnz);
+                                nz -= tnz;
+                            } while (nz>0);
                         }
-                        curvid = edge.src;
                     }
+                    curvid = edge.src;
                 }
-                
-                /* Flush buffers and free memory */
-                writea(f, buf, bufptr - buf);
-                free(buf);
-                free(shovelbuf);
-                close(f);
-                
-                /* Write edata size file */
-                if (!no_edgevalues) {
-                    edata_flush<EdgeDataType>(ebuf, ebufptr, edfname, tot_edatabytes);
-                    
-                    std::string sizefilename = edfname + ".size";
-                    std::ofstream ofs(sizefilename.c_str());
-#ifndef DYNAMICEDATA
-                    ofs << tot_edatabytes;
-#else
-                    ofs << num_uniq_edges * sizeof(int); // For dynamic edge data, write the number of edges.
-#endif
-                    
-                    ofs.close();
-                }
-                free(ebuf);
-                
-                m.stop_time("shard_final");
             }
             
-            if (!count_degrees_inmem) {
+            /* Flush buffers and free memory */
+            writea(f, buf, bufptr - buf);
+            free(buf);
+            free(shovelbuf);
+            close(f);
+            
+            /* Write edata size file */
+            if (!no_edgevalues) {
+                edata_flush(ew);
+                
+                std::string sizefilename = edfname + ".size";
+                std::ofstream ofs(sizefilename.c_str());
 #ifndef DYNAMICEDATA
-                // Use memory-efficient (but slower) method to create degree-data
-                create_degree_file();
+                ofs << ew.totbytes;
+#else
+                ofs << num_uniq_edges * sizeof(int); // For dynamic edge data, write the number of edges.
 #endif
                 
-            } else {
-                std::string degreefname = filename_degree_data(basefilename);
-                int degreeOutF = open(degreefname.c_str(), O_RDWR | O_CREAT, S_IROTH | S_IWOTH | S_IWUSR | S_IRUSR);
-                if (degreeOutF < 0) {
-                    logstream(LOG_ERROR) << "Could not create: " << degreeOutF << std::endl;
-                    assert(degreeOutF >= 0);
-                }
-                
-                writea(degreeOutF, degrees, sizeof(degree) * (1 + max_vertex_id));
-                free(degrees);
-                close(degreeOutF);
+                ofs.close();
             }
+            free(ew.buf);
             
+            m.stop_time(write_me, "shard_write");
+            m.stop_time(shard_me, "shard_final");
+            return numedges;
         }
         
         
@@ -0,0 +1,231 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Compressed shard adjacency format. The vertex records have the same
+ * count tags as the original format (count byte, 0xff + 32-bit count,
+ * or 0x00 + number of empty vertices), but the sorted neighbor list is
+ * stored as gaps in StreamVByte encoding: first one control byte per
+ * four neighbors (2 bits per neighbor: number of bytes - 1), then the
+ * data bytes. The decoder uses SSSE3 shuffles if the CPU supports them.
+ *
+ * A compressed adjacency file starts with an 8-byte header. The header
+ * begins with three zero bytes, which never start a file in the
+ * original format.
+ */
+
+#ifndef DEF_GRAPHCHI_ADJACENCY_CODEC
+#define DEF_GRAPHCHI_ADJACENCY_CODEC
+
+#include <string>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "graphchi_types.hpp"
+#include "logger/logger.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GRAPHCHI_SVB_SSSE3
+#include <immintrin.h>
+#endif
+
+namespace graphchi {
+
+    enum adjacency_format { ADJ_FORMAT_RAW = 0, ADJ_FORMAT_SVB = 1 };
+
+    static const size_t SVB_ADJ_HEADER_SIZE = 8;
+    static const uint8_t svb_adj_header[SVB_ADJ_HEADER_SIZE] = {0, 0, 0, 'S', 'V', 'B', 'A', 1};
+
+    /**
+     * Tables for the control bytes: data length of the four values,
+     * and the pshufb mask that spreads the values to 32-bit lanes.
+     */
+    struct svb_tables {
+        uint8_t length[256];
+        uint8_t shuffle[256][16];
+        svb_tables() {
+            for(int c=0; c < 256; c++) {
+                int pos = 0;
+                for(int k=0; k < 4; k++) {
+                    int len = ((c >> (2 * k)) & 3) + 1;
+                    for(int b=0; b < 4; b++) {
+                        shuffle[c][4 * k + b] = (uint8_t) (b < len ? pos + b : 0x80);
+                    }
+                    pos += len;
+                }
+                length[c] = (uint8_t) pos;
+            }
+        }
+    };
+
+    static inline const svb_tables & get_svb_tables() {
+        static svb_tables tables;
+        return tables;
+    }
+
+    static inline size_t svb_control_bytes(size_t n) {
+        return (n + 3) / 4;
+    }
+
+    /* Maximum encoded size of n neighbors */
+    static inline size_t svb_max_bytes(size_t n) {
+        return svb_control_bytes(n) + 4 * n;
+    }
+
+    /**
+     * Number of data bytes, given the control bytes of n values.
+     */
+    static inline size_t svb_data_bytes(const uint8_t * ctrl, size_t n) {
+        const svb_tables & t = get_svb_tables();
+        size_t full = n / 4;
+        size_t len = 0;
+        for(size_t i=0; i < full; i++) len += t.length[ctrl[i]];
+        for(size_t k=0; k < n % 4; k++) len += ((ctrl[full] >> (2 * k)) & 3) + 1;
+        return len;
+    }
+
+    /**
+     * Encodes a sorted neighbor list. Returns the number of bytes written.
+     */
+    static inline size_t svb_encode_neighbors(const vid_t * nbrs, size_t n, uint8_t * out) {
+        size_t nctrl = svb_control_bytes(n);
+        uint8_t * ctrl = out;
+        uint8_t * data = out + nctrl;
+        memset(ctrl, 0, nctrl);
+        vid_t prev = 0;
+        for(size_t i=0; i < n; i++) {
+            uint32_t gap = nbrs[i] - prev;
+            prev = nbrs[i];
+            int len = (gap < (1u << 8) ? 1 : (gap < (1u << 16) ? 2 : (gap < (1u << 24) ? 3 : 4)));
+            ctrl[i / 4] |= (uint8_t) ((len - 1) << (2 * (i % 4)));
+            for(int b=0; b < len; b++) {
+                *data++ = (uint8_t) (gap >> (8 * b));
+            }
+        }
+        return data - out;
+    }
+
+    static inline const uint8_t * svb_decode_scalar(const uint8_t * ctrl, const uint8_t * data, size_t first, size_t n,
+                                                    vid_t * out, vid_t & prev) {
+        for(size_t i=first; i < n; i++) {
+            int len = ((ctrl[i / 4] >> (2 * (i % 4))) & 3) + 1;
+            uint32_t gap = 0;
+            for(int b=0; b < len; b++) gap |= (uint32_t) data[b] << (8 * b);
+            data += len;
+            prev += gap;
+            out[i] = prev;
+        }
+        return data;
+    }
+
+#ifdef GRAPHCHI_SVB_SSSE3
+    /**
+     * Decodes groups of four with pshufb and a SIMD prefix sum. Reads 16 bytes
+     * at a time, so stops when less than 16 bytes remain before bufend.
+     */
+    __attribute__((target("ssse3")))
+    static inline size_t svb_decode_ssse3(const uint8_t * ctrl, const uint8_t *& data, size_t ngroups,
+                                   const uint8_t * bufend, vid_t * out, vid_t & prev) {
+        const svb_tables & t = get_svb_tables();
+        __m128i vprev = _mm_set1_epi32((int) prev);
+        size_t g = 0;
+        for(; g < ngroups && data + 16 <= bufend; g++) {
+            uint8_t c = ctrl[g];
+            __m128i v = _mm_loadu_si128((const __m128i *) data);
+            v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *) t.shuffle[c]));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi32(v, vprev);
+            _mm_storeu_si128((__m128i *) (out + 4 * g), v);
+            vprev = _mm_shuffle_epi32(v, 0xff);
+            data += t.length[c];
+        }
+        prev = (vid_t) _mm_cvtsi128_si32(vprev);
+        return g;
+    }
+
+    static inline bool svb_have_ssse3() {
+        static bool have = __builtin_cpu_supports("ssse3");
+        return have;
+    }
+#endif
+
+    /**
+     * Decodes n neighbors encoded at in. Bytes up to bufend may be read
+     * (the decoder reads ahead). Returns the number of bytes consumed.
+     */
+    static inline size_t svb_decode_neighbors(const uint8_t * in, size_t n, const uint8_t * bufend, vid_t * out) {
+        const uint8_t * ctrl = in;
+        const uint8_t * data = in + svb_control_bytes(n);
+        vid_t prev = 0;
+        size_t done = 0;
+#ifdef GRAPHCHI_SVB_SSSE3
+        if (svb_have_ssse3()) {
+            done = 4 * svb_decode_ssse3(ctrl, data, n / 4, bufend, out, prev);
+        }
+#endif
+        data = svb_decode_scalar(ctrl, data, done, n, out, prev);
+        return data - in;
+    }
+
+    /**
+     * Size of the encoded neighbor list of n vertices that starts at in.
+     */
+    static inline size_t svb_encoded_bytes(const uint8_t * in, size_t n) {
+        return svb_control_bytes(n) + svb_data_bytes(in, n);
+    }
+
+    static inline bool is_svb_adjacency_header(const uint8_t * buf, size_t len) {
+        return len >= SVB_ADJ_HEADER_SIZE && memcmp(buf, svb_adj_header, SVB_ADJ_HEADER_SIZE) == 0;
+    }
+
+    /**
+     * Returns the format of a shard adjacency file.
+     */
+    static inline int get_adjacency_format(std::string filename) {
+        uint8_t hdr[SVB_ADJ_HEADER_SIZE];
+        int f = open(filename.c_str(), O_RDONLY);
+        if (f < 0) return ADJ_FORMAT_RAW;
+        ssize_t len = pread(f, hdr, SVB_ADJ_HEADER_SIZE, 0);
+        close(f);
+        return (len > 0 && is_svb_adjacency_header(hdr, (size_t) len)) ? ADJ_FORMAT_SVB : ADJ_FORMAT_RAW;
+    }
+
+    /**
+     * Stops with a fatal error if the adjacency file is compressed. For the
+     * shard readers and writers that only handle the raw format.
+     */
+    static inline void require_raw_adjacency(std::string filename, std::string reader) {
+        if (get_adjacency_format(filename) == ADJ_FORMAT_SVB) {
+            logstream(LOG_FATAL) << reader << " does not support compressed adjacency shards (shard.adjformat=svb): "
+                << filename << ". Delete the shards and create them again with shard.adjformat=raw." << std::endl;
+            assert(false);
+        }
+    }
+
+}
+
+#endif
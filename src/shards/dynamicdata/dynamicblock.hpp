@@ -31,6 +31,8 @@
 
 #include <stdint.h>
 
+#include "api/dynamicdata/chivector.hpp"
+
 namespace graphchi {
     
     int get_block_uncompressed_size(std::string blockfilename, int defaultsize);
@@ -76,6 +78,9 @@ namespace graphchi {
         uint8_t * data;
         ET * chivecs;
         
+        /* Elements of the vectors that grow past their capacity */
+        extension_pool<typename ET::element_type_t> extensions;
+        
         dynamicdata_block() : data(NULL), chivecs(NULL) {}
         
         dynamicdata_block(int nitems, uint8_t * data, int datasize) : nitems(nitems){
@@ -85,7 +90,7 @@ namespace graphchi {
                 assert(ptr - data <= datasize);
                 typename ET::sizeword_t * sz = ((typename ET::sizeword_t *) ptr);
                 ptr += sizeof(typename ET::sizeword_t);
-                chivecs[i] = ET(((uint16_t *)sz)[0], ((uint16_t *)sz)[1], (typename ET::element_type_t *) ptr);
+                chivecs[i] = ET(((uint16_t *)sz)[0], ((uint16_t *)sz)[1], (typename ET::element_type_t *) ptr, &extensions);
                 ptr += (int) ((uint16_t *)sz)[1] * sizeof(typename ET::element_type_t);
             }
         }
@@ -44,6 +44,7 @@
 #include "metrics/metrics.hpp"
 #include "io/stripedio.hpp"
 #include "graphchi_types.hpp"
+#include "shards/adjacency_codec.hpp"
 #include "shards/dynamicdata/dynamicblock.hpp"
 
 namespace graphchi {
@@ -260,6 +261,7 @@ namespace graphchi {
         /* Dynamic edata */ 
         void load() {
             is_loaded = true;
+            require_raw_adjacency(filename_adj, "Dynamic edge data memory shard");
             adjfilesize = get_filesize(filename_adj);
             edatafilesize = get_shard_edata_filesize<ET>(filename_edata);            
             
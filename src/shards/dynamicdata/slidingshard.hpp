@@ -47,6 +47,7 @@
 #include "graphchi_types.hpp"
 
 #include "api/dynamicdata/chivector.hpp"
+#include "shards/adjacency_codec.hpp"
 #include "shards/dynamicdata/dynamicblock.hpp"
 
 
@@ -161,6 +162,7 @@ namespace graphchi {
         sblock<ET> * curblock;
         sblock<ET> * curadjblock;
         metrics &m;
+        metric_handle mh_blockload, mh_read_next_vertices;
         
         std::map<int, indexentry> sparse_index; // Sparse index that can be created in the fly
         bool disable_writes;
@@ -189,11 +191,14 @@ namespace graphchi {
             curblock = NULL;
             curadjblock = NULL;
             window_start_edataoffset = 0;
+            mh_blockload = m.register_timer("blockload");
+            mh_read_next_vertices = m.register_timer("read_next_vertices");
             
             
             while(blocksize % sizeof(int) != 0) blocksize++;
             assert(blocksize % sizeof(int)==0);
             
+            require_raw_adjacency(filename_adj, "Dynamic edge data sliding shard");
             adjfilesize = get_filesize(filename_adj);
             edatafilesize = get_shard_edata_filesize<int>(filename_edata);
             if (!only_adjacency) {
@@ -311,7 +316,7 @@ namespace graphchi {
                 newblock->ptr = newblock->data;
                 metrics_entry me = m.start_time();
                 iomgr->managed_preada_now(adjfile_session, &newblock->data, newblock->end - newblock->offset, adjoffset);
-                m.stop_time(me, "blockload");
+                m.stop_time(me, mh_blockload);
                 curadjblock = newblock;
             }
         }
@@ -422,7 +427,7 @@ namespace graphchi {
                 }
                 curvid++;
             }
-            m.stop_time(me, "read_next_vertices");
+            m.stop_time(me, mh_read_next_vertices);
             curblock = NULL;
         }
         
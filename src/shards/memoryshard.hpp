@@ -47,6 +47,7 @@
 #include "metrics/metrics.hpp"
 #include "io/stripedio.hpp"
 #include "graphchi_types.hpp"
+#include "shards/adjacency_codec.hpp"
 
 
 namespace graphchi {
@@ -74,6 +75,7 @@ namespace graphchi {
         uint8_t * adjdata;
         char ** edgedata;
         int * doneptr;
+        std::vector<vid_t> nbrbuf; // Decoded neighbors of compressed adjacency
         std::vector<size_t> blocksizes;
         uint64_t chunkid;
         
@@ -222,7 +224,7 @@ namespace graphchi {
                     size_t fsize = std::min(edatafilesize - blocksize * blockid, blocksize);
                     
                     compressedsize += get_filesize(block_filename);
-                    int blocksession = iomgr->open_session(block_filename, false, true); // compressed
+                    int blocksession = iomgr->open_mapped_session(block_filename, false, true); // compressed
                     block_edatasessions.push_back(blocksession);
                     blocksizes.push_back(fsize);
                     
@@ -246,6 +248,8 @@ namespace graphchi {
                     break;
                 }
             }
+            /* Start all block reads of the shard at once */
+            iomgr->submit_reads();
             logstream(LOG_DEBUG) << "Compressed/full size: " << compressedsize * 1.0 / edatafilesize <<
             " number of blocks: " << nblocks << std::endl;
             assert(blockid == nblocks);
@@ -267,7 +271,7 @@ namespace graphchi {
             
             //preada(adjf, adjdata, adjfilesize, 0);
             
-            adj_session = iomgr->open_session(filename_adj, true);
+            adj_session = iomgr->open_mapped_session(filename_adj, true);
             iomgr->managed_malloc(adj_session, &adjdata, adjfilesize, 0);
             adj_stream_session = streaming_task(iomgr, adj_session, adjfilesize, (char**) &adjdata);
             
@@ -292,7 +296,7 @@ namespace graphchi {
         
         void load_vertices(vid_t window_st, vid_t window_en, std::vector<svertex_t> & prealloc, bool inedges=true, bool outedges=true) {
             /* Find file size */
-            m.start_time("memoryshard_create_edges");
+            metrics_entry me = m.start_time();
             
             assert(adjdata != NULL);
             
@@ -300,6 +304,11 @@ namespace graphchi {
             uint8_t * ptr = adjdata;
             uint8_t * end = ptr + adjfilesize;
             vid_t vid = 0;
+            
+            /* Compressed adjacency: the neighbor lists are decoded to a buffer */
+            check_stream_progress(SVB_ADJ_HEADER_SIZE, 0);
+            bool svb = is_svb_adjacency_header(adjdata, adjfilesize);
+            if (svb) ptr += SVB_ADJ_HEADER_SIZE;
             edgeptr = 0;
             
             streaming_offset = 0;
@@ -308,6 +317,10 @@ namespace graphchi {
             range_start_offset = adjfilesize;
             range_start_edge_ptr = edatafilesize;
             
+            /* Block and offset of edgeptr, kept without dividing for each edge */
+            int blockid = 0;
+            size_t blockoff = 0;
+            
             bool setoffset = false;
             bool setrangeoffset = false;
             while (ptr < end) {
@@ -352,20 +365,35 @@ namespace graphchi {
                     vertex = &prealloc[vid-window_st];
                     if (!vertex->scheduled) vertex = NULL;
                 }
-                check_stream_progress(n * 4, ptr - adjdata);
+                vid_t * nbrs = NULL;
+                if (svb) {
+                    check_stream_progress((int) svb_control_bytes(n), ptr - adjdata);
+                    size_t reclen = svb_encoded_bytes(ptr, n);
+                    check_stream_progress((int) reclen, ptr - adjdata);
+                    if (nbrbuf.size() < (size_t) n) nbrbuf.resize(n);
+                    nbrs = &nbrbuf[0];
+                    svb_decode_neighbors(ptr, n, end, nbrs);
+                    ptr += reclen;
+                } else {
+                    check_stream_progress(n * 4, ptr - adjdata);
+                }
                 bool any_edges = false;
                 while(--n>=0) {
-                    int blockid = (int) (edgeptr / blocksize);
                     if (!async_edata_loading && !only_adjacency) {
                         /* Wait until blocks loaded (non-asynchronous version) */
-                        while(doneptr[edgeptr / blocksize] != 0) { usleep(10); }
+                        while(doneptr[blockid] != 0) { usleep(10); }
                     }
                     
-                    vid_t target = *((vid_t*) ptr);
-                    ptr += sizeof(vid_t);
+                    vid_t target;
+                    if (svb) {
+                        target = *(nbrs++);
+                    } else {
+                        target = *((vid_t*) ptr);
+                        ptr += sizeof(vid_t);
+                    }
                     if (vertex != NULL && outedges)
                     {
-                        char * eptr = (only_adjacency ? NULL  : &(edgedata[blockid][edgeptr % blocksize]));
+                        char * eptr = (only_adjacency ? NULL  : &(edgedata[blockid][blockoff]));
                         vertex->add_outedge(target, (only_adjacency ? NULL : (ET*) eptr), false);
                     }
                     
@@ -376,7 +404,7 @@ namespace graphchi {
                                 if (dstvertex.scheduled) {
                                     any_edges = true;
                                     //  assert(only_adjacency ||  edgeptr < edatafilesize);
-                                    char * eptr = (only_adjacency ? NULL  : &(edgedata[blockid][edgeptr % blocksize]));
+                                    char * eptr = (only_adjacency ? NULL  : &(edgedata[blockid][blockoff]));
                                     
                                     dstvertex.add_inedge(vid,  (only_adjacency ? NULL : (ET*) eptr), false);
                                     dstvertex.parallel_safe = dstvertex.parallel_safe && (vertex == NULL); // Avoid if
@@ -385,14 +413,23 @@ namespace graphchi {
                         } else { // Note, we cannot skip if there can be "special edges". FIXME so dirty.
                             // This vertex has no edges any more for this window, bail out
                             if (vertex == NULL) {
-                                ptr += sizeof(vid_t) * n;
+                                if (!svb) ptr += sizeof(vid_t) * n;
                                 edgeptr += (n + 1) * sizeof(ET);
+                                blockoff += (n + 1) * sizeof(ET);
+                                while (blockoff >= blocksize) {
+                                    blockoff -= blocksize;
+                                    blockid++;
+                                }
                                 break;
                             }
                         }
                     }
                     edgeptr += sizeof(ET);
-                    
+                    blockoff += sizeof(ET);
+                    if (blockoff == blocksize) {
+                        blockid++;
+                        blockoff = 0;
+                    }
                 }
                 
                 if (any_edges && vertex != NULL) {
@@ -400,7 +437,100 @@ namespace graphchi {
                 }
                 vid++;
             }
-            m.stop_time("memoryshard_create_edges", false);
+            m.stop_time(me, "memoryshard_create_edges", false);
+        }
+        
+        /**
+         * Copies the values of the in-edges of the window to spans, without
+         * creating the in-edges of the vertices. The in-edges of vertex v are
+         * written to vals (and the source ids to nbids, if it is not NULL)
+         * from index cursors[v - window_st] on, and the cursor is advanced.
+         * Vertices with cursor (size_t)-1 are skipped. The value of an edge
+         * is value_of(edge value).
+         */
+        template <typename SpanValue, typename ValueFunc>
+        void load_inedge_spans(vid_t window_st, vid_t window_en, std::vector<size_t> &cursors,
+                               vid_t * nbids, SpanValue * vals, ValueFunc &value_of) {
+            metrics_entry me = m.start_time();
+            assert(adjdata != NULL);
+            assert(!async_edata_loading && !only_adjacency);
+            
+            uint8_t * ptr = adjdata;
+            uint8_t * end = ptr + adjfilesize;
+            vid_t vid = 0;
+            check_stream_progress(SVB_ADJ_HEADER_SIZE, 0);
+            bool svb = is_svb_adjacency_header(adjdata, adjfilesize);
+            if (svb) ptr += SVB_ADJ_HEADER_SIZE;
+            
+            int blockid = 0;
+            size_t blockoff = 0;
+            int readyblock = -1;
+            
+            while (ptr < end) {
+                check_stream_progress(6, ptr-adjdata);
+                uint8_t ns = *ptr;
+                ptr += sizeof(uint8_t);
+                if (ns == 0x00) {
+                    uint8_t nz = *ptr;
+                    ptr += sizeof(uint8_t);
+                    vid += nz + 1;
+                    continue;
+                }
+                int n;
+                if (ns == 0xff) {
+                    n = *((uint32_t*)ptr);
+                    ptr += sizeof(uint32_t);
+                } else {
+                    n = ns;
+                }
+                vid_t * nbrs;
+                if (svb) {
+                    check_stream_progress((int) svb_control_bytes(n), ptr - adjdata);
+                    size_t reclen = svb_encoded_bytes(ptr, n);
+                    check_stream_progress((int) reclen, ptr - adjdata);
+                    if (nbrbuf.size() < (size_t) n) nbrbuf.resize(n);
+                    nbrs = &nbrbuf[0];
+                    svb_decode_neighbors(ptr, n, end, nbrs);
+                    ptr += reclen;
+                } else {
+                    check_stream_progress(n * 4, ptr - adjdata);
+                    nbrs = (vid_t *) ptr;
+                    ptr += n * sizeof(vid_t);
+                }
+                
+                /* The neighbors are sorted, so the in-edges of the window are a run */
+                for(int i=0; i < n; i++) {
+                    vid_t target = nbrs[i];
+                    if (target > window_en) {
+                        blockoff += (n - i) * sizeof(ET);
+                        while (blockoff >= blocksize) {
+                            blockoff -= blocksize;
+                            blockid++;
+                        }
+                        break;
+                    }
+                    if (target >= window_st) {
+                        size_t &c = cursors[target - window_st];
+                        if (c != (size_t)-1) {
+                            if (blockid != readyblock) {
+                                /* Wait until the block is loaded */
+                                while(doneptr[blockid] != 0) { usleep(10); }
+                                readyblock = blockid;
+                            }
+                            vals[c] = value_of(*((ET*) &edgedata[blockid][blockoff]));
+                            if (nbids != NULL) nbids[c] = vid;
+                            c++;
+                        }
+                    }
+                    blockoff += sizeof(ET);
+                    if (blockoff == blocksize) {
+                        blockid++;
+                        blockoff = 0;
+                    }
+                }
+                vid++;
+            }
+            m.stop_time(me, "memoryshard_inedge_spans", false);
         }
         
         size_t offset_for_stream_cont() {
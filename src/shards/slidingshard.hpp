@@ -49,6 +49,7 @@
 #include "logger/logger.hpp"
 #include "io/stripedio.hpp"
 #include "graphchi_types.hpp"
+#include "shards/adjacency_codec.hpp"
 
 
 namespace graphchi {
@@ -154,10 +155,15 @@ namespace graphchi {
         sblock * curblock;
         sblock * curadjblock;
         metrics &m;
+        metric_handle mh_blockload, mh_read_next_vertices;
         
         std::map<int, indexentry> sparse_index; // Sparse index that can be created in the fly
         bool disable_writes;
         bool async_edata_loading;
+        bool pipelined;
+        size_t adjstart;              // Size of the adjacency file header
+        bool svb;                     // Compressed adjacency format
+        std::vector<vid_t> nbrbuf;    // Decoded neighbors
         // bool need_read_outedges; // Disabled - does not work with compressed data: whole block needs to be read.
         
         
@@ -182,12 +188,18 @@ namespace graphchi {
             curblock = NULL;
             curadjblock = NULL;
             window_start_edataoffset = 0;
+            mh_blockload = m.register_timer("blockload");
+            mh_read_next_vertices = m.register_timer("read_next_vertices");
+            pipelined = false;
             
             
             while(blocksize % sizeof(ET) != 0) blocksize++;
             assert(blocksize % sizeof(ET)==0);
             
             adjfilesize = get_filesize(filename_adj);
+            svb = (get_adjacency_format(filename_adj) == ADJ_FORMAT_SVB);
+            adjstart = (svb ? SVB_ADJ_HEADER_SIZE : 0);
+            adjoffset = adjstart;
             if (!only_adjacency) {
                 edatafilesize = get_shard_edata_filesize<ET>(filename_edata);
                 logstream(LOG_DEBUG) << "Total edge data size: " << edatafilesize  << ", " << filename_edata
@@ -196,7 +208,7 @@ namespace graphchi {
                 // Nothing
             }
             
-            adjfile_session = iomgr->open_session(filename_adj, true);
+            adjfile_session = iomgr->open_mapped_session(filename_adj, true);
             save_offset();
             
             async_edata_loading = !svertex_t().computational_edges();
@@ -270,7 +282,7 @@ namespace graphchi {
                 }
                 // Load next
                 std::string blockfilename = filename_shard_edata_block(filename_edata, (int) (edataoffset / blocksize), blocksize);
-                int edata_session = iomgr->open_session(blockfilename, false, true);
+                int edata_session = iomgr->open_mapped_session(blockfilename, false, true);
                 sblock newblock(edata_session, edata_session, true);
                 
                 // We align blocks always to the blocksize, even if that requires
@@ -279,7 +291,7 @@ namespace graphchi {
                 size_t correction = edataoffset - newblock.offset;
                 newblock.end = std::min(edatafilesize, newblock.offset + blocksize);
                 assert(newblock.end >= newblock.offset);
-                iomgr->managed_malloc(edata_session, &newblock.data, newblock.end - newblock.offset, newblock.offset);
+                iomgr->managed_malloc(edata_session, &newblock.data, newblock.end - newblock.offset, 0);
                 newblock.ptr = newblock.data + correction;
                 activeblocks.push_back(newblock);
                 curblock = &activeblocks[activeblocks.size()-1];                
@@ -295,14 +307,14 @@ namespace graphchi {
                 }
                 sblock * newblock = new sblock(0, adjfile_session);
                 newblock->offset = adjoffset;
-                newblock->end = std::min(adjfilesize, adjoffset+blocksize);
+                newblock->end = std::min(adjfilesize, adjoffset + std::max(blocksize, toread));
                 assert(newblock->end > 0);
                 assert(newblock->end >= newblock->offset);
                 iomgr->managed_malloc(adjfile_session, &newblock->data, newblock->end - newblock->offset, adjoffset);
                 newblock->ptr = newblock->data;
                 metrics_entry me = m.start_time();
                 iomgr->managed_preada_now(adjfile_session, &newblock->data, newblock->end - newblock->offset, adjoffset);
-                m.stop_time(me, "blockload");
+                m.stop_time(me, mh_blockload);
                 curadjblock = newblock;
             }
         }
@@ -327,7 +339,13 @@ namespace graphchi {
         }
         
         inline void skip(int n, int sz) {
-            size_t tot = n * sz;
+            skip_record(n, (size_t)n * sz);
+        }
+        
+        /**
+         * Skips n edges whose adjacency data takes tot bytes.
+         */
+        inline void skip_record(int n, size_t tot) {
             adjoffset += tot;
             if (curadjblock != NULL)
                 curadjblock->ptr += tot;
@@ -345,22 +363,42 @@ namespace graphchi {
             if (!record_index)
                 move_close_to(start);
             
-            /* Release the blocks we do not need anymore */
+            /* Release the blocks we do not need anymore. In the pipelined mode
+               the previous window may still be executing, so only blocks behind it
+               can be released. */
             curblock = NULL;
-            release_prior_to_offset(false, disable_writes);
-            assert(activeblocks.size() <= 1);
+            if (pipelined) {
+                release_prior_to(window_start_edataoffset, false, disable_writes);
+            } else {
+                release_prior_to_offset(false, disable_writes);
+                assert(activeblocks.size() <= 1);
+            }
             
             /* Read next */
             if (!activeblocks.empty() && !only_adjacency) {
-                curblock = &activeblocks[0];
+                curblock = &activeblocks[activeblocks.size() - 1];
             }
             vid_t lastrec = start;
             window_start_edataoffset = edataoffset;
+            int unscheduled_until = -1;
             
             for(int i=((int)curvid) - ((int)start); i<nvecs; i++) {
                 if (adjoffset >= adjfilesize) break;
                 
-                // TODO: skip unscheduled vertices.
+                /* Jump over a run of unscheduled vertices using the sparse index,
+                   so that the adjacency blocks in between are not read. */
+                if (!record_index && i >= 0 && i > unscheduled_until && !prealloc[i].scheduled) {
+                    int j = i;
+                    while (j < nvecs && !prealloc[j].scheduled) j++;
+                    unscheduled_until = j - 1;
+                    vid_t before = curvid;
+                    move_close_to(start + j);
+                    if (curvid != before) {
+                        m.add("slidingshard_skipped_vertices", (double) (curvid - before));
+                        i = ((int)curvid) - ((int)start) - 1;
+                        continue;
+                    }
+                }
                 
                 int n;
                 if (record_index && (size_t)(curvid - lastrec) >= (size_t) std::max((int)100000, nvecs/16)) {
@@ -382,18 +420,36 @@ namespace graphchi {
                     n = ns;
                 }
                 
+                /* Compressed adjacency: whole record is brought to the block */
+                size_t reclen = 0;
+                if (svb) {
+                    check_adjblock(svb_control_bytes(n));
+                    reclen = svb_encoded_bytes(curadjblock->ptr, n);
+                    check_adjblock(reclen);
+                }
+                
                 if (i<0) {
                     // Just skipping
-                    skip(n, sizeof(vid_t));
+                    if (svb) skip_record(n, reclen);
+                    else skip(n, sizeof(vid_t));
                 } else {
                     svertex_t& vertex = prealloc[i];
                     assert(vertex.id() == curvid);
                     
                     if (vertex.scheduled) {
+                        vid_t * nbrs = NULL;
+                        if (svb) {
+                            if (nbrbuf.size() < (size_t) n) nbrbuf.resize(n);
+                            nbrs = &nbrbuf[0];
+                            svb_decode_neighbors(curadjblock->ptr, n, curadjblock->data + (curadjblock->end - curadjblock->offset), nbrs);
+                            adjoffset += reclen;
+                            curadjblock->ptr += reclen;
+                        }
                         
                         while(--n >= 0) {
                             bool special_edge = false;
-                            vid_t target = (sizeof(ET) == sizeof(ETspecial) ? read_val<vid_t>() : translate_edge(read_val<vid_t>(), special_edge));
+                            vid_t rawtarget = (svb ? *(nbrs++) : read_val<vid_t>());
+                            vid_t target = (sizeof(ET) == sizeof(ETspecial) ? rawtarget : translate_edge(rawtarget, special_edge));
                             ET * evalue = (special_edge ? (ET*)read_edgeptr<ETspecial>(): read_edgeptr<ET>());
                             
                             if (!only_adjacency) {
@@ -418,12 +474,14 @@ namespace graphchi {
                         
                     } else {
                         // This vertex was not scheduled, so we can just skip its edges.
-                        skip(n, sizeof(vid_t));
+                        if (svb) skip_record(n, reclen);
+                        else skip(n, sizeof(vid_t));
                     }
                 }
                 curvid++;
             }
-            m.stop_time(me, "read_next_vertices");
+            iomgr->submit_reads();
+            m.stop_time(me, mh_read_next_vertices);
             curblock = NULL;
         }
         
@@ -459,7 +517,7 @@ namespace graphchi {
          * Set the position of the sliding shard.
          */
         void set_offset(size_t newoff, vid_t _curvid, size_t edgeptr) {
-            this->adjoffset = newoff;
+            this->adjoffset = std::max(newoff, adjstart);
             this->curvid = _curvid;
             this->edataoffset = edgeptr;
             if (curadjblock != NULL) {
@@ -469,13 +527,28 @@ namespace graphchi {
             }
         }
         
+        /**
+         * If pipelined, the blocks of the previously read window are kept
+         * in memory while the next window is read.
+         */
+        void set_pipelined(bool b) {
+            pipelined = b;
+        }
+        
         /**
          * Release blocks that come prior to the current offset/
          */
         void release_prior_to_offset(bool all=false, bool disable_writes=false) { // disable writes is for the dynamic case
+            release_prior_to(edataoffset, all, disable_writes);
+        }
+        
+        /**
+         * Release blocks that end before the given edge data offset.
+         */
+        void release_prior_to(size_t offset, bool all=false, bool disable_writes=false) {
             for(int i=(int)activeblocks.size() - 1; i >= 0; i--) {
                 sblock &b = activeblocks[i];
-                if (b.end <= edataoffset || all) {
+                if (b.end <= offset || all) {
                     commit(b, all, disable_writes);
                     activeblocks.erase(activeblocks.begin() + (unsigned int)i);
                 }
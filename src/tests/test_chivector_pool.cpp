@@ -0,0 +1,143 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Checks the growth of chi-vectors into their extension pool: vectors
+ * that start in the block buffer with MINCAPACITY elements grow past it,
+ * the pool takes new chunks when EXTENSION_POOL_CHUNK is used up, and
+ * allocations larger than a chunk get a chunk of their own. The elements
+ * must survive every move.
+ */
+
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#include "graphchi_basic_includes.hpp"
+#include "api/dynamicdata/chivector.hpp"
+
+using namespace graphchi;
+
+/* Element larger than a word, so that a full vector exceeds a chunk */
+struct wide_t {
+    uint64_t v[4];
+};
+
+vid_t value_of(int vec, int idx) {
+    return (vid_t) (vec * 100003 + idx * 7 + 1);
+}
+
+/**
+ * Vectors of a block: each starts with one element in a buffer of
+ * MINCAPACITY elements, as the dynamic block gives them, and elements
+ * are added to all vectors in turn, by several threads.
+ */
+void test_block_vectors(int nvectors, int nelements) {
+    extension_pool<vid_t> pool;
+    std::vector<vid_t> buffer(nvectors * MINCAPACITY);
+    std::vector< chivector<vid_t> > vectors;
+    for(int i=0; i < nvectors; i++) {
+        buffer[i * MINCAPACITY] = value_of(i, 0);
+        vectors.push_back(chivector<vid_t>(1, MINCAPACITY, &buffer[i * MINCAPACITY], &pool));
+    }
+    for(int k=1; k < nelements; k++) {
+#pragma omp parallel for
+        for(int i=0; i < nvectors; i++) {
+            vectors[i].add(value_of(i, k));
+        }
+    }
+    std::vector<vid_t> out(nelements);
+    for(int i=0; i < nvectors; i++) {
+        assert(vectors[i].size() == nelements);
+        vectors[i].write(&out[0]);
+        for(int k=0; k < nelements; k++) {
+            assert(vectors[i].get(k) == value_of(i, k));
+            assert(out[k] == value_of(i, k));
+        }
+    }
+    /* The block buffer is not written past the initial elements */
+    for(int i=0; i < nvectors; i++) {
+        assert(buffer[i * MINCAPACITY] == value_of(i, 0));
+    }
+}
+
+int main(int argc, const char ** argv) {
+    graphchi_init(argc, argv);
+
+    /* Within MINCAPACITY: no growth needed, pool not used */
+    {
+        vid_t buf[MINCAPACITY];
+        chivector<vid_t> v(0, MINCAPACITY, buf, NULL);
+        for(int k=0; k < MINCAPACITY; k++) v.add(value_of(0, k));
+        for(int k=0; k < MINCAPACITY; k++) assert(buf[k] == value_of(0, k));
+    }
+
+    /* Empty vector without a buffer */
+    {
+        extension_pool<vid_t> pool;
+        chivector<vid_t> v(0, 0, NULL, &pool);
+        v.add(5);
+        v.set(0, 6);
+        assert(v.size() == 1 && v.get(0) == 6);
+    }
+
+    /* Growth past MINCAPACITY, and through several pool chunks: the
+       capacities of 1000 vectors doubled up to 1024 take about eight */
+    omp_set_num_threads(4);
+    test_block_vectors(1000, 600);
+    assert((size_t) 1000 * 600 * sizeof(vid_t) > 2 * EXTENSION_POOL_CHUNK);
+
+    /* Pool allocations do not overlap across chunks */
+    {
+        extension_pool<vid_t> pool;
+        size_t chunkelems = EXTENSION_POOL_CHUNK / sizeof(vid_t);
+        vid_t * a = pool.allocate(chunkelems - 1);
+        vid_t * b = pool.allocate(2);   // does not fit: new chunk
+        vid_t * c = pool.allocate(1);
+        for(size_t i=0; i < chunkelems - 1; i++) a[i] = 1;
+        b[0] = b[1] = 2;
+        c[0] = 3;
+        assert(b + 2 == c);
+        for(size_t i=0; i < chunkelems - 1; i++) assert(a[i] == 1);
+        assert(b[0] == 2 && b[1] == 2 && c[0] == 3);
+    }
+
+    /* Vector larger than a chunk: up to the maximum size of 0xffff */
+    {
+        extension_pool<wide_t> pool;
+        assert(0xffff * sizeof(wide_t) > EXTENSION_POOL_CHUNK);
+        chivector<wide_t> v(0, 0, NULL, &pool);
+        for(int k=0; k < 0xffff; k++) {
+            wide_t w;
+            for(int j=0; j < 4; j++) w.v[j] = (uint64_t) k * 4 + j;
+            v.add(w);
+        }
+        assert(v.size() == 0xffff);
+        for(int k=0; k < 0xffff; k++) {
+            for(int j=0; j < 4; j++) assert(v.get(k).v[j] == (uint64_t) k * 4 + j);
+        }
+    }
+
+    logstream(LOG_INFO) << "Test passed successfully! Your system is working!" << std::endl;
+    return 0;
+}
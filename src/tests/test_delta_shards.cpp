@@ -0,0 +1,183 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Checks the delta shards of the dynamic graph engine: sorting of flushed
+ * edges, merging of runs, lower_bound() and the size-tiered compaction
+ * policy. Edges are flushed in small runs and compacted as the engine does,
+ * and the merged runs must contain exactly the flushed edges, in order.
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "graphchi_basic_includes.hpp"
+#include "engine/dynamic_graphs/deltashard.hpp"
+
+using namespace graphchi;
+
+typedef delta_shard<float> delta_t;
+
+std::string dirname = "/tmp/__chi_deltatest";
+int seq = 0;
+
+std::string next_filename() {
+    std::stringstream ss;
+    ss << dirname << "/shard.delta" << seq++;
+    return ss.str();
+}
+
+/* Deterministic pseudo-random numbers */
+unsigned int lcg_state = 12345;
+unsigned int next_rand() {
+    lcg_state = lcg_state * 1103515245u + 12345u;
+    return (lcg_state >> 8) & 0xffffff;
+}
+
+bool edge_order(const created_edge<float> &a, const created_edge<float> &b) {
+    return a.src < b.src || (a.src == b.src && a.dst < b.dst);
+}
+
+bool edge_value_order(const created_edge<float> &a, const created_edge<float> &b) {
+    return edge_order(a, b) || (!edge_order(b, a) && a.data < b.data);
+}
+
+/**
+ * Checks that the runs contain the expected edges: each run sorted by
+ * source, and all runs together the expected multiset of (src, dst, value).
+ */
+void check_runs(std::vector<delta_t *> &runs, std::vector< created_edge<float> > expected) {
+    std::vector< created_edge<float> > all;
+    for(size_t i=0; i < runs.size(); i++) {
+        delta_t &run = *runs[i];
+        for(size_t j=0; j < run.size(); j++) {
+            if (j > 0) assert(!edge_order(*run[j], *run[j - 1]));
+            all.push_back(*run[j]);
+        }
+    }
+    assert(all.size() == expected.size());
+    std::sort(all.begin(), all.end(), edge_value_order);
+    std::sort(expected.begin(), expected.end(), edge_value_order);
+    for(size_t i=0; i < all.size(); i++) {
+        assert(all[i].src == expected[i].src && all[i].dst == expected[i].dst);
+        assert(all[i].data == expected[i].data);
+    }
+}
+
+int main(int argc, const char ** argv) {
+    graphchi_init(argc, argv);
+    mkdir(dirname.c_str(), 0777);
+
+    const size_t min_edges = 16;
+    const int factor = 4;
+    const vid_t nvertices = 1000;
+
+    /* Compaction policy on fixed run sizes */
+    {
+        std::vector< created_edge<float> > e1(10, created_edge<float>(1, 2, 0.0f));
+        std::vector< created_edge<float> > e2(100, created_edge<float>(1, 2, 0.0f));
+        std::vector<delta_t *> runs;
+        for(int i=0; i < factor - 1; i++) runs.push_back(delta_t::create(next_filename(), e1));
+        runs.push_back(delta_t::create(next_filename(), e2));
+        /* Three small runs and one of the next tier: no merge */
+        assert(select_delta_merge(runs, min_edges, factor).empty());
+        runs.push_back(delta_t::create(next_filename(), e1));
+        std::vector<int> sel = select_delta_merge(runs, min_edges, factor);
+        assert((int) sel.size() == factor);
+        for(int i=0; i < factor; i++) assert(sel[i] == (i < factor - 1 ? i : factor));
+        for(size_t i=0; i < runs.size(); i++) {
+            runs[i]->remove_file();
+            delete runs[i];
+        }
+    }
+
+    /* Flush runs of random edges and compact them as the engine does */
+    std::vector<delta_t *> runs;
+    std::vector< created_edge<float> > flushed;
+    for(int flush=0; flush < 50; flush++) {
+        std::vector< created_edge<float> > newedges;
+        size_t n = 1 + next_rand() % (2 * min_edges);
+        for(size_t i=0; i < n; i++) {
+            vid_t src = next_rand() % nvertices;
+            vid_t dst = next_rand() % nvertices;
+            newedges.push_back(created_edge<float>(src, dst, (float) flushed.size()));
+            flushed.push_back(newedges.back());
+        }
+        runs.push_back(delta_t::create(next_filename(), newedges));
+
+        std::vector<int> tomerge;
+        while (!(tomerge = select_delta_merge(runs, min_edges, factor)).empty()) {
+            std::vector<delta_t *> merging;
+            for(size_t i=0; i < tomerge.size(); i++) merging.push_back(runs[tomerge[i]]);
+            delta_t * merged = delta_t::merge(next_filename(), merging);
+            std::vector<delta_t *> remaining;
+            for(size_t j=0; j < runs.size(); j++) {
+                if (std::find(merging.begin(), merging.end(), runs[j]) == merging.end()) {
+                    remaining.push_back(runs[j]);
+                } else {
+                    runs[j]->remove_file();
+                    delete runs[j];
+                }
+            }
+            remaining.push_back(merged);
+            runs = remaining;
+        }
+        check_runs(runs, flushed);
+    }
+    /* 818 edges: runs of tiers 0-2, fewer than factor runs in each */
+    assert(runs.size() < (size_t) (factor - 1) * 3 + 1);
+    logstream(LOG_INFO) << "Flushed " << flushed.size() << " edges, compacted to " << runs.size() << " delta shards" << std::endl;
+
+    /* lower_bound() finds the first edge of each source */
+    for(size_t i=0; i < runs.size(); i++) {
+        delta_t &run = *runs[i];
+        for(vid_t src=0; src <= nvertices; src++) {
+            size_t k = run.lower_bound(src);
+            assert(k == run.size() || run[k]->src >= src);
+            assert(k == 0 || run[k - 1]->src < src);
+        }
+    }
+
+    /* Edge values written through the mapping persist in the file */
+    std::string fname = next_filename();
+    std::vector< created_edge<float> > vals;
+    for(vid_t i=0; i < 100; i++) vals.push_back(created_edge<float>(i, i + 1, 0.0f));
+    delta_t * d = delta_t::create(fname, vals);
+    for(size_t i=0; i < d->size(); i++) (*d)[i]->data = (float) (*d)[i]->src * 2;
+    delete d;
+    d = new delta_t(fname);
+    for(size_t i=0; i < d->size(); i++) assert((*d)[i]->data == (float) (*d)[i]->src * 2);
+    d->remove_file();
+    delete d;
+
+    for(size_t i=0; i < runs.size(); i++) {
+        runs[i]->remove_file();
+        delete runs[i];
+    }
+
+    logstream(LOG_INFO) << "Test passed successfully! Your system is working!" << std::endl;
+    return 0;
+}
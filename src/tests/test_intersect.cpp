@@ -0,0 +1,167 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Checks that the sorted-list intersection kernels (gallop, scalar merge
+ * and AVX2 merge) find the same matches as std::set_intersection, for
+ * lists of random and boundary sizes and densities.
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "graphchi_basic_includes.hpp"
+#include "util/intersect.hpp"
+
+using namespace graphchi;
+
+/* Deterministic pseudo-random numbers */
+unsigned int lcg_state = 4711;
+unsigned int next_rand() {
+    lcg_state = lcg_state * 1103515245u + 12345u;
+    return (lcg_state >> 8) & 0xffffff;
+}
+
+/**
+ * Strictly increasing list of n ids, starting at first, with gaps
+ * of 1..maxgap.
+ */
+std::vector<vid_t> make_list(size_t n, vid_t first, unsigned int maxgap) {
+    std::vector<vid_t> l;
+    vid_t v = first;
+    for(size_t i=0; i < n; i++) {
+        l.push_back(v);
+        v += 1 + next_rand() % maxgap;
+    }
+    return l;
+}
+
+struct match_collector {
+    std::vector<size_t> matches;
+    inline void operator()(size_t j) {
+        matches.push_back(j);
+    }
+};
+
+typedef size_t (*intersect_fn)(const vid_t *, size_t, const vid_t *, size_t, match_collector &);
+
+size_t run_gallop(const vid_t * a, size_t na, const vid_t * b, size_t nb, match_collector &c) {
+    return intersect_gallop(a, na, b, nb, c);
+}
+
+size_t run_merge(const vid_t * a, size_t na, const vid_t * b, size_t nb, match_collector &c) {
+    return intersect_merge(a, na, b, nb, c);
+}
+
+size_t run_sorted(const vid_t * a, size_t na, const vid_t * b, size_t nb, match_collector &c) {
+    return intersect_sorted(a, na, b, nb, c);
+}
+
+#ifdef GRAPHCHI_INTERSECT_AVX2
+size_t run_avx2(const vid_t * a, size_t na, const vid_t * b, size_t nb, match_collector &c) {
+    return intersect_merge_avx2(a, na, b, nb, c);
+}
+#endif
+
+size_t ncases = 0;
+
+void check(const std::vector<vid_t> &a, const std::vector<vid_t> &b) {
+    std::vector<size_t> expected;
+    for(size_t j=0; j < b.size(); j++) {
+        if (std::binary_search(a.begin(), a.end(), b[j])) expected.push_back(j);
+    }
+    std::vector<vid_t> common;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(common));
+    assert(common.size() == expected.size());
+
+    std::vector<intersect_fn> fns;
+    fns.push_back(run_gallop);
+    fns.push_back(run_merge);
+    fns.push_back(run_sorted);
+#ifdef GRAPHCHI_INTERSECT_AVX2
+    if (intersect_have_avx2()) fns.push_back(run_avx2);
+#endif
+    const vid_t * ap = a.empty() ? NULL : &a[0];
+    const vid_t * bp = b.empty() ? NULL : &b[0];
+    for(size_t f=0; f < fns.size(); f++) {
+        match_collector c;
+        size_t n = fns[f](ap, a.size(), bp, b.size(), c);
+        assert(n == expected.size());
+        /* The AVX2 kernel reports the matches of a block of b in any order */
+        std::sort(c.matches.begin(), c.matches.end());
+        assert(c.matches == expected);
+    }
+    assert(intersection_size(ap, a.size(), bp, b.size()) == expected.size());
+    ncases++;
+}
+
+int main(int argc, const char ** argv) {
+    graphchi_init(argc, argv);
+
+    std::vector<vid_t> empty;
+    std::vector<vid_t> l = make_list(100, 0, 3);
+    check(empty, empty);
+    check(empty, l);
+    check(l, empty);
+    check(l, l);
+
+    /* Disjoint: even and odd ids */
+    std::vector<vid_t> even, odd;
+    for(vid_t v=0; v < 200; v++) (v % 2 == 0 ? even : odd).push_back(v);
+    check(even, odd);
+
+    /* Ids near the top of the range */
+    std::vector<vid_t> top = make_list(40, (vid_t) -200, 4);
+    std::vector<vid_t> top2 = make_list(40, (vid_t) -200, 4);
+    check(top, top2);
+
+    /* Sizes around the AVX2 block of eight and the gallop ratio */
+    size_t sizes[] = {1, 2, 7, 8, 9, 15, 16, 17, 33, 64, 100, 257, 1000, 4096};
+    int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    unsigned int gaps[] = {1, 2, 5, 50};
+    for(int s1=0; s1 < nsizes; s1++) {
+        for(int s2=0; s2 < nsizes; s2++) {
+            for(int g=0; g < 4; g++) {
+                std::vector<vid_t> a = make_list(sizes[s1], next_rand() % 16, gaps[g]);
+                std::vector<vid_t> b = make_list(sizes[s2], next_rand() % 16, gaps[(g + s2) % 4]);
+                check(a, b);
+            }
+        }
+    }
+
+    /* A short list inside a long one, as in the gallop path */
+    std::vector<vid_t> longlist = make_list(100000, 0, 3);
+    std::vector<vid_t> shortlist;
+    for(size_t i=0; i < longlist.size(); i += 997) shortlist.push_back(longlist[i] + (i % 2));
+    check(shortlist, longlist);
+    check(longlist, shortlist);
+
+    logstream(LOG_INFO) << "Checked " << ncases << " intersections"
+#ifdef GRAPHCHI_INTERSECT_AVX2
+        << (intersect_have_avx2() ? ", with AVX2" : ", without AVX2")
+#endif
+        << std::endl;
+    logstream(LOG_INFO) << "Test passed successfully! Your system is working!" << std::endl;
+    return 0;
+}
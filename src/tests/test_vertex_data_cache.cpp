@@ -0,0 +1,151 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Checks the page admission, eviction and writeback of the vertex data
+ * cache: a vertex file of four pages is accessed through a cache of two
+ * pages, and the file contents are checked after the cache is deleted.
+ */
+
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "graphchi_basic_includes.hpp"
+#include "engine/auxdata/vertex_data_cache.hpp"
+
+using namespace graphchi;
+
+typedef vid_t VertexDataType;
+
+/* Vertices of a page, see cached_vertex_data_store */
+const vid_t P = VERTEXCACHE_PAGE_BYTES / sizeof(VertexDataType);
+const vid_t NPAGES = 4;
+
+void write_vertexfile(std::string filename) {
+    std::vector<VertexDataType> vals(P * NPAGES);
+    for(vid_t i=0; i < vals.size(); i++) vals[i] = i;
+    FILE * f = fopen(filename.c_str(), "w");
+    assert(f != NULL);
+    fwrite(&vals[0], sizeof(VertexDataType), vals.size(), f);
+    fclose(f);
+}
+
+/**
+ * Checks that vertex i has value i + added[page of i].
+ */
+void check_vertexfile(std::string filename, const int * added) {
+    std::vector<VertexDataType> vals(P * NPAGES);
+    FILE * f = fopen(filename.c_str(), "r");
+    assert(f != NULL);
+    size_t n = fread(&vals[0], sizeof(VertexDataType), vals.size(), f);
+    assert(n == vals.size());
+    fclose(f);
+    for(vid_t i=0; i < vals.size(); i++) {
+        if (vals[i] != i + added[i / P]) {
+            logstream(LOG_FATAL) << "Mismatch at vertex " << i << ": " << vals[i] << ", expected "
+                << (i + added[i / P]) << std::endl;
+        }
+        assert(vals[i] == i + added[i / P]);
+    }
+}
+
+/**
+ * Loads a page and adds one to its vertices, checking the
+ * values read first.
+ */
+void increment_page(cached_vertex_data_store<VertexDataType> &store, vid_t page, int added) {
+    store.load(page * P, (page + 1) * P - 1);
+    for(vid_t i=page * P; i < (page + 1) * P; i++) {
+        VertexDataType * v = store.vertex_data_ptr(i);
+        assert(*v == i + added);
+        (*v)++;
+    }
+    store.save();
+}
+
+size_t metric_value(metrics &m, std::string key) {
+    return (size_t) m.get(key).value;
+}
+
+int main(int argc, const char ** argv) {
+    graphchi_init(argc, argv);
+    metrics m("test-vertex-data-cache");
+
+    mkdir("/tmp/__chi_vcachetest", 0777);
+    std::string basefilename = "/tmp/__chi_vcachetest/vertices";
+    std::string filename = filename_vertex_data<VertexDataType>(basefilename);
+    stripedio * iomgr = new stripedio(m);
+
+    /* Cache of two pages: pages are admitted by access count */
+    write_vertexfile(filename);
+    cached_vertex_data_store<VertexDataType> * store = new cached_vertex_data_store<VertexDataType>(basefilename,
+            P * NPAGES, iomgr, 2 * VERTEXCACHE_PAGE_BYTES, m);
+
+    increment_page(*store, 0, 0);
+    increment_page(*store, 1, 0);
+    /* Page 2 has no more accesses than the resident pages: not admitted,
+       so its values are written to the file directly. */
+    increment_page(*store, 2, 0);
+    store->flush();
+    assert(metric_value(m, "vertexcache_resident_pages") == 2);
+    assert(metric_value(m, "vertexcache_evictions") == 0);
+    assert(metric_value(m, "vertexcache_misses") == 1);
+
+    /* Second access of page 2: it replaces page 0, the least recently
+       used of the pages accessed once. Page 0 is modified, so it is
+       written back when evicted. */
+    increment_page(*store, 2, 1);
+    store->flush();
+    assert(metric_value(m, "vertexcache_resident_pages") == 2);
+    assert(metric_value(m, "vertexcache_evictions") == 1);
+    assert(metric_value(m, "vertexcache_hits") == 3);
+
+    /* Page 0, now accessed twice, is read again from the file and
+       replaces page 1 */
+    increment_page(*store, 0, 1);
+    store->flush();
+    assert(metric_value(m, "vertexcache_misses") == 1);
+    assert(metric_value(m, "vertexcache_evictions") == 2);
+
+    /* Remaining dirty pages are written back when the store is deleted */
+    delete store;
+    int added[NPAGES] = {2, 1, 2, 0};
+    check_vertexfile(filename, added);
+
+    /* Cache larger than the file: the vertex data is pinned */
+    store = new cached_vertex_data_store<VertexDataType>(basefilename, P * NPAGES, iomgr,
+            (NPAGES + 1) * VERTEXCACHE_PAGE_BYTES, m);
+    for(vid_t p=0; p < NPAGES; p++) {
+        increment_page(*store, p, added[p]);
+    }
+    delete store;
+    int added2[NPAGES] = {3, 2, 3, 1};
+    check_vertexfile(filename, added2);
+
+    delete iomgr;
+    remove(filename.c_str());
+
+    logstream(LOG_INFO) << "Test passed successfully! Your system is working!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Checks the walk encoding of the walk engine (vertex, source and hops
+ * packed in a 64-bit word) and the bucketing of walks by interval in
+ * walk_manager: gathered walks must be sorted by vertex, and the range
+ * of a window must contain exactly the walks at its vertices.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "graphchi_basic_includes.hpp"
+#include "engine/randomwalks/walk_manager.hpp"
+
+using namespace graphchi;
+
+void check_encoding(vid_t vertex, uint32_t source, uint32_t hops) {
+    walk_t w = make_walk(vertex, source, hops);
+    assert(walk_vertex(w) == vertex);
+    assert(walk_source(w) == source);
+    assert(walk_hops(w) == hops);
+}
+
+int main(int argc, const char ** argv) {
+    graphchi_init(argc, argv);
+
+    /* Encoding: fields at their limits do not overlap */
+    check_encoding(0, 0, 0);
+    check_encoding((vid_t) -1, 0, 0);
+    check_encoding(0, WALK_MAX_SOURCES - 1, 0);
+    check_encoding(0, 0, WALK_MAX_HOPS);
+    check_encoding((vid_t) -1, WALK_MAX_SOURCES - 1, WALK_MAX_HOPS);
+    check_encoding(123456789, 654321, 17);
+
+    /* Walks order by vertex first */
+    assert(make_walk(1, WALK_MAX_SOURCES - 1, WALK_MAX_HOPS) < make_walk(2, 0, 0));
+
+    /* A step keeps the source and increments the hops */
+    walk_t w = make_walk(5, 77, 3);
+    walk_t moved = make_walk(9, walk_source(w), walk_hops(w) + 1);
+    assert(walk_vertex(moved) == 9 && walk_source(moved) == 77 && walk_hops(moved) == 4);
+
+    /* Random numbers are deterministic per seed and within range */
+    walk_rng r1(42), r2(42), r3(43);
+    bool differs = false;
+    for(int i=0; i < 1000; i++) {
+        uint64_t a = r1.next();
+        assert(a == r2.next());
+        differs = differs || (a != r3.next());
+        uint32_t idx = r1.next_index(7);
+        assert(idx == r2.next_index(7) && idx < 7);
+        double d = r1.next_double();
+        assert(d == r2.next_double() && d >= 0.0 && d < 1.0);
+        r3.next_index(7);
+        r3.next_double();
+    }
+    assert(differs);
+
+    /* Bucketing: three intervals, walks added by four threads */
+    std::vector< std::pair<vid_t, vid_t> > intervals;
+    intervals.push_back(std::pair<vid_t, vid_t>(0, 999));
+    intervals.push_back(std::pair<vid_t, vid_t>(1000, 4999));
+    intervals.push_back(std::pair<vid_t, vid_t>(5000, 9999));
+    int nthreads = 4;
+    walk_manager walks;
+    walks.init(nthreads, intervals);
+    assert(walks.interval_of(0) == 0 && walks.interval_of(999) == 0);
+    assert(walks.interval_of(1000) == 1 && walks.interval_of(4999) == 1);
+    assert(walks.interval_of(5000) == 2 && walks.interval_of(9999) == 2);
+
+    /* Expected number of walks at each vertex */
+    std::map<vid_t, size_t> count;
+    walk_rng rng(1);
+    size_t nwalks = 20000;
+    for(size_t i=0; i < nwalks; i++) {
+        vid_t v = rng.next_index(10000);
+        walks.add_walk((int) (i % nthreads), make_walk(v, (uint32_t) (i % WALK_MAX_SOURCES), (uint32_t) (i % 5)));
+        count[v]++;
+    }
+    assert(walks.num_walks() == nwalks);
+
+    size_t total = 0;
+    for(int interval=0; interval < (int) intervals.size(); interval++) {
+        size_t n = walks.gather(interval);
+        std::vector<walk_t> &cur = walks.current_walks();
+        assert(cur.size() == n);
+        total += n;
+        for(size_t i=0; i < n; i++) {
+            assert(walk_vertex(cur[i]) >= intervals[interval].first && walk_vertex(cur[i]) <= intervals[interval].second);
+            if (i > 0) assert(walk_vertex(cur[i - 1]) <= walk_vertex(cur[i]));
+        }
+        /* Windows of 100 vertices */
+        for(vid_t st=intervals[interval].first; st <= intervals[interval].second; st += 100) {
+            vid_t en = std::min(st + 99, intervals[interval].second);
+            std::pair<size_t, size_t> range = walks.current_range(st, en);
+            size_t expected = 0;
+            for(vid_t v=st; v <= en; v++) expected += count.count(v) ? count[v] : 0;
+            assert(range.second - range.first == expected);
+            for(size_t i=range.first; i < range.second; i++) {
+                assert(walk_vertex(cur[i]) >= st && walk_vertex(cur[i]) <= en);
+            }
+        }
+        /* The walks of the earlier intervals were replaced by the current walks */
+        assert(walks.num_walks() == nwalks - (total - n));
+    }
+    assert(total == nwalks);
+
+    /* The buckets are empty after gathering all intervals */
+    walks.gather(0);
+    assert(walks.num_walks() == 0);
+
+    logstream(LOG_INFO) << "Test passed successfully! Your system is working!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,325 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Codecs for the compressed edge data block files. A block file starts
+ * with a header that records the codec, so that shards written with
+ * different codecs can be mixed. Files without the header are zlib
+ * streams written by earlier versions.
+ *
+ * LZ4 and Zstd are compiled in with -DGRAPHCHI_USE_LZ4 (link -llz4)
+ * and -DGRAPHCHI_USE_ZSTD (link -lzstd).
+ */
+
+#ifndef DEF_GRAPHCHI_BLOCK_CODEC
+#define DEF_GRAPHCHI_BLOCK_CODEC
+
+#include <string>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <zlib.h>
+
+#ifdef GRAPHCHI_USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef GRAPHCHI_USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace graphchi {
+
+    enum block_codec_id {
+        BLOCK_CODEC_NONE = 0,
+        BLOCK_CODEC_ZLIB = 1,
+        BLOCK_CODEC_LZ4 = 2,
+        BLOCK_CODEC_ZSTD = 3,
+        BLOCK_CODEC_DELTAVARINT = 4,
+        BLOCK_CODEC_COUNT = 5
+    };
+
+    struct block_codec_header {
+        uint32_t magic;
+        uint32_t codec;
+        uint64_t rawsize;
+    };
+
+    /* "GCBK". A zlib stream starts with 0x78, so legacy files do not match. */
+    static const uint32_t BLOCK_CODEC_MAGIC = 0x4b424347;
+
+    class block_codec {
+    public:
+        virtual ~block_codec() {}
+        virtual int id() = 0;
+        virtual std::string name() = 0;
+
+        /* Maximum size of the encoded data */
+        virtual size_t bound(size_t n) = 0;
+
+        /* Returns the encoded size */
+        virtual size_t encode(const uint8_t * in, size_t n, uint8_t * out, size_t outcap) = 0;
+
+        /* Decodes exactly rawsize bytes to out */
+        virtual void decode(const uint8_t * in, size_t n, uint8_t * out, size_t rawsize) = 0;
+    };
+
+    class none_codec : public block_codec {
+    public:
+        int id() { return BLOCK_CODEC_NONE; }
+        std::string name() { return "none"; }
+        size_t bound(size_t n) { return n; }
+        size_t encode(const uint8_t * in, size_t n, uint8_t * out, size_t outcap) {
+            assert(outcap >= n);
+            memcpy(out, in, n);
+            return n;
+        }
+        void decode(const uint8_t * in, size_t n, uint8_t * out, size_t rawsize) {
+            assert(n == rawsize);
+            memcpy(out, in, rawsize);
+        }
+    };
+
+    class zlib_codec : public block_codec {
+    public:
+        int id() { return BLOCK_CODEC_ZLIB; }
+        std::string name() { return "zlib"; }
+        size_t bound(size_t n) { return compressBound((uLong) n); }
+        size_t encode(const uint8_t * in, size_t n, uint8_t * out, size_t outcap) {
+            z_stream strm;
+            strm.zalloc = Z_NULL;
+            strm.zfree = Z_NULL;
+            strm.opaque = Z_NULL;
+            int ret = deflateInit(&strm, Z_BEST_SPEED);
+            assert(ret == Z_OK);
+            strm.avail_in = (unsigned) n;
+            strm.next_in = (unsigned char *) in;
+            strm.avail_out = (unsigned) outcap;
+            strm.next_out = out;
+            ret = deflate(&strm, Z_FINISH);
+            assert(ret == Z_STREAM_END);
+            size_t outlen = outcap - strm.avail_out;
+            (void)deflateEnd(&strm);
+            return outlen;
+        }
+        void decode(const uint8_t * in, size_t n, uint8_t * out, size_t rawsize) {
+            z_stream strm;
+            strm.zalloc = Z_NULL;
+            strm.zfree = Z_NULL;
+            strm.opaque = Z_NULL;
+            strm.avail_in = (unsigned) n;
+            strm.next_in = (unsigned char *) in;
+            int ret = inflateInit(&strm);
+            assert(ret == Z_OK);
+            strm.avail_out = (unsigned) rawsize;
+            strm.next_out = out;
+            ret = inflate(&strm, Z_FINISH);
+            assert(ret == Z_STREAM_END);
+            (void)inflateEnd(&strm);
+        }
+    };
+
+#ifdef GRAPHCHI_USE_LZ4
+    class lz4_codec : public block_codec {
+    public:
+        int id() { return BLOCK_CODEC_LZ4; }
+        std::string name() { return "lz4"; }
+        size_t bound(size_t n) { return LZ4_compressBound((int) n); }
+        size_t encode(const uint8_t * in, size_t n, uint8_t * out, size_t outcap) {
+            int len = LZ4_compress_default((const char *) in, (char *) out, (int) n, (int) outcap);
+            assert(len > 0 || n == 0);
+            return (size_t) len;
+        }
+        void decode(const uint8_t * in, size_t n, uint8_t * out, size_t rawsize) {
+            int len = LZ4_decompress_safe((const char *) in, (char *) out, (int) n, (int) rawsize);
+            assert(len == (int) rawsize);
+        }
+    };
+#endif
+
+#ifdef GRAPHCHI_USE_ZSTD
+    class zstd_codec : public block_codec {
+    public:
+        int id() { return BLOCK_CODEC_ZSTD; }
+        std::string name() { return "zstd"; }
+        size_t bound(size_t n) { return ZSTD_compressBound(n); }
+        size_t encode(const uint8_t * in, size_t n, uint8_t * out, size_t outcap) {
+            size_t len = ZSTD_compress(out, outcap, in, n, 1);
+            assert(!ZSTD_isError(len));
+            return len;
+        }
+        void decode(const uint8_t * in, size_t n, uint8_t * out, size_t rawsize) {
+            size_t len = ZSTD_decompress(out, rawsize, in, n);
+            assert(!ZSTD_isError(len) && len == rawsize);
+        }
+    };
+#endif
+
+    /**
+     * Encodes the block as 32-bit words: each word is stored as the
+     * zigzag-encoded difference to the previous word, in varint format.
+     * Good for integer edge values (labels, ids, counters) that are close
+     * to each other. Trailing bytes are stored as is.
+     */
+    class deltavarint_codec : public block_codec {
+    public:
+        int id() { return BLOCK_CODEC_DELTAVARINT; }
+        std::string name() { return "deltavarint"; }
+        size_t bound(size_t n) { return (n / 4) * 5 + n % 4; }
+        size_t encode(const uint8_t * in, size_t n, uint8_t * out, size_t outcap) {
+            assert(outcap >= bound(n));
+            size_t nwords = n / 4;
+            uint8_t * o = out;
+            uint32_t prev = 0;
+            for(size_t i=0; i < nwords; i++) {
+                uint32_t w;
+                memcpy(&w, in + i * 4, 4);
+                int32_t d = (int32_t) (w - prev);
+                uint32_t z = ((uint32_t) d << 1) ^ (uint32_t) (d >> 31);
+                while (z >= 0x80) {
+                    *o++ = (uint8_t) (z | 0x80);
+                    z >>= 7;
+                }
+                *o++ = (uint8_t) z;
+                prev = w;
+            }
+            for(size_t i=nwords * 4; i < n; i++) *o++ = in[i];
+            return o - out;
+        }
+        void decode(const uint8_t * in, size_t n, uint8_t * out, size_t rawsize) {
+            size_t nwords = rawsize / 4;
+            const uint8_t * p = in;
+            const uint8_t * end = in + n;
+            uint32_t prev = 0;
+            for(size_t i=0; i < nwords; i++) {
+                uint32_t z = 0;
+                int shift = 0;
+                uint8_t b;
+                do {
+                    assert(p < end);
+                    b = *p++;
+                    z |= (uint32_t) (b & 0x7f) << shift;
+                    shift += 7;
+                } while (b & 0x80);
+                uint32_t d = (z >> 1) ^ (0 - (z & 1));
+                prev += d;
+                memcpy(out + i * 4, &prev, 4);
+            }
+            size_t tail = rawsize - nwords * 4;
+            assert((size_t) (end - p) == tail);
+            memcpy(out + nwords * 4, p, tail);
+        }
+    };
+
+    /**
+     * Returns the codec, or NULL if it is not compiled in.
+     */
+    static inline block_codec * get_block_codec(int id) {
+        static none_codec none;
+        static zlib_codec zlib;
+        static deltavarint_codec deltavarint;
+#ifdef GRAPHCHI_USE_LZ4
+        static lz4_codec lz4;
+#endif
+#ifdef GRAPHCHI_USE_ZSTD
+        static zstd_codec zstd;
+#endif
+        switch(id) {
+            case BLOCK_CODEC_NONE: return &none;
+            case BLOCK_CODEC_ZLIB: return &zlib;
+            case BLOCK_CODEC_DELTAVARINT: return &deltavarint;
+#ifdef GRAPHCHI_USE_LZ4
+            case BLOCK_CODEC_LZ4: return &lz4;
+#endif
+#ifdef GRAPHCHI_USE_ZSTD
+            case BLOCK_CODEC_ZSTD: return &zstd;
+#endif
+        }
+        return NULL;
+    }
+
+    /**
+     * Returns codec id for a name, or -1 if the codec is unknown or not compiled in.
+     */
+    static inline int block_codec_for_name(std::string name) {
+        for(int i=0; i < BLOCK_CODEC_COUNT; i++) {
+            block_codec * c = get_block_codec(i);
+            if (c != NULL && c->name() == name) return i;
+        }
+        return -1;
+    }
+
+    /**
+     * Codec used for new block files. Set by the sharder and the
+     * I/O manager from the "io.codec" option.
+     */
+    static inline int & default_block_codec() {
+        static int codec = BLOCK_CODEC_ZLIB;
+        return codec;
+    }
+
+    /**
+     * Encodes a block with header. The result is allocated
+     * with malloc() and must be freed by the caller.
+     * @return size of the encoded block
+     */
+    static inline size_t encode_block(int codecid, const uint8_t * in, size_t n, uint8_t ** out) {
+        block_codec * codec = get_block_codec(codecid);
+        assert(codec != NULL);
+        size_t cap = sizeof(block_codec_header) + codec->bound(n);
+        *out = (uint8_t *) malloc(cap);
+        assert(*out != NULL);
+        block_codec_header hdr;
+        hdr.magic = BLOCK_CODEC_MAGIC;
+        hdr.codec = codecid;
+        hdr.rawsize = n;
+        memcpy(*out, &hdr, sizeof(hdr));
+        return sizeof(hdr) + codec->encode(in, n, *out + sizeof(hdr), cap - sizeof(hdr));
+    }
+
+    /**
+     * Decodes a block file contents to a buffer of rawsize bytes.
+     * @return the codec of the block
+     */
+    static inline int decode_block(const uint8_t * in, size_t n, uint8_t * out, size_t rawsize) {
+        block_codec_header hdr;
+        if (n >= sizeof(hdr)) {
+            memcpy(&hdr, in, sizeof(hdr));
+        } else {
+            hdr.magic = 0;
+        }
+        if (hdr.magic != BLOCK_CODEC_MAGIC) {
+            /* Legacy headerless zlib stream */
+            get_block_codec(BLOCK_CODEC_ZLIB)->decode(in, n, out, rawsize);
+            return BLOCK_CODEC_ZLIB;
+        }
+        assert(hdr.rawsize == rawsize);
+        block_codec * codec = get_block_codec(hdr.codec);
+        assert(codec != NULL);  // Block was written with a codec that is not compiled in
+        codec->decode(in + sizeof(hdr), n - sizeof(hdr), out, rawsize);
+        return hdr.codec;
+    }
+
+}
+
+#endif
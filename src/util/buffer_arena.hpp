@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Buffer that is reused over consecutive allocations. It grows to the
+ * largest requested size and is freed only when released, so that
+ * large buffers are not allocated (and page-faulted) again and again.
+ */
+
+#ifndef DEF_GRAPHCHI_BUFFER_ARENA
+#define DEF_GRAPHCHI_BUFFER_ARENA
+
+#include <stdlib.h>
+#include <assert.h>
+
+namespace graphchi {
+
+    template <typename T>
+    class buffer_arena {
+
+        T * buf;
+        size_t capacity;
+
+        /* Not copyable */
+        buffer_arena(const buffer_arena &);
+        buffer_arena & operator=(const buffer_arena &);
+
+    public:
+        buffer_arena() : buf(NULL), capacity(0) {}
+
+        ~buffer_arena() {
+            release();
+        }
+
+        /**
+         * Returns a buffer for at least n elements. The buffer is
+         * the same as in the previous call, unless it had to grow. Contents
+         * are not preserved when the buffer grows.
+         */
+        T * allocate(size_t n) {
+            if (n > capacity) {
+                if (buf != NULL) free(buf);
+                buf = (T *) malloc(n * sizeof(T));
+                assert(buf != NULL);
+                capacity = n;
+            }
+            return buf;
+        }
+
+        /**
+         * Frees the memory.
+         */
+        void release() {
+            if (buf != NULL) free(buf);
+            buf = NULL;
+            capacity = 0;
+        }
+
+        size_t capacity_bytes() const {
+            return capacity * sizeof(T);
+        }
+    };
+
+}
+
+#endif
@@ -5,16 +5,17 @@
 #define DENSE_BITSET_HPP
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <stdint.h>
 
 namespace graphchi {
     class dense_bitset {
     public:
-        dense_bitset() : array(NULL), len(0) {
+        dense_bitset() : array(NULL), len(0), arrlen(0) {
             generate_bit_masks();
         }
         
-        dense_bitset(size_t size) : array(NULL), len(size) {
+        dense_bitset(size_t size) : array(NULL), len(size), arrlen(0) {
             resize(size);
             clear();
             generate_bit_masks();
@@ -24,10 +25,13 @@ namespace graphchi {
         virtual ~dense_bitset() {free(array);}
         
         void resize(size_t n) {
+            size_t oldarrlen = arrlen;
             len = n;
             //need len bits
             arrlen =  n / (8*sizeof(size_t)) + 1;
             array = (size_t*)realloc(array, sizeof(size_t) * arrlen);
+            // New words are cleared
+            for (size_t i = oldarrlen; i < arrlen; ++i) array[i] = 0;
         }
         
         void clear() {
@@ -36,6 +40,9 @@ namespace graphchi {
         
         void setall() {
             memset(array, 0xff,  arrlen * sizeof(size_t));
+            // Bits past the end are left cleared
+            const size_t bitsperword = 8 * sizeof(size_t);
+            array[arrlen - 1] = (len % bitsperword == 0 ? 0 : ~size_t(0) >> (bitsperword - len % bitsperword));
         }
         
         inline bool get(uint32_t b) const{
@@ -90,6 +97,38 @@ namespace graphchi {
             memset(&array[from_arrpos], 0, (to_arrpos-from_arrpos) * (int)  sizeof(size_t));
         }
         
+        //! Returns true if any bit in the range is set (tob is inclusive)
+        inline bool any_set(uint32_t fromb, uint32_t tob) const {
+            return next_set(fromb, tob) <= tob;
+        }
+        
+        //! Returns the first set bit in the range, or tob + 1 if none (tob is inclusive)
+        inline uint32_t next_set(uint32_t fromb, uint32_t tob) const {
+            const uint32_t bitsperword = 8 * (int) sizeof(size_t);
+            uint32_t from_arrpos = fromb / bitsperword;
+            uint32_t to_arrpos = tob / bitsperword;
+            size_t lastmask = ~size_t(0) >> (bitsperword - 1 - tob % bitsperword);
+            size_t word = array[from_arrpos] & (~size_t(0) << (fromb % bitsperword));
+            for(uint32_t i=from_arrpos; ; word = array[++i]) {
+                if (i == to_arrpos) word &= lastmask;
+                if (word != 0) return i * bitsperword + __builtin_ctzl(word);
+                if (i == to_arrpos) return tob + 1;
+            }
+        }
+        
+        //! Number of set bits in the range (tob is inclusive)
+        inline size_t count_set(uint32_t fromb, uint32_t tob) const {
+            const uint32_t bitsperword = 8 * (int) sizeof(size_t);
+            uint32_t from_arrpos = fromb / bitsperword;
+            uint32_t to_arrpos = tob / bitsperword;
+            size_t lastmask = ~size_t(0) >> (bitsperword - 1 - tob % bitsperword);
+            size_t word = array[from_arrpos] & (~size_t(0) << (fromb % bitsperword));
+            size_t n = 0;
+            for(uint32_t i=from_arrpos; ; word = array[++i]) {
+                if (i == to_arrpos) return n + __builtin_popcountl(word & lastmask);
+                n += __builtin_popcountl(word);
+            }
+        }
                 
         inline size_t size() const {
             return len;
@@ -0,0 +1,185 @@
+
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Intersection of sorted lists of vertex ids. The lists must be strictly
+ * increasing. For each common id, a callback is called with its index in
+ * the second list. If one list is much longer than the other, the elements
+ * of the shorter are searched from the longer by galloping; otherwise the
+ * lists are merged, eight ids at a time with AVX2 if the CPU supports it.
+ */
+
+#ifndef DEF_GRAPHCHI_INTERSECT
+#define DEF_GRAPHCHI_INTERSECT
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graphchi_types.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GRAPHCHI_INTERSECT_AVX2
+#include <immintrin.h>
+#endif
+
+/* Gallop if one list is this many times longer than the other */
+#define INTERSECT_GALLOP_RATIO 32
+
+namespace graphchi {
+
+    /**
+     * Index of the first element of a[lo..n) that is at least x.
+     */
+    inline size_t gallop_lower_bound(const vid_t * a, size_t lo, size_t n, vid_t x) {
+        size_t step = 1;
+        size_t hi = lo;
+        while (hi < n && a[hi] < x) {
+            lo = hi + 1;
+            hi += step;
+            step <<= 1;
+        }
+        if (hi > n) hi = n;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (a[mid] < x) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    template <typename MatchFunc>
+    size_t intersect_merge(const vid_t * a, size_t na, const vid_t * b, size_t nb, MatchFunc &onmatch,
+                           size_t i=0, size_t j=0) {
+        size_t count = 0;
+        while (i < na && j < nb) {
+            vid_t x = a[i], y = b[j];
+            if (x == y) {
+                onmatch(j);
+                count++;
+                i++; j++;
+            } else {
+                i += x < y;
+                j += x > y;
+            }
+        }
+        return count;
+    }
+
+    template <typename MatchFunc>
+    size_t intersect_gallop(const vid_t * a, size_t na, const vid_t * b, size_t nb, MatchFunc &onmatch) {
+        size_t count = 0;
+        if (na <= nb) {
+            size_t j = 0;
+            for(size_t i=0; i < na && j < nb; i++) {
+                j = gallop_lower_bound(b, j, nb, a[i]);
+                if (j < nb && b[j] == a[i]) {
+                    onmatch(j);
+                    count++;
+                    j++;
+                }
+            }
+        } else {
+            size_t i = 0;
+            for(size_t j=0; j < nb && i < na; j++) {
+                i = gallop_lower_bound(a, i, na, b[j]);
+                if (i < na && a[i] == b[j]) {
+                    onmatch(j);
+                    count++;
+                    i++;
+                }
+            }
+        }
+        return count;
+    }
+
+#ifdef GRAPHCHI_INTERSECT_AVX2
+    /**
+     * Compares blocks of eight ids of both lists: the block of b is compared
+     * to all rotations of the block of a, and the block whose last id is smaller
+     * is skipped. The rest is merged with the scalar code.
+     */
+    template <typename MatchFunc>
+    __attribute__((target("avx2")))
+    size_t intersect_merge_avx2(const vid_t * a, size_t na, const vid_t * b, size_t nb, MatchFunc &onmatch) {
+        size_t count = 0;
+        size_t i = 0, j = 0;
+        const __m256i rot = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+        while (i + 8 <= na && j + 8 <= nb) {
+            __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i *) (b + j));
+            __m256i eq = _mm256_cmpeq_epi32(vb, va);
+            for(int r=1; r < 8; r++) {
+                va = _mm256_permutevar8x32_epi32(va, rot);
+                eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(vb, va));
+            }
+            unsigned int mask = (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+            while (mask != 0) {
+                onmatch(j + __builtin_ctz(mask));
+                count++;
+                mask &= mask - 1;
+            }
+            vid_t amax = a[i + 7];
+            vid_t bmax = b[j + 7];
+            if (amax <= bmax) i += 8;
+            if (bmax <= amax) j += 8;
+        }
+        return count + intersect_merge(a, na, b, nb, onmatch, i, j);
+    }
+
+    inline bool intersect_have_avx2() {
+        static bool have = __builtin_cpu_supports("avx2");
+        return have;
+    }
+#endif
+
+    /**
+     * Intersects sorted lists a and b, calling onmatch(j) for each
+     * b[j] that is in a. Returns the size of the intersection.
+     */
+    template <typename MatchFunc>
+    size_t intersect_sorted(const vid_t * a, size_t na, const vid_t * b, size_t nb, MatchFunc &onmatch) {
+        if (na == 0 || nb == 0) return 0;
+        if (na > INTERSECT_GALLOP_RATIO * nb || nb > INTERSECT_GALLOP_RATIO * na) {
+            return intersect_gallop(a, na, b, nb, onmatch);
+        }
+#ifdef GRAPHCHI_INTERSECT_AVX2
+        if (intersect_have_avx2()) {
+            return intersect_merge_avx2(a, na, b, nb, onmatch);
+        }
+#endif
+        return intersect_merge(a, na, b, nb, onmatch);
+    }
+
+    struct intersect_nop {
+        inline void operator()(size_t j) {}
+    };
+
+    inline size_t intersection_size(const vid_t * a, size_t na, const vid_t * b, size_t nb) {
+        intersect_nop nop;
+        return intersect_sorted(a, na, b, nb, nop);
+    }
+
+};
+
+#endif
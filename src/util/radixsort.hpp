@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @author  Aapo Kyrola <akyrola@cs.cmu.edu>
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Aapo Kyrola, Guy Blelloch, Carlos Guestrin / Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+
+ *
+ * @section DESCRIPTION
+ *
+ * Parallel LSD radix sort for integer keys of up to 64 bits. Each pass
+ * sorts by 11 bits of the key: the threads count digits of their part of
+ * the array, and then scatter their elements to the positions given by
+ * the prefix sums. The sort is stable. Passes where all keys have the
+ * same digit are skipped.
+ */
+
+#ifndef GRAPHCHI_RADIXSORT_INCLUDED
+#define GRAPHCHI_RADIXSORT_INCLUDED
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <omp.h>
+
+#define RADIX_BITS 11
+#define RADIX_MIN_PARALLEL 65536
+
+/**
+ * Sorts A by key(A[i]), which must be less than 2^keybits.
+ * Needs a temporary buffer of the size of the array.
+ */
+template <class E, class KeyFunc>
+void radixSort(E * A, size_t n, int keybits, KeyFunc key, int nthreads) {
+    if (n < 2) return;
+    if (n < RADIX_MIN_PARALLEL) nthreads = 1;
+    const size_t nbuckets = (size_t)1 << RADIX_BITS;
+    const uint64_t mask = nbuckets - 1;
+
+    E * tmp = (E *) malloc(n * sizeof(E));
+    assert(tmp != NULL);
+    E * src = A;
+    E * dst = tmp;
+    std::vector<size_t> counts(nthreads * nbuckets);
+
+    for(int shift=0; shift < keybits; shift += RADIX_BITS) {
+        bool skip = false;
+#pragma omp parallel num_threads(nthreads)
+        {
+            int nt = omp_get_num_threads();
+            int t = omp_get_thread_num();
+            size_t st = n * t / nt;
+            size_t en = n * (t + 1) / nt;
+            size_t * c = &counts[t * nbuckets];
+            std::fill(c, c + nbuckets, 0);
+            for(size_t i=st; i < en; i++) c[(key(src[i]) >> shift) & mask]++;
+#pragma omp barrier
+#pragma omp single
+            {
+                /* Digit-major, thread-minor offsets keep the sort stable */
+                size_t sum = 0;
+                for(size_t d=0; d < nbuckets; d++) {
+                    size_t digitsum = 0;
+                    for(int j=0; j < nt; j++) {
+                        size_t x = counts[j * nbuckets + d];
+                        counts[j * nbuckets + d] = sum;
+                        sum += x;
+                        digitsum += x;
+                    }
+                    if (digitsum == n) skip = true;
+                }
+            }
+            if (!skip) {
+                for(size_t i=st; i < en; i++) dst[c[(key(src[i]) >> shift) & mask]++] = src[i];
+            }
+        }
+        if (!skip) std::swap(src, dst);
+    }
+    if (src != A) memcpy(A, src, n * sizeof(E));
+    free(tmp);
+}
+
+/**
+ * Number of bits needed to store x.
+ */
+static inline int radix_key_bits(uint64_t x) {
+    int bits = 0;
+    while (x > 0) { bits++; x >>= 1; }
+    return bits;
+}
+
+#endif
@@ -115,6 +115,8 @@ float als_predict(const vertex_data& user,
  */
 struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
 
+  std::vector<normal_equations> normal_eqs; // one for each thread
+
 
 
   /**
@@ -122,16 +124,15 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
    */
   void update(graphchi_vertex<VertexDataType, EdgeDataType> &vertex, graphchi_context &gcontext) {
     vertex_data & vdata = latent_factors_inmem[vertex.id()];
-    mat XtX = mat::Zero(D, D); 
-    vec Xty = vec::Zero(D);
+    normal_equations & eqs = normal_eqs[omp_get_thread_num()];
+    eqs.reset(D);
 
     bool compute_rmse = (vertex.num_outedges() > 0);
     // Compute XtX and Xty (NOTE: unweighted)
     for(int e=0; e < vertex.num_edges(); e++) {
       float observation = vertex.edge(e)->get_data();                
       vertex_data & nbr_latent = latent_factors_inmem[vertex.edge(e)->vertex_id()];
-      Xty += nbr_latent.pvec * observation;
-      XtX.triangularView<Eigen::Upper>() += nbr_latent.pvec * nbr_latent.pvec.transpose();
+      eqs.add(nbr_latent.pvec, observation);
       if (compute_rmse) {
         double prediction;
         rmse_vec[omp_get_thread_num()] += als_predict(vdata, nbr_latent, observation, prediction);
@@ -141,11 +142,11 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
     double regularization = lambda;
     if (regnormal)
       regularization *= vertex.num_edges();
-    for(int i=0; i < D; i++) XtX(i,i) += regularization;
+    eqs.regularize(regularization);
 
 
     // Solve the least squares problem with eigen using Cholesky decomposition
-    vdata.pvec = XtX.selfadjointView<Eigen::Upper>().ldlt().solve(Xty);
+    eqs.solve(vdata.pvec);
   }
 
 
@@ -154,6 +155,7 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
    */
   void before_iteration(int iteration, graphchi_context &gcontext) {
     reset_rmse(gcontext.execthreads);
+    normal_eqs.resize(gcontext.execthreads);
   }
 
 
@@ -106,13 +106,15 @@ float als_tensor_predict(const vertex_data& user,
  */
 struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
 
+  std::vector<normal_equations> normal_eqs; // one for each thread
+
    /*
    *  Vertex update function - computes the least square step
    */
   void update(graphchi_vertex<VertexDataType, EdgeDataType> &vertex, graphchi_context &gcontext) {
     vertex_data & vdata = latent_factors_inmem[vertex.id()];
-    mat XtX = mat::Zero(D, D); 
-    vec Xty = vec::Zero(D);
+    normal_equations & eqs = normal_eqs[omp_get_thread_num()];
+    eqs.reset(D);
 
     bool compute_rmse = is_user(vertex.id()); 
     // Compute XtX and Xty (NOTE: unweighted)
@@ -124,9 +126,7 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
       vertex_data & nbr_latent = latent_factors_inmem[vertex.edge(e)->vertex_id()];
       vertex_data & time_node = latent_factors_inmem[time];
       assert(time != vertex.id() && time != vertex.edge(e)->vertex_id());
-      vec XY = nbr_latent.pvec.cwiseProduct(time_node.pvec);
-      Xty += XY * observation;
-      XtX.triangularView<Eigen::Upper>() += XY * XY.transpose();
+      eqs.add(nbr_latent.pvec.cwiseProduct(time_node.pvec), observation);
       if (compute_rmse) {
         double prediction;
         rmse_vec[omp_get_thread_num()] += als_tensor_predict(vdata, nbr_latent, observation, prediction, (void*)&time_node);
@@ -135,10 +135,10 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
     double regularization = lambda;
     if (regnormal)
       lambda *= vertex.num_edges();
-    for(int i=0; i < D; i++) XtX(i,i) += regularization;
+    eqs.regularize(regularization);
 
     // Solve the least squares problem with eigen using Cholesky decomposition
-    vdata.pvec = XtX.selfadjointView<Eigen::Upper>().ldlt().solve(Xty);
+    eqs.solve(vdata.pvec);
   }
 
 
@@ -147,6 +147,7 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
    */
   void before_iteration(int iteration, graphchi_context &gcontext) {
     reset_rmse(gcontext.execthreads);
+    normal_eqs.resize(gcontext.execthreads);
   }
 
 
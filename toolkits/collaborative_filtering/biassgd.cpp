@@ -38,11 +38,11 @@ double biassgd_step_dec = 0.9; //sgd step decrement
 #define BIAS_POS -1
 
 struct vertex_data {
-  vec pvec; //storing the feature vector
+  fvec pvec; //storing the feature vector
   double bias;
 
   vertex_data() {
-    pvec = zeros(D);
+    pvec = fzeros(D);
     bias = 0;
   }
 
@@ -74,6 +74,7 @@ std::vector<vertex_data> latent_factors_inmem;
 #include "rmse.hpp"
 #include "rmse_engine.hpp"
 #include "io.hpp"
+#include "sgd_engine.hpp"
 
 /** compute a missing value based on bias-SGD algorithm */
 float bias_sgd_predict(const vertex_data& user, 
@@ -83,7 +84,7 @@ float bias_sgd_predict(const vertex_data& user,
     void * extra = NULL){
 
 
-  prediction = globalMean + user.bias + movie.bias + dot_prod(user.pvec, movie.pvec);  
+  prediction = globalMean + user.bias + movie.bias + sgd_dot(user.pvec.data(), movie.pvec.data(), D);  
   //truncate prediction to allowed values
   prediction = std::min((double)prediction, maxval);
   prediction = std::max((double)prediction, minval);
@@ -97,17 +98,51 @@ float bias_sgd_predict(const vertex_data& user,
 
 
 
+/** Bias-SGD step for a rating of user to movie. Returns the squared error. */
+float bias_sgd_step(vertex_data & user, vertex_data & movie, float observation){
+  double estScore = 0;
+  float sqerr = bias_sgd_predict(user, movie, observation, estScore);
+  float err = observation - estScore;
+  if (std::isnan(err) || std::isinf(err))
+    logstream(LOG_FATAL)<<"BIASSGD got into numerical error. Please tune step size using --biassgd_gamma and biassgd_lambda" << std::endl;
+  user.bias += biassgd_gamma*(err - biassgd_lambda* user.bias);
+  movie.bias += biassgd_gamma*(err - biassgd_lambda* movie.bias); 
+  sgd_update(user.pvec.data(), movie.pvec.data(), NULL, NULL, err, biassgd_gamma, biassgd_lambda, biassgd_gamma, biassgd_lambda, D);
+  return sqerr;
+}
+
+struct bias_sgd_rating_step{
+  inline float operator()(vid_t user, vid_t item, float observation){
+    return bias_sgd_step(latent_factors_inmem[user], latent_factors_inmem[item], observation);
+  }
+};
+
+
 /**
  * GraphChi programs need to subclass GraphChiProgram<vertex-type, edge-type> 
  * class. The main logic is usually in the update function.
  */
 struct BIASSGDVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
 
+  sgd_item_blocks_queue item_blocks;
+
  /**
    * Called before an iteration is started.
    */
   void before_iteration(int iteration, graphchi_context &gcontext) {
     reset_rmse(gcontext.execthreads);
+    if (iteration == 0 && sgd_item_blocks > 0)
+      item_blocks.init(gcontext.execthreads, sgd_item_blocks, M, N);
+  }
+
+  /**
+   * Called after an execution interval has finished.
+   */
+  void after_exec_interval(vid_t window_st, vid_t window_en, graphchi_context &gcontext) {
+    if (sgd_item_blocks > 0){
+      bias_sgd_rating_step step;
+      item_blocks.run(step, rmse_vec, gcontext.execthreads);
+    }
   }
 
 
@@ -125,28 +160,23 @@ struct BIASSGDVerticesInMemProgram : public GraphChiProgram<VertexDataType, Edge
    */
   void update(graphchi_vertex<VertexDataType, EdgeDataType> &vertex, graphchi_context &gcontext) {
     if ( vertex.num_outedges() > 0){
+      //with item blocks, the ratings are processed after the interval
+      if (sgd_item_blocks > 0){
+        for(int e=0; e < vertex.num_edges(); e++)
+          item_blocks.add(vertex.id(), vertex.edge(e)->vertex_id(), vertex.edge(e)->get_data());
+        return;
+      }
       vertex_data & user = latent_factors_inmem[vertex.id()]; 
+      double sqerr = 0;
       for(int e=0; e < vertex.num_edges(); e++) {
         float observation = vertex.edge(e)->get_data();                
-        vertex_data & movie = latent_factors_inmem[vertex.edge(e)->vertex_id()];
-        double estScore = 0;
-        rmse_vec[omp_get_thread_num()] += bias_sgd_predict(user, movie, observation, estScore);
-        double err = observation - estScore;
-        if (std::isnan(err) || std::isinf(err))
-          logstream(LOG_FATAL)<<"BIASSGD got into numerical error. Please tune step size using --biassgd_gamma and biassgd_lambda" << std::endl;
-        user.bias += biassgd_gamma*(err - biassgd_lambda* user.bias);
-        movie.bias += biassgd_gamma*(err - biassgd_lambda* movie.bias); 
-        //NOTE: the following code is not thread safe, since potentially several
-        //user nodes may update this item gradient vector concurrently. However in practice it
-        //did not matter in terms of accuracy on a multicore machine.
-        //if you like to defend the code, you can define a global variable
-        //mutex mymutex;
-        //
-        //and then do: mymutex.lock()
-        movie.pvec += biassgd_gamma*(err*user.pvec - biassgd_lambda*movie.pvec);
-        //here add: mymutex.unlock();
-        user.pvec += biassgd_gamma*(err*movie.pvec - biassgd_lambda*user.pvec);
+        vid_t item = vertex.edge(e)->vertex_id();
+        //several user nodes may update this item vector concurrently, see --sgd_policy
+        sgd_lock(item);
+        sqerr += bias_sgd_step(user, latent_factors_inmem[item], observation);
+        sgd_unlock(item);
       }
+      rmse_vec[omp_get_thread_num()] += sqerr;
     }
 
   }
@@ -182,6 +212,7 @@ int main(int argc, const char ** argv) {
   biassgd_lambda    = get_option_float("biassgd_lambda", 1e-3);
   biassgd_gamma     = get_option_float("biassgd_gamma", 1e-3);
   biassgd_step_dec  = get_option_float("biassgd_step_dec", 0.9);
+  parse_sgd_command_line();
 
 
   parse_command_line_args();
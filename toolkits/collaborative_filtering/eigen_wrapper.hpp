@@ -213,6 +213,108 @@ inline bool ls_solve(const mat &A, const vec &b, vec &result){
   result = A.ldlt().solve(b);
   return true;
 }
+
+/* Number of rows of X collected before X'X is updated */
+#define LS_BLOCK 64
+
+/**
+ * Normal equations (X'WX + lambda I) x = X'Wy of a weighted least squares
+ * problem, added one row of X at a time. The rows are copied to a block,
+ * and X'WX is updated once per block with a rank-k update of its upper
+ * triangle. The matrices are allocated once, so an object should be
+ * reused by one thread for all of its least squares problems.
+ */
+class normal_equations {
+  mat XtX;
+  vec Xty;
+  mat X;       // rows of the block, as columns
+  vec wy;      // weight * observation of each row
+  vec w;       // weight of each row
+  mat Xw;      // rows of the block multiplied by their weights
+  int n;
+  bool weighted;
+  LLT<mat, Upper> llt;
+  LDLT<mat, Upper> ldlt;
+
+  void flush(){
+    if (n == 0)
+      return;
+    if (weighted){
+      Xw.leftCols(n).noalias() = X.leftCols(n) * w.head(n).asDiagonal();
+      XtX.triangularView<Upper>() += X.leftCols(n) * Xw.leftCols(n).transpose();
+    }
+    else XtX.selfadjointView<Upper>().rankUpdate(X.leftCols(n));
+    Xty.noalias() += X.leftCols(n) * wy.head(n);
+    n = 0;
+    weighted = false;
+  }
+
+public:
+  normal_equations() : n(0), weighted(false) {}
+
+  /** Starts a new problem with D unknowns */
+  void reset(int D){
+    if (XtX.rows() != D){
+      XtX.resize(D, D);
+      Xty.resize(D);
+      X.resize(D, LS_BLOCK);
+      Xw.resize(D, LS_BLOCK);
+      wy.resize(LS_BLOCK);
+      w.resize(LS_BLOCK);
+    }
+    XtX.setZero();
+    Xty.setZero();
+    n = 0;
+    weighted = false;
+  }
+
+  /** Adds row x of X, with observation y and weight */
+  template<typename Derived>
+  inline void add(const MatrixBase<Derived> & x, double y, double weight = 1.0){
+    X.col(n) = x;
+    wy[n] = weight * y;
+    w[n] = weight;
+    weighted = weighted || weight != 1.0;
+    if (++n == LS_BLOCK)
+      flush();
+  }
+
+  /** Adds lambda to the diagonal of X'WX */
+  void regularize(double lambda){
+    flush();
+    XtX.diagonal().array() += lambda;
+  }
+
+  /** X'WX, with both triangles filled */
+  const mat & get_XtX(){
+    flush();
+    for (int j=0; j< XtX.cols(); j++)
+      for (int i=j+1; i< XtX.rows(); i++)
+        XtX(i,j) = XtX(j,i);
+    return XtX;
+  }
+
+  const vec & get_Xty(){
+    flush();
+    return Xty;
+  }
+
+  /**
+   * Solves the equations using Cholesky decomposition. If X'WX + lambda I
+   * is not positive definite, LDLT decomposition is used instead.
+   */
+  void solve(vec & result){
+    flush();
+    llt.compute(XtX);
+    if (llt.info() == Success){
+      result = llt.solve(Xty);
+      return;
+    }
+    ldlt.compute(XtX);
+    result = ldlt.solve(Xty);
+  }
+};
+
 inline bool chol(mat& sigma, mat& out){
   out = sigma.llt().matrixLLT();
   return true;
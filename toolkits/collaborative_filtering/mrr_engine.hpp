@@ -29,8 +29,8 @@
 
 #include "climf.hpp"
 
-vec mrr_vec;                     // cumulative sum of MRR per thread
-vec users_vec;                   // user count per thread
+sum_aggregator<double> mrr_sum;  // cumulative sum of MRR
+count_aggregator users_count;    // number of users
 int num_threads = 1;
 int cur_iteration = 0;
 
@@ -88,19 +88,18 @@ struct ValidationMRRProgram : public GraphChiProgram<VertexDataType, EdgeDataTyp
           }
         }
 
-        assert(mrr_vec.size() > omp_get_thread_num());
-        mrr_vec[omp_get_thread_num()] += MRR;
-
-        assert(users_vec.size() > omp_get_thread_num());
-        users_vec[omp_get_thread_num()]++;
+        mrr_sum.add(MRR);
+        users_count.inc();
       }
     }
   }
 
   void before_iteration(int iteration, graphchi_context & gcontext)
   {
-    users_vec = zeros(num_threads);
-    mrr_vec = zeros(num_threads);
+    users_count.reset();
+    mrr_sum.reset();
+    gcontext.register_aggregator(&users_count);
+    gcontext.register_aggregator(&mrr_sum);
   }
 
   /**
@@ -108,7 +107,7 @@ struct ValidationMRRProgram : public GraphChiProgram<VertexDataType, EdgeDataTyp
    */
   void after_iteration(int iteration, graphchi_context &gcontext)
   {
-    double mrr = sum(mrr_vec) / sum(users_vec);
+    double mrr = mrr_sum.get() / users_count.get();
     std::cout<<"  Validation MRR:" << std::setw(10) << mrr << std::endl;
   }
 };
@@ -117,7 +116,6 @@ void reset_mrr(int exec_threads)
 {
   logstream(LOG_DEBUG)<<"Detected number of threads: " << exec_threads << std::endl;
   num_threads = exec_threads;
-  mrr_vec = zeros(num_threads);
 }
 
 template<typename VertexDataType, typename EdgeDataType>
@@ -25,9 +25,9 @@
  */
 
 float (*pprediction_func)(const vertex_data&, const vertex_data&, const float, double &, void *) = NULL;
-vec validation_rmse_vec;
-vec users_vec;
-vec sum_ap_vec;
+sum_aggregator<double> validation_rmse_sum;  // sum of validation errors
+count_aggregator users_count;                // number of users with validation data
+sum_aggregator<double> sum_ap;               // sum of AP over users
 bool user_nodes = true;
 int num_threads = 1;
 bool converged_engine = false;
@@ -51,7 +51,7 @@ struct ValidationAPProgram : public GraphChiProgram<VertexDataType, EdgeDataType
     vec ratings = zeros(vertex.num_outedges());
     vec real_vals = zeros(vertex.num_outedges());
     if (ratings.size() > 0){
-      users_vec[omp_get_thread_num()]++;
+      users_count.inc();
       int j=0;
       int real_click_count = 0;
       for(int e=0; e < vertex.num_outedges(); e++) {
@@ -75,20 +75,22 @@ struct ValidationAPProgram : public GraphChiProgram<VertexDataType, EdgeDataType
       if (real_click_count > 0 )
         ap /= real_click_count;
       else ap = 0;
-      sum_ap_vec[omp_get_thread_num()] += ap;
+      sum_ap.add(ap);
     }
   }
   void before_iteration(int iteration, graphchi_context & gcontext){
     last_validation_rmse = dvalidation_rmse;
-    users_vec = zeros(num_threads);
-    sum_ap_vec = zeros(num_threads);
+    users_count.reset();
+    sum_ap.reset();
+    gcontext.register_aggregator(&users_count);
+    gcontext.register_aggregator(&sum_ap);
   }
   /**
    * Called after an iteration has finished.
    */
   void after_iteration(int iteration, graphchi_context &gcontext) {
     assert(Le > 0);
-    dvalidation_rmse = finalize_rmse(sum(sum_ap_vec) , (double)sum(users_vec));
+    dvalidation_rmse = finalize_rmse(sum_ap.get(), (double)users_count.get());
     std::cout<<"  Validation  " << error_names[loss_type] << ":" << std::setw(10) << dvalidation_rmse << std::endl;
     if (halt_on_rmse_increase > 0 && halt_on_rmse_increase < cur_iteration && dvalidation_rmse > last_validation_rmse){
       logstream(LOG_WARNING)<<"Stopping engine because of validation " << error_names[loss_type] <<  " increase" << std::endl;
@@ -121,21 +123,21 @@ struct ValidationRMSEProgram : public GraphChiProgram<VertexDataType, EdgeDataTy
       double prediction;
       double rmse = (*pprediction_func)(vdata, nbr_latent, observation, prediction, NULL);
       assert(rmse <= pow(maxval - minval, 2));
-      assert(validation_rmse_vec.size() > omp_get_thread_num());
-      validation_rmse_vec[omp_get_thread_num()] += rmse;
+      validation_rmse_sum.add(rmse);
     }
   }
 
   void before_iteration(int iteration, graphchi_context & gcontext){
     last_validation_rmse = dvalidation_rmse;
-    validation_rmse_vec = zeros(num_threads);
+    validation_rmse_sum.reset();
+    gcontext.register_aggregator(&validation_rmse_sum);
   }
   /**
    * Called after an iteration has finished.
    */
   void after_iteration(int iteration, graphchi_context &gcontext) {
     assert(Le > 0);
-    dvalidation_rmse = finalize_rmse(sum(validation_rmse_vec) , (double)Le);
+    dvalidation_rmse = finalize_rmse(validation_rmse_sum.get(), (double)Le);
     std::cout<<"  Validation  " << error_names[loss_type] << ":" << std::setw(10) << dvalidation_rmse << std::endl;
     if (halt_on_rmse_increase > 0 && halt_on_rmse_increase < cur_iteration && dvalidation_rmse > last_validation_rmse){
       logstream(LOG_WARNING)<<"Stopping engine because of validation RMSE increase" << std::endl;
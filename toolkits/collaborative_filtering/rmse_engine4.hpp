@@ -25,7 +25,7 @@
  */
 
 float (*pprediction_func)(const vertex_data&, const vertex_data&, const float, double &, void *) = NULL;
-vec validation_rmse_vec;
+sum_aggregator<double> validation_rmse_sum;  // sum of validation errors
 bool user_nodes = true;
 int counter = 0;
 bool time_weighting = false;
@@ -63,21 +63,21 @@ struct ValidationRMSEProgram4 : public GraphChiProgram<VertexDataType, EdgeDataT
       assert(rmse <= pow(maxval - minval, 2));
       if (time_weighting)
         rmse *= vertex.edge(e)->get_data().time;
-      assert(validation_rmse_vec.size() > omp_get_thread_num());
-      validation_rmse_vec[omp_get_thread_num()] += rmse;
+      validation_rmse_sum.add(rmse);
     }
   }
 
   void before_iteration(int iteration, graphchi_context & gcontext){
     last_validation_rmse = dvalidation_rmse;
-    validation_rmse_vec = zeros(num_threads);
+    validation_rmse_sum.reset();
+    gcontext.register_aggregator(&validation_rmse_sum);
   }
   /**
    * Called after an iteration has finished.
    */
   void after_iteration(int iteration, graphchi_context &gcontext) {
     assert(Le > 0);
-    dvalidation_rmse = finalize_rmse(sum(validation_rmse_vec) , (double)Le);
+    dvalidation_rmse = finalize_rmse(validation_rmse_sum.get(), (double)Le);
     std::cout<<"  Validation  " << error_names[loss_type] << ":" << std::setw(10) << dvalidation_rmse << std::endl;
   if (halt_on_rmse_increase > 0 && halt_on_rmse_increase < cur_iteration && dvalidation_rmse > last_validation_rmse){
     logstream(LOG_WARNING)<<"Stopping engine because of validation RMSE increase" << std::endl;
@@ -27,6 +27,15 @@ else
   echo "FAIL TEST 2 (Weighted Alternating least squares)"| tee -a $stdoutfname
 fi
 
+echo "---------SGD-------------" | tee -a $stdoutfname
+./sgd --unittest=1 --quiet=1 >> $stdoutfname 2>& 1
+if [ $? -eq 0 ]; then
+  echo "PASS TEST 3 (Stochastic gradient descent)"| tee -a $stdoutfname
+else
+  somefailed=1
+  echo "FAIL TEST 3 (Stochastic gradient descent)"| tee -a $stdoutfname
+fi
+
 if [ $somefailed == 1 ]; then
   echo "**** FAILURE LOG **************" >> $stdoutfname
   echo `date` >> $stdoutfname
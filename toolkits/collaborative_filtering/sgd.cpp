@@ -39,10 +39,10 @@ double sgd_gamma = 1e-3;  //sgd step size
 double sgd_step_dec = 0.9; //sgd step decrement
 
 struct vertex_data {
-  vec pvec; //storing the feature vector
+  fvec pvec; //storing the feature vector
 
   vertex_data() {
-    pvec = zeros(D);
+    pvec = fzeros(D);
   }
   void set_val(int index, float val){
     pvec[index] = val;
@@ -69,6 +69,7 @@ std::vector<vertex_data> latent_factors_inmem;
 #include "rmse.hpp"
 #include "rmse_engine.hpp"
 #include "io.hpp"
+#include "sgd_engine.hpp"
 
 /** compute a missing value based on SGD algorithm */
 float sgd_predict(const vertex_data& user, 
@@ -78,7 +79,7 @@ float sgd_predict(const vertex_data& user,
     void * extra = NULL){
 
 
-  prediction = dot_prod(user.pvec,movie.pvec);
+  prediction = sgd_dot(user.pvec.data(), movie.pvec.data(), D);
 
   //truncate prediction to allowed values
   prediction = std::min((double)prediction, maxval);
@@ -91,17 +92,101 @@ float sgd_predict(const vertex_data& user,
 }
 
 
+/** SGD step for a rating of user to movie. Returns the squared error. */
+float sgd_step(vertex_data & user, vertex_data & movie, float observation){
+  double estScore;
+  float sqerr = sgd_predict(user, movie, observation, estScore);
+  float err = observation - estScore;
+  if (std::isnan(err) || std::isinf(err))
+    logstream(LOG_FATAL)<<"SGD got into numerical error. Please tune step size using --sgd_gamma and sgd_lambda" << std::endl;
+  sgd_update(user.pvec.data(), movie.pvec.data(), NULL, NULL, err, sgd_gamma, sgd_lambda, sgd_gamma, sgd_lambda, D);
+  return sqerr;
+}
+
+struct sgd_rating_step{
+  inline float operator()(vid_t user, vid_t item, float observation){
+    return sgd_step(latent_factors_inmem[user], latent_factors_inmem[item], observation);
+  }
+};
+
+
+/**
+ * Unit test of the item blocks: checks that run() processes each rating
+ * once, a whole block at a time, and sums the returned errors.
+ */
+struct sgd_block_check_step{
+  vid_t first_item, nitems;
+  int nblocks;
+  int last_block;
+  std::vector<int> count;
+  inline float operator()(vid_t user, vid_t item, float observation){
+    assert(item >= first_item && item < first_item + nitems);
+    int b = (int)((uint64_t)(item - first_item) * nblocks / nitems);
+    if (b < last_block)
+      logstream(LOG_FATAL)<<"Unit test 1 failed. Item " << item << " of block " << b << " processed after block " << last_block << std::endl;
+    last_block = b;
+    count[user]++;
+    return observation;
+  }
+};
+
+void test_item_blocks(){
+  const int nthreads = 4, nblocks = 7;
+  const vid_t first_item = 100, nitems = 1000, nratings = 5000;
+  sgd_item_blocks_queue queue;
+  queue.init(nthreads, nblocks, first_item, nitems);
+  double expected = 0;
+#pragma omp parallel for num_threads(nthreads) reduction(+:expected)
+  for (int u=0; u< (int)nratings; u++){
+    vid_t item = first_item + (vid_t)(((uint64_t)u * 7919) % nitems);
+    queue.add(u, item, (float)(u % 3));
+    expected += u % 3;
+  }
+  //a single thread goes over the blocks in order
+  sgd_block_check_step step;
+  step.first_item = first_item; step.nitems = nitems; step.nblocks = nblocks;
+  step.last_block = 0;
+  step.count.resize(nratings, 0);
+  vec errsum = zeros(nthreads);
+  queue.run(step, errsum, 1);
+  for (int u=0; u< (int)nratings; u++)
+    if (step.count[u] != 1)
+      logstream(LOG_FATAL)<<"Unit test 1 failed. Rating " << u << " processed " << step.count[u] << " times" << std::endl;
+  if (errsum[0] != expected || sum(errsum) != expected)
+    logstream(LOG_FATAL)<<"Unit test 1 failed. Error sum is " << sum(errsum) << ", expected " << expected << std::endl;
+  //the queue is empty after a run
+  queue.run(step, errsum, 1);
+  if (sum(errsum) != expected)
+    logstream(LOG_FATAL)<<"Unit test 1 failed. Ratings processed twice" << std::endl;
+  logstream(LOG_INFO)<<"SGD item blocks unit test passed" << std::endl;
+}
+
+
 /**
  * GraphChi programs need to subclass GraphChiProgram<vertex-type, edge-type> 
  * class. The main logic is usually in the update function.
  */
 struct SGDVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
 
+  sgd_item_blocks_queue item_blocks;
+
   /**
    * Called before an iteration is started.
    */
   void before_iteration(int iteration, graphchi_context &gcontext) {
     reset_rmse(gcontext.execthreads);
+    if (iteration == 0 && sgd_item_blocks > 0)
+      item_blocks.init(gcontext.execthreads, sgd_item_blocks, M, N);
+  }
+
+  /**
+   * Called after an execution interval has finished.
+   */
+  void after_exec_interval(vid_t window_st, vid_t window_en, graphchi_context &gcontext) {
+    if (sgd_item_blocks > 0){
+      sgd_rating_step step;
+      item_blocks.run(step, rmse_vec, gcontext.execthreads);
+    }
   }
 
 
@@ -121,27 +206,24 @@ struct SGDVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
   void update(graphchi_vertex<VertexDataType, EdgeDataType> &vertex, graphchi_context &gcontext) {
     //go over all user nodes
     if ( vertex.num_outedges() > 0){
+      //with item blocks, the ratings are processed after the interval
+      if (sgd_item_blocks > 0){
+        for(int e=0; e < vertex.num_edges(); e++)
+          item_blocks.add(vertex.id(), vertex.edge(e)->vertex_id(), vertex.edge(e)->get_data());
+        return;
+      }
       vertex_data & user = latent_factors_inmem[vertex.id()]; 
+      double sqerr = 0;
       //go over all ratings
       for(int e=0; e < vertex.num_edges(); e++) {
         float observation = vertex.edge(e)->get_data();                
-        vertex_data & movie = latent_factors_inmem[vertex.edge(e)->vertex_id()];
-        double estScore;
-        rmse_vec[omp_get_thread_num()] += sgd_predict(user, movie, observation, estScore);
-        double err = observation - estScore;
-        if (std::isnan(err) || std::isinf(err))
-          logstream(LOG_FATAL)<<"SGD got into numerical error. Please tune step size using --sgd_gamma and sgd_lambda" << std::endl;
-        //NOTE: the following code is not thread safe, since potentially several
-        //user nodes may updates this item gradient vector concurrently. However in practice it
-        //did not matter in terms of accuracy on a multicore machine.
-        //if you like to defend the code, you can define a global variable
-        //mutex mymutex;
-        //
-        //and then do: mymutex.lock()
-        movie.pvec += sgd_gamma*(err*user.pvec - sgd_lambda*movie.pvec);
-        //and here add: mymutex.unlock();
-        user.pvec += sgd_gamma*(err*movie.pvec - sgd_lambda*user.pvec);
+        vid_t item = vertex.edge(e)->vertex_id();
+        //several user nodes may update this item vector concurrently, see --sgd_policy
+        sgd_lock(item);
+        sqerr += sgd_step(user, latent_factors_inmem[item], observation);
+        sgd_unlock(item);
       }
+      rmse_vec[omp_get_thread_num()] += sqerr;
     }
 
   }
@@ -177,9 +259,15 @@ int main(int argc, const char ** argv) {
   sgd_lambda    = get_option_float("sgd_lambda", 1e-3);
   sgd_gamma     = get_option_float("sgd_gamma", 1e-3);
   sgd_step_dec  = get_option_float("sgd_step_dec", 0.9);
+  parse_sgd_command_line();
 
   parse_command_line_args();
   parse_implicit_command_line();
+  if (unittest == 1){
+    test_item_blocks();
+    if (training == "") training = "test_als";
+    if (sgd_item_blocks == 0) sgd_item_blocks = 2;
+  }
 
   /* Preprocess data if needed, or discover preprocess files */
   int nshards = convert_matrixmarket<EdgeDataType>(training, NULL, 0, 0, 3, TRAINING, false);
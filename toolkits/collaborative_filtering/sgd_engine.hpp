@@ -0,0 +1,258 @@
+#ifndef _SGD_ENGINE_HPP__
+#define _SGD_ENGINE_HPP__
+/**
+ * @file
+ * @author  Danny Bickson
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2012] [Carnegie Mellon University]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Common parts of the SGD algorithms (SGD, bias-SGD, SVD++): float kernels
+ * for the prediction and the update of the factors of a rating, the policy
+ * for factor vectors that several threads update at the same time, and the
+ * processing of the ratings of an execution interval by blocks of items.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <string>
+#include <vector>
+
+#include "eigen_wrapper.hpp"
+#include "common.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SGD_KERNEL_AVX2
+#include <immintrin.h>
+#endif
+
+/* Number of locks for the striped locking policy */
+#define SGD_NLOCKS 1024
+
+enum{
+  SGD_HOGWILD = 0, // factor vectors are updated without locking (Hogwild)
+  SGD_LOCKS = 1    // factor vectors are locked, one lock for each stripe of vertex ids
+};
+
+int sgd_policy = SGD_HOGWILD;
+int sgd_item_blocks = 0; // if > 0, ratings are processed after each interval by item blocks
+spinlock sgd_locks[SGD_NLOCKS];
+
+inline float sgd_dot_scalar(const float * a, const float * b, int n){
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int j = 0;
+  for (; j+4 <= n; j+=4){
+    s0 += a[j] * b[j];
+    s1 += a[j+1] * b[j+1];
+    s2 += a[j+2] * b[j+2];
+    s3 += a[j+3] * b[j+3];
+  }
+  for (; j < n; j++)
+    s0 += a[j] * b[j];
+  return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * Updates the factors u and v of a rating with prediction error err:
+ *   u += ugamma * (err * v - ulambda * u)
+ *   v += vgamma * (err * (u + uext) - vlambda * v)
+ * Both updates use the factors from before the step. uext (the implicit
+ * feedback of SVD++) may be NULL. If vsum is not NULL, err * v is added to it.
+ */
+inline void sgd_update_scalar(float * u, float * v, const float * uext, float * vsum, float err,
+    float ugamma, float ulambda, float vgamma, float vlambda, int n){
+  float ua = 1 - ugamma * ulambda, ue = ugamma * err;
+  float va = 1 - vgamma * vlambda, ve = vgamma * err;
+  for (int j=0; j < n; j++){
+    float uj = u[j], vj = v[j];
+    float ux = (uext != NULL ? uj + uext[j] : uj);
+    u[j] = ua * uj + ue * vj;
+    v[j] = va * vj + ve * ux;
+    if (vsum != NULL)
+      vsum[j] += err * vj;
+  }
+}
+
+#ifdef SGD_KERNEL_AVX2
+__attribute__((target("avx2,fma")))
+inline float sgd_dot_avx2(const float * a, const float * b, int n){
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  int j = 0;
+  for (; j+16 <= n; j+=16){
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+j), _mm256_loadu_ps(b+j), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+j+8), _mm256_loadu_ps(b+j+8), s1);
+  }
+  for (; j+8 <= n; j+=8)
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+j), _mm256_loadu_ps(b+j), s0);
+  s0 = _mm256_add_ps(s0, s1);
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+  h = _mm_hadd_ps(h, h);
+  h = _mm_hadd_ps(h, h);
+  float s = _mm_cvtss_f32(h);
+  for (; j < n; j++)
+    s += a[j] * b[j];
+  return s;
+}
+
+__attribute__((target("avx2,fma")))
+inline void sgd_update_avx2(float * u, float * v, const float * uext, float * vsum, float err,
+    float ugamma, float ulambda, float vgamma, float vlambda, int n){
+  __m256 ua = _mm256_set1_ps(1 - ugamma * ulambda), ue = _mm256_set1_ps(ugamma * err);
+  __m256 va = _mm256_set1_ps(1 - vgamma * vlambda), ve = _mm256_set1_ps(vgamma * err);
+  __m256 e = _mm256_set1_ps(err);
+  int j = 0;
+  for (; j+8 <= n; j+=8){
+    __m256 uj = _mm256_loadu_ps(u+j), vj = _mm256_loadu_ps(v+j);
+    __m256 ux = (uext != NULL ? _mm256_add_ps(uj, _mm256_loadu_ps(uext+j)) : uj);
+    _mm256_storeu_ps(u+j, _mm256_fmadd_ps(ua, uj, _mm256_mul_ps(ue, vj)));
+    _mm256_storeu_ps(v+j, _mm256_fmadd_ps(va, vj, _mm256_mul_ps(ve, ux)));
+    if (vsum != NULL)
+      _mm256_storeu_ps(vsum+j, _mm256_fmadd_ps(e, vj, _mm256_loadu_ps(vsum+j)));
+  }
+  if (j < n)
+    sgd_update_scalar(u+j, v+j, (uext != NULL ? uext+j : NULL), (vsum != NULL ? vsum+j : NULL), err,
+        ugamma, ulambda, vgamma, vlambda, n-j);
+}
+
+inline bool sgd_have_avx2(){
+  static bool have = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return have;
+}
+#endif
+
+/** Dot product of float vectors of length n */
+inline float sgd_dot(const float * a, const float * b, int n){
+#ifdef SGD_KERNEL_AVX2
+  if (sgd_have_avx2())
+    return sgd_dot_avx2(a, b, n);
+#endif
+  return sgd_dot_scalar(a, b, n);
+}
+
+/** See sgd_update_scalar() */
+inline void sgd_update(float * u, float * v, const float * uext, float * vsum, float err,
+    float ugamma, float ulambda, float vgamma, float vlambda, int n){
+#ifdef SGD_KERNEL_AVX2
+  if (sgd_have_avx2()){
+    sgd_update_avx2(u, v, uext, vsum, err, ugamma, ulambda, vgamma, vlambda, n);
+    return;
+  }
+#endif
+  sgd_update_scalar(u, v, uext, vsum, err, ugamma, ulambda, vgamma, vlambda, n);
+}
+
+/** Locks the factors of vertex v, if the policy is SGD_LOCKS */
+inline void sgd_lock(vid_t v){
+  if (sgd_policy == SGD_LOCKS)
+    sgd_locks[v % SGD_NLOCKS].lock();
+}
+
+inline void sgd_unlock(vid_t v){
+  if (sgd_policy == SGD_LOCKS)
+    sgd_locks[v % SGD_NLOCKS].unlock();
+}
+
+struct sgd_rating{
+  vid_t user;
+  vid_t item;
+  float rating;
+  sgd_rating(vid_t user, vid_t item, float rating) : user(user), item(item), rating(rating) {}
+};
+
+/**
+ * Ratings of an execution interval, grouped by blocks of items. The update
+ * functions add the ratings of their user, and after the interval each thread
+ * processes one item block at a time, starting from a random rating. The item
+ * factors of a block stay in the cache of the thread, and no two threads update
+ * the same item: only the user factors are shared, and locked if the policy is
+ * SGD_LOCKS.
+ */
+class sgd_item_blocks_queue{
+  std::vector<std::vector<std::vector<sgd_rating> > > ratings; // thread, block
+  std::vector<std::vector<sgd_rating> > scratch; // thread
+  std::vector<unsigned int> seeds; // random number generator of each thread
+  int nblocks;
+  vid_t first_item;
+  vid_t nitems;
+
+public:
+  sgd_item_blocks_queue() : nblocks(0), first_item(0), nitems(0) {}
+
+  void init(int nthreads, int _nblocks, vid_t _first_item, vid_t _nitems){
+    nblocks = _nblocks;
+    first_item = _first_item;
+    nitems = _nitems;
+    ratings.resize(nthreads);
+    for (int t=0; t< nthreads; t++)
+      ratings[t].resize(nblocks);
+    scratch.resize(nthreads);
+    seeds.resize(nthreads);
+    for (int t=0; t< nthreads; t++)
+      seeds[t] = (unsigned int)(t * 7919 + 1);
+  }
+
+  /** Adds a rating, from the update function */
+  inline void add(vid_t user, vid_t item, float rating){
+    int b = (int)((uint64_t)(item - first_item) * nblocks / nitems);
+    ratings[omp_get_thread_num()][b].push_back(sgd_rating(user, item, rating));
+  }
+
+  /**
+   * Processes the ratings added since the last call: step(user, item, rating)
+   * returns the squared error, which is added to errsum of the thread.
+   */
+  template<typename StepFunc>
+  void run(StepFunc & step, vec & errsum, int nthreads){
+    assert((int)ratings.size() >= nthreads);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+    for (int b=0; b< nblocks; b++){
+      int t = omp_get_thread_num();
+      std::vector<sgd_rating> & block = scratch[t];
+      block.clear();
+      for (int i=0; i< (int)ratings.size(); i++){
+        block.insert(block.end(), ratings[i][b].begin(), ratings[i][b].end());
+        ratings[i][b].clear();
+      }
+      if (block.empty())
+        continue;
+      // start from a random rating, but keep the order by user for locality
+      size_t n = block.size();
+      size_t start = (size_t)rand_r(&seeds[t]) % n;
+      double sqerr = 0;
+      for (size_t k=0; k< n; k++){
+        sgd_rating & r = block[(start + k) % n];
+        sgd_lock(r.user);
+        sqerr += step(r.user, r.item, r.rating);
+        sgd_unlock(r.user);
+      }
+      errsum[t] += sqerr;
+    }
+  }
+};
+
+void parse_sgd_command_line(){
+  std::string policy = get_option_string("sgd_policy", "hogwild");
+  if (policy == "hogwild")
+    sgd_policy = SGD_HOGWILD;
+  else if (policy == "locks")
+    sgd_policy = SGD_LOCKS;
+  else logstream(LOG_FATAL)<<"Unknown --sgd_policy: " << policy << ". Use hogwild or locks." << std::endl;
+  sgd_item_blocks = get_option_int("sgd_item_blocks", sgd_item_blocks);
+}
+
+#endif //_SGD_ENGINE_HPP__
@@ -103,22 +103,23 @@ float sparse_als_predict(const vertex_data& user,
  */
 struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
 
+  std::vector<normal_equations> normal_eqs; // one for each thread
+
 
   /**
    *  Vertex update function - computes the least square step
    */
   void update(graphchi_vertex<VertexDataType, EdgeDataType> &vertex, graphchi_context &gcontext) {
     vertex_data & vdata = latent_factors_inmem[vertex.id()];
-    mat XtX = mat::Zero(D, D); 
-    vec Xty = vec::Zero(D);
+    normal_equations & eqs = normal_eqs[omp_get_thread_num()];
+    eqs.reset(D);
 
     bool compute_rmse = (vertex.num_outedges() > 0);
     // Compute XtX and Xty (NOTE: unweighted)
     for(int e=0; e < vertex.num_edges(); e++) {
       float observation = vertex.edge(e)->get_data();                
       vertex_data & nbr_latent = latent_factors_inmem[vertex.edge(e)->vertex_id()];
-      Xty += nbr_latent.pvec * observation;
-      XtX += nbr_latent.pvec * nbr_latent.pvec.transpose();
+      eqs.add(nbr_latent.pvec, observation);
       if (compute_rmse) {
         double prediction;
         rmse_vec[omp_get_thread_num()] += sparse_als_predict(vdata, nbr_latent, observation, prediction);
@@ -128,7 +129,7 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
     double regularization = lambda;
     if (regnormal)
       lambda *= vertex.num_edges();
-    for(int i=0; i < D; i++) XtX(i,i) += regularization;
+    eqs.regularize(regularization);
 
 
     bool isuser = vertex.id() < (uint)M;
@@ -138,9 +139,9 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
       if (isuser)
         sparsity_level -= user_sparsity;
       else sparsity_level -= movie_sparsity;
-      vdata.pvec = CoSaMP(XtX, Xty, (int)ceil(sparsity_level*(double)D), 10, 1e-4, D); 
+      vdata.pvec = CoSaMP(eqs.get_XtX(), eqs.get_Xty(), (int)ceil(sparsity_level*(double)D), 10, 1e-4, D); 
     }
-    else vdata.pvec = XtX.selfadjointView<Eigen::Upper>().ldlt().solve(Xty);
+    else eqs.solve(vdata.pvec);
   }
 
  /**
@@ -148,6 +149,7 @@ struct ALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeData
    */
   void before_iteration(int iteration, graphchi_context &gcontext) {
     reset_rmse(gcontext.execthreads);
+    normal_eqs.resize(gcontext.execthreads);
   }
 
 
@@ -64,13 +64,13 @@ svdpp_params svdpp;
 #define BIAS_POS -1
 
 struct vertex_data {
-  vec pvec;
-  vec weight;
+  fvec pvec;
+  fvec weight;
   double bias;
 
   vertex_data() {
-    pvec = zeros(D);
-    weight = zeros(D);
+    pvec = fzeros(D);
+    weight = fzeros(D);
     bias = 0;
   }
   void set_val(int index, float val){
@@ -105,6 +105,7 @@ std::vector<vertex_data> latent_factors_inmem;
 #include "io.hpp"
 #include "rmse.hpp"
 #include "rmse_engine.hpp"
+#include "sgd_engine.hpp"
 
 /** compute a missing value based on SVD++ algorithm */
 float svdpp_predict(const vertex_data& user, const vertex_data& movie, const float rating, double & prediction, void * extra = NULL){
@@ -113,9 +114,7 @@ float svdpp_predict(const vertex_data& user, const vertex_data& movie, const flo
   // + b_u  +    b_i +
   prediction += user.bias + movie.bias;
   // + q_i^T   *(p_u      +sqrt(|N(u)|)\sum y_j)
-  //prediction += dot_prod(movie.pvec,(user.pvec+user.weight));
-  for (int j=0; j< D; j++)
-    prediction += movie.pvec[j] * (user.pvec[j] + user.weight[j]);
+  prediction += sgd_dot(movie.pvec.data(), user.pvec.data(), D) + sgd_dot(movie.pvec.data(), user.weight.data(), D);
 
   prediction = std::min((double)prediction, maxval);
   prediction = std::max((double)prediction, minval);
@@ -161,7 +160,7 @@ struct SVDPPVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDa
       if ( vertex.num_outedges() > 0){
         vertex_data & user = latent_factors_inmem[vertex.id()]; 
 
-        memset(&user.weight[0], 0, sizeof(double)*D);
+        user.weight.setZero();
         for(int e=0; e < vertex.num_outedges(); e++) {
           vertex_data & movie = latent_factors_inmem[vertex.edge(e)->vertex_id()]; 
           user.weight += movie.weight;
@@ -172,41 +171,45 @@ struct SVDPPVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDa
         //sqrt(|N(u)| * sum_j y_j
         user.weight *= usrNorm;
 
-        vec step = zeros(D);
+        fvec step = fzeros(D);
+        double sqerr = 0;
 
         // main algorithm, see Koren's paper, just below below equation (16)
         for(int e=0; e < vertex.num_outedges(); e++) {
-          vertex_data & movie = latent_factors_inmem[vertex.edge(e)->vertex_id()]; 
+          vid_t item = vertex.edge(e)->vertex_id();
+          vertex_data & movie = latent_factors_inmem[item]; 
           float observation = vertex.edge(e)->get_data();                
+          //several user nodes may update this item concurrently, see --sgd_policy
+          sgd_lock(item);
           double estScore;
-          rmse_vec[omp_get_thread_num()] += svdpp_predict(user, movie,observation, estScore); 
+          sqerr += svdpp_predict(user, movie,observation, estScore); 
           // e_ui = r_ui - \hat{r_ui}
           float err = observation - estScore;
-          assert(!std::isnan(rmse_vec[omp_get_thread_num()]));
-          vec itmFctr = movie.pvec;
-          vec usrFctr = user.pvec;
 
           //q_i = q_i + gamma2     *(e_ui*(p_u      +  sqrt(N(U))\sum_j y_j) - gamma7    *q_i)
-          for (int j=0; j< D; j++)
-            movie.pvec[j] += svdpp.itmFctrStep*(err*(usrFctr[j] +  user.weight[j])             - svdpp.itmFctrReg*itmFctr[j]);
           //p_u = p_u + gamma2    *(e_ui*q_i   -gamma7     *p_u)
-          for (int j=0; j< D; j++)
-            user.pvec[j] += svdpp.usrFctrStep*(err *itmFctr[j] - svdpp.usrFctrReg*usrFctr[j]);
-          step += err*itmFctr;
+          //step += e_ui*q_i
+          sgd_update(user.pvec.data(), movie.pvec.data(), user.weight.data(), step.data(), err,
+              svdpp.usrFctrStep, svdpp.usrFctrReg, svdpp.itmFctrStep, svdpp.itmFctrReg, D);
 
           //b_i = b_i + gamma1*(e_ui - gmma6 * b_i) 
           movie.bias += svdpp.itmBiasStep*(err-svdpp.itmBiasReg* movie.bias);
           //b_u = b_u + gamma1*(e_ui - gamma6 * b_u)
           user.bias += svdpp.usrBiasStep*(err-svdpp.usrBiasReg* user.bias);
+          sgd_unlock(item);
         }
+        rmse_vec[omp_get_thread_num()] += sqerr;
 
         step *= float(svdpp.itmFctr2Step*usrNorm);
         //gamma7 
-        double mult = svdpp.itmFctr2Step*svdpp.itmFctr2Reg;
+        float mult = svdpp.itmFctr2Step*svdpp.itmFctr2Reg;
         for(int e=0; e < vertex.num_edges(); e++) {
-          vertex_data&  movie = latent_factors_inmem[vertex.edge(e)->vertex_id()];
+          vid_t item = vertex.edge(e)->vertex_id();
+          vertex_data&  movie = latent_factors_inmem[item];
           //y_j = y_j  +   gamma2*sqrt|N(u)| * q_i - gamma7 * y_j
+          sgd_lock(item);
           movie.weight +=  step                    -  mult  * movie.weight;
+          sgd_unlock(item);
         }
       }
   }
@@ -235,9 +238,9 @@ void svdpp_init(){
 #pragma omp parallel for
   for(int i = 0; i < (int)(M+N); ++i){
     vertex_data & data = latent_factors_inmem[i];
-    data.pvec = zeros(D);
+    data.pvec = fzeros(D);
     if (i < (int)M) //user node
-      data.weight = zeros(D);
+      data.weight = fzeros(D);
     for (int j=0; j<D; j++)
       latent_factors_inmem[i].pvec[j] = drand48();
   }
@@ -267,6 +270,9 @@ int main(int argc, const char ** argv) {
   svdpp.itmFctrStep =   get_option_float("svdpp_item_factor_step", 1e-3);
   svdpp.itmFctr2Reg =   get_option_float("svdpp_item_factor2_reg", 1e-3);
   svdpp.itmFctr2Step =   get_option_float("svdpp_item_factor2_step", 1e-3);
+  parse_sgd_command_line();
+  if (sgd_item_blocks > 0)
+    logstream(LOG_WARNING)<<"SVD++ processes the ratings of a user together, ignoring --sgd_item_blocks" << std::endl;
 
   parse_command_line_args();
   parse_implicit_command_line();
@@ -105,21 +105,22 @@ float wals_predict(const vertex_data& user,
  */
 struct WALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDataType> {
 
+  std::vector<normal_equations> normal_eqs; // one for each thread
+
   /**
    *  Vertex update function.
    */
   void update(graphchi_vertex<VertexDataType, EdgeDataType> &vertex, graphchi_context &gcontext) {
     vertex_data & vdata = latent_factors_inmem[vertex.id()];
-    mat XtX = mat::Zero(D, D); 
-    vec Xty = vec::Zero(D);
+    normal_equations & eqs = normal_eqs[omp_get_thread_num()];
+    eqs.reset(D);
 
     bool compute_rmse = (vertex.num_outedges() > 0);
     // Compute XtX and Xty (NOTE: unweighted)
     for(int e=0; e < vertex.num_edges(); e++) {
       const edge_data & edge = vertex.edge(e)->get_data();                
       vertex_data & nbr_latent = latent_factors_inmem[vertex.edge(e)->vertex_id()];
-      Xty += nbr_latent.pvec * edge.weight * edge.time;      
-      XtX.triangularView<Eigen::Upper>() += nbr_latent.pvec * nbr_latent.pvec.transpose() * edge.time;
+      eqs.add(nbr_latent.pvec, edge.weight, edge.time);
       if (compute_rmse) {
         double prediction;
         rmse_vec[omp_get_thread_num()] += wals_predict(vdata, nbr_latent, edge.weight, prediction) * edge.time;
@@ -128,10 +129,10 @@ struct WALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDat
     double regularization = lambda;
     if (regnormal)
       lambda *= vertex.num_edges();
-    for(int i=0; i < D; i++) XtX(i,i) += regularization;
+    eqs.regularize(regularization);
 
     // Solve the least squares problem with eigen using Cholesky decomposition
-    vdata.pvec = XtX.selfadjointView<Eigen::Upper>().ldlt().solve(Xty);
+    eqs.solve(vdata.pvec);
   }
 
 
@@ -140,6 +141,7 @@ struct WALSVerticesInMemProgram : public GraphChiProgram<VertexDataType, EdgeDat
    */
   void before_iteration(int iteration, graphchi_context &gcontext) {
     reset_rmse(gcontext.execthreads);
+    normal_eqs.resize(gcontext.execthreads);
   }
 
 